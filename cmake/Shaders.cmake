@@ -0,0 +1,88 @@
+#Compiles GLSL shaders to SPIR-V at build time and embeds them into generated headers, so the library carries its own shaders
+#instead of reading them from the APK assets. Works with the glslc/spirv-opt shipped in the NDK, the Vulkan SDK or a distro package.
+
+file(GLOB _qov_ndk_shader_tools "${CMAKE_ANDROID_NDK}/shader-tools/*")
+
+find_program(
+        GLSLC_EXECUTABLE glslc
+        HINTS ${Vulkan_GLSLC_EXECUTABLE} ${_qov_ndk_shader_tools} "$ENV{VULKAN_SDK}/bin"
+        NO_CMAKE_FIND_ROOT_PATH
+)
+find_program(
+        SPIRV_OPT_EXECUTABLE spirv-opt
+        HINTS ${_qov_ndk_shader_tools} "$ENV{VULKAN_SDK}/bin"
+        NO_CMAKE_FIND_ROOT_PATH
+)
+
+if (NOT GLSLC_EXECUTABLE)
+    message(FATAL_ERROR "glslc not found, install the NDK shader tools or the Vulkan SDK")
+endif ()
+
+if (NOT SPIRV_OPT_EXECUTABLE)
+    message(WARNING "spirv-opt not found, shaders will be embedded without optimization")
+endif ()
+
+set(_qov_spirv_embed_script "${CMAKE_CURRENT_LIST_DIR}/SpirvEmbed.cmake")
+
+#qov_add_shaders(<target> <shader>...)
+#Creates an interface library <target> exposing one header per shader, shaders/<name>_<stage>.h, which defines
+#k_shader_<name>_<stage> (a ShaderBlob from src/shader_reflection.h) holding the optimized SPIR-V and its reflected layout.
+function(qov_add_shaders TARGET_NAME)
+    set(_include_dir "${CMAKE_CURRENT_BINARY_DIR}/${TARGET_NAME}")
+    set(_output_dir "${_include_dir}/shaders")
+    file(MAKE_DIRECTORY "${_output_dir}")
+
+    set(_headers)
+    foreach (_source ${ARGN})
+        get_filename_component(_source "${_source}" ABSOLUTE)
+        get_filename_component(_name "${_source}" NAME_WE)
+        get_filename_component(_stage "${_source}" LAST_EXT)
+        string(SUBSTRING "${_stage}" 1 -1 _stage)
+
+        set(_symbol "${_name}_${_stage}")
+        set(_spirv_compiled "${_output_dir}/${_symbol}.spv")
+        set(_spirv_optimized "${_output_dir}/${_symbol}.opt.spv")
+        set(_header "${_output_dir}/${_symbol}.h")
+
+        #Reflection reads the unoptimized module, which still has the names of every binding
+        set(_commands
+                COMMAND "${GLSLC_EXECUTABLE}" --target-env=vulkan1.1 -MD -MF "${_spirv_compiled}.d" -o "${_spirv_compiled}" "${_source}"
+        )
+        if (SPIRV_OPT_EXECUTABLE)
+            list(APPEND _commands
+                    COMMAND "${SPIRV_OPT_EXECUTABLE}" -O $<$<NOT:$<CONFIG:Debug>>:--strip-debug> -o "${_spirv_optimized}" "${_spirv_compiled}"
+            )
+        else ()
+            list(APPEND _commands
+                    COMMAND "${CMAKE_COMMAND}" -E copy "${_spirv_compiled}" "${_spirv_optimized}"
+            )
+        endif ()
+
+        add_custom_command(
+                OUTPUT "${_header}"
+                ${_commands}
+                COMMAND "${CMAKE_COMMAND}"
+                -D "SPIRV=${_spirv_optimized}"
+                -D "SPIRV_REFLECT=${_spirv_compiled}"
+                -D "SOURCE=${_source}"
+                -D "SYMBOL=${_symbol}"
+                -D "STAGE=${_stage}"
+                -D "OUTPUT=${_header}"
+                -P "${_qov_spirv_embed_script}"
+                MAIN_DEPENDENCY "${_source}"
+                DEPENDS "${_qov_spirv_embed_script}"
+                DEPFILE "${_spirv_compiled}.d"
+                COMMENT "Embedding SPIR-V for ${_name}.${_stage}"
+                COMMAND_EXPAND_LISTS
+                VERBATIM
+        )
+
+        list(APPEND _headers "${_header}")
+    endforeach ()
+
+    add_custom_target(${TARGET_NAME}_spirv ALL DEPENDS ${_headers})
+
+    add_library(${TARGET_NAME} INTERFACE)
+    target_include_directories(${TARGET_NAME} INTERFACE "${_include_dir}" "${PROJECT_SOURCE_DIR}/src")
+    add_dependencies(${TARGET_NAME} ${TARGET_NAME}_spirv)
+endfunction()
@@ -0,0 +1,344 @@
+#Script mode helper for qov_add_shaders, run as
+#  cmake -D SPIRV=<module> -D SPIRV_REFLECT=<module> -D SOURCE=<glsl> -D SYMBOL=<name> -D STAGE=<ext> -D OUTPUT=<header> -P SpirvEmbed.cmake
+#Writes SPIRV as a constexpr uint32_t array, and the descriptor bindings and push constant range found in SPIRV_REFLECT.
+
+cmake_minimum_required(VERSION 3.22.1)
+
+foreach (_variable SPIRV SPIRV_REFLECT SOURCE SYMBOL STAGE OUTPUT)
+    if (NOT DEFINED ${_variable})
+        message(FATAL_ERROR "SpirvEmbed: ${_variable} is not set")
+    endif ()
+endforeach ()
+
+set(_stage_vert VK_SHADER_STAGE_VERTEX_BIT)
+set(_stage_tesc VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT)
+set(_stage_tese VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT)
+set(_stage_geom VK_SHADER_STAGE_GEOMETRY_BIT)
+set(_stage_frag VK_SHADER_STAGE_FRAGMENT_BIT)
+set(_stage_comp VK_SHADER_STAGE_COMPUTE_BIT)
+if (NOT DEFINED _stage_${STAGE})
+    message(FATAL_ERROR "SpirvEmbed: unknown shader stage ${STAGE}")
+endif ()
+
+#Reads a module as a list of words, each one 8 hex digits with the most significant byte first
+function(spirv_read_words OUT_WORDS PATH)
+    file(READ "${PATH}" _hex HEX)
+    string(LENGTH "${_hex}" _length)
+    math(EXPR _remainder "${_length} % 8")
+    if (_length LESS 40 OR NOT _remainder EQUAL 0)
+        message(FATAL_ERROR "SpirvEmbed: ${PATH} is not a SPIR-V module")
+    endif ()
+
+    string(REGEX REPLACE "(..)(..)(..)(..)" "\\4\\3\\2\\1;" _words "${_hex}")
+    string(REGEX REPLACE ";$" "" _words "${_words}")
+
+    list(GET _words 0 _magic)
+    if (NOT _magic STREQUAL "07230203")
+        message(FATAL_ERROR "SpirvEmbed: ${PATH} does not start with the SPIR-V magic number")
+    endif ()
+
+    set(${OUT_WORDS} "${_words}" PARENT_SCOPE)
+endfunction()
+
+#Decodes a nul terminated literal string packed into words
+function(spirv_decode_string OUT_STRING)
+    set(_string "")
+    foreach (_word ${ARGN})
+        foreach (_offset 6 4 2 0)
+            string(SUBSTRING "${_word}" ${_offset} 2 _byte)
+            if (_byte STREQUAL "00")
+                set(${OUT_STRING} "${_string}" PARENT_SCOPE)
+                return()
+            endif ()
+            math(EXPR _code "0x${_byte}")
+            string(ASCII ${_code} _char)
+            string(APPEND _string "${_char}")
+        endforeach ()
+    endforeach ()
+    set(${OUT_STRING} "${_string}" PARENT_SCOPE)
+endfunction()
+
+#Size in bytes of a type as laid out in a buffer, using the stride decorations glslang emits for explicit layouts
+function(spirv_type_size OUT_SIZE ID)
+    set(_op "${_op_${ID}}")
+    set(_size 0)
+    if (_op STREQUAL "int" OR _op STREQUAL "float")
+        math(EXPR _size "${_width_${ID}} / 8")
+    elseif (_op STREQUAL "vector" OR _op STREQUAL "matrix")
+        spirv_type_size(_element_size ${_element_${ID}})
+        math(EXPR _size "${_count_${ID}} * ${_element_size}")
+    elseif (_op STREQUAL "array")
+        if (DEFINED _array_stride_${ID})
+            math(EXPR _size "${_length_${ID}} * ${_array_stride_${ID}}")
+        else ()
+            spirv_type_size(_element_size ${_element_${ID}})
+            math(EXPR _size "${_length_${ID}} * ${_element_size}")
+        endif ()
+    elseif (_op STREQUAL "struct")
+        set(_member 0)
+        foreach (_member_type ${_members_${ID}})
+            set(_offset 0)
+            if (DEFINED _offset_${ID}_${_member})
+                set(_offset ${_offset_${ID}_${_member}})
+            endif ()
+
+            if (DEFINED _matrix_stride_${ID}_${_member} AND _op_${_member_type} STREQUAL "matrix")
+                math(EXPR _member_size "${_count_${_member_type}} * ${_matrix_stride_${ID}_${_member}}")
+            else ()
+                spirv_type_size(_member_size ${_member_type})
+            endif ()
+
+            math(EXPR _end "${_offset} + ${_member_size}")
+            if (_end GREATER _size)
+                set(_size ${_end})
+            endif ()
+            math(EXPR _member "${_member} + 1")
+        endforeach ()
+    endif ()
+    set(${OUT_SIZE} ${_size} PARENT_SCOPE)
+endfunction()
+
+#Records what reflection needs from one instruction, operands are still hex words
+macro(spirv_parse_instruction)
+    set(_decimal)
+    foreach (_operand IN LISTS _operands)
+        math(EXPR _value "0x${_operand}")
+        list(APPEND _decimal ${_value})
+    endforeach ()
+
+    if (_opcode EQUAL 5) #OpName
+        list(GET _decimal 0 _id)
+        list(SUBLIST _operands 1 -1 _literal)
+        spirv_decode_string(_name_${_id} ${_literal})
+    elseif (_opcode EQUAL 71) #OpDecorate
+        list(GET _decimal 0 _id)
+        list(GET _decimal 1 _decoration)
+        if (_decoration EQUAL 2)
+            set(_block_${_id} TRUE)
+        elseif (_decoration EQUAL 3)
+            set(_buffer_block_${_id} TRUE)
+        elseif (_decoration EQUAL 6)
+            list(GET _decimal 2 _array_stride_${_id})
+        elseif (_decoration EQUAL 33)
+            list(GET _decimal 2 _binding_${_id})
+        elseif (_decoration EQUAL 34)
+            list(GET _decimal 2 _set_${_id})
+        endif ()
+    elseif (_opcode EQUAL 72) #OpMemberDecorate
+        list(GET _decimal 0 _id)
+        list(GET _decimal 1 _member)
+        list(GET _decimal 2 _decoration)
+        if (_decoration EQUAL 7)
+            list(GET _decimal 3 _matrix_stride_${_id}_${_member})
+        elseif (_decoration EQUAL 35)
+            list(GET _decimal 3 _offset_${_id}_${_member})
+        endif ()
+    elseif (_opcode EQUAL 21 OR _opcode EQUAL 22) #OpTypeInt, OpTypeFloat
+        list(GET _decimal 0 _id)
+        if (_opcode EQUAL 21)
+            set(_op_${_id} int)
+        else ()
+            set(_op_${_id} float)
+        endif ()
+        list(GET _decimal 1 _width_${_id})
+    elseif (_opcode EQUAL 23 OR _opcode EQUAL 24) #OpTypeVector, OpTypeMatrix
+        list(GET _decimal 0 _id)
+        if (_opcode EQUAL 23)
+            set(_op_${_id} vector)
+        else ()
+            set(_op_${_id} matrix)
+        endif ()
+        list(GET _decimal 1 _element_${_id})
+        list(GET _decimal 2 _count_${_id})
+    elseif (_opcode EQUAL 25) #OpTypeImage
+        list(GET _decimal 0 _id)
+        set(_op_${_id} image)
+        list(GET _decimal 2 _dim_${_id})
+        list(GET _decimal 6 _sampled_${_id})
+    elseif (_opcode EQUAL 26) #OpTypeSampler
+        list(GET _decimal 0 _id)
+        set(_op_${_id} sampler)
+    elseif (_opcode EQUAL 27) #OpTypeSampledImage
+        list(GET _decimal 0 _id)
+        set(_op_${_id} sampled_image)
+    elseif (_opcode EQUAL 28) #OpTypeArray
+        list(GET _decimal 0 _id)
+        set(_op_${_id} array)
+        list(GET _decimal 1 _element_${_id})
+        list(GET _decimal 2 _length_id_${_id})
+    elseif (_opcode EQUAL 29) #OpTypeRuntimeArray
+        list(GET _decimal 0 _id)
+        set(_op_${_id} runtime_array)
+        list(GET _decimal 1 _element_${_id})
+    elseif (_opcode EQUAL 30) #OpTypeStruct
+        list(GET _decimal 0 _id)
+        set(_op_${_id} struct)
+        list(SUBLIST _decimal 1 -1 _members_${_id})
+    elseif (_opcode EQUAL 32) #OpTypePointer
+        list(GET _decimal 0 _id)
+        set(_op_${_id} pointer)
+        list(GET _decimal 1 _storage_class_${_id})
+        list(GET _decimal 2 _pointee_${_id})
+    elseif (_opcode EQUAL 43) #OpConstant
+        list(GET _decimal 1 _id)
+        list(GET _decimal 2 _constant_${_id})
+    elseif (_opcode EQUAL 59) #OpVariable
+        list(GET _decimal 0 _type)
+        list(GET _decimal 1 _id)
+        set(_variable_type_${_id} ${_type})
+        list(APPEND _variables ${_id})
+    endif ()
+endmacro()
+
+spirv_read_words(_words "${SPIRV}")
+spirv_read_words(_reflect_words "${SPIRV_REFLECT}")
+
+#Walk the instruction stream of the reflection module
+set(_variables)
+set(_remaining 0)
+list(SUBLIST _reflect_words 5 -1 _stream)
+foreach (_word IN LISTS _stream)
+    if (_remaining EQUAL 0)
+        string(SUBSTRING "${_word}" 0 4 _word_count)
+        string(SUBSTRING "${_word}" 4 4 _opcode)
+        math(EXPR _remaining "0x${_word_count} - 1")
+        math(EXPR _opcode "0x${_opcode}")
+        set(_operands)
+        if (_remaining LESS 0)
+            message(FATAL_ERROR "SpirvEmbed: ${SPIRV_REFLECT} contains an instruction with a word count of 0")
+        endif ()
+    else ()
+        list(APPEND _operands ${_word})
+        math(EXPR _remaining "${_remaining} - 1")
+    endif ()
+
+    if (_remaining EQUAL 0)
+        spirv_parse_instruction()
+    endif ()
+endforeach ()
+
+#Array lengths are ids of constants, resolve every array type now that all constants are known
+get_cmake_property(_all_variables VARIABLES)
+foreach (_variable_name IN LISTS _all_variables)
+    if (_variable_name MATCHES "^_length_id_([0-9]+)$")
+        set(_length_${CMAKE_MATCH_1} ${_constant_${${_variable_name}}})
+    endif ()
+endforeach ()
+
+set(_bindings)
+set(_push_constant_offset 0)
+set(_push_constant_size 0)
+foreach (_id IN LISTS _variables)
+    set(_pointer ${_variable_type_${_id}})
+    set(_storage_class ${_storage_class_${_pointer}})
+    set(_type ${_pointee_${_pointer}})
+
+    if (_storage_class EQUAL 9) #PushConstant
+        spirv_type_size(_size ${_type})
+        set(_offset ${_size})
+        set(_member 0)
+        foreach (_member_type ${_members_${_type}})
+            if (DEFINED _offset_${_type}_${_member} AND _offset_${_type}_${_member} LESS _offset)
+                set(_offset ${_offset_${_type}_${_member}})
+            endif ()
+            math(EXPR _member "${_member} + 1")
+        endforeach ()
+        set(_push_constant_offset ${_offset})
+        math(EXPR _push_constant_size "${_size} - ${_offset}")
+        continue()
+    endif ()
+
+    if (NOT (_storage_class EQUAL 0 OR _storage_class EQUAL 2 OR _storage_class EQUAL 12) OR NOT DEFINED _binding_${_id})
+        continue()
+    endif ()
+
+    set(_count 1)
+    while (_op_${_type} STREQUAL "array" OR _op_${_type} STREQUAL "runtime_array")
+        if (_op_${_type} STREQUAL "array")
+            math(EXPR _count "${_count} * ${_length_${_type}}")
+        else ()
+            set(_count 0)
+        endif ()
+        set(_type ${_element_${_type}})
+    endwhile ()
+
+    set(_op ${_op_${_type}})
+    if (_storage_class EQUAL 12 OR _buffer_block_${_type})
+        set(_descriptor_type VK_DESCRIPTOR_TYPE_STORAGE_BUFFER)
+    elseif (_storage_class EQUAL 2)
+        set(_descriptor_type VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER)
+    elseif (_op STREQUAL "sampler")
+        set(_descriptor_type VK_DESCRIPTOR_TYPE_SAMPLER)
+    elseif (_op STREQUAL "sampled_image")
+        set(_descriptor_type VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER)
+    elseif (_op STREQUAL "image" AND _dim_${_type} EQUAL 6) #SubpassData
+        set(_descriptor_type VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT)
+    elseif (_op STREQUAL "image" AND _dim_${_type} EQUAL 5) #Buffer
+        if (_sampled_${_type} EQUAL 2)
+            set(_descriptor_type VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER)
+        else ()
+            set(_descriptor_type VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER)
+        endif ()
+    elseif (_op STREQUAL "image")
+        if (_sampled_${_type} EQUAL 2)
+            set(_descriptor_type VK_DESCRIPTOR_TYPE_STORAGE_IMAGE)
+        else ()
+            set(_descriptor_type VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE)
+        endif ()
+    else ()
+        message(FATAL_ERROR "SpirvEmbed: unsupported descriptor type for variable ${_id} in ${SOURCE}")
+    endif ()
+
+    set(_set 0)
+    if (DEFINED _set_${_id})
+        set(_set ${_set_${_id}})
+    endif ()
+
+    #Blocks without an instance name only carry the name of their type
+    set(_name "${_name_${_id}}")
+    if (_name STREQUAL "")
+        set(_name "${_name_${_type}}")
+    endif ()
+
+    list(APPEND _bindings "        {.un_set = ${_set}, .un_binding = ${_binding_${_id}}, .vk_descriptor_type = ${_descriptor_type}, .un_descriptor_count = ${_count}}, //${_name}")
+endforeach ()
+
+#Emit the header
+set(_code "")
+set(_column 0)
+foreach (_word IN LISTS _words)
+    if (_column EQUAL 8)
+        string(APPEND _code "\n       ")
+        set(_column 0)
+    endif ()
+    string(APPEND _code " 0x${_word},")
+    math(EXPR _column "${_column} + 1")
+endforeach ()
+list(LENGTH _words _word_count)
+
+get_filename_component(_source_name "${SOURCE}" NAME)
+
+set(_header "#pragma once\n\n#include \"shader_reflection.h\"\n\n")
+string(APPEND _header "//Generated from ${_source_name} by cmake/SpirvEmbed.cmake, do not edit\n\n")
+string(APPEND _header "inline constexpr uint32_t k_aun_spirv_${SYMBOL}[${_word_count}] = {\n       ${_code}\n};\n\n")
+
+list(LENGTH _bindings _binding_count)
+if (_binding_count GREATER 0)
+    string(REPLACE ";" "\n" _bindings "${_bindings}")
+    string(APPEND _header "inline constexpr ShaderBinding k_a_bindings_${SYMBOL}[${_binding_count}] = {\n${_bindings}\n};\n\n")
+    set(_bindings_pointer "k_a_bindings_${SYMBOL}")
+else ()
+    set(_bindings_pointer "nullptr")
+endif ()
+
+string(APPEND _header "inline constexpr ShaderBlob k_shader_${SYMBOL} = {\n")
+string(APPEND _header "        .pun_spirv = k_aun_spirv_${SYMBOL},\n")
+string(APPEND _header "        .size_spirv = sizeof(k_aun_spirv_${SYMBOL}),\n")
+string(APPEND _header "        .vk_stage = ${_stage_${STAGE}},\n")
+string(APPEND _header "        .p_bindings = ${_bindings_pointer},\n")
+string(APPEND _header "        .un_binding_count = ${_binding_count},\n")
+string(APPEND _header "        .un_push_constant_offset = ${_push_constant_offset},\n")
+string(APPEND _header "        .un_push_constant_size = ${_push_constant_size},\n")
+string(APPEND _header "};\n")
+
+file(WRITE "${OUTPUT}" "${_header}")
@@ -0,0 +1,145 @@
+#include "async_compute.h"
+
+#include "log.h"
+#include "qualify.h"
+
+bool AsyncCompute::BInit(VkDevice vk_device, uint32_t un_queue_family, VkQueue vk_queue, uint32_t un_slot_count) {
+    mvk_device = vk_device;
+    mvk_queue = vk_queue;
+
+    vk_get_device_proc(mvk_device, vkWaitSemaphoresKHR);
+    vk_get_device_proc(mvk_device, vkGetSemaphoreCounterValueKHR);
+    if (!vkWaitSemaphoresKHR || !vkGetSemaphoreCounterValueKHR) {
+        Log(LogError, "[AsyncCompute] VK_KHR_timeline_semaphore entry points are not available");
+        return false;
+    }
+
+    {//Timeline semaphores, the compute queue's own and the graphics queue's handoffs
+        VkSemaphoreTypeCreateInfoKHR vk_semaphore_type_create_info = {
+                .sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO_KHR,
+                .semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE_KHR,
+                .initialValue = 0,
+        };
+        VkSemaphoreCreateInfo vk_semaphore_create_info = {
+                .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+                .pNext = &vk_semaphore_type_create_info,
+        };
+        b_qualify_vk(vkCreateSemaphore(mvk_device, &vk_semaphore_create_info, nullptr, &mvk_timeline_semaphore));
+        b_qualify_vk(vkCreateSemaphore(mvk_device, &vk_semaphore_create_info, nullptr, &mvk_handoff_semaphore));
+    }
+
+    mv_slots.resize(un_slot_count);
+    for (Slot &slot: mv_slots) {
+        //Reset as a whole once the slot is reused
+        VkCommandPoolCreateInfo vk_command_pool_create_info = {
+                .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+                .flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+                .queueFamilyIndex = un_queue_family,
+        };
+        b_qualify_vk(vkCreateCommandPool(mvk_device, &vk_command_pool_create_info, nullptr, &slot.vk_command_pool));
+
+        VkCommandBufferAllocateInfo vk_command_buffer_allocate_info = {
+                .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+                .commandPool = slot.vk_command_pool,
+                .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+                .commandBufferCount = 1,
+        };
+        b_qualify_vk(vkAllocateCommandBuffers(mvk_device, &vk_command_buffer_allocate_info, &slot.vk_command_buffer));
+    }
+
+    Log("[AsyncCompute] Initialized on queue family %u with %u frames in flight", un_queue_family, un_slot_count);
+
+    return true;
+}
+
+void AsyncCompute::Destroy() {
+    if (mvk_device == VK_NULL_HANDLE) {
+        return;
+    }
+
+    for (Slot &slot: mv_slots) {
+        vkDestroyCommandPool(mvk_device, slot.vk_command_pool, nullptr);
+    }
+    mv_slots.clear();
+    mp_recording = nullptr;
+
+    vkDestroySemaphore(mvk_device, mvk_timeline_semaphore, nullptr);
+    vkDestroySemaphore(mvk_device, mvk_handoff_semaphore, nullptr);
+
+    mvk_device = VK_NULL_HANDLE;
+}
+
+VkCommandBuffer AsyncCompute::GetCommandBuffer(uint32_t un_slot) {
+    if (un_slot >= mv_slots.size()) {
+        Log(LogError, "[AsyncCompute] No command buffer for slot %u", un_slot);
+        return VK_NULL_HANDLE;
+    }
+    Slot &slot = mv_slots[un_slot];
+
+    //Has passed by now whenever the graphics submission of the slot's last frame has, which waited for it
+    uint64_t un_completed_value = 0;
+    d_qualify_vk(vkGetSemaphoreCounterValueKHR(mvk_device, mvk_timeline_semaphore, &un_completed_value));
+    if (slot.un_timeline_value > un_completed_value) {
+        VkSemaphoreWaitInfoKHR vk_semaphore_wait_info = {
+                .sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO_KHR,
+                .semaphoreCount = 1,
+                .pSemaphores = &mvk_timeline_semaphore,
+                .pValues = &slot.un_timeline_value,
+        };
+        d_qualify_vk(vkWaitSemaphoresKHR(mvk_device, &vk_semaphore_wait_info, UINT64_MAX));
+    }
+
+    d_qualify_vk(vkResetCommandPool(mvk_device, slot.vk_command_pool, 0));
+
+    VkCommandBufferBeginInfo vk_command_buffer_begin_info = {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+            .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+    };
+    d_qualify_vk(vkBeginCommandBuffer(slot.vk_command_buffer, &vk_command_buffer_begin_info));
+
+    mp_recording = &slot;
+
+    return slot.vk_command_buffer;
+}
+
+uint64_t AsyncCompute::UnSubmit() {
+    Slot *p_slot = mp_recording;
+    mp_recording = nullptr;
+
+    if (!p_slot) {
+        Log(LogError, "[AsyncCompute] Submitted without a command buffer being recorded");
+        return 0;
+    }
+
+    d_qualify_vk(vkEndCommandBuffer(p_slot->vk_command_buffer));
+
+    //Until the graphics queue has signalled a handoff there is nothing submitted before this that it could depend on
+    const uint64_t un_signal_value = mun_timeline_next + 1;
+    const uint32_t un_wait_count = mun_handoff_value > 0 ? 1 : 0;
+    const VkPipelineStageFlags vk_wait_stage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+
+    VkTimelineSemaphoreSubmitInfoKHR vk_timeline_submit_info = {
+            .sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO_KHR,
+            .waitSemaphoreValueCount = un_wait_count,
+            .pWaitSemaphoreValues = &mun_handoff_value,
+            .signalSemaphoreValueCount = 1,
+            .pSignalSemaphoreValues = &un_signal_value,
+    };
+    VkSubmitInfo vk_submit_info = {
+            .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+            .pNext = &vk_timeline_submit_info,
+            .waitSemaphoreCount = un_wait_count,
+            .pWaitSemaphores = &mvk_handoff_semaphore,
+            .pWaitDstStageMask = &vk_wait_stage,
+            .commandBufferCount = 1,
+            .pCommandBuffers = &p_slot->vk_command_buffer,
+            .signalSemaphoreCount = 1,
+            .pSignalSemaphores = &mvk_timeline_semaphore,
+    };
+    d_qualify_vk(vkQueueSubmit(mvk_queue, 1, &vk_submit_info, VK_NULL_HANDLE));
+
+    mun_timeline_next = un_signal_value;
+    p_slot->un_timeline_value = un_signal_value;
+
+    return un_signal_value;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "vulkan/vulkan.h"
+
+//Second queue for compute work of a frame that can start before the graphics queue is done with the frame before it.
+//A compute submission waits on the last handoff the graphics queue signalled, placed after the last commands of a frame
+//the next frame's compute work depends on, so what comes after the handoff overlaps with it. The graphics submission of a
+//frame in turn waits on the compute submission of the same frame.
+//
+//The queue comes from the graphics queue family, so every resource can be used on both queues without ownership transfers.
+class AsyncCompute {
+public:
+    //One command buffer per frame in flight
+    bool BInit(VkDevice vk_device, uint32_t un_queue_family, VkQueue vk_queue, uint32_t un_slot_count);
+    void Destroy();
+
+    //Begins the command buffer of un_slot, blocking only while its last submission is still running. Returns VK_NULL_HANDLE
+    //if it could not be begun.
+    VkCommandBuffer GetCommandBuffer(uint32_t un_slot);
+
+    //Ends and submits the command buffer begun last. Returns the value of GetTimelineSemaphore() the graphics submission of
+    //the frame has to wait on, 0 if nothing was submitted.
+    uint64_t UnSubmit();
+
+    //The graphics submission ending with the handoff signals GetHandoffSemaphore() to UnNextHandoffValue() and calls
+    //HandoffSubmitted once it went through. Frames without one leave the next compute submission waiting on an older handoff.
+    VkSemaphore GetHandoffSemaphore() const { return mvk_handoff_semaphore; }
+    uint64_t UnNextHandoffValue() const { return mun_handoff_value + 1; }
+    void HandoffSubmitted() { mun_handoff_value++; }
+
+    VkSemaphore GetTimelineSemaphore() const { return mvk_timeline_semaphore; }
+
+private:
+    struct Slot {
+        VkCommandPool vk_command_pool = VK_NULL_HANDLE;
+        VkCommandBuffer vk_command_buffer = VK_NULL_HANDLE;
+
+        //value mvk_timeline_semaphore reaches once the slot's last submission has finished
+        uint64_t un_timeline_value = 0;
+    };
+
+    VkDevice mvk_device = VK_NULL_HANDLE;
+    VkQueue mvk_queue = VK_NULL_HANDLE;
+
+    std::vector<Slot> mv_slots;
+    Slot *mp_recording = nullptr;
+
+    VkSemaphore mvk_timeline_semaphore = VK_NULL_HANDLE;
+    uint64_t mun_timeline_next = 0;
+
+    VkSemaphore mvk_handoff_semaphore = VK_NULL_HANDLE;
+    uint64_t mun_handoff_value = 0;
+
+    PFN_vkWaitSemaphoresKHR vkWaitSemaphoresKHR = nullptr;
+    PFN_vkGetSemaphoreCounterValueKHR vkGetSemaphoreCounterValueKHR = nullptr;
+};
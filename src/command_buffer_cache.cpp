@@ -0,0 +1,110 @@
+#include "command_buffer_cache.h"
+
+#include "log.h"
+#include "qualify.h"
+
+bool CommandBufferCache::BInit(VkDevice vk_device, uint32_t un_queue_family, uint32_t un_framebuffer_count, uint32_t un_slot_count) {
+    mvk_device = vk_device;
+    mun_slot_count = un_slot_count;
+
+    //Secondaries are begun again one at a time, which implicitly resets them
+    VkCommandPoolCreateInfo vk_command_pool_create_info = {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+            .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+            .queueFamilyIndex = un_queue_family,
+    };
+    b_qualify_vk(vkCreateCommandPool(mvk_device, &vk_command_pool_create_info, nullptr, &mvk_command_pool));
+
+    std::vector<VkCommandBuffer> vvk_command_buffers(un_framebuffer_count * un_slot_count);
+    VkCommandBufferAllocateInfo vk_command_buffer_allocate_info = {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+            .commandPool = mvk_command_pool,
+            .level = VK_COMMAND_BUFFER_LEVEL_SECONDARY,
+            .commandBufferCount = static_cast<uint32_t>(vvk_command_buffers.size()),
+    };
+    b_qualify_vk(vkAllocateCommandBuffers(mvk_device, &vk_command_buffer_allocate_info, vvk_command_buffers.data()));
+
+    mv_entries.resize(vvk_command_buffers.size());
+    for (size_t i = 0; i < mv_entries.size(); i++) {
+        mv_entries[i].vk_command_buffer = vvk_command_buffers[i];
+    }
+
+    Log("[CommandBufferCache] Initialized %u secondaries for %u framebuffers and %u frames in flight", static_cast<uint32_t>(mv_entries.size()),
+        un_framebuffer_count, un_slot_count);
+
+    return true;
+}
+
+void CommandBufferCache::Destroy() {
+    if (mvk_device == VK_NULL_HANDLE) {
+        return;
+    }
+
+    //Frees the secondaries with it
+    vkDestroyCommandPool(mvk_device, mvk_command_pool, nullptr);
+    mvk_command_pool = VK_NULL_HANDLE;
+    mv_entries.clear();
+
+    mvk_device = VK_NULL_HANDLE;
+}
+
+void CommandBufferCache::Invalidate() {
+    for (Entry &entry: mv_entries) {
+        entry.b_valid = false;
+    }
+}
+
+VkCommandBuffer CommandBufferCache::GetSecondary(uint32_t un_framebuffer, uint32_t un_slot, uint64_t un_version, VkRenderPass vk_render_pass,
+                                                 VkFramebuffer vk_framebuffer, bool &out_b_record) {
+    out_b_record = false;
+
+    const size_t un_entry = static_cast<size_t>(un_framebuffer) * mun_slot_count + un_slot;
+    if (un_entry >= mv_entries.size() || un_slot >= mun_slot_count) {
+        Log(LogError, "[CommandBufferCache] No secondary for framebuffer %u and slot %u", un_framebuffer, un_slot);
+        return VK_NULL_HANDLE;
+    }
+
+    Entry &entry = mv_entries[un_entry];
+    if (entry.b_valid && entry.un_version == un_version) {
+        return entry.vk_command_buffer;
+    }
+
+    //Stays invalid until it has been ended, so a recording that fails halfway is never replayed
+    entry.b_valid = false;
+
+    VkCommandBufferInheritanceInfo vk_inheritance_info = {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO,
+            .renderPass = vk_render_pass,
+            .subpass = 0,
+            .framebuffer = vk_framebuffer,
+    };
+    VkCommandBufferBeginInfo vk_command_buffer_begin_info = {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+            .flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT,
+            .pInheritanceInfo = &vk_inheritance_info,
+    };
+    d_qualify_vk(vkBeginCommandBuffer(entry.vk_command_buffer, &vk_command_buffer_begin_info));
+
+    mp_recording = &entry;
+    mun_recording_version = un_version;
+    out_b_record = true;
+
+    return entry.vk_command_buffer;
+}
+
+bool CommandBufferCache::BEnd(VkCommandBuffer vk_command_buffer) {
+    Entry *p_entry = mp_recording;
+    mp_recording = nullptr;
+
+    if (!p_entry || p_entry->vk_command_buffer != vk_command_buffer) {
+        Log(LogError, "[CommandBufferCache] Ended a secondary that was not being recorded");
+        return false;
+    }
+
+    b_qualify_vk(vkEndCommandBuffer(vk_command_buffer));
+
+    p_entry->un_version = mun_recording_version;
+    p_entry->b_valid = true;
+
+    return true;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "vulkan/vulkan.h"
+
+//Secondary command buffers holding the part of a render pass that stays the same from frame to frame, replayed with
+//vkCmdExecuteCommands instead of being recorded again. There is one per framebuffer and frame in flight: the secondaries
+//inherit the framebuffer and the frame ring's uniform sets differ per slot, and keying on the slot also keeps a secondary
+//from being re-recorded while a primary that executes it is still pending.
+//
+//The caller folds everything the recorded commands depend on into a version, a secondary whose version differs is recorded
+//again. What only lives in buffers the commands read, like uniforms at an unchanged dynamic offset, does not count.
+class CommandBufferCache {
+public:
+    bool BInit(VkDevice vk_device, uint32_t un_queue_family, uint32_t un_framebuffer_count, uint32_t un_slot_count);
+    void Destroy();
+
+    //Forces every secondary to be recorded again, for when a render pass or framebuffer they were recorded against goes away
+    void Invalidate();
+
+    //Returns the secondary for the framebuffer index and slot, un_framebuffer always has to stand for the same vk_framebuffer.
+    //If it was not last recorded with un_version it has been begun for subpass 0 of vk_render_pass and out_b_record is set,
+    //the caller records the content then and finishes it with BEnd.
+    VkCommandBuffer GetSecondary(uint32_t un_framebuffer, uint32_t un_slot, uint64_t un_version, VkRenderPass vk_render_pass, VkFramebuffer vk_framebuffer,
+                                 bool &out_b_record);
+    bool BEnd(VkCommandBuffer vk_command_buffer);
+
+private:
+    struct Entry {
+        VkCommandBuffer vk_command_buffer = VK_NULL_HANDLE;
+        uint64_t un_version = 0;
+        bool b_valid = false;
+    };
+
+    VkDevice mvk_device = VK_NULL_HANDLE;
+    VkCommandPool mvk_command_pool = VK_NULL_HANDLE;
+
+    //framebuffer major
+    std::vector<Entry> mv_entries;
+    uint32_t mun_slot_count = 0;
+
+    //entry begun by GetSecondary and not ended yet
+    Entry *mp_recording = nullptr;
+    uint64_t mun_recording_version = 0;
+};
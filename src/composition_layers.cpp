@@ -0,0 +1,223 @@
+#include "composition_layers.h"
+
+#include <utility>
+
+#include "log.h"
+
+bool CompositionLayers::BInit(XrSession xr_session, VkFormat vk_format, bool b_cylinder_supported) {
+    mxr_session = xr_session;
+    mvk_format = vk_format;
+    mb_cylinder_supported = b_cylinder_supported;
+
+    return true;
+}
+
+void CompositionLayers::Destroy() {
+    for (Layer &layer: mv_layers) {
+        xrDestroySwapchain(layer.xr_swapchain);
+    }
+    mv_layers.clear();
+}
+
+uint32_t CompositionLayers::UnAdd(const CompositionLayerDesc &desc) {
+    Layer layer;
+    layer.desc = desc;
+    layer.e_shape = desc.e_shape == CompositionLayerCylinder && !mb_cylinder_supported ? CompositionLayerQuad : desc.e_shape;
+
+    if (desc.e_shape == CompositionLayerCylinder && layer.e_shape == CompositionLayerQuad) {
+        const float f_width = desc.f_radius * desc.f_central_angle;
+        layer.desc.xr_size = {f_width, f_width * static_cast<float>(desc.un_height) / static_cast<float>(desc.un_width)};
+        Log(LogWarning, "[CompositionLayers] Cylinder layers are not supported, submitting a %.2fx%.2fm quad instead", layer.desc.xr_size.width,
+            layer.desc.xr_size.height);
+    }
+
+    //Contents are copied in, the compositor samples them
+    XrSwapchainCreateInfo xr_swapchain_create_info = {
+            .type = XR_TYPE_SWAPCHAIN_CREATE_INFO,
+            .createFlags = 0,
+            .usageFlags = XR_SWAPCHAIN_USAGE_TRANSFER_DST_BIT | XR_SWAPCHAIN_USAGE_COLOR_ATTACHMENT_BIT,
+            .format = mvk_format,
+            .sampleCount = 1,
+            .width = desc.un_width,
+            .height = desc.un_height,
+            .faceCount = 1,
+            .arraySize = 1,
+            .mipCount = 1,
+    };
+    XrResult xr_result = xrCreateSwapchain(mxr_session, &xr_swapchain_create_info, &layer.xr_swapchain);
+    if (XR_FAILED(xr_result)) {
+        Log(LogError, "[CompositionLayers] Failed to create a %ux%u swapchain: %i", desc.un_width, desc.un_height, xr_result);
+        return UINT32_MAX;
+    }
+
+    uint32_t un_image_count = 0;
+    xr_result = xrEnumerateSwapchainImages(layer.xr_swapchain, 0, &un_image_count, nullptr);
+    if (XR_SUCCEEDED(xr_result)) {
+        layer.v_images.resize(un_image_count, {XR_TYPE_SWAPCHAIN_IMAGE_VULKAN2_KHR});
+        xr_result = xrEnumerateSwapchainImages(layer.xr_swapchain, un_image_count, &un_image_count,
+                                               reinterpret_cast<XrSwapchainImageBaseHeader *>(layer.v_images.data()));
+    }
+    if (XR_FAILED(xr_result)) {
+        Log(LogError, "[CompositionLayers] Failed to enumerate swapchain images: %i", xr_result);
+        xrDestroySwapchain(layer.xr_swapchain);
+        return UINT32_MAX;
+    }
+
+    const XrSwapchainSubImage xr_sub_image = {
+            .swapchain = layer.xr_swapchain,
+            .imageRect = {
+                    .offset = {0, 0},
+                    .extent = {static_cast<int32_t>(desc.un_width), static_cast<int32_t>(desc.un_height)},
+            },
+            .imageArrayIndex = 0,
+    };
+    const XrCompositionLayerFlags xr_layer_flags = desc.b_blend_alpha ? XR_COMPOSITION_LAYER_BLEND_TEXTURE_SOURCE_ALPHA_BIT : 0;
+
+    layer.xr_quad.layerFlags = xr_layer_flags;
+    layer.xr_quad.eyeVisibility = XR_EYE_VISIBILITY_BOTH;
+    layer.xr_quad.subImage = xr_sub_image;
+    layer.xr_quad.size = layer.desc.xr_size;
+
+    layer.xr_cylinder.layerFlags = xr_layer_flags;
+    layer.xr_cylinder.eyeVisibility = XR_EYE_VISIBILITY_BOTH;
+    layer.xr_cylinder.subImage = xr_sub_image;
+    layer.xr_cylinder.radius = desc.f_radius;
+    layer.xr_cylinder.centralAngle = desc.f_central_angle;
+    layer.xr_cylinder.aspectRatio = static_cast<float>(desc.un_width) / static_cast<float>(desc.un_height);
+
+    mv_layers.push_back(std::move(layer));
+
+    return static_cast<uint32_t>(mv_layers.size() - 1);
+}
+
+void CompositionLayers::MarkDirty(uint32_t un_layer) {
+    if (un_layer < mv_layers.size()) {
+        mv_layers[un_layer].b_dirty = true;
+    }
+}
+
+void CompositionLayers::SetPose(uint32_t un_layer, const XrPosef &xr_pose) {
+    if (un_layer < mv_layers.size()) {
+        mv_layers[un_layer].desc.xr_pose = xr_pose;
+    }
+}
+
+void CompositionLayers::SetVisible(uint32_t un_layer, bool b_visible) {
+    if (un_layer < mv_layers.size()) {
+        mv_layers[un_layer].b_visible = b_visible;
+    }
+}
+
+void CompositionLayers::RecordUpdates(VkCommandBuffer vk_command_buffer) {
+    for (Layer &layer: mv_layers) {
+        //Hidden layers catch up once they are shown again
+        if (!layer.b_dirty || !layer.b_visible || !layer.desc.record) {
+            continue;
+        }
+
+        uint32_t un_image_index;
+        XrSwapchainImageAcquireInfo xr_acquire_info{XR_TYPE_SWAPCHAIN_IMAGE_ACQUIRE_INFO};
+        XrResult xr_result = xrAcquireSwapchainImage(layer.xr_swapchain, &xr_acquire_info, &un_image_index);
+        if (XR_FAILED(xr_result)) {
+            Log(LogError, "[CompositionLayers] Failed to acquire a layer image: %i", xr_result);
+            continue;
+        }
+
+        XrSwapchainImageWaitInfo xr_wait_info = {
+                .type = XR_TYPE_SWAPCHAIN_IMAGE_WAIT_INFO,
+                .timeout = XR_INFINITE_DURATION,
+        };
+        xr_result = xrWaitSwapchainImage(layer.xr_swapchain, &xr_wait_info);
+        if (XR_FAILED(xr_result)) {
+            //An image that was never waited cannot be released, the layer stays dirty and keeps showing its last released image
+            Log(LogError, "[CompositionLayers] Failed to wait for a layer image: %i", xr_result);
+            continue;
+        }
+        layer.b_acquired = true;
+
+        const VkImage vk_image = layer.v_images[un_image_index].image;
+        const VkExtent2D vk_extent = {layer.desc.un_width, layer.desc.un_height};
+
+        VkImageMemoryBarrier vk_image_barrier = {
+                .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+                .srcAccessMask = 0,
+                .dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+                .oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+                .newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                .image = vk_image,
+                .subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1},
+        };
+        vkCmdPipelineBarrier(vk_command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1,
+                             &vk_image_barrier);
+
+        layer.desc.record(vk_command_buffer, vk_image, vk_extent);
+
+        //Released images have to be in COLOR_ATTACHMENT_OPTIMAL, the runtime takes it from there
+        vk_image_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        vk_image_barrier.dstAccessMask = 0;
+        vk_image_barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        vk_image_barrier.newLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+        vkCmdPipelineBarrier(vk_command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, 1,
+                             &vk_image_barrier);
+
+        layer.b_dirty = false;
+        layer.b_recorded = true;
+    }
+}
+
+void CompositionLayers::ReleaseUpdated() {
+    for (Layer &layer: mv_layers) {
+        if (!layer.b_acquired) {
+            continue;
+        }
+
+        XrSwapchainImageReleaseInfo xr_release_info{XR_TYPE_SWAPCHAIN_IMAGE_RELEASE_INFO};
+        const XrResult xr_result = xrReleaseSwapchainImage(layer.xr_swapchain, &xr_release_info);
+        if (XR_FAILED(xr_result)) {
+            Log(LogError, "[CompositionLayers] Failed to release a layer image: %i", xr_result);
+        } else if (layer.b_recorded) {
+            layer.b_has_content = true;
+        }
+        layer.b_acquired = false;
+        layer.b_recorded = false;
+    }
+}
+
+void CompositionLayers::ReleaseUnsubmitted() {
+    for (Layer &layer: mv_layers) {
+        if (!layer.b_acquired) {
+            continue;
+        }
+
+        XrSwapchainImageReleaseInfo xr_release_info{XR_TYPE_SWAPCHAIN_IMAGE_RELEASE_INFO};
+        const XrResult xr_result = xrReleaseSwapchainImage(layer.xr_swapchain, &xr_release_info);
+        if (XR_FAILED(xr_result)) {
+            Log(LogError, "[CompositionLayers] Failed to release a layer image: %i", xr_result);
+        }
+        layer.b_has_content = false;
+        layer.b_dirty = true;
+        layer.b_acquired = false;
+        layer.b_recorded = false;
+    }
+}
+
+void CompositionLayers::AppendLayers(std::vector<XrCompositionLayerBaseHeader *> &v_layers) {
+    for (Layer &layer: mv_layers) {
+        //A layer that never had an image released cannot be submitted
+        if (!layer.b_visible || !layer.b_has_content) {
+            continue;
+        }
+
+        if (layer.e_shape == CompositionLayerCylinder) {
+            layer.xr_cylinder.space = layer.desc.xr_space;
+            layer.xr_cylinder.pose = layer.desc.xr_pose;
+            v_layers.push_back(reinterpret_cast<XrCompositionLayerBaseHeader *>(&layer.xr_cylinder));
+        } else {
+            layer.xr_quad.space = layer.desc.xr_space;
+            layer.xr_quad.pose = layer.desc.xr_pose;
+            v_layers.push_back(reinterpret_cast<XrCompositionLayerBaseHeader *>(&layer.xr_quad));
+        }
+    }
+}
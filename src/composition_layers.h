@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "vulkan/vulkan.h"
+
+#include "openxr/openxr.h"
+#include "openxr/openxr_platform.h"
+
+enum ECompositionLayerShape : uint32_t {
+    CompositionLayerQuad = 0,
+    CompositionLayerCylinder, //needs XR_KHR_composition_layer_cylinder, falls back to a quad as wide as the arc without it
+};
+
+//Records a layer's content into the image acquired for it. The image is in TRANSFER_DST_OPTIMAL and has to be left in it.
+using CompositionLayerRecordFn = std::function<void(VkCommandBuffer vk_command_buffer, VkImage vk_image, const VkExtent2D &vk_extent)>;
+
+struct CompositionLayerDesc {
+    ECompositionLayerShape e_shape = CompositionLayerQuad;
+
+    //swapchain size in pixels
+    uint32_t un_width = 0;
+    uint32_t un_height = 0;
+
+    XrSpace xr_space = XR_NULL_HANDLE;
+    XrPosef xr_pose{};           //center of the quad, or of the cylinder
+    XrExtent2Df xr_size{};       //quad, in meters
+    float f_radius = 1.f;        //cylinder, in meters
+    float f_central_angle = 1.f; //cylinder, in radians. The height follows from the swapchain's aspect ratio.
+
+    bool b_blend_alpha = false;
+
+    CompositionLayerRecordFn record;
+};
+
+//Quad and cylinder layers with swapchains of their own, submitted on top of the projection layer. The compositor samples
+//them straight at their place in the world, so they stay sharp without being rendered into both eyes at full resolution.
+//
+//A layer's content is only recorded again after it has been marked dirty, every other frame resubmits the image released
+//last. Everything here runs on the render thread.
+class CompositionLayers {
+public:
+    bool BInit(XrSession xr_session, VkFormat vk_format, bool b_cylinder_supported);
+    void Destroy();
+
+    //Returns the id of the new layer, or UINT32_MAX if its swapchain could not be created. Its content is recorded on the next update.
+    uint32_t UnAdd(const CompositionLayerDesc &desc);
+
+    void MarkDirty(uint32_t un_layer);
+    void SetPose(uint32_t un_layer, const XrPosef &xr_pose);
+    void SetVisible(uint32_t un_layer, bool b_visible);
+
+    //Acquires an image for every dirty layer and records its content into vk_command_buffer
+    void RecordUpdates(VkCommandBuffer vk_command_buffer);
+
+    //Releases what RecordUpdates acquired, once the command buffer has been submitted
+    void ReleaseUpdated();
+
+    //Releases what RecordUpdates acquired when the command buffer never got submitted. Those images hold nothing, so their
+    //layers are left out until they have been recorded again.
+    void ReleaseUnsubmitted();
+
+    //Appends every visible layer that has content. The pointers stay valid until the next call.
+    void AppendLayers(std::vector<XrCompositionLayerBaseHeader *> &v_layers);
+
+private:
+    struct Layer {
+        CompositionLayerDesc desc;
+        ECompositionLayerShape e_shape = CompositionLayerQuad; //what is submitted, after any fallback
+
+        XrSwapchain xr_swapchain = XR_NULL_HANDLE;
+        std::vector<XrSwapchainImageVulkan2KHR> v_images;
+
+        bool b_dirty = true;
+        bool b_acquired = false;
+        bool b_recorded = false; //into the acquired image, which holds content once released
+        bool b_has_content = false;
+        bool b_visible = true;
+
+        XrCompositionLayerQuad xr_quad{XR_TYPE_COMPOSITION_LAYER_QUAD};
+        XrCompositionLayerCylinderKHR xr_cylinder{XR_TYPE_COMPOSITION_LAYER_CYLINDER_KHR};
+    };
+
+    XrSession mxr_session = XR_NULL_HANDLE;
+    VkFormat mvk_format = VK_FORMAT_UNDEFINED;
+    bool mb_cylinder_supported = false;
+
+    std::vector<Layer> mv_layers;
+};
@@ -0,0 +1,306 @@
+#include "frame_context.h"
+
+#include <algorithm>
+
+#include "log.h"
+#include "qualify.h"
+
+bool FrameContextRing::BInit(VkDevice vk_device, GpuAllocator *p_allocator, uint32_t un_queue_family, uint32_t un_depth, VkDeviceSize size_transient) {
+    mvk_device = vk_device;
+
+    vk_get_device_proc(mvk_device, vkWaitSemaphoresKHR);
+    vk_get_device_proc(mvk_device, vkGetSemaphoreCounterValueKHR);
+    if (!vkWaitSemaphoresKHR || !vkGetSemaphoreCounterValueKHR) {
+        Log(LogError, "[FrameContextRing] VK_KHR_timeline_semaphore entry points are not available");
+        return false;
+    }
+
+    un_depth = std::clamp(un_depth, k_un_min_depth, k_un_max_depth);
+
+    {//Timeline semaphore
+        VkSemaphoreTypeCreateInfoKHR vk_semaphore_type_create_info = {
+                .sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO_KHR,
+                .semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE_KHR,
+                .initialValue = 0,
+        };
+        VkSemaphoreCreateInfo vk_semaphore_create_info = {
+                .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+                .pNext = &vk_semaphore_type_create_info,
+        };
+        b_qualify_vk(vkCreateSemaphore(mvk_device, &vk_semaphore_create_info, nullptr, &mvk_timeline_semaphore));
+    }
+
+    mv_frame_contexts.resize(un_depth);
+    for (FrameContext &frame_context: mv_frame_contexts) {
+        {//Command pool, reset as a whole once the slot is reused
+            VkCommandPoolCreateInfo vk_command_pool_create_info = {
+                    .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+                    .flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+                    .queueFamilyIndex = un_queue_family,
+            };
+            b_qualify_vk(vkCreateCommandPool(mvk_device, &vk_command_pool_create_info, nullptr, &frame_context.vk_command_pool));
+
+            VkCommandBuffer avk_command_buffers[2];
+            VkCommandBufferAllocateInfo vk_command_buffer_allocate_info = {
+                    .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+                    .commandPool = frame_context.vk_command_pool,
+                    .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+                    .commandBufferCount = static_cast<uint32_t>(std::size(avk_command_buffers)),
+            };
+            b_qualify_vk(vkAllocateCommandBuffers(mvk_device, &vk_command_buffer_allocate_info, avk_command_buffers));
+            frame_context.vk_command_buffer = avk_command_buffers[0];
+            frame_context.vk_tail_command_buffer = avk_command_buffers[1];
+        }
+
+        {//Transient buffer
+            const VkBufferUsageFlags vk_buffer_usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                                                       VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+            if (!frame_context.transient_page.BInit(p_allocator, size_transient, vk_buffer_usage)) {
+                Log(LogError, "[FrameContextRing] Failed to allocate transient buffer");
+                return false;
+            }
+        }
+    }
+
+    //start on the last slot so the first PBeginFrame lands on slot 0
+    mun_current = un_depth - 1;
+
+    Log("[FrameContextRing] Initialized with %u frames in flight", un_depth);
+
+    return true;
+}
+
+bool FrameContextRing::BInitUniformSets(VkDescriptorSetLayout vk_set_layout, const VkDeviceSize *asize_ranges, uint32_t un_binding_count,
+                                        VkDeviceSize size_uniform_alignment) {
+    msize_uniform_alignment = size_uniform_alignment;
+    msize_uniform_range_max = *std::max_element(asize_ranges, asize_ranges + un_binding_count);
+
+    const uint32_t un_depth = UnDepth();
+
+    VkDescriptorPoolSize vk_descriptor_pool_size = {
+            .type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+            .descriptorCount = un_binding_count * un_depth,
+    };
+    VkDescriptorPoolCreateInfo vk_descriptor_pool_create_info = {
+            .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+            .maxSets = un_depth,
+            .poolSizeCount = 1,
+            .pPoolSizes = &vk_descriptor_pool_size,
+    };
+    b_qualify_vk(vkCreateDescriptorPool(mvk_device, &vk_descriptor_pool_create_info, nullptr, &mvk_descriptor_pool));
+
+    std::vector<VkDescriptorSetLayout> v_set_layouts(un_depth, vk_set_layout);
+    std::vector<VkDescriptorSet> v_sets(un_depth);
+
+    VkDescriptorSetAllocateInfo vk_descriptor_set_allocate_info = {
+            .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+            .descriptorPool = mvk_descriptor_pool,
+            .descriptorSetCount = un_depth,
+            .pSetLayouts = v_set_layouts.data(),
+    };
+    b_qualify_vk(vkAllocateDescriptorSets(mvk_device, &vk_descriptor_set_allocate_info, v_sets.data()));
+
+    //The sets never change after this, every draw only supplies new dynamic offsets
+    std::vector<VkDescriptorBufferInfo> v_buffer_infos;
+    std::vector<VkWriteDescriptorSet> v_writes;
+    v_buffer_infos.reserve(un_binding_count * un_depth);
+
+    for (uint32_t i = 0; i < un_depth; i++) {
+        mv_frame_contexts[i].vk_uniform_set = v_sets[i];
+
+        for (uint32_t un_binding = 0; un_binding < un_binding_count; un_binding++) {
+            v_buffer_infos.push_back({
+                    .buffer = mv_frame_contexts[i].transient_page.GetBuffer(),
+                    .offset = 0,
+                    .range = asize_ranges[un_binding],
+            });
+            v_writes.push_back({
+                    .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                    .dstSet = v_sets[i],
+                    .dstBinding = un_binding,
+                    .dstArrayElement = 0,
+                    .descriptorCount = 1,
+                    .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+                    .pBufferInfo = &v_buffer_infos.back(),
+            });
+        }
+    }
+    vkUpdateDescriptorSets(mvk_device, static_cast<uint32_t>(v_writes.size()), v_writes.data(), 0, nullptr);
+
+    return true;
+}
+
+bool FrameContextRing::BInitTimestamps(float f_timestamp_period, uint32_t un_timestamp_valid_bits) {
+    if (un_timestamp_valid_bits == 0) {
+        Log(LogWarning, "[FrameContextRing] The queue does not support timestamps, GPU times are not measured");
+        return false;
+    }
+
+    mf_timestamp_period = f_timestamp_period;
+    mun_timestamp_mask = un_timestamp_valid_bits >= 64 ? UINT64_MAX : (1ull << un_timestamp_valid_bits) - 1;
+
+    for (FrameContext &frame_context: mv_frame_contexts) {
+        VkQueryPoolCreateInfo vk_query_pool_create_info = {
+                .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+                .queryType = VK_QUERY_TYPE_TIMESTAMP,
+                .queryCount = 2,
+        };
+        b_qualify_vk(vkCreateQueryPool(mvk_device, &vk_query_pool_create_info, nullptr, &frame_context.vk_timestamp_query_pool));
+    }
+
+    return true;
+}
+
+void FrameContextRing::RecordGpuTimeBegin(VkCommandBuffer vk_command_buffer) {
+    FrameContext &frame_context = mv_frame_contexts[mun_current];
+    if (frame_context.vk_timestamp_query_pool == VK_NULL_HANDLE) {
+        return;
+    }
+
+    vkCmdResetQueryPool(vk_command_buffer, frame_context.vk_timestamp_query_pool, 0, 2);
+    vkCmdWriteTimestamp(vk_command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, frame_context.vk_timestamp_query_pool, 0);
+}
+
+void FrameContextRing::RecordGpuTimeEnd(VkCommandBuffer vk_command_buffer) {
+    FrameContext &frame_context = mv_frame_contexts[mun_current];
+    if (frame_context.vk_timestamp_query_pool == VK_NULL_HANDLE) {
+        return;
+    }
+
+    vkCmdWriteTimestamp(vk_command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, frame_context.vk_timestamp_query_pool, 1);
+    frame_context.b_timestamps_written = true;
+}
+
+bool FrameContextRing::BTakeGpuTime(float &out_f_milliseconds) {
+    if (!mb_gpu_time_new) {
+        return false;
+    }
+
+    mb_gpu_time_new = false;
+    out_f_milliseconds = mf_gpu_time_ms;
+
+    return true;
+}
+
+void FrameContextRing::Destroy() {
+    if (mvk_device == VK_NULL_HANDLE) {
+        return;
+    }
+
+    for (FrameContext &frame_context: mv_frame_contexts) {
+        vkDestroyQueryPool(mvk_device, frame_context.vk_timestamp_query_pool, nullptr);
+        frame_context.transient_page.Destroy();
+        vkDestroyCommandPool(mvk_device, frame_context.vk_command_pool, nullptr);
+    }
+    mv_frame_contexts.clear();
+
+    vkDestroyDescriptorPool(mvk_device, mvk_descriptor_pool, nullptr);
+    mvk_descriptor_pool = VK_NULL_HANDLE;
+
+    vkDestroySemaphore(mvk_device, mvk_timeline_semaphore, nullptr);
+    mvk_timeline_semaphore = VK_NULL_HANDLE;
+
+    mvk_device = VK_NULL_HANDLE;
+}
+
+FrameContext *FrameContextRing::PBeginFrame() {
+    mun_current = (mun_current + 1) % mv_frame_contexts.size();
+    FrameContext &frame_context = mv_frame_contexts[mun_current];
+
+    //The CPU only waits here when it has lapped the GPU by the full depth of the ring
+    if (frame_context.un_timeline_value > UnCompletedValue()) {
+        VkSemaphoreWaitInfoKHR vk_semaphore_wait_info = {
+                .sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO_KHR,
+                .semaphoreCount = 1,
+                .pSemaphores = &mvk_timeline_semaphore,
+                .pValues = &frame_context.un_timeline_value,
+        };
+        d_qualify_vk(vkWaitSemaphoresKHR(mvk_device, &vk_semaphore_wait_info, UINT64_MAX));
+    }
+
+    //The slot's last submission has finished, so its timestamps are available without waiting
+    if (frame_context.b_timestamps_written) {
+        frame_context.b_timestamps_written = false;
+
+        uint64_t aun_timestamps[2];
+        if (vkGetQueryPoolResults(mvk_device, frame_context.vk_timestamp_query_pool, 0, 2, sizeof(aun_timestamps), aun_timestamps, sizeof(uint64_t),
+                                  VK_QUERY_RESULT_64_BIT) == VK_SUCCESS) {
+            const uint64_t un_ticks = (aun_timestamps[1] - aun_timestamps[0]) & mun_timestamp_mask;
+            mf_gpu_time_ms = static_cast<float>(static_cast<double>(un_ticks) * mf_timestamp_period * 1e-6);
+            mb_gpu_time_new = true;
+        }
+    }
+
+    d_qualify_vk(vkResetCommandPool(mvk_device, frame_context.vk_command_pool, 0));
+    frame_context.transient_page.Reset();
+
+    return &frame_context;
+}
+
+void *FrameContextRing::PAllocateTransient(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize &out_offset) {
+    return mv_frame_contexts[mun_current].transient_page.PAllocate(size, alignment, out_offset);
+}
+
+void *FrameContextRing::PAllocateUniform(VkDeviceSize size, uint32_t &out_dynamic_offset) {
+    GpuLinearPage &transient_page = mv_frame_contexts[mun_current].transient_page;
+
+    VkDeviceSize size_offset;
+    void *p_data = transient_page.PAllocate(size, msize_uniform_alignment, size_offset);
+
+    //The bound range of every binding has to stay inside the buffer, whichever binding the offset ends up used with
+    if (!p_data || size_offset + msize_uniform_range_max > transient_page.Size()) {
+        return nullptr;
+    }
+
+    out_dynamic_offset = static_cast<uint32_t>(size_offset);
+    return p_data;
+}
+
+void FrameContextRing::FlushTransient() {
+    mv_frame_contexts[mun_current].transient_page.Flush();
+}
+
+const VkTimelineSemaphoreSubmitInfoKHR &FrameContextRing::TimelineSubmitInfo(uint32_t un_wait_count, const uint64_t *pun_wait_values) {
+    //Last point before the GPU can read this frame's transient data
+    mv_frame_contexts[mun_current].transient_page.Flush();
+
+    mun_signal_value = mun_timeline_next + 1;
+
+    mvk_timeline_submit_info = {
+            .sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO_KHR,
+            .waitSemaphoreValueCount = un_wait_count,
+            .pWaitSemaphoreValues = pun_wait_values,
+            .signalSemaphoreValueCount = 1,
+            .pSignalSemaphoreValues = &mun_signal_value,
+    };
+
+    return mvk_timeline_submit_info;
+}
+
+void FrameContextRing::CommitSubmit() {
+    mun_timeline_next = mun_signal_value;
+    mv_frame_contexts[mun_current].un_timeline_value = mun_signal_value;
+}
+
+uint64_t FrameContextRing::UnCompletedValue() const {
+    uint64_t un_value = 0;
+    vkGetSemaphoreCounterValueKHR(mvk_device, mvk_timeline_semaphore, &un_value);
+
+    return un_value;
+}
+
+bool FrameContextRing::BWaitIdle() {
+    if (mun_timeline_next == 0 || mun_timeline_next <= UnCompletedValue()) {
+        return true;
+    }
+
+    VkSemaphoreWaitInfoKHR vk_semaphore_wait_info = {
+            .sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO_KHR,
+            .semaphoreCount = 1,
+            .pSemaphores = &mvk_timeline_semaphore,
+            .pValues = &mun_timeline_next,
+    };
+    b_qualify_vk(vkWaitSemaphoresKHR(mvk_device, &vk_semaphore_wait_info, UINT64_MAX));
+
+    return true;
+}
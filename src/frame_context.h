@@ -0,0 +1,114 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "vulkan/vulkan.h"
+
+#include "gpu_allocator.h"
+
+//Resources owned by one frame in flight. Nothing in here may be touched by the CPU until the GPU has passed un_timeline_value.
+struct FrameContext {
+    VkCommandPool vk_command_pool = VK_NULL_HANDLE;
+    VkCommandBuffer vk_command_buffer = VK_NULL_HANDLE;
+
+    //for frames submitted in two parts, the part after the async compute handoff
+    VkCommandBuffer vk_tail_command_buffer = VK_NULL_HANDLE;
+
+    //host visible scratch memory for data that only lives for the duration of this frame
+    GpuLinearPage transient_page;
+
+    //every binding is a UNIFORM_BUFFER_DYNAMIC over transient_page, written once at startup and addressed with dynamic offsets
+    VkDescriptorSet vk_uniform_set = VK_NULL_HANDLE;
+
+    //value the timeline semaphore reaches once the GPU has finished this slot's last submission. Only set once that has been
+    //queued, a frame that failed before keeps the value of the one before it.
+    uint64_t un_timeline_value = 0;
+
+    //two timestamps around the frame's commands, only read back once the slot comes around again
+    VkQueryPool vk_timestamp_query_pool = VK_NULL_HANDLE;
+    bool b_timestamps_written = false;
+};
+
+//Ring of FrameContexts whose GPU completion is tracked by a single timeline semaphore
+class FrameContextRing {
+public:
+    static constexpr uint32_t k_un_min_depth = 2;
+    static constexpr uint32_t k_un_max_depth = 3;
+
+    bool BInit(VkDevice vk_device, GpuAllocator *p_allocator, uint32_t un_queue_family, uint32_t un_depth, VkDeviceSize size_transient);
+    void Destroy();
+
+    //Moves to the next slot. Blocks only if the GPU is still working on the submission that last used it.
+    FrameContext *PBeginFrame();
+
+    //Blocks until the GPU has finished every frame submitted so far, for tearing down what those frames still reference
+    bool BWaitIdle();
+
+    //Allocates one descriptor set per slot with vk_set_layout, binding i covers asize_ranges[i] bytes of the transient buffer
+    bool BInitUniformSets(VkDescriptorSetLayout vk_set_layout, const VkDeviceSize *asize_ranges, uint32_t un_binding_count,
+                          VkDeviceSize size_uniform_alignment);
+
+    //Enables measuring how long the GPU spends on each frame. f_timestamp_period is VkPhysicalDeviceLimits::timestampPeriod and
+    //un_timestamp_valid_bits the queue family's timestampValidBits, which has to be non zero.
+    bool BInitTimestamps(float f_timestamp_period, uint32_t un_timestamp_valid_bits);
+
+    //Bracket everything recorded into the current slot's command buffer, outside of any render pass. No-ops without timestamps.
+    void RecordGpuTimeBegin(VkCommandBuffer vk_command_buffer);
+    void RecordGpuTimeEnd(VkCommandBuffer vk_command_buffer);
+
+    //GPU time of the latest frame read back by PBeginFrame, which lags the current one by the depth of the ring.
+    //Returns false if there is no measurement that has not been taken yet.
+    bool BTakeGpuTime(float &out_f_milliseconds);
+
+    //Sub-allocates from the current slot's transient buffer, returns nullptr if it is exhausted
+    void *PAllocateTransient(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize &out_offset);
+
+    //Sub-allocates uniform data addressable through the current slot's vk_uniform_set, out_dynamic_offset is what
+    //vkCmdBindDescriptorSets takes for it. A pointer bump, returns nullptr if the transient buffer is exhausted.
+    void *PAllocateUniform(VkDeviceSize size, uint32_t &out_dynamic_offset);
+
+    //Makes what was written to the current slot's transient buffer so far visible to the GPU, for submissions of the frame
+    //before its last one. TimelineSubmitInfo flushes everything.
+    void FlushTransient();
+
+    //Chained into the VkSubmitInfo of the current frame's last submission to signal its timeline value. Submissions that also wait
+    //on timeline semaphores pass one value per wait semaphore, as VkTimelineSemaphoreSubmitInfo requires.
+    const VkTimelineSemaphoreSubmitInfoKHR &TimelineSubmitInfo(uint32_t un_wait_count = 0, const uint64_t *pun_wait_values = nullptr);
+
+    //Called once the submission TimelineSubmitInfo was chained into has been queued successfully. Only then do the current slot
+    //and BWaitIdle wait for its value, one that is never signaled would block them forever.
+    void CommitSubmit();
+
+    VkSemaphore GetTimelineSemaphore() const { return mvk_timeline_semaphore; }
+    FrameContext &GetCurrent() { return mv_frame_contexts[mun_current]; }
+    uint32_t UnCurrentSlot() const { return mun_current; }
+
+    uint32_t UnDepth() const { return static_cast<uint32_t>(mv_frame_contexts.size()); }
+    uint64_t UnCompletedValue() const;
+
+private:
+    VkDevice mvk_device = VK_NULL_HANDLE;
+
+    std::vector<FrameContext> mv_frame_contexts;
+    uint32_t mun_current = 0;
+
+    VkDescriptorPool mvk_descriptor_pool = VK_NULL_HANDLE;
+    VkDeviceSize msize_uniform_alignment = 1;
+    VkDeviceSize msize_uniform_range_max = 0;
+
+    VkSemaphore mvk_timeline_semaphore = VK_NULL_HANDLE;
+    uint64_t mun_timeline_next = 0; //last value of a submission that was queued
+
+    float mf_timestamp_period = 0.f;
+    uint64_t mun_timestamp_mask = 0;
+    float mf_gpu_time_ms = 0.f;
+    bool mb_gpu_time_new = false;
+
+    //value of the submission TimelineSubmitInfo was last called for
+    uint64_t mun_signal_value = 0;
+    VkTimelineSemaphoreSubmitInfoKHR mvk_timeline_submit_info{};
+
+    PFN_vkWaitSemaphoresKHR vkWaitSemaphoresKHR = nullptr;
+    PFN_vkGetSemaphoreCounterValueKHR vkGetSemaphoreCounterValueKHR = nullptr;
+};
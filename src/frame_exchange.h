@@ -0,0 +1,70 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+//Lock-free single producer / single consumer hand-off of per-frame data between two threads.
+//Slots are filled in place and published by bumping a counter, blocked sides sleep on the counter via atomic wait.
+template<typename T, uint32_t N>
+class FrameExchange {
+public:
+    //Returns the next free slot, blocking while the consumer still owns all N slots
+    T *PAcquireWrite() {
+        const uint64_t un_write = mun_write.load(std::memory_order_relaxed) & ~k_un_closed_bit;
+
+        uint64_t un_read = mun_read.load(std::memory_order_acquire);
+        while (un_write - un_read >= N) {
+            mun_read.wait(un_read, std::memory_order_acquire);
+            un_read = mun_read.load(std::memory_order_acquire);
+        }
+
+        return &ma_slots[un_write % N];
+    }
+
+    void Publish() {
+        mun_write.fetch_add(1, std::memory_order_release);
+        mun_write.notify_one();
+    }
+
+    //Called by the producer once it will not publish anymore. The consumer still drains published slots.
+    void Close() {
+        mun_write.fetch_or(k_un_closed_bit, std::memory_order_release);
+        mun_write.notify_one();
+    }
+
+    //Returns the oldest published slot, or nullptr once the exchange is closed and drained
+    T *PAcquireRead() {
+        const uint64_t un_read = mun_read.load(std::memory_order_relaxed);
+
+        uint64_t un_write = mun_write.load(std::memory_order_acquire);
+        while ((un_write & ~k_un_closed_bit) == un_read) {
+            if (un_write & k_un_closed_bit) {
+                return nullptr;
+            }
+
+            mun_write.wait(un_write, std::memory_order_acquire);
+            un_write = mun_write.load(std::memory_order_acquire);
+        }
+
+        return &ma_slots[un_read % N];
+    }
+
+    void ReleaseRead() {
+        mun_read.fetch_add(1, std::memory_order_release);
+        mun_read.notify_one();
+    }
+
+    void Reset() {
+        mun_write.store(0, std::memory_order_relaxed);
+        mun_read.store(0, std::memory_order_relaxed);
+    }
+
+private:
+    static constexpr uint64_t k_un_closed_bit = 1ull << 63;
+
+    std::array<T, N> ma_slots{};
+
+    std::atomic<uint64_t> mun_write{0};
+    std::atomic<uint64_t> mun_read{0};
+};
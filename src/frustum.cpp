@@ -0,0 +1,159 @@
+#include "frustum.h"
+
+#include <cmath>
+#include <vector>
+
+//Distance a corner may sit outside a candidate plane, absorbs the rounding of corners lying on the plane itself
+constexpr float k_f_plane_tolerance = 1e-3f;
+
+static XrVector4f NormalizePlane(float f_x, float f_y, float f_z, float f_w) {
+    const float f_length = std::sqrt(f_x * f_x + f_y * f_y + f_z * f_z);
+    if (f_length <= 0.f) {
+        return {0.f, 0.f, 0.f, 1.f};
+    }
+
+    return {f_x / f_length, f_y / f_length, f_z / f_length, f_w / f_length};
+}
+
+//Four lanes of af starting at i, the ones past un_count are 0
+static Float4 LoadLanes(const float *af, uint32_t i, uint32_t un_count) {
+    if (i + k_un_float4_lanes <= un_count) {
+        return Float4Load(af + i);
+    }
+
+    float af_lanes[k_un_float4_lanes] = {};
+    for (uint32_t un_lane = 0; i + un_lane < un_count; un_lane++) {
+        af_lanes[un_lane] = af[i + un_lane];
+    }
+
+    return Float4Load(af_lanes);
+}
+
+static void StoreVisible(uint32_t un_visible_bits, uint32_t i, uint32_t un_count, uint8_t *pun_out_visible) {
+    for (uint32_t un_lane = 0; un_lane < k_un_float4_lanes && i + un_lane < un_count; un_lane++) {
+        pun_out_visible[i + un_lane] = static_cast<uint8_t>((un_visible_bits >> un_lane) & 1u);
+    }
+}
+
+static float PlaneDistance(const XrVector4f &xr_plane, const XrVector3f &xr_point) {
+    return xr_plane.x * xr_point.x + xr_plane.y * xr_point.y + xr_plane.z * xr_point.z + xr_plane.w;
+}
+
+Frustum FrustumFromViewProjection(const Mat4 &mat4_view_projection) {
+    //Columns transposed into the rows of the matrix, af4_rows[i] multiplied with a point gives its clip space coordinate i
+    Float4 af4_rows[4] = {Float4Load(mat4_view_projection.af), Float4Load(mat4_view_projection.af + 4), Float4Load(mat4_view_projection.af + 8),
+                          Float4Load(mat4_view_projection.af + 12)};
+    Float4Transpose(af4_rows[0], af4_rows[1], af4_rows[2], af4_rows[3]);
+
+    //-w <= x <= w, -w <= y <= w and, with reversed depth, 0 <= z <= w from the far to the near plane
+    Float4 af4_planes[FrustumPlaneCount];
+    af4_planes[FrustumPlaneLeft] = Float4Add(af4_rows[3], af4_rows[0]);
+    af4_planes[FrustumPlaneRight] = Float4Sub(af4_rows[3], af4_rows[0]);
+    af4_planes[FrustumPlaneTop] = Float4Add(af4_rows[3], af4_rows[1]);
+    af4_planes[FrustumPlaneBottom] = Float4Sub(af4_rows[3], af4_rows[1]);
+    af4_planes[FrustumPlaneNear] = Float4Sub(af4_rows[3], af4_rows[2]);
+    af4_planes[FrustumPlaneFar] = af4_rows[2];
+
+    Frustum frustum;
+    for (uint32_t un_plane = 0; un_plane < FrustumPlaneCount; un_plane++) {
+        float af_plane[4];
+        Float4Store(af_plane, af4_planes[un_plane]);
+        frustum.axr_planes[un_plane] = NormalizePlane(af_plane[0], af_plane[1], af_plane[2], af_plane[3]);
+    }
+
+    return frustum;
+}
+
+Frustum FrustumFromViews(const XrView *pxr_views, uint32_t un_view_count, float f_near, float f_far) {
+    std::vector<Frustum> v_frustums(un_view_count);
+    std::vector<XrVector3f> v_corners;
+    v_corners.reserve(un_view_count * 8);
+
+    for (uint32_t i = 0; i < un_view_count; i++) {
+        const XrView &xr_view = pxr_views[i];
+        v_frustums[i] = FrustumFromViewProjection(Mat4Multiply(Mat4ProjectionFromFov(xr_view.fov, f_near, f_far), Mat4ViewFromPose(xr_view.pose)));
+
+        const Mat4 mat4_pose = Mat4FromPose(xr_view.pose);
+        const float af_tan_x[] = {std::tan(xr_view.fov.angleLeft), std::tan(xr_view.fov.angleRight)};
+        const float af_tan_y[] = {std::tan(xr_view.fov.angleDown), std::tan(xr_view.fov.angleUp)};
+
+        for (float f_depth: {f_near, f_far}) {
+            for (float f_tan_x: af_tan_x) {
+                for (float f_tan_y: af_tan_y) {
+                    v_corners.push_back(Mat4TransformPoint(mat4_pose, {f_tan_x * f_depth, f_tan_y * f_depth, -f_depth}));
+                }
+            }
+        }
+    }
+
+    const float f_tolerance = k_f_plane_tolerance * f_far;
+
+    Frustum frustum;
+    for (uint32_t un_plane = 0; un_plane < FrustumPlaneCount; un_plane++) {
+        //An open plane, everything is inside it
+        frustum.axr_planes[un_plane] = {0.f, 0.f, 0.f, 1.f};
+
+        for (const Frustum &view_frustum: v_frustums) {
+            const XrVector4f &xr_candidate = view_frustum.axr_planes[un_plane];
+
+            bool b_bounds_all = true;
+            for (const XrVector3f &xr_corner: v_corners) {
+                if (PlaneDistance(xr_candidate, xr_corner) < -f_tolerance) {
+                    b_bounds_all = false;
+                    break;
+                }
+            }
+
+            if (b_bounds_all) {
+                frustum.axr_planes[un_plane] = xr_candidate;
+                break;
+            }
+        }
+    }
+
+    return frustum;
+}
+
+void FrustumTestSpheres(const Frustum &frustum, const float *af_centers_x, const float *af_centers_y, const float *af_centers_z, const float *af_radii,
+                        uint32_t un_count, uint8_t *pun_out_visible) {
+    for (uint32_t i = 0; i < un_count; i += k_un_float4_lanes) {
+        const Float4 f4_x = LoadLanes(af_centers_x, i, un_count);
+        const Float4 f4_y = LoadLanes(af_centers_y, i, un_count);
+        const Float4 f4_z = LoadLanes(af_centers_z, i, un_count);
+        const Float4 f4_negative_radius = Float4Sub(Float4Splat(0.f), LoadLanes(af_radii, i, un_count));
+
+        //Inside as long as no plane has the whole sphere on its outer side
+        Mask4 m4_visible = Mask4All();
+        for (const XrVector4f &xr_plane: frustum.axr_planes) {
+            Float4 f4_distance = Float4MulAdd(Float4Splat(xr_plane.z), f4_z, Float4Splat(xr_plane.w));
+            f4_distance = Float4MulAdd(Float4Splat(xr_plane.y), f4_y, f4_distance);
+            f4_distance = Float4MulAdd(Float4Splat(xr_plane.x), f4_x, f4_distance);
+            m4_visible = Mask4And(m4_visible, Float4GreaterEqual(f4_distance, f4_negative_radius));
+        }
+
+        StoreVisible(UnMask4Bits(m4_visible), i, un_count, pun_out_visible);
+    }
+}
+
+void FrustumTestBoxes(const Frustum &frustum, const float *af_mins_x, const float *af_mins_y, const float *af_mins_z, const float *af_maxs_x,
+                      const float *af_maxs_y, const float *af_maxs_z, uint32_t un_count, uint8_t *pun_out_visible) {
+    for (uint32_t i = 0; i < un_count; i += k_un_float4_lanes) {
+        const Float4 af4_mins[] = {LoadLanes(af_mins_x, i, un_count), LoadLanes(af_mins_y, i, un_count), LoadLanes(af_mins_z, i, un_count)};
+        const Float4 af4_maxs[] = {LoadLanes(af_maxs_x, i, un_count), LoadLanes(af_maxs_y, i, un_count), LoadLanes(af_maxs_z, i, un_count)};
+
+        //Only the corner furthest along a plane's normal has to be on its inner side, the same corner for every box
+        Mask4 m4_visible = Mask4All();
+        for (const XrVector4f &xr_plane: frustum.axr_planes) {
+            const Float4 &f4_x = xr_plane.x >= 0.f ? af4_maxs[0] : af4_mins[0];
+            const Float4 &f4_y = xr_plane.y >= 0.f ? af4_maxs[1] : af4_mins[1];
+            const Float4 &f4_z = xr_plane.z >= 0.f ? af4_maxs[2] : af4_mins[2];
+
+            Float4 f4_distance = Float4MulAdd(Float4Splat(xr_plane.z), f4_z, Float4Splat(xr_plane.w));
+            f4_distance = Float4MulAdd(Float4Splat(xr_plane.y), f4_y, f4_distance);
+            f4_distance = Float4MulAdd(Float4Splat(xr_plane.x), f4_x, f4_distance);
+            m4_visible = Mask4And(m4_visible, Float4GreaterEqual(f4_distance, Float4Splat(0.f)));
+        }
+
+        StoreVisible(UnMask4Bits(m4_visible), i, un_count, pun_out_visible);
+    }
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+
+#include "openxr/openxr.h"
+
+#include "xr_math.h"
+
+enum EFrustumPlane : uint32_t {
+    FrustumPlaneLeft = 0,
+    FrustumPlaneRight,
+    FrustumPlaneTop,
+    FrustumPlaneBottom,
+    FrustumPlaneNear,
+    FrustumPlaneFar,
+    FrustumPlaneCount,
+};
+
+//Inward facing planes, xyz is the unit normal and w the distance: a point p is inside if dot(xyz, p) + w >= 0 for every plane.
+//Laid out like a vec4[6] so it can be copied straight into shader constants.
+struct Frustum {
+    XrVector4f axr_planes[FrustumPlaneCount];
+};
+
+//Planes of a view-projection matrix producing Vulkan clip space with reversed depth, z going from w at the near plane to 0
+//at the far one, as Mat4ProjectionFromFov does
+Frustum FrustumFromViewProjection(const Mat4 &mat4_view_projection);
+
+//One convex volume containing the frustums of every view, so a single test culls for all eyes of a multiview pass.
+//Each plane is taken from whichever view's frustum has every corner of the other frustums on its inner side. Where no
+//view qualifies, as with strongly canted displays, the plane is left open. The result only ever over-includes.
+Frustum FrustumFromViews(const XrView *pxr_views, uint32_t un_view_count, float f_near, float f_far);
+
+//Batched tests of structure of arrays bounds, four objects per instruction. pun_out_visible gets 1 for every object
+//intersecting or inside the frustum and 0 for the rest. Like the planes, both only ever over-include.
+void FrustumTestSpheres(const Frustum &frustum, const float *af_centers_x, const float *af_centers_y, const float *af_centers_z, const float *af_radii,
+                        uint32_t un_count, uint8_t *pun_out_visible);
+void FrustumTestBoxes(const Frustum &frustum, const float *af_mins_x, const float *af_mins_y, const float *af_mins_z, const float *af_maxs_x,
+                      const float *af_maxs_y, const float *af_maxs_z, uint32_t un_count, uint8_t *pun_out_visible);
@@ -0,0 +1,769 @@
+#include "gpu_allocator.h"
+
+#include <algorithm>
+#include <bit>
+
+#include "log.h"
+#include "qualify.h"
+
+constexpr VkDeviceSize k_size_block_default = 64ull * 1024 * 1024;
+
+//allocations above this fraction of a block get their own VkDeviceMemory instead of fragmenting a block
+constexpr VkDeviceSize k_un_dedicated_block_divisor = 2;
+
+//empty blocks kept around per pool, so a resource being recreated every few frames does not hit vkAllocateMemory each time
+constexpr size_t k_un_empty_blocks_kept = 1;
+
+//TLSF
+
+constexpr uint32_t k_un_null_node = UINT32_MAX;
+
+//16 second level lists per power of two, so a free range is never more than 1/16th larger than the size class it is filed under
+constexpr uint32_t k_un_sl_bits = 4;
+constexpr uint32_t k_un_sl_count = 1u << k_un_sl_bits;
+constexpr uint32_t k_un_fl_count = 64 - k_un_sl_bits + 1;
+
+//free ranges smaller than this are left attached to the allocation in front of them
+constexpr VkDeviceSize k_size_min_split = 64;
+
+struct TlsfNode {
+    VkDeviceSize size_offset = 0;
+    VkDeviceSize size = 0;
+
+    uint32_t un_prev_physical = k_un_null_node;
+    uint32_t un_next_physical = k_un_null_node;
+
+    uint32_t un_prev_free = k_un_null_node;
+    uint32_t un_next_free = k_un_null_node;
+
+    bool b_free = false;
+};
+
+//Two level segregated fit over a range of offsets. Nodes live in a side table since the memory they describe is not CPU addressable.
+class Tlsf {
+public:
+    void Init(VkDeviceSize size) {
+        mv_nodes.clear();
+        mv_unused_nodes.clear();
+        mun_fl_bitmap = 0;
+        std::fill(std::begin(maun_sl_bitmaps), std::end(maun_sl_bitmaps), 0u);
+        for (auto &aun_heads: maaun_heads) {
+            std::fill(std::begin(aun_heads), std::end(aun_heads), k_un_null_node);
+        }
+
+        const uint32_t un_node = UnNewNode();
+        mv_nodes[un_node].size = size;
+        InsertFree(un_node);
+
+        msize_used = 0;
+    }
+
+    //Returns k_un_null_node if no free range is large enough
+    uint32_t UnAllocate(VkDeviceSize size, VkDeviceSize alignment) {
+        //Searching for size + alignment - 1 guarantees whatever range is found can be aligned without another search
+        const uint32_t un_node = UnFindFree(size + alignment - 1);
+        if (un_node == k_un_null_node) {
+            return k_un_null_node;
+        }
+        RemoveFree(un_node);
+
+        const VkDeviceSize size_aligned_offset = (mv_nodes[un_node].size_offset + alignment - 1) & ~(alignment - 1);
+        const VkDeviceSize size_padding = size_aligned_offset - mv_nodes[un_node].size_offset;
+        if (size_padding > 0) {
+            //the range in front is physically preceded by a used node, otherwise the two would have been merged
+            const uint32_t un_front = UnNewNode();
+            TlsfNode &node = mv_nodes[un_node];
+            TlsfNode &front = mv_nodes[un_front];
+
+            front.size_offset = node.size_offset;
+            front.size = size_padding;
+            front.un_prev_physical = node.un_prev_physical;
+            front.un_next_physical = un_node;
+            if (front.un_prev_physical != k_un_null_node) {
+                mv_nodes[front.un_prev_physical].un_next_physical = un_front;
+            }
+
+            node.size_offset = size_aligned_offset;
+            node.size -= size_padding;
+            node.un_prev_physical = un_front;
+
+            InsertFree(un_front);
+        }
+
+        if (mv_nodes[un_node].size - size >= k_size_min_split) {
+            const uint32_t un_back = UnNewNode();
+            TlsfNode &node = mv_nodes[un_node];
+            TlsfNode &back = mv_nodes[un_back];
+
+            back.size_offset = node.size_offset + size;
+            back.size = node.size - size;
+            back.un_prev_physical = un_node;
+            back.un_next_physical = node.un_next_physical;
+            if (back.un_next_physical != k_un_null_node) {
+                mv_nodes[back.un_next_physical].un_prev_physical = un_back;
+            }
+
+            node.size = size;
+            node.un_next_physical = un_back;
+
+            InsertFree(un_back);
+        }
+
+        mv_nodes[un_node].b_free = false;
+        msize_used += mv_nodes[un_node].size;
+
+        return un_node;
+    }
+
+    void Free(uint32_t un_node) {
+        msize_used -= mv_nodes[un_node].size;
+
+        const uint32_t un_prev = mv_nodes[un_node].un_prev_physical;
+        if (un_prev != k_un_null_node && mv_nodes[un_prev].b_free) {
+            RemoveFree(un_prev);
+            Absorb(un_prev, un_node);
+            un_node = un_prev;
+        }
+
+        const uint32_t un_next = mv_nodes[un_node].un_next_physical;
+        if (un_next != k_un_null_node && mv_nodes[un_next].b_free) {
+            RemoveFree(un_next);
+            Absorb(un_node, un_next);
+        }
+
+        InsertFree(un_node);
+    }
+
+    const TlsfNode &GetNode(uint32_t un_node) const { return mv_nodes[un_node]; }
+
+    VkDeviceSize SizeUsed() const { return msize_used; }
+
+private:
+    static void Mapping(VkDeviceSize size, uint32_t &out_fl, uint32_t &out_sl) {
+        if (size < k_un_sl_count) {
+            out_fl = 0;
+            out_sl = static_cast<uint32_t>(size);
+            return;
+        }
+
+        const uint32_t un_msb = 63 - std::countl_zero(size);
+        out_fl = un_msb - k_un_sl_bits + 1;
+        out_sl = static_cast<uint32_t>(size >> (un_msb - k_un_sl_bits)) & (k_un_sl_count - 1);
+    }
+
+    uint32_t UnFindFree(VkDeviceSize size) const {
+        //Round up to the next size class so every range in the list found is large enough
+        if (size >= k_un_sl_count) {
+            const uint32_t un_msb = 63 - std::countl_zero(size);
+            size += (VkDeviceSize(1) << (un_msb - k_un_sl_bits)) - 1;
+        }
+
+        uint32_t un_fl, un_sl;
+        Mapping(size, un_fl, un_sl);
+        if (un_fl >= k_un_fl_count) {
+            return k_un_null_node;
+        }
+
+        uint32_t un_sl_bitmap = maun_sl_bitmaps[un_fl] & (~0u << un_sl);
+        if (un_sl_bitmap == 0) {
+            const uint64_t un_fl_bitmap = un_fl + 1 < 64 ? mun_fl_bitmap & (~0ull << (un_fl + 1)) : 0;
+            if (un_fl_bitmap == 0) {
+                return k_un_null_node;
+            }
+
+            un_fl = std::countr_zero(un_fl_bitmap);
+            un_sl_bitmap = maun_sl_bitmaps[un_fl];
+        }
+
+        return maaun_heads[un_fl][std::countr_zero(un_sl_bitmap)];
+    }
+
+    void InsertFree(uint32_t un_node) {
+        uint32_t un_fl, un_sl;
+        Mapping(mv_nodes[un_node].size, un_fl, un_sl);
+
+        TlsfNode &node = mv_nodes[un_node];
+        node.b_free = true;
+        node.un_prev_free = k_un_null_node;
+        node.un_next_free = maaun_heads[un_fl][un_sl];
+        if (node.un_next_free != k_un_null_node) {
+            mv_nodes[node.un_next_free].un_prev_free = un_node;
+        }
+
+        maaun_heads[un_fl][un_sl] = un_node;
+        maun_sl_bitmaps[un_fl] |= 1u << un_sl;
+        mun_fl_bitmap |= 1ull << un_fl;
+    }
+
+    void RemoveFree(uint32_t un_node) {
+        uint32_t un_fl, un_sl;
+        Mapping(mv_nodes[un_node].size, un_fl, un_sl);
+
+        TlsfNode &node = mv_nodes[un_node];
+        if (node.un_prev_free != k_un_null_node) {
+            mv_nodes[node.un_prev_free].un_next_free = node.un_next_free;
+        } else {
+            maaun_heads[un_fl][un_sl] = node.un_next_free;
+        }
+        if (node.un_next_free != k_un_null_node) {
+            mv_nodes[node.un_next_free].un_prev_free = node.un_prev_free;
+        }
+
+        if (maaun_heads[un_fl][un_sl] == k_un_null_node) {
+            maun_sl_bitmaps[un_fl] &= ~(1u << un_sl);
+            if (maun_sl_bitmaps[un_fl] == 0) {
+                mun_fl_bitmap &= ~(1ull << un_fl);
+            }
+        }
+
+        node.b_free = false;
+        node.un_prev_free = k_un_null_node;
+        node.un_next_free = k_un_null_node;
+    }
+
+    //Merges un_next into the physically preceding un_node and recycles un_next
+    void Absorb(uint32_t un_node, uint32_t un_next) {
+        TlsfNode &node = mv_nodes[un_node];
+        const TlsfNode &next = mv_nodes[un_next];
+
+        node.size += next.size;
+        node.un_next_physical = next.un_next_physical;
+        if (node.un_next_physical != k_un_null_node) {
+            mv_nodes[node.un_next_physical].un_prev_physical = un_node;
+        }
+
+        mv_unused_nodes.push_back(un_next);
+    }
+
+    uint32_t UnNewNode() {
+        if (!mv_unused_nodes.empty()) {
+            const uint32_t un_node = mv_unused_nodes.back();
+            mv_unused_nodes.pop_back();
+            mv_nodes[un_node] = {};
+            return un_node;
+        }
+
+        mv_nodes.emplace_back();
+        return static_cast<uint32_t>(mv_nodes.size() - 1);
+    }
+
+    std::vector<TlsfNode> mv_nodes;
+    std::vector<uint32_t> mv_unused_nodes;
+
+    uint64_t mun_fl_bitmap = 0;
+    uint32_t maun_sl_bitmaps[k_un_fl_count] = {};
+    uint32_t maaun_heads[k_un_fl_count][k_un_sl_count] = {};
+
+    VkDeviceSize msize_used = 0;
+};
+
+struct GpuMemoryBlock {
+    VkDeviceMemory vk_memory = VK_NULL_HANDLE;
+    VkDeviceSize size = 0;
+    uint32_t un_memory_type = 0;
+    uint32_t un_pool = 0; //index into GpuAllocator::mvv_blocks
+
+    uint8_t *pun_mapped = nullptr;
+
+    bool b_dedicated = false;
+    Tlsf tlsf;
+};
+
+bool GpuAllocator::BInit(VkDevice vk_device, VkPhysicalDevice vk_physical_device) {
+    mvk_device = vk_device;
+
+    vkGetPhysicalDeviceMemoryProperties(vk_physical_device, &mvk_memory_properties);
+
+    VkPhysicalDeviceProperties vk_physical_device_properties;
+    vkGetPhysicalDeviceProperties(vk_physical_device, &vk_physical_device_properties);
+    mvk_limits = vk_physical_device_properties.limits;
+
+    mvv_blocks.resize(mvk_memory_properties.memoryTypeCount * 2);
+
+    Log("[GpuAllocator] %u memory types, %u heaps, bufferImageGranularity %llu, maxMemoryAllocationCount %u", mvk_memory_properties.memoryTypeCount,
+        mvk_memory_properties.memoryHeapCount, static_cast<unsigned long long>(mvk_limits.bufferImageGranularity), mvk_limits.maxMemoryAllocationCount);
+
+    return true;
+}
+
+void GpuAllocator::Destroy() {
+    if (mvk_device == VK_NULL_HANDLE) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mmutex);
+
+    if (m_statistics.un_allocation_count > 0) {
+        Log(LogWarning, "[GpuAllocator] %u allocations still alive on destruction", m_statistics.un_allocation_count);
+    }
+
+    for (auto &v_blocks: mvv_blocks) {
+        for (auto &p_block: v_blocks) {
+            vkFreeMemory(mvk_device, p_block->vk_memory, nullptr);
+        }
+    }
+    mvv_blocks.clear();
+
+    for (auto &[p_block, up_block]: mmap_dedicated) {
+        vkFreeMemory(mvk_device, p_block->vk_memory, nullptr);
+    }
+    mmap_dedicated.clear();
+
+    m_statistics = {};
+    mvk_device = VK_NULL_HANDLE;
+}
+
+uint32_t GpuAllocator::UnFindMemoryType(uint32_t un_type_bits, EGpuMemoryUsage e_usage) const {
+    VkMemoryPropertyFlags vk_required = 0;
+    VkMemoryPropertyFlags vk_preferred = 0;
+    VkMemoryPropertyFlags vk_avoided = 0;
+
+    switch (e_usage) {
+        case GpuMemoryDeviceLocal: {
+            vk_required = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+            vk_avoided = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT;
+            break;
+        }
+        case GpuMemoryUpload: {
+            vk_required = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+            vk_preferred = VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+            vk_avoided = VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+            break;
+        }
+        case GpuMemoryReadback: {
+            vk_required = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+            vk_preferred = VK_MEMORY_PROPERTY_HOST_CACHED_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+            break;
+        }
+        case GpuMemoryTransient: {
+            vk_required = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+            vk_preferred = VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT;
+            vk_avoided = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+            break;
+        }
+    }
+
+    uint32_t un_best = UINT32_MAX;
+    int n_best_score = INT32_MIN;
+    for (uint32_t i = 0; i < mvk_memory_properties.memoryTypeCount; i++) {
+        const VkMemoryPropertyFlags vk_flags = mvk_memory_properties.memoryTypes[i].propertyFlags;
+        if (!(un_type_bits & (1u << i)) || (vk_flags & vk_required) != vk_required) {
+            continue;
+        }
+
+        const int n_score = 2 * std::popcount(vk_flags & vk_preferred) - std::popcount(vk_flags & vk_avoided);
+        if (n_score > n_best_score) {
+            n_best_score = n_score;
+            un_best = i;
+        }
+    }
+
+    return un_best;
+}
+
+VkDeviceSize GpuAllocator::SizeBlockForType(uint32_t un_memory_type) const {
+    //Small heaps get proportionally smaller blocks so a single block never claims a large share of them
+    const VkDeviceSize size_heap = mvk_memory_properties.memoryHeaps[mvk_memory_properties.memoryTypes[un_memory_type].heapIndex].size;
+    return std::min(k_size_block_default, std::bit_floor(size_heap / 8));
+}
+
+GpuMemoryBlock *GpuAllocator::PCreateBlock(uint32_t un_memory_type, VkDeviceSize size, const void *p_next) {
+    if (m_statistics.un_device_memory_count >= mvk_limits.maxMemoryAllocationCount) {
+        Log(LogError, "[GpuAllocator] maxMemoryAllocationCount (%u) reached", mvk_limits.maxMemoryAllocationCount);
+        return nullptr;
+    }
+
+    VkMemoryAllocateInfo vk_memory_allocate_info = {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+            .pNext = p_next,
+            .allocationSize = size,
+            .memoryTypeIndex = un_memory_type,
+    };
+
+    VkDeviceMemory vk_memory;
+    const VkResult vk_result = vkAllocateMemory(mvk_device, &vk_memory_allocate_info, nullptr, &vk_memory);
+    if (vk_result != VK_SUCCESS) {
+        Log(LogError, "[GpuAllocator] vkAllocateMemory of %llu bytes from memory type %u failed with: %i", static_cast<unsigned long long>(size),
+            un_memory_type, vk_result);
+        return nullptr;
+    }
+
+    auto p_block = new GpuMemoryBlock{
+            .vk_memory = vk_memory,
+            .size = size,
+            .un_memory_type = un_memory_type,
+    };
+
+    //Host visible memory is mapped once for its whole lifetime, mapping is not free on every driver
+    if (mvk_memory_properties.memoryTypes[un_memory_type].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+        if (vkMapMemory(mvk_device, vk_memory, 0, VK_WHOLE_SIZE, 0, reinterpret_cast<void **>(&p_block->pun_mapped)) != VK_SUCCESS) {
+            Log(LogError, "[GpuAllocator] Failed to map memory type %u", un_memory_type);
+            vkFreeMemory(mvk_device, vk_memory, nullptr);
+            delete p_block;
+            return nullptr;
+        }
+    }
+
+    const uint32_t un_heap = mvk_memory_properties.memoryTypes[un_memory_type].heapIndex;
+    m_statistics.un_device_memory_count++;
+    m_statistics.asize_heap_bytes[un_heap] += size;
+
+    return p_block;
+}
+
+void GpuAllocator::DestroyBlock(GpuMemoryBlock *p_block) {
+    const uint32_t un_heap = mvk_memory_properties.memoryTypes[p_block->un_memory_type].heapIndex;
+    m_statistics.un_device_memory_count--;
+    m_statistics.asize_heap_bytes[un_heap] -= p_block->size;
+
+    vkFreeMemory(mvk_device, p_block->vk_memory, nullptr);
+}
+
+bool GpuAllocator::BAllocate(const VkMemoryRequirements &vk_memory_requirements, EGpuMemoryUsage e_usage, bool b_optimal_image, bool b_dedicated,
+                             GpuAllocation &out_allocation) {
+    return BAllocateInternal(vk_memory_requirements, e_usage, b_optimal_image, b_dedicated, nullptr, out_allocation);
+}
+
+bool GpuAllocator::BAllocateInternal(const VkMemoryRequirements &vk_memory_requirements, EGpuMemoryUsage e_usage, bool b_optimal_image, bool b_dedicated,
+                                     const VkMemoryDedicatedAllocateInfo *p_vk_dedicated_allocate_info, GpuAllocation &out_allocation) {
+    const uint32_t un_memory_type = UnFindMemoryType(vk_memory_requirements.memoryTypeBits, e_usage);
+    if (un_memory_type == UINT32_MAX) {
+        Log(LogError, "[GpuAllocator] No memory type for usage %u in type bits 0x%x", e_usage, vk_memory_requirements.memoryTypeBits);
+        return false;
+    }
+
+    const VkMemoryPropertyFlags vk_flags = mvk_memory_properties.memoryTypes[un_memory_type].propertyFlags;
+    const VkDeviceSize size_block = SizeBlockForType(un_memory_type);
+
+    //Lazily allocated memory only saves anything when each attachment has its own allocation
+    b_dedicated = b_dedicated || vk_memory_requirements.size > size_block / k_un_dedicated_block_divisor || (vk_flags & VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT);
+
+    std::lock_guard<std::mutex> lock(mmutex);
+
+    if (b_dedicated) {
+        GpuMemoryBlock *p_block = PCreateBlock(un_memory_type, vk_memory_requirements.size, p_vk_dedicated_allocate_info);
+        if (!p_block) {
+            return false;
+        }
+        p_block->b_dedicated = true;
+        mmap_dedicated.emplace(p_block, std::unique_ptr<GpuMemoryBlock>(p_block));
+
+        out_allocation = {
+                .vk_memory = p_block->vk_memory,
+                .size_offset = 0,
+                .size = vk_memory_requirements.size,
+                .pun_mapped = p_block->pun_mapped,
+                .un_memory_type = un_memory_type,
+                .p_block = p_block,
+                .un_node = UINT32_MAX,
+        };
+
+        m_statistics.un_dedicated_count++;
+        m_statistics.un_allocation_count++;
+        m_statistics.size_dedicated_bytes += vk_memory_requirements.size;
+        m_statistics.size_peak_bytes = std::max(m_statistics.size_peak_bytes, m_statistics.size_block_bytes + m_statistics.size_dedicated_bytes);
+
+        return true;
+    }
+
+    //Host visible, non coherent memory is flushed in nonCoherentAtomSize units, which must not spill into a neighbouring allocation
+    VkDeviceSize alignment = vk_memory_requirements.alignment;
+    VkDeviceSize size = vk_memory_requirements.size;
+    if ((vk_flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) && !(vk_flags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)) {
+        alignment = std::max(alignment, mvk_limits.nonCoherentAtomSize);
+        size = (size + mvk_limits.nonCoherentAtomSize - 1) & ~(mvk_limits.nonCoherentAtomSize - 1);
+    }
+
+    const bool b_split_by_tiling = mvk_limits.bufferImageGranularity > 1;
+    const uint32_t un_pool = un_memory_type * 2 + (b_split_by_tiling && b_optimal_image ? 1 : 0);
+    std::vector<std::unique_ptr<GpuMemoryBlock>> &v_blocks = mvv_blocks[un_pool];
+
+    GpuMemoryBlock *p_block = nullptr;
+    uint32_t un_node = k_un_null_node;
+    for (auto &up_block: v_blocks) {
+        un_node = up_block->tlsf.UnAllocate(size, alignment);
+        if (un_node != k_un_null_node) {
+            p_block = up_block.get();
+            break;
+        }
+    }
+
+    if (!p_block) {
+        p_block = PCreateBlock(un_memory_type, size_block, nullptr);
+        if (!p_block) {
+            return false;
+        }
+        p_block->un_pool = un_pool;
+        p_block->tlsf.Init(size_block);
+        v_blocks.emplace_back(p_block);
+
+        m_statistics.un_block_count++;
+        m_statistics.size_block_bytes += size_block;
+        m_statistics.size_peak_bytes = std::max(m_statistics.size_peak_bytes, m_statistics.size_block_bytes + m_statistics.size_dedicated_bytes);
+
+        un_node = p_block->tlsf.UnAllocate(size, alignment);
+        if (un_node == k_un_null_node) {
+            Log(LogError, "[GpuAllocator] Allocation of %llu bytes does not fit a fresh block", static_cast<unsigned long long>(size));
+            return false;
+        }
+    }
+
+    const TlsfNode &node = p_block->tlsf.GetNode(un_node);
+    out_allocation = {
+            .vk_memory = p_block->vk_memory,
+            .size_offset = node.size_offset,
+            .size = size,
+            .pun_mapped = p_block->pun_mapped ? p_block->pun_mapped + node.size_offset : nullptr,
+            .un_memory_type = un_memory_type,
+            .p_block = p_block,
+            .un_node = un_node,
+    };
+
+    m_statistics.un_allocation_count++;
+    m_statistics.size_allocated_bytes += node.size;
+
+    return true;
+}
+
+void GpuAllocator::Free(GpuAllocation &allocation) {
+    if (!allocation.BValid()) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mmutex);
+
+    GpuMemoryBlock *p_block = allocation.p_block;
+    m_statistics.un_allocation_count--;
+
+    if (p_block->b_dedicated) {
+        m_statistics.un_dedicated_count--;
+        m_statistics.size_dedicated_bytes -= p_block->size;
+
+        DestroyBlock(p_block);
+        mmap_dedicated.erase(p_block);
+    } else {
+        m_statistics.size_allocated_bytes -= p_block->tlsf.GetNode(allocation.un_node).size;
+        p_block->tlsf.Free(allocation.un_node);
+
+        if (p_block->tlsf.SizeUsed() == 0) {
+            std::vector<std::unique_ptr<GpuMemoryBlock>> &v_blocks = mvv_blocks[p_block->un_pool];
+
+            const size_t un_empty = std::count_if(v_blocks.begin(), v_blocks.end(), [](const auto &up_block) { return up_block->tlsf.SizeUsed() == 0; });
+            if (un_empty > k_un_empty_blocks_kept) {
+                m_statistics.un_block_count--;
+                m_statistics.size_block_bytes -= p_block->size;
+
+                DestroyBlock(p_block);
+                std::erase_if(v_blocks, [&](const auto &up_block) { return up_block.get() == p_block; });
+            }
+        }
+    }
+
+    allocation = {};
+}
+
+bool GpuAllocator::BCreateBuffer(const VkBufferCreateInfo &vk_buffer_create_info, EGpuMemoryUsage e_usage, VkBuffer &out_vk_buffer,
+                                 GpuAllocation &out_allocation) {
+    b_qualify_vk(vkCreateBuffer(mvk_device, &vk_buffer_create_info, nullptr, &out_vk_buffer));
+
+    VkMemoryDedicatedRequirements vk_memory_dedicated_requirements = {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS,
+    };
+    VkMemoryRequirements2 vk_memory_requirements = {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2,
+            .pNext = &vk_memory_dedicated_requirements,
+    };
+    VkBufferMemoryRequirementsInfo2 vk_buffer_memory_requirements_info = {
+            .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_REQUIREMENTS_INFO_2,
+            .buffer = out_vk_buffer,
+    };
+    vkGetBufferMemoryRequirements2(mvk_device, &vk_buffer_memory_requirements_info, &vk_memory_requirements);
+
+    VkMemoryDedicatedAllocateInfo vk_memory_dedicated_allocate_info = {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO,
+            .buffer = out_vk_buffer,
+    };
+
+    const bool b_dedicated = vk_memory_dedicated_requirements.prefersDedicatedAllocation || vk_memory_dedicated_requirements.requiresDedicatedAllocation;
+    if (!BAllocateInternal(vk_memory_requirements.memoryRequirements, e_usage, false, b_dedicated, &vk_memory_dedicated_allocate_info, out_allocation)) {
+        vkDestroyBuffer(mvk_device, out_vk_buffer, nullptr);
+        out_vk_buffer = VK_NULL_HANDLE;
+        return false;
+    }
+
+    const VkResult vk_result = vkBindBufferMemory(mvk_device, out_vk_buffer, out_allocation.vk_memory, out_allocation.size_offset);
+    if (vk_result != VK_SUCCESS) {
+        Log(LogError, "[GpuAllocator] vkBindBufferMemory failed with: %i", vk_result);
+        DestroyBuffer(out_vk_buffer, out_allocation);
+        out_vk_buffer = VK_NULL_HANDLE;
+        return false;
+    }
+
+    return true;
+}
+
+bool GpuAllocator::BCreateImage(const VkImageCreateInfo &vk_image_create_info, EGpuMemoryUsage e_usage, VkImage &out_vk_image, GpuAllocation &out_allocation) {
+    b_qualify_vk(vkCreateImage(mvk_device, &vk_image_create_info, nullptr, &out_vk_image));
+
+    VkMemoryDedicatedRequirements vk_memory_dedicated_requirements = {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS,
+    };
+    VkMemoryRequirements2 vk_memory_requirements = {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2,
+            .pNext = &vk_memory_dedicated_requirements,
+    };
+    VkImageMemoryRequirementsInfo2 vk_image_memory_requirements_info = {
+            .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_REQUIREMENTS_INFO_2,
+            .image = out_vk_image,
+    };
+    vkGetImageMemoryRequirements2(mvk_device, &vk_image_memory_requirements_info, &vk_memory_requirements);
+
+    VkMemoryDedicatedAllocateInfo vk_memory_dedicated_allocate_info = {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO,
+            .image = out_vk_image,
+    };
+
+    const bool b_dedicated = vk_memory_dedicated_requirements.prefersDedicatedAllocation || vk_memory_dedicated_requirements.requiresDedicatedAllocation;
+    const bool b_optimal_image = vk_image_create_info.tiling == VK_IMAGE_TILING_OPTIMAL;
+    if (!BAllocateInternal(vk_memory_requirements.memoryRequirements, e_usage, b_optimal_image, b_dedicated, &vk_memory_dedicated_allocate_info,
+                           out_allocation)) {
+        vkDestroyImage(mvk_device, out_vk_image, nullptr);
+        out_vk_image = VK_NULL_HANDLE;
+        return false;
+    }
+
+    const VkResult vk_result = vkBindImageMemory(mvk_device, out_vk_image, out_allocation.vk_memory, out_allocation.size_offset);
+    if (vk_result != VK_SUCCESS) {
+        Log(LogError, "[GpuAllocator] vkBindImageMemory failed with: %i", vk_result);
+        DestroyImage(out_vk_image, out_allocation);
+        out_vk_image = VK_NULL_HANDLE;
+        return false;
+    }
+
+    return true;
+}
+
+void GpuAllocator::DestroyBuffer(VkBuffer vk_buffer, GpuAllocation &allocation) {
+    vkDestroyBuffer(mvk_device, vk_buffer, nullptr);
+    Free(allocation);
+}
+
+void GpuAllocator::DestroyImage(VkImage vk_image, GpuAllocation &allocation) {
+    vkDestroyImage(mvk_device, vk_image, nullptr);
+    Free(allocation);
+}
+
+bool GpuAllocator::BIsCoherent(const GpuAllocation &allocation) const {
+    return mvk_memory_properties.memoryTypes[allocation.un_memory_type].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+}
+
+VkMappedMemoryRange GpuAllocator::MappedRange(const GpuAllocation &allocation, VkDeviceSize size_offset, VkDeviceSize size) const {
+    if (size == VK_WHOLE_SIZE) {
+        size = allocation.size - size_offset;
+    }
+
+    //Widen to whole atoms, allocations in non coherent memory are atom aligned so this stays inside the allocation
+    const VkDeviceSize size_atom = mvk_limits.nonCoherentAtomSize;
+    const VkDeviceSize size_begin = (allocation.size_offset + size_offset) & ~(size_atom - 1);
+    const VkDeviceSize size_end = std::min((allocation.size_offset + size_offset + size + size_atom - 1) & ~(size_atom - 1),
+                                           allocation.p_block->size);
+
+    return {
+            .sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE,
+            .memory = allocation.vk_memory,
+            .offset = size_begin,
+            .size = size_end - size_begin,
+    };
+}
+
+void GpuAllocator::Flush(const GpuAllocation &allocation, VkDeviceSize size_offset, VkDeviceSize size) {
+    if (!allocation.pun_mapped || BIsCoherent(allocation)) {
+        return;
+    }
+
+    const VkMappedMemoryRange vk_mapped_memory_range = MappedRange(allocation, size_offset, size);
+    vkFlushMappedMemoryRanges(mvk_device, 1, &vk_mapped_memory_range);
+}
+
+void GpuAllocator::Invalidate(const GpuAllocation &allocation, VkDeviceSize size_offset, VkDeviceSize size) {
+    if (!allocation.pun_mapped || BIsCoherent(allocation)) {
+        return;
+    }
+
+    const VkMappedMemoryRange vk_mapped_memory_range = MappedRange(allocation, size_offset, size);
+    vkInvalidateMappedMemoryRanges(mvk_device, 1, &vk_mapped_memory_range);
+}
+
+GpuAllocatorStatistics GpuAllocator::GetStatistics() const {
+    std::lock_guard<std::mutex> lock(mmutex);
+    return m_statistics;
+}
+
+void GpuAllocator::LogStatistics() const {
+    const GpuAllocatorStatistics statistics = GetStatistics();
+
+    constexpr double k_d_mib = 1024.0 * 1024.0;
+    Log("[GpuAllocator] %u allocations, %u device memory objects (%u blocks, %u dedicated), %.2f of %.2f MiB block memory used, "
+        "%.2f MiB dedicated, %.2f MiB peak",
+        statistics.un_allocation_count, statistics.un_device_memory_count, statistics.un_block_count, statistics.un_dedicated_count,
+        statistics.size_allocated_bytes / k_d_mib, statistics.size_block_bytes / k_d_mib, statistics.size_dedicated_bytes / k_d_mib,
+        statistics.size_peak_bytes / k_d_mib);
+
+    for (uint32_t i = 0; i < mvk_memory_properties.memoryHeapCount; i++) {
+        Log("[GpuAllocator] Heap %u: %.2f of %.2f MiB", i, statistics.asize_heap_bytes[i] / k_d_mib, mvk_memory_properties.memoryHeaps[i].size / k_d_mib);
+    }
+}
+
+bool GpuLinearPage::BInit(GpuAllocator *p_allocator, VkDeviceSize size, VkBufferUsageFlags vk_buffer_usage, EGpuMemoryUsage e_usage) {
+    mp_allocator = p_allocator;
+
+    VkBufferCreateInfo vk_buffer_create_info = {
+            .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+            .size = size,
+            .usage = vk_buffer_usage,
+            .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+    };
+    if (!mp_allocator->BCreateBuffer(vk_buffer_create_info, e_usage, mvk_buffer, m_allocation)) {
+        return false;
+    }
+
+    if (!m_allocation.pun_mapped) {
+        Log(LogError, "[GpuLinearPage] Page memory is not host visible");
+        Destroy();
+        return false;
+    }
+
+    msize_requested = size;
+    msize_used = 0;
+
+    return true;
+}
+
+void GpuLinearPage::Destroy() {
+    if (mvk_buffer == VK_NULL_HANDLE) {
+        return;
+    }
+
+    mp_allocator->DestroyBuffer(mvk_buffer, m_allocation);
+    mvk_buffer = VK_NULL_HANDLE;
+}
+
+void *GpuLinearPage::PAllocate(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize &out_offset) {
+    const VkDeviceSize size_offset = (msize_used + alignment - 1) & ~(alignment - 1);
+    if (size_offset + size > msize_requested) {
+        Log(LogError, "[GpuLinearPage] Page exhausted (%llu of %llu bytes used)", static_cast<unsigned long long>(size_offset),
+            static_cast<unsigned long long>(msize_requested));
+        return nullptr;
+    }
+
+    msize_used = size_offset + size;
+    out_offset = size_offset;
+
+    return m_allocation.pun_mapped + size_offset;
+}
+
+void GpuLinearPage::Flush() {
+    if (msize_used > 0) {
+        mp_allocator->Flush(m_allocation, 0, msize_used);
+    }
+}
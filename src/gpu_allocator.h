@@ -0,0 +1,128 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "vulkan/vulkan.h"
+
+struct GpuMemoryBlock;
+
+enum EGpuMemoryUsage : uint32_t {
+    GpuMemoryDeviceLocal = 0, //only touched by the GPU
+    GpuMemoryUpload,          //written by the CPU and read by the GPU, staging and per frame data
+    GpuMemoryReadback,        //written by the GPU and read back by the CPU
+    GpuMemoryTransient,       //attachments that never leave tile memory, lazily allocated where supported
+};
+
+//A range of device memory handed out by GpuAllocator. pun_mapped stays valid for the lifetime of the allocation.
+struct GpuAllocation {
+    VkDeviceMemory vk_memory = VK_NULL_HANDLE;
+    VkDeviceSize size_offset = 0;
+    VkDeviceSize size = 0;
+
+    uint8_t *pun_mapped = nullptr; //nullptr unless the memory type is host visible
+    uint32_t un_memory_type = UINT32_MAX;
+
+    GpuMemoryBlock *p_block = nullptr;
+    uint32_t un_node = UINT32_MAX; //UINT32_MAX for dedicated allocations
+
+    bool BValid() const { return p_block != nullptr; }
+};
+
+struct GpuAllocatorStatistics {
+    uint32_t un_device_memory_count = 0; //live vkAllocateMemory allocations, bounded by maxMemoryAllocationCount
+    uint32_t un_block_count = 0;
+    uint32_t un_dedicated_count = 0;
+    uint32_t un_allocation_count = 0;
+
+    VkDeviceSize size_block_bytes = 0;      //reserved for sub-allocation
+    VkDeviceSize size_allocated_bytes = 0;  //in use by sub-allocations
+    VkDeviceSize size_dedicated_bytes = 0;
+    VkDeviceSize size_peak_bytes = 0;       //peak of block plus dedicated bytes
+
+    VkDeviceSize asize_heap_bytes[VK_MAX_MEMORY_HEAPS] = {};
+};
+
+//Sub-allocates buffers and images out of large per memory type blocks, so the number of vkAllocateMemory calls stays
+//small and independent of the number of resources. Blocks are managed with TLSF, which finds a fitting free range in O(1).
+class GpuAllocator {
+public:
+    bool BInit(VkDevice vk_device, VkPhysicalDevice vk_physical_device);
+
+    //Frees every block, all resources allocated from it have to be destroyed by now
+    void Destroy();
+
+    bool BCreateBuffer(const VkBufferCreateInfo &vk_buffer_create_info, EGpuMemoryUsage e_usage, VkBuffer &out_vk_buffer, GpuAllocation &out_allocation);
+    bool BCreateImage(const VkImageCreateInfo &vk_image_create_info, EGpuMemoryUsage e_usage, VkImage &out_vk_image, GpuAllocation &out_allocation);
+
+    void DestroyBuffer(VkBuffer vk_buffer, GpuAllocation &allocation);
+    void DestroyImage(VkImage vk_image, GpuAllocation &allocation);
+
+    //For memory the caller binds itself. b_optimal_image keeps the allocation apart from linear resources when bufferImageGranularity requires it.
+    bool BAllocate(const VkMemoryRequirements &vk_memory_requirements, EGpuMemoryUsage e_usage, bool b_optimal_image, bool b_dedicated,
+                   GpuAllocation &out_allocation);
+    void Free(GpuAllocation &allocation);
+
+    //No-ops for host coherent memory. Ranges are relative to the start of the allocation.
+    void Flush(const GpuAllocation &allocation, VkDeviceSize size_offset = 0, VkDeviceSize size = VK_WHOLE_SIZE);
+    void Invalidate(const GpuAllocation &allocation, VkDeviceSize size_offset = 0, VkDeviceSize size = VK_WHOLE_SIZE);
+
+    bool BIsCoherent(const GpuAllocation &allocation) const;
+
+    GpuAllocatorStatistics GetStatistics() const;
+    void LogStatistics() const;
+
+private:
+    bool BAllocateInternal(const VkMemoryRequirements &vk_memory_requirements, EGpuMemoryUsage e_usage, bool b_optimal_image, bool b_dedicated,
+                           const VkMemoryDedicatedAllocateInfo *p_vk_dedicated_allocate_info, GpuAllocation &out_allocation);
+
+    uint32_t UnFindMemoryType(uint32_t un_type_bits, EGpuMemoryUsage e_usage) const;
+
+    GpuMemoryBlock *PCreateBlock(uint32_t un_memory_type, VkDeviceSize size, const void *p_next);
+    void DestroyBlock(GpuMemoryBlock *p_block);
+
+    VkDeviceSize SizeBlockForType(uint32_t un_memory_type) const;
+    VkMappedMemoryRange MappedRange(const GpuAllocation &allocation, VkDeviceSize size_offset, VkDeviceSize size) const;
+
+    VkDevice mvk_device = VK_NULL_HANDLE;
+    VkPhysicalDeviceMemoryProperties mvk_memory_properties{};
+    VkPhysicalDeviceLimits mvk_limits{};
+
+    mutable std::mutex mmutex;
+
+    //indexed by memory type * 2 + b_optimal_image, linear and optimal resources only share blocks if bufferImageGranularity is 1
+    std::vector<std::vector<std::unique_ptr<GpuMemoryBlock>>> mvv_blocks;
+    std::unordered_map<GpuMemoryBlock *, std::unique_ptr<GpuMemoryBlock>> mmap_dedicated;
+
+    GpuAllocatorStatistics m_statistics;
+};
+
+//Bump allocator over a single buffer, for data that only lives for one frame and is thrown away as a whole
+class GpuLinearPage {
+public:
+    bool BInit(GpuAllocator *p_allocator, VkDeviceSize size, VkBufferUsageFlags vk_buffer_usage, EGpuMemoryUsage e_usage = GpuMemoryUpload);
+    void Destroy();
+
+    void Reset() { msize_used = 0; }
+
+    //Returns nullptr once the page is exhausted
+    void *PAllocate(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize &out_offset);
+
+    //Makes everything written since the last Reset visible to the GPU
+    void Flush();
+
+    VkBuffer GetBuffer() const { return mvk_buffer; }
+    VkDeviceSize Size() const { return msize_requested; }
+    VkDeviceSize SizeUsed() const { return msize_used; }
+
+private:
+    GpuAllocator *mp_allocator = nullptr;
+
+    VkBuffer mvk_buffer = VK_NULL_HANDLE;
+    GpuAllocation m_allocation;
+    VkDeviceSize msize_requested = 0;
+    VkDeviceSize msize_used = 0;
+};
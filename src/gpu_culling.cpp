@@ -0,0 +1,466 @@
+#include "gpu_culling.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "log.h"
+#include "qualify.h"
+#include "shader_reflection.h"
+#include "simd.h"
+
+#include "shaders/cull_comp.h"
+
+//Matches local_size_x in cull.comp
+constexpr uint32_t k_un_cull_group_size = 64;
+
+//Objects one job of CullDirect tests, a multiple of k_un_float4_lanes
+constexpr uint32_t k_un_direct_cull_batch_objects = 512;
+static_assert(k_un_direct_cull_batch_objects % k_un_float4_lanes == 0);
+
+//Matches the CullConstants push constant block in cull.comp
+struct CullConstants {
+    Frustum frustum;
+    uint32_t un_object_count;
+    uint32_t b_compact;
+    uint32_t un_phase;
+    uint32_t b_occlusion;
+    uint32_t un_lod_offset;
+};
+
+static_assert(sizeof(CullConstants) == 116, "CullConstants has to match the push constant block in cull.comp");
+static_assert(sizeof(GpuObject) == 96 && sizeof(GpuMesh) == 80 && sizeof(GpuVertex) == 32, "GPU structs have to match their std430 layout");
+
+bool GpuCulling::BInit(VkDevice vk_device, GpuAllocator *p_allocator, UploadManager *p_upload_manager, PipelineCache *p_pipeline_cache,
+                       VkDescriptorSetLayout vk_frame_set_layout, VkDescriptorSetLayout vk_scene_set_layout, const HiZPyramid *p_hiz_pyramid,
+                       const GpuCullingFeatures &features, uint32_t un_frames_in_flight) {
+    mvk_device = vk_device;
+    mp_allocator = p_allocator;
+    mp_upload_manager = p_upload_manager;
+    mvk_scene_set_layout = vk_scene_set_layout;
+    m_features = features;
+    mun_slice_count = std::max(un_frames_in_flight, 1u);
+
+    if (!m_features.b_draw_indirect_first_instance) {
+        me_draw_mode = DrawModeDirect;
+    } else if (m_features.b_draw_indirect_count) {
+        vk_get_device_proc(mvk_device, vkCmdDrawIndexedIndirectCountKHR);
+        me_draw_mode = vkCmdDrawIndexedIndirectCountKHR ? DrawModeIndirectCount : DrawModeIndirect;
+    } else {
+        me_draw_mode = DrawModeIndirect;
+    }
+
+    if (!BInitCullPipeline(p_pipeline_cache, vk_frame_set_layout)) {
+        Log(LogError, "[GpuCulling] Failed to create the cull pipeline");
+        return false;
+    }
+
+    {//Descriptor sets, a cull set per slice and the scene set
+        const VkDescriptorPoolSize avk_pool_sizes[] = {
+                {.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, .descriptorCount = 6 * mun_slice_count + 2},
+                {.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, .descriptorCount = mun_slice_count},
+        };
+        VkDescriptorPoolCreateInfo vk_descriptor_pool_create_info = {
+                .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+                .maxSets = mun_slice_count + 1,
+                .poolSizeCount = static_cast<uint32_t>(std::size(avk_pool_sizes)),
+                .pPoolSizes = avk_pool_sizes,
+        };
+        b_qualify_vk(vkCreateDescriptorPool(mvk_device, &vk_descriptor_pool_create_info, nullptr, &mvk_descriptor_pool));
+
+        std::vector<VkDescriptorSetLayout> v_set_layouts(mun_slice_count, mvk_cull_set_layout);
+        v_set_layouts.push_back(mvk_scene_set_layout);
+        std::vector<VkDescriptorSet> v_sets(v_set_layouts.size());
+
+        VkDescriptorSetAllocateInfo vk_descriptor_set_allocate_info = {
+                .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+                .descriptorPool = mvk_descriptor_pool,
+                .descriptorSetCount = static_cast<uint32_t>(v_set_layouts.size()),
+                .pSetLayouts = v_set_layouts.data(),
+        };
+        b_qualify_vk(vkAllocateDescriptorSets(mvk_device, &vk_descriptor_set_allocate_info, v_sets.data()));
+
+        mv_slices.resize(mun_slice_count);
+        for (uint32_t i = 0; i < mun_slice_count; i++) {
+            mv_slices[i].vk_cull_set = v_sets[i];
+        }
+        mvk_scene_set = v_sets.back();
+
+        //The render graph keeps the pyramid in GENERAL whenever a cull pass can read it
+        const VkDescriptorImageInfo vk_pyramid_info = {
+                .sampler = p_hiz_pyramid->GetSampler(),
+                .imageView = p_hiz_pyramid->GetView(),
+                .imageLayout = VK_IMAGE_LAYOUT_GENERAL,
+        };
+        std::vector<VkWriteDescriptorSet> v_writes;
+        for (const CullSlice &slice: mv_slices) {
+            v_writes.push_back({
+                    .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                    .dstSet = slice.vk_cull_set,
+                    .dstBinding = 5,
+                    .dstArrayElement = 0,
+                    .descriptorCount = 1,
+                    .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                    .pImageInfo = &vk_pyramid_info,
+            });
+        }
+        vkUpdateDescriptorSets(mvk_device, static_cast<uint32_t>(v_writes.size()), v_writes.data(), 0, nullptr);
+    }
+
+    static const char *k_apc_draw_modes[] = {"vkCmdDrawIndexedIndirectCount", "fixed count vkCmdDrawIndexedIndirect", "direct draws without culling"};
+    Log("[GpuCulling] Drawing with %s", k_apc_draw_modes[me_draw_mode]);
+
+    return true;
+}
+
+bool GpuCulling::BInitCullPipeline(PipelineCache *p_pipeline_cache, VkDescriptorSetLayout vk_frame_set_layout) {
+    const ShaderBlob &shader = k_shader_cull_comp;
+
+    {//Layout, the frame set comes from Program and only the cull set is ours
+        std::vector<VkDescriptorSetLayoutBinding> v_bindings = CollectSetBindings({&shader}, 1);
+
+        VkDescriptorSetLayoutCreateInfo vk_descriptor_set_layout_create_info = {
+                .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+                .bindingCount = static_cast<uint32_t>(v_bindings.size()),
+                .pBindings = v_bindings.data(),
+        };
+        b_qualify_vk(vkCreateDescriptorSetLayout(mvk_device, &vk_descriptor_set_layout_create_info, nullptr, &mvk_cull_set_layout));
+
+        if (shader.un_push_constant_size != sizeof(CullConstants)) {
+            Log(LogError, "[GpuCulling] cull.comp declares %u bytes of push constants, expected %zu", shader.un_push_constant_size, sizeof(CullConstants));
+            return false;
+        }
+
+        VkPushConstantRange vk_push_constant_range = {
+                .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+                .offset = shader.un_push_constant_offset,
+                .size = shader.un_push_constant_size,
+        };
+        const VkDescriptorSetLayout avk_set_layouts[] = {vk_frame_set_layout, mvk_cull_set_layout};
+        VkPipelineLayoutCreateInfo vk_pipeline_layout_create_info = {
+                .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+                .setLayoutCount = static_cast<uint32_t>(std::size(avk_set_layouts)),
+                .pSetLayouts = avk_set_layouts,
+                .pushConstantRangeCount = 1,
+                .pPushConstantRanges = &vk_push_constant_range,
+        };
+        b_qualify_vk(vkCreatePipelineLayout(mvk_device, &vk_pipeline_layout_create_info, nullptr, &mvk_cull_pipeline_layout));
+    }
+
+    VkShaderModuleCreateInfo vk_shader_module_create_info = {
+            .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+            .codeSize = shader.size_spirv,
+            .pCode = shader.pun_spirv,
+    };
+    VkShaderModule vksm_compute;
+    b_qualify_vk(vkCreateShaderModule(mvk_device, &vk_shader_module_create_info, nullptr, &vksm_compute));
+
+    VkComputePipelineCreateInfo vk_compute_pipeline_create_info = {
+            .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+            .stage = {
+                    .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+                    .stage = VK_SHADER_STAGE_COMPUTE_BIT,
+                    .module = vksm_compute,
+                    .pName = "main",
+            },
+            .layout = mvk_cull_pipeline_layout,
+    };
+    const VkResult vk_result = p_pipeline_cache->CreateComputePipeline(vk_compute_pipeline_create_info, mvk_cull_pipeline);
+
+    //The pipeline keeps what it needs, the module can go right away
+    vkDestroyShaderModule(mvk_device, vksm_compute, nullptr);
+
+    b_qualify_vk(vk_result);
+
+    return true;
+}
+
+bool GpuCulling::BCreateBuffer(VkDeviceSize size, VkBufferUsageFlags vk_buffer_usage, VkBuffer &out_vk_buffer, GpuAllocation &out_allocation) {
+    VkBufferCreateInfo vk_buffer_create_info = {
+            .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+            .size = size,
+            .usage = vk_buffer_usage,
+            .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+    };
+
+    return mp_allocator->BCreateBuffer(vk_buffer_create_info, GpuMemoryDeviceLocal, out_vk_buffer, out_allocation);
+}
+
+bool GpuCulling::BSetScene(const std::vector<GpuVertex> &v_vertices, const std::vector<uint32_t> &v_indices, const std::vector<GpuMesh> &v_meshes,
+                           const std::vector<GpuObject> &v_objects) {
+    if (v_vertices.empty() || v_indices.empty() || v_meshes.empty() || v_objects.empty()) {
+        Log(LogError, "[GpuCulling] Scene is empty");
+        return false;
+    }
+
+    const uint32_t un_object_count = static_cast<uint32_t>(v_objects.size());
+
+    //A count draw has to be able to draw every object in one call, otherwise fall back to fixed count draws split at the limit
+    if (me_draw_mode == DrawModeIndirectCount && m_features.un_max_draw_indirect_count < un_object_count) {
+        Log(LogWarning, "[GpuCulling] maxDrawIndirectCount %u is below the object count %u, not compacting draws", m_features.un_max_draw_indirect_count,
+            un_object_count);
+        me_draw_mode = DrawModeIndirect;
+    }
+
+    {//Buffers
+        const VkBufferUsageFlags vk_storage_usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+        const VkBufferUsageFlags vk_indirect_usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT;
+
+        if (!BCreateBuffer(v_vertices.size() * sizeof(GpuVertex), vk_storage_usage, mvk_vertex_buffer, m_vertex_allocation) ||
+            !BCreateBuffer(v_indices.size() * sizeof(uint32_t), VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, mvk_index_buffer,
+                           m_index_allocation) ||
+            !BCreateBuffer(v_meshes.size() * sizeof(GpuMesh), vk_storage_usage, mvk_mesh_buffer, m_mesh_allocation) ||
+            !BCreateBuffer(v_objects.size() * sizeof(GpuObject), vk_storage_usage, mvk_object_buffer, m_object_allocation)) {
+            Log(LogError, "[GpuCulling] Failed to create scene buffers");
+            return false;
+        }
+
+        for (CullSlice &slice: mv_slices) {
+            if (!BCreateBuffer(2 * v_objects.size() * sizeof(VkDrawIndexedIndirectCommand), vk_indirect_usage, slice.vk_draw_buffer, slice.draw_allocation) ||
+                !BCreateBuffer(2 * sizeof(uint32_t), vk_indirect_usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT, slice.vk_draw_count_buffer,
+                               slice.draw_count_allocation) ||
+                !BCreateBuffer(v_objects.size() * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, slice.vk_drawn_early_buffer,
+                               slice.drawn_early_allocation)) {
+                Log(LogError, "[GpuCulling] Failed to create cull output buffers");
+                return false;
+            }
+        }
+
+        //Four LOD indices per uint, cull.comp unpacks them
+        mun_lod_slice_uints = (un_object_count + 3) / 4;
+
+        VkBufferCreateInfo vk_buffer_create_info = {
+                .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+                .size = static_cast<VkDeviceSize>(mun_slice_count) * mun_lod_slice_uints * sizeof(uint32_t),
+                .usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+        };
+        if (!mp_allocator->BCreateBuffer(vk_buffer_create_info, GpuMemoryUpload, mvk_lod_buffer, m_lod_allocation) || !m_lod_allocation.pun_mapped) {
+            Log(LogError, "[GpuCulling] Failed to create the LOD buffer");
+            return false;
+        }
+        memset(m_lod_allocation.pun_mapped, 0, vk_buffer_create_info.size);
+        mp_allocator->Flush(m_lod_allocation);
+    }
+
+    {//Uploads
+        if (!mp_upload_manager->BUploadBuffer(mvk_vertex_buffer, 0, v_vertices.data(), v_vertices.size() * sizeof(GpuVertex)) ||
+            !mp_upload_manager->BUploadBuffer(mvk_index_buffer, 0, v_indices.data(), v_indices.size() * sizeof(uint32_t)) ||
+            !mp_upload_manager->BUploadBuffer(mvk_mesh_buffer, 0, v_meshes.data(), v_meshes.size() * sizeof(GpuMesh)) ||
+            !mp_upload_manager->BUploadBuffer(mvk_object_buffer, 0, v_objects.data(), v_objects.size() * sizeof(GpuObject))) {
+            Log(LogError, "[GpuCulling] Failed to upload scene");
+            return false;
+        }
+
+        mun_upload_value = mp_upload_manager->UnFlush();
+        if (mun_upload_value == 0) {
+            Log(LogError, "[GpuCulling] Failed to submit scene upload");
+            return false;
+        }
+    }
+
+    {//Descriptor sets
+        const VkDescriptorBufferInfo vk_object_info = {.buffer = mvk_object_buffer, .offset = 0, .range = VK_WHOLE_SIZE};
+        const VkDescriptorBufferInfo vk_mesh_info = {.buffer = mvk_mesh_buffer, .offset = 0, .range = VK_WHOLE_SIZE};
+        const VkDescriptorBufferInfo vk_lod_info = {.buffer = mvk_lod_buffer, .offset = 0, .range = VK_WHOLE_SIZE};
+        const VkDescriptorBufferInfo vk_vertex_info = {.buffer = mvk_vertex_buffer, .offset = 0, .range = VK_WHOLE_SIZE};
+
+        auto Write = [](VkDescriptorSet vk_set, uint32_t un_binding, const VkDescriptorBufferInfo &vk_buffer_info) -> VkWriteDescriptorSet {
+            return {
+                    .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                    .dstSet = vk_set,
+                    .dstBinding = un_binding,
+                    .dstArrayElement = 0,
+                    .descriptorCount = 1,
+                    .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                    .pBufferInfo = &vk_buffer_info,
+            };
+        };
+
+        //Bindings as declared in cull.comp and scene.vert
+        std::vector<VkDescriptorBufferInfo> v_slice_infos;
+        v_slice_infos.reserve(3 * mv_slices.size());
+        std::vector<VkWriteDescriptorSet> v_writes = {
+                Write(mvk_scene_set, 0, vk_vertex_info),
+                Write(mvk_scene_set, 1, vk_object_info),
+        };
+        for (const CullSlice &slice: mv_slices) {
+            v_slice_infos.push_back({.buffer = slice.vk_draw_buffer, .offset = 0, .range = VK_WHOLE_SIZE});
+            v_writes.push_back(Write(slice.vk_cull_set, 2, v_slice_infos.back()));
+            v_slice_infos.push_back({.buffer = slice.vk_draw_count_buffer, .offset = 0, .range = VK_WHOLE_SIZE});
+            v_writes.push_back(Write(slice.vk_cull_set, 3, v_slice_infos.back()));
+            v_slice_infos.push_back({.buffer = slice.vk_drawn_early_buffer, .offset = 0, .range = VK_WHOLE_SIZE});
+            v_writes.push_back(Write(slice.vk_cull_set, 4, v_slice_infos.back()));
+
+            v_writes.push_back(Write(slice.vk_cull_set, 0, vk_object_info));
+            v_writes.push_back(Write(slice.vk_cull_set, 1, vk_mesh_info));
+            v_writes.push_back(Write(slice.vk_cull_set, 6, vk_lod_info));
+        }
+        vkUpdateDescriptorSets(mvk_device, static_cast<uint32_t>(v_writes.size()), v_writes.data(), 0, nullptr);
+    }
+
+    mv_meshes = v_meshes;
+    mv_object_meshes.resize(v_objects.size());
+    std::transform(v_objects.begin(), v_objects.end(), mv_object_meshes.begin(), [](const GpuObject &object) { return object.un_mesh; });
+
+    //Everything is drawn until the first CullDirect
+    mv_direct_visible.assign(v_objects.size(), 1);
+
+    mun_object_count = un_object_count;
+
+    Log("[GpuCulling] Scene of %u objects, %zu meshes, %zu vertices", mun_object_count, v_meshes.size(), v_vertices.size());
+
+    return true;
+}
+
+uint8_t *GpuCulling::PNextLods() {
+    mun_slice = (mun_slice + 1) % mun_slice_count;
+
+    return m_lod_allocation.pun_mapped + static_cast<size_t>(mun_slice) * mun_lod_slice_uints * sizeof(uint32_t);
+}
+
+void GpuCulling::RecordCull(VkCommandBuffer vk_command_buffer, const Frustum &frustum, ECullPhase e_phase, bool b_occlusion,
+                            VkDescriptorSet vk_frame_set, uint32_t un_dynamic_offset_count, const uint32_t *pun_dynamic_offsets) {
+    if (me_draw_mode == DrawModeDirect) {
+        return;
+    }
+
+    //The CPU is done selecting LODs by the time culling is recorded
+    const VkDeviceSize size_lod_slice = static_cast<VkDeviceSize>(mun_lod_slice_uints) * sizeof(uint32_t);
+    if (e_phase == CullPhaseEarly) {
+        mp_allocator->Flush(m_lod_allocation, mun_slice * size_lod_slice, size_lod_slice);
+    }
+
+    const CullSlice &slice = mv_slices[mun_slice];
+
+    const bool b_compact = me_draw_mode == DrawModeIndirectCount;
+    if (b_compact) {
+        vkCmdFillBuffer(vk_command_buffer, slice.vk_draw_count_buffer, e_phase * sizeof(uint32_t), sizeof(uint32_t), 0);
+
+        const VkMemoryBarrier vk_memory_barrier = {
+                .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+                .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+                .dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+        };
+        vkCmdPipelineBarrier(vk_command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &vk_memory_barrier, 0, nullptr,
+                             0, nullptr);
+    }
+
+    const CullConstants cull_constants = {
+            .frustum = frustum,
+            .un_object_count = mun_object_count,
+            .b_compact = b_compact ? 1u : 0u,
+            .un_phase = e_phase,
+            .b_occlusion = b_occlusion ? 1u : 0u,
+            .un_lod_offset = mun_slice * mun_lod_slice_uints,
+    };
+
+    const VkDescriptorSet avk_sets[] = {vk_frame_set, slice.vk_cull_set};
+
+    vkCmdBindPipeline(vk_command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, mvk_cull_pipeline);
+    vkCmdBindDescriptorSets(vk_command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, mvk_cull_pipeline_layout, 0, static_cast<uint32_t>(std::size(avk_sets)),
+                            avk_sets, un_dynamic_offset_count, pun_dynamic_offsets);
+    vkCmdPushConstants(vk_command_buffer, mvk_cull_pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(cull_constants), &cull_constants);
+    vkCmdDispatch(vk_command_buffer, (mun_object_count + k_un_cull_group_size - 1) / k_un_cull_group_size, 1, 1);
+}
+
+void GpuCulling::CullDirect(JobSystem &job_system, const Frustum &frustum, const Scene &scene) {
+    if (me_draw_mode != DrawModeDirect || scene.UnObjectCount() != mun_object_count) {
+        return;
+    }
+
+    job_system.ParallelFor(mun_object_count, k_un_direct_cull_batch_objects, [&](uint32_t un_begin, uint32_t un_end) {
+        FrustumTestSpheres(frustum, scene.PCentersX() + un_begin, scene.PCentersY() + un_begin, scene.PCentersZ() + un_begin, scene.PRadii() + un_begin,
+                           un_end - un_begin, mv_direct_visible.data() + un_begin);
+    });
+}
+
+void GpuCulling::RecordDraws(VkCommandBuffer vk_command_buffer, VkPipelineLayout vk_pipeline_layout, ECullPhase e_phase) {
+    if (me_draw_mode == DrawModeDirect && e_phase == CullPhaseLate) {
+        return;
+    }
+
+    BindDrawResources(vk_command_buffer, vk_pipeline_layout);
+
+    const CullSlice &slice = mv_slices[mun_slice];
+    const uint32_t un_stride = sizeof(VkDrawIndexedIndirectCommand);
+    const VkDeviceSize size_first_command = static_cast<VkDeviceSize>(e_phase) * mun_object_count * un_stride;
+
+    switch (me_draw_mode) {
+        case DrawModeIndirectCount: {
+            vkCmdDrawIndexedIndirectCountKHR(vk_command_buffer, slice.vk_draw_buffer, size_first_command, slice.vk_draw_count_buffer, e_phase * sizeof(uint32_t),
+                                             mun_object_count, un_stride);
+            break;
+        }
+        case DrawModeIndirect: {
+            //Split at maxDrawIndirectCount, which is 1 without multiDrawIndirect
+            const uint32_t un_max_draw_count = std::max(m_features.un_max_draw_indirect_count, 1u);
+            for (uint32_t un_first = 0; un_first < mun_object_count; un_first += un_max_draw_count) {
+                vkCmdDrawIndexedIndirect(vk_command_buffer, slice.vk_draw_buffer, size_first_command + un_first * un_stride,
+                                         std::min(un_max_draw_count, mun_object_count - un_first), un_stride);
+            }
+            break;
+        }
+        case DrawModeDirect: {
+            RecordDirectDraws(vk_command_buffer, 0, mun_object_count);
+            break;
+        }
+    }
+}
+
+void GpuCulling::RecordDrawRange(VkCommandBuffer vk_command_buffer, VkPipelineLayout vk_pipeline_layout, uint32_t un_begin, uint32_t un_end) const {
+    if (me_draw_mode != DrawModeDirect) {
+        return;
+    }
+
+    BindDrawResources(vk_command_buffer, vk_pipeline_layout);
+    RecordDirectDraws(vk_command_buffer, un_begin, std::min(un_end, mun_object_count));
+}
+
+void GpuCulling::BindDrawResources(VkCommandBuffer vk_command_buffer, VkPipelineLayout vk_pipeline_layout) const {
+    vkCmdBindDescriptorSets(vk_command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, vk_pipeline_layout, k_un_scene_set, 1, &mvk_scene_set, 0, nullptr);
+    vkCmdBindIndexBuffer(vk_command_buffer, mvk_index_buffer, 0, VK_INDEX_TYPE_UINT32);
+}
+
+void GpuCulling::RecordDirectDraws(VkCommandBuffer vk_command_buffer, uint32_t un_begin, uint32_t un_end) const {
+    const uint8_t *pun_lods = m_lod_allocation.pun_mapped + static_cast<size_t>(mun_slice) * mun_lod_slice_uints * sizeof(uint32_t);
+    for (uint32_t i = un_begin; i < un_end; i++) {
+        if (!mv_direct_visible[i]) {
+            continue;
+        }
+
+        const GpuMesh &mesh = mv_meshes[mv_object_meshes[i]];
+        const GpuMeshLod &lod = mesh.a_lods[std::min<uint32_t>(pun_lods[i], mesh.un_lod_count - 1)];
+        vkCmdDrawIndexed(vk_command_buffer, lod.un_index_count, 1, lod.un_first_index, mesh.n_vertex_offset, i);
+    }
+}
+
+void GpuCulling::Destroy() {
+    if (mvk_device == VK_NULL_HANDLE) {
+        return;
+    }
+
+    auto DestroyBuffer = [&](VkBuffer &vk_buffer, GpuAllocation &allocation) {
+        if (vk_buffer != VK_NULL_HANDLE) {
+            mp_allocator->DestroyBuffer(vk_buffer, allocation);
+            vk_buffer = VK_NULL_HANDLE;
+        }
+    };
+    DestroyBuffer(mvk_vertex_buffer, m_vertex_allocation);
+    DestroyBuffer(mvk_index_buffer, m_index_allocation);
+    DestroyBuffer(mvk_mesh_buffer, m_mesh_allocation);
+    DestroyBuffer(mvk_object_buffer, m_object_allocation);
+    for (CullSlice &slice: mv_slices) {
+        DestroyBuffer(slice.vk_draw_buffer, slice.draw_allocation);
+        DestroyBuffer(slice.vk_draw_count_buffer, slice.draw_count_allocation);
+        DestroyBuffer(slice.vk_drawn_early_buffer, slice.drawn_early_allocation);
+    }
+    mv_slices.clear();
+    DestroyBuffer(mvk_lod_buffer, m_lod_allocation);
+
+    vkDestroyDescriptorPool(mvk_device, mvk_descriptor_pool, nullptr);
+    vkDestroyPipeline(mvk_device, mvk_cull_pipeline, nullptr);
+    vkDestroyPipelineLayout(mvk_device, mvk_cull_pipeline_layout, nullptr);
+    vkDestroyDescriptorSetLayout(mvk_device, mvk_cull_set_layout, nullptr);
+
+    mvk_device = VK_NULL_HANDLE;
+}
@@ -0,0 +1,201 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "vulkan/vulkan.h"
+
+#include "frustum.h"
+#include "gpu_allocator.h"
+#include "hiz_pyramid.h"
+#include "job_system.h"
+#include "pipeline_cache.h"
+#include "scene.h"
+#include "upload_manager.h"
+#include "xr_math.h"
+
+//Descriptor set GpuCulling binds for the graphics pipelines that draw its objects, after the per frame set
+constexpr uint32_t k_un_scene_set = 1;
+
+//std430 mirrors of the structs in src/main/shaders/cull.comp and scene.vert. Keep them in sync with the GLSL.
+struct GpuVertex {
+    float af_position[4]; //w unused
+    float af_color[4];
+};
+
+//Levels of detail a mesh can carry, each one a range of the index buffer over the mesh's vertices
+constexpr uint32_t k_un_max_mesh_lods = 4;
+
+struct GpuMeshLod {
+    uint32_t un_index_count;
+    uint32_t un_first_index;
+    float f_error; //largest distance to the full detail surface in mesh units, 0 for the first LOD
+    uint32_t un_pad;
+};
+
+//LODs go from full detail to coarsest, their errors have to increase
+struct GpuMesh {
+    int32_t n_vertex_offset;
+    uint32_t un_lod_count;
+    uint32_t aun_pad[2];
+    GpuMeshLod a_lods[k_un_max_mesh_lods];
+};
+
+struct GpuObject {
+    Mat4 mat4_model;
+    float af_bounding_sphere[4]; //world space center and radius
+    uint32_t un_mesh;
+    uint32_t aun_pad[3];
+};
+
+struct GpuCullingFeatures {
+    bool b_draw_indirect_count = false;          //VK_KHR_draw_indirect_count is enabled
+    bool b_draw_indirect_first_instance = false; //drawIndirectFirstInstance is enabled
+    uint32_t un_max_draw_indirect_count = 1;     //1 unless multiDrawIndirect is enabled
+};
+
+//Two phase occlusion culling: the early phase tests against the depth pyramid of the previous frame and its draws fill this
+//frame's depth. The pyramid is rebuilt from that, and the late phase retests only what the early phase rejected, so objects
+//that just came into view are drawn in the same frame instead of popping in one frame late.
+enum ECullPhase : uint32_t {
+    CullPhaseEarly = 0,
+    CullPhaseLate = 1,
+};
+
+//GPU driven drawing of a static set of objects. Every frame a compute pass tests each object's bounding sphere against a
+//frustum and writes a VkDrawIndexedIndirectCommand for the survivors, so the CPU cost of a frame does not grow with the scene.
+//Each command covers the index range of the LOD picked for the object this frame, see PNextLods.
+//
+//With VK_KHR_draw_indirect_count the commands are compacted and drawn with one vkCmdDrawIndexedIndirectCount. Without it
+//every object keeps its slot, culled ones with an instance count of 0, and the whole array is drawn with a fixed count.
+//Devices without drawIndirectFirstInstance cannot tell the vertex shader which object it draws through an indirect command,
+//they draw every object directly instead and skip culling.
+//
+//Occlusion tests read the OcclusionUniforms of the per frame set, which is why the cull pipeline is laid out as the frame
+//set followed by its own.
+class GpuCulling {
+public:
+    //un_frames_in_flight sizes the rings of per frame LOD selections and cull outputs
+    bool BInit(VkDevice vk_device, GpuAllocator *p_allocator, UploadManager *p_upload_manager, PipelineCache *p_pipeline_cache,
+               VkDescriptorSetLayout vk_frame_set_layout, VkDescriptorSetLayout vk_scene_set_layout, const HiZPyramid *p_hiz_pyramid,
+               const GpuCullingFeatures &features, uint32_t un_frames_in_flight);
+    void Destroy();
+
+    //Creates the buffers and queues their uploads. Only called once, objects index into meshes.
+    bool BSetScene(const std::vector<GpuVertex> &v_vertices, const std::vector<uint32_t> &v_indices, const std::vector<GpuMesh> &v_meshes,
+                   const std::vector<GpuObject> &v_objects);
+
+    //True once the scene's uploads are visible to graphics submissions recorded from now on
+    bool BReady(uint64_t un_graphics_visible_value) const { return mun_object_count > 0 && un_graphics_visible_value >= mun_upload_value; }
+
+    //False if objects are drawn without any culling, occlusion culling has nothing to add then
+    bool BCulls() const { return me_draw_mode != DrawModeDirect; }
+
+    //Moves to the next frame's LOD selection and cull outputs and returns the former, one LOD index per object that RecordCull
+    //and RecordDraws of this frame draw with. Indices past a mesh's LOD count pick its last. Only call once the frame that used
+    //them before has finished on the GPU, which FrameContextRing::PBeginFrame guarantees.
+    uint8_t *PNextLods();
+
+    //Records the culling dispatch of e_phase. Has to be recorded outside of a render pass, before RecordDraws of the same phase.
+    //b_occlusion tests against the pyramid and the OcclusionUniforms bound with vk_frame_set, which takes one dynamic offset
+    //per binding. The late phase is only meaningful after an early phase with occlusion. Ordering against earlier and later
+    //uses of the cull output is up to the caller, as RenderGraphTransferWrite and RenderGraphComputeWrite of it. Can be
+    //recorded for a queue other than the one drawing, of the same queue family.
+    void RecordCull(VkCommandBuffer vk_command_buffer, const Frustum &frustum, ECullPhase e_phase, bool b_occlusion, VkDescriptorSet vk_frame_set,
+                    uint32_t un_dynamic_offset_count, const uint32_t *pun_dynamic_offsets);
+
+    //Without culling on the GPU, tests the bounding spheres of scene's objects, the ones BSetScene got, against frustum on the
+    //CPU instead, in batches across job_system's threads, and this frame's direct draws leave out what is outside of it. Does
+    //nothing when the GPU culls.
+    void CullDirect(JobSystem &job_system, const Frustum &frustum, const Scene &scene);
+
+    //Records the draws of e_phase inside the render pass. A pipeline using vk_pipeline_layout, whose set k_un_scene_set is
+    //vk_scene_set_layout, has to be bound. Without culling the early phase draws every object CullDirect left in, the late
+    //phase nothing.
+    void RecordDraws(VkCommandBuffer vk_command_buffer, VkPipelineLayout vk_pipeline_layout, ECullPhase e_phase);
+
+    //Without culling on the GPU the early phase is one draw per object, which can be split across command buffers
+    bool BDrawsPerObject() const { return me_draw_mode == DrawModeDirect; }
+
+    //Records the early phase draws of objects [un_begin, un_end) CullDirect left in, as RecordDraws does for all of them. Only
+    //reads, so command buffers of different ranges can be recorded on different threads at once. Requires BDrawsPerObject.
+    void RecordDrawRange(VkCommandBuffer vk_command_buffer, VkPipelineLayout vk_pipeline_layout, uint32_t un_begin, uint32_t un_end) const;
+
+    uint32_t UnObjectCount() const { return mun_object_count; }
+
+    //Stands for everything the cull passes of this frame write: draw commands, counts and the drawn early flags are always
+    //used together
+    VkBuffer GetCullOutput() const { return mv_slices.empty() ? VK_NULL_HANDLE : mv_slices[mun_slice].vk_draw_buffer; }
+
+private:
+    enum EDrawMode {
+        DrawModeIndirectCount, //compacted commands and a GPU written draw count
+        DrawModeIndirect,      //one command per object, culled ones have instanceCount 0
+        DrawModeDirect,        //no culling, one vkCmdDrawIndexed per object
+    };
+
+    bool BInitCullPipeline(PipelineCache *p_pipeline_cache, VkDescriptorSetLayout vk_frame_set_layout);
+    bool BCreateBuffer(VkDeviceSize size, VkBufferUsageFlags vk_buffer_usage, VkBuffer &out_vk_buffer, GpuAllocation &out_allocation);
+    void BindDrawResources(VkCommandBuffer vk_command_buffer, VkPipelineLayout vk_pipeline_layout) const;
+    void RecordDirectDraws(VkCommandBuffer vk_command_buffer, uint32_t un_begin, uint32_t un_end) const;
+
+    VkDevice mvk_device = VK_NULL_HANDLE;
+    GpuAllocator *mp_allocator = nullptr;
+    UploadManager *mp_upload_manager = nullptr;
+
+    GpuCullingFeatures m_features;
+    EDrawMode me_draw_mode = DrawModeDirect;
+
+    VkDescriptorSetLayout mvk_cull_set_layout = VK_NULL_HANDLE;
+    VkPipelineLayout mvk_cull_pipeline_layout = VK_NULL_HANDLE;
+    VkPipeline mvk_cull_pipeline = VK_NULL_HANDLE;
+
+    VkDescriptorSetLayout mvk_scene_set_layout = VK_NULL_HANDLE;
+    VkDescriptorPool mvk_descriptor_pool = VK_NULL_HANDLE;
+    VkDescriptorSet mvk_scene_set = VK_NULL_HANDLE;
+
+    VkBuffer mvk_vertex_buffer = VK_NULL_HANDLE;
+    GpuAllocation m_vertex_allocation;
+    VkBuffer mvk_index_buffer = VK_NULL_HANDLE;
+    GpuAllocation m_index_allocation;
+    VkBuffer mvk_mesh_buffer = VK_NULL_HANDLE;
+    GpuAllocation m_mesh_allocation;
+    VkBuffer mvk_object_buffer = VK_NULL_HANDLE;
+    GpuAllocation m_object_allocation;
+
+    //Written by the cull passes of one frame, with a cull set over them. Cull and draws of a frame only touch its own slice,
+    //so the early cull of the next frame can run on another queue while this frame's draws still read theirs.
+    struct CullSlice {
+        VkDescriptorSet vk_cull_set = VK_NULL_HANDLE;
+
+        //commands and counts of the early phase come first, then those of the late phase
+        VkBuffer vk_draw_buffer = VK_NULL_HANDLE;
+        GpuAllocation draw_allocation;
+        VkBuffer vk_draw_count_buffer = VK_NULL_HANDLE;
+        GpuAllocation draw_count_allocation;
+
+        //one uint per object, set by the early phase for the late phase to skip what was already drawn
+        VkBuffer vk_drawn_early_buffer = VK_NULL_HANDLE;
+        GpuAllocation drawn_early_allocation;
+    };
+
+    uint32_t mun_object_count = 0;
+    uint64_t mun_upload_value = 0;
+
+    //one per frame in flight, mun_slice is the current frame's for both
+    std::vector<CullSlice> mv_slices;
+    uint32_t mun_slice_count = 0;
+    uint32_t mun_slice = 0;
+
+    //un_frames_in_flight slices of one byte per object rounded up to whole uints, written by the CPU every frame
+    VkBuffer mvk_lod_buffer = VK_NULL_HANDLE;
+    GpuAllocation m_lod_allocation;
+    uint32_t mun_lod_slice_uints = 0;
+
+    //kept for DrawModeDirect, which builds its draws on the CPU
+    std::vector<GpuMesh> mv_meshes;
+    std::vector<uint32_t> mv_object_meshes;
+    std::vector<uint8_t> mv_direct_visible;
+
+    PFN_vkCmdDrawIndexedIndirectCountKHR vkCmdDrawIndexedIndirectCountKHR = nullptr;
+};
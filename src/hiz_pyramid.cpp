@@ -0,0 +1,360 @@
+#include "hiz_pyramid.h"
+
+#include <algorithm>
+
+#include "log.h"
+#include "qualify.h"
+#include "shader_reflection.h"
+
+#include "shaders/hiz_reduce_comp.h"
+
+//Matches local_size_x and local_size_y in hiz_reduce.comp
+constexpr uint32_t k_un_reduce_group_size = 8;
+
+//Matches the ReduceConstants push constant block in hiz_reduce.comp
+struct ReduceConstants {
+    int32_t an_source_size[2];
+    int32_t an_level_size[2];
+    uint32_t b_depth_source;
+};
+
+static_assert(sizeof(ReduceConstants) == 20, "ReduceConstants has to match the push constant block in hiz_reduce.comp");
+static_assert(sizeof(OcclusionUniforms) == 144, "OcclusionUniforms has to match its std140 layout");
+
+bool HiZPyramid::BInit(VkDevice vk_device, GpuAllocator *p_allocator, PipelineCache *p_pipeline_cache, const std::vector<VkImageView> &vvk_depth_views,
+                       VkSampleCountFlagBits vk_depth_samples, uint32_t un_width, uint32_t un_height, uint32_t un_view_count) {
+    mvk_device = vk_device;
+    mp_allocator = p_allocator;
+    mun_depth_image_count = static_cast<uint32_t>(vvk_depth_views.size());
+    mun_depth_width = un_width;
+    mun_depth_height = un_height;
+    mun_view_count = std::min<uint32_t>(un_view_count, std::size(ma_view_projections));
+
+    SetDepthSamples(vk_depth_samples);
+
+    {//Levels
+        uint32_t un_level_width = std::max((un_width + 1) / 2, 1u);
+        uint32_t un_level_height = std::max((un_height + 1) / 2, 1u);
+        while (true) {
+            mv_level_extents.push_back({un_level_width, un_level_height});
+            if (un_level_width == 1 && un_level_height == 1) {
+                break;
+            }
+            un_level_width = (un_level_width + 1) / 2;
+            un_level_height = (un_level_height + 1) / 2;
+        }
+    }
+
+    const uint32_t un_level_count = static_cast<uint32_t>(mv_level_extents.size());
+
+    {//Pyramid image
+        VkImageCreateInfo vk_image_create_info = {
+                .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+                .imageType = VK_IMAGE_TYPE_2D,
+                .format = VK_FORMAT_R32G32_SFLOAT,
+                .extent = {mv_level_extents.front().width, mv_level_extents.front().height, 1},
+                .mipLevels = un_level_count,
+                .arrayLayers = mun_view_count,
+                .samples = VK_SAMPLE_COUNT_1_BIT,
+                .tiling = VK_IMAGE_TILING_OPTIMAL,
+                .usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+                .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+                .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+        };
+        if (!mp_allocator->BCreateImage(vk_image_create_info, GpuMemoryDeviceLocal, mvk_pyramid, m_pyramid_allocation)) {
+            Log(LogError, "[HiZPyramid] Failed to create the pyramid image");
+            return false;
+        }
+
+        VkImageViewCreateInfo vk_image_view_create_info = {
+                .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+                .image = mvk_pyramid,
+                .viewType = VK_IMAGE_VIEW_TYPE_2D_ARRAY,
+                .format = VK_FORMAT_R32G32_SFLOAT,
+                .subresourceRange = {
+                        .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                        .baseMipLevel = 0,
+                        .levelCount = un_level_count,
+                        .baseArrayLayer = 0,
+                        .layerCount = mun_view_count,
+                },
+        };
+        b_qualify_vk(vkCreateImageView(mvk_device, &vk_image_view_create_info, nullptr, &mvk_pyramid_view));
+
+        mv_level_views.resize(un_level_count);
+        for (uint32_t i = 0; i < un_level_count; i++) {
+            vk_image_view_create_info.subresourceRange.baseMipLevel = i;
+            vk_image_view_create_info.subresourceRange.levelCount = 1;
+            b_qualify_vk(vkCreateImageView(mvk_device, &vk_image_view_create_info, nullptr, &mv_level_views[i]));
+        }
+    }
+
+    {//Sampler, only ever used with texelFetch
+        VkSamplerCreateInfo vk_sampler_create_info = {
+                .sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+                .magFilter = VK_FILTER_NEAREST,
+                .minFilter = VK_FILTER_NEAREST,
+                .mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST,
+                .addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+                .addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+                .addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+                .maxLod = static_cast<float>(un_level_count),
+        };
+        b_qualify_vk(vkCreateSampler(mvk_device, &vk_sampler_create_info, nullptr, &mvk_sampler));
+    }
+
+    if (!BInitReducePipeline(p_pipeline_cache)) {
+        Log(LogError, "[HiZPyramid] Failed to create the reduce pipeline");
+        return false;
+    }
+
+    if (!BInitDescriptorSets(vvk_depth_views)) {
+        Log(LogError, "[HiZPyramid] Failed to create descriptor sets");
+        return false;
+    }
+
+    Log("[HiZPyramid] %u levels from %ux%u, %u views", un_level_count, mv_level_extents.front().width, mv_level_extents.front().height, mun_view_count);
+
+    return true;
+}
+
+bool HiZPyramid::BInitReducePipeline(PipelineCache *p_pipeline_cache) {
+    const ShaderBlob &shader = k_shader_hiz_reduce_comp;
+
+    {//Layout
+        std::vector<VkDescriptorSetLayoutBinding> v_bindings = CollectSetBindings({&shader}, 0);
+
+        VkDescriptorSetLayoutCreateInfo vk_descriptor_set_layout_create_info = {
+                .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+                .bindingCount = static_cast<uint32_t>(v_bindings.size()),
+                .pBindings = v_bindings.data(),
+        };
+        b_qualify_vk(vkCreateDescriptorSetLayout(mvk_device, &vk_descriptor_set_layout_create_info, nullptr, &mvk_reduce_set_layout));
+
+        if (shader.un_push_constant_size != sizeof(ReduceConstants)) {
+            Log(LogError, "[HiZPyramid] hiz_reduce.comp declares %u bytes of push constants, expected %zu", shader.un_push_constant_size,
+                sizeof(ReduceConstants));
+            return false;
+        }
+
+        VkPushConstantRange vk_push_constant_range = {
+                .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+                .offset = shader.un_push_constant_offset,
+                .size = shader.un_push_constant_size,
+        };
+        VkPipelineLayoutCreateInfo vk_pipeline_layout_create_info = {
+                .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+                .setLayoutCount = 1,
+                .pSetLayouts = &mvk_reduce_set_layout,
+                .pushConstantRangeCount = 1,
+                .pPushConstantRanges = &vk_push_constant_range,
+        };
+        b_qualify_vk(vkCreatePipelineLayout(mvk_device, &vk_pipeline_layout_create_info, nullptr, &mvk_reduce_pipeline_layout));
+    }
+
+    VkShaderModuleCreateInfo vk_shader_module_create_info = {
+            .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+            .codeSize = shader.size_spirv,
+            .pCode = shader.pun_spirv,
+    };
+    VkShaderModule vksm_compute;
+    b_qualify_vk(vkCreateShaderModule(mvk_device, &vk_shader_module_create_info, nullptr, &vksm_compute));
+
+    VkComputePipelineCreateInfo vk_compute_pipeline_create_info = {
+            .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+            .stage = {
+                    .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+                    .stage = VK_SHADER_STAGE_COMPUTE_BIT,
+                    .module = vksm_compute,
+                    .pName = "main",
+            },
+            .layout = mvk_reduce_pipeline_layout,
+    };
+    const VkResult vk_result = p_pipeline_cache->CreateComputePipeline(vk_compute_pipeline_create_info, mvk_reduce_pipeline);
+
+    vkDestroyShaderModule(mvk_device, vksm_compute, nullptr);
+
+    b_qualify_vk(vk_result);
+
+    return true;
+}
+
+bool HiZPyramid::BInitDescriptorSets(const std::vector<VkImageView> &vvk_depth_views) {
+    const uint32_t un_depth_set_count = static_cast<uint32_t>(vvk_depth_views.size());
+    const uint32_t un_level_set_count = static_cast<uint32_t>(mv_level_views.size()) - 1;
+    const uint32_t un_set_count = un_depth_set_count + un_level_set_count;
+
+    const VkDescriptorPoolSize avk_pool_sizes[] = {
+            {.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, .descriptorCount = un_set_count},
+            {.type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, .descriptorCount = un_set_count},
+    };
+    VkDescriptorPoolCreateInfo vk_descriptor_pool_create_info = {
+            .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+            .maxSets = un_set_count,
+            .poolSizeCount = static_cast<uint32_t>(std::size(avk_pool_sizes)),
+            .pPoolSizes = avk_pool_sizes,
+    };
+    b_qualify_vk(vkCreateDescriptorPool(mvk_device, &vk_descriptor_pool_create_info, nullptr, &mvk_descriptor_pool));
+
+    std::vector<VkDescriptorSetLayout> v_set_layouts(un_set_count, mvk_reduce_set_layout);
+    std::vector<VkDescriptorSet> v_sets(un_set_count);
+
+    VkDescriptorSetAllocateInfo vk_descriptor_set_allocate_info = {
+            .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+            .descriptorPool = mvk_descriptor_pool,
+            .descriptorSetCount = un_set_count,
+            .pSetLayouts = v_set_layouts.data(),
+    };
+    b_qualify_vk(vkAllocateDescriptorSets(mvk_device, &vk_descriptor_set_allocate_info, v_sets.data()));
+
+    mv_depth_sets.assign(v_sets.begin(), v_sets.begin() + un_depth_set_count);
+    mv_level_sets.assign(v_sets.begin() + un_depth_set_count, v_sets.end());
+
+    //Bindings as declared in hiz_reduce.comp. Image infos are reserved up front, the writes point into them.
+    std::vector<VkDescriptorImageInfo> v_image_infos;
+    std::vector<VkWriteDescriptorSet> v_writes;
+    v_image_infos.reserve(un_set_count * 2);
+
+    auto AddSet = [&](VkDescriptorSet vk_set, VkImageView vk_source_view, VkImageLayout vk_source_layout, VkImageView vk_level_view) {
+        v_image_infos.push_back({.sampler = mvk_sampler, .imageView = vk_source_view, .imageLayout = vk_source_layout});
+        v_writes.push_back({
+                .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                .dstSet = vk_set,
+                .dstBinding = 0,
+                .descriptorCount = 1,
+                .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                .pImageInfo = &v_image_infos.back(),
+        });
+
+        v_image_infos.push_back({.imageView = vk_level_view, .imageLayout = VK_IMAGE_LAYOUT_GENERAL});
+        v_writes.push_back({
+                .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                .dstSet = vk_set,
+                .dstBinding = 1,
+                .descriptorCount = 1,
+                .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+                .pImageInfo = &v_image_infos.back(),
+        });
+    };
+
+    for (uint32_t i = 0; i < un_depth_set_count; i++) {
+        AddSet(mv_depth_sets[i], vvk_depth_views[i], VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL, mv_level_views[0]);
+    }
+    for (uint32_t i = 0; i < un_level_set_count; i++) {
+        AddSet(mv_level_sets[i], mv_level_views[i], VK_IMAGE_LAYOUT_GENERAL, mv_level_views[i + 1]);
+    }
+
+    vkUpdateDescriptorSets(mvk_device, static_cast<uint32_t>(v_writes.size()), v_writes.data(), 0, nullptr);
+
+    return true;
+}
+
+void HiZPyramid::SetDepthSamples(VkSampleCountFlagBits vk_depth_samples) {
+    //Reducing sample 0 of a multisampled attachment would need its own shader, the pyramid just stays unbuilt then. What it
+    //held is dropped, by the time depth is stored again it is too old to test against.
+    mb_buildable = vk_depth_samples == VK_SAMPLE_COUNT_1_BIT;
+    if (!mb_buildable) {
+        mb_built = false;
+        Log(LogWarning, "[HiZPyramid] Depth is multisampled, occlusion culling is disabled until it is single sampled again");
+    }
+}
+
+bool HiZPyramid::BCanBuild(uint32_t un_depth_image_index, const VkExtent2D &vk_depth_extent) const {
+    return mb_buildable && un_depth_image_index < mun_depth_image_count && vk_depth_extent.width > 0 && vk_depth_extent.height > 0;
+}
+
+VkImageSubresourceRange HiZPyramid::GetSubresourceRange() const {
+    return {
+            .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+            .baseMipLevel = 0,
+            .levelCount = static_cast<uint32_t>(mv_level_views.size()),
+            .baseArrayLayer = 0,
+            .layerCount = mun_view_count,
+    };
+}
+
+bool HiZPyramid::BRecordBuild(VkCommandBuffer vk_command_buffer, uint32_t un_depth_image_index, const VkExtent2D &vk_depth_extent,
+                              const Mat4 *amat4_view_projection) {
+    if (!BCanBuild(un_depth_image_index, vk_depth_extent)) {
+        return false;
+    }
+
+    VkMemoryBarrier vk_memory_barrier = {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+            .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+            .dstAccessMask = VK_ACCESS_SHADER_READ_BIT,
+    };
+
+    vkCmdBindPipeline(vk_command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, mvk_reduce_pipeline);
+
+    //Each level reads the one before it, so every dispatch waits for the previous one. A smaller rendered area needs fewer
+    //levels, the ones past its 1x1 level keep stale texels no test reads. Ordering the last level before the tests is left
+    //to the render graph.
+    VkExtent2D vk_source_extent = {std::min(vk_depth_extent.width, mun_depth_width), std::min(vk_depth_extent.height, mun_depth_height)};
+    const VkExtent2D vk_rendered_extent = vk_source_extent;
+
+    uint32_t un_level_count = 0;
+    for (uint32_t i = 0; i < mv_level_extents.size(); i++) {
+        const VkExtent2D vk_level_extent = {std::max((vk_source_extent.width + 1) / 2, 1u), std::max((vk_source_extent.height + 1) / 2, 1u)};
+        const VkDescriptorSet vk_set = i == 0 ? mv_depth_sets[un_depth_image_index] : mv_level_sets[i - 1];
+
+        const ReduceConstants reduce_constants = {
+                .an_source_size = {static_cast<int32_t>(vk_source_extent.width), static_cast<int32_t>(vk_source_extent.height)},
+                .an_level_size = {static_cast<int32_t>(vk_level_extent.width), static_cast<int32_t>(vk_level_extent.height)},
+                .b_depth_source = i == 0 ? 1u : 0u,
+        };
+
+        vkCmdBindDescriptorSets(vk_command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, mvk_reduce_pipeline_layout, 0, 1, &vk_set, 0, nullptr);
+        vkCmdPushConstants(vk_command_buffer, mvk_reduce_pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(reduce_constants), &reduce_constants);
+        vkCmdDispatch(vk_command_buffer, (vk_level_extent.width + k_un_reduce_group_size - 1) / k_un_reduce_group_size,
+                      (vk_level_extent.height + k_un_reduce_group_size - 1) / k_un_reduce_group_size, mun_view_count);
+
+        vk_source_extent = vk_level_extent;
+        un_level_count++;
+
+        if (vk_level_extent.width == 1 && vk_level_extent.height == 1) {
+            break;
+        }
+
+        vkCmdPipelineBarrier(vk_command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &vk_memory_barrier, 0,
+                             nullptr, 0, nullptr);
+    }
+
+    std::copy(amat4_view_projection, amat4_view_projection + mun_view_count, ma_view_projections);
+    mvk_built_extent = vk_rendered_extent;
+    mun_built_level_count = un_level_count;
+    mb_built = true;
+
+    return true;
+}
+
+void HiZPyramid::FillOcclusionUniforms(OcclusionUniforms &out_occlusion_uniforms) const {
+    std::copy(std::begin(ma_view_projections), std::end(ma_view_projections), out_occlusion_uniforms.amat4_view_projection);
+    out_occlusion_uniforms.af_depth_size[0] = static_cast<float>(mvk_built_extent.width);
+    out_occlusion_uniforms.af_depth_size[1] = static_cast<float>(mvk_built_extent.height);
+    out_occlusion_uniforms.un_level_count = mun_built_level_count;
+    out_occlusion_uniforms.un_view_count = mun_view_count;
+}
+
+void HiZPyramid::Destroy() {
+    if (mvk_device == VK_NULL_HANDLE) {
+        return;
+    }
+
+    vkDestroyDescriptorPool(mvk_device, mvk_descriptor_pool, nullptr);
+    vkDestroyPipeline(mvk_device, mvk_reduce_pipeline, nullptr);
+    vkDestroyPipelineLayout(mvk_device, mvk_reduce_pipeline_layout, nullptr);
+    vkDestroyDescriptorSetLayout(mvk_device, mvk_reduce_set_layout, nullptr);
+    vkDestroySampler(mvk_device, mvk_sampler, nullptr);
+
+    for (VkImageView vk_image_view: mv_level_views) {
+        vkDestroyImageView(mvk_device, vk_image_view, nullptr);
+    }
+    vkDestroyImageView(mvk_device, mvk_pyramid_view, nullptr);
+
+    if (mvk_pyramid != VK_NULL_HANDLE) {
+        mp_allocator->DestroyImage(mvk_pyramid, m_pyramid_allocation);
+    }
+
+    mvk_device = VK_NULL_HANDLE;
+}
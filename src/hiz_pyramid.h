@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "vulkan/vulkan.h"
+
+#include "gpu_allocator.h"
+#include "pipeline_cache.h"
+#include "shader_uniforms.h"
+#include "xr_math.h"
+
+//Hierarchical min/max depth pyramid of a multiview depth attachment, one pyramid layer per view. Level 0 is half the
+//rendered area's size and every level halves the previous one, rounding up, down to 1x1. Storage is sized for the whole
+//attachment. Texels hold the nearest depth in x
+//and the farthest in y of everything beneath them.
+//
+//The pyramid is reduced with compute right after the depth has been rendered, and stays valid for occlusion tests until
+//the next build, together with the view projections it was built with. Barriers around a build and the pyramid's layout
+//are up to the render graph, the pyramid is in GENERAL whenever it is read or written.
+class HiZPyramid {
+public:
+    //vvk_depth_views are the depth swapchain's, they have to be single sampled, 2D_ARRAY and of the depth aspect only.
+    //vk_depth_samples is what the main pass renders depth with, see SetDepthSamples.
+    bool BInit(VkDevice vk_device, GpuAllocator *p_allocator, PipelineCache *p_pipeline_cache, const std::vector<VkImageView> &vvk_depth_views,
+               VkSampleCountFlagBits vk_depth_samples, uint32_t un_width, uint32_t un_height, uint32_t un_view_count);
+    void Destroy();
+
+    //Multisampled depth stays in a transient attachment and never reaches the depth images, so there is nothing to build
+    //from until the sample count goes back to one
+    void SetDepthSamples(VkSampleCountFlagBits vk_depth_samples);
+
+    //False if BRecordBuild would not record anything for these arguments
+    bool BCanBuild(uint32_t un_depth_image_index, const VkExtent2D &vk_depth_extent) const;
+
+    //Reduces depth image un_depth_image_index, which has to be in DEPTH_STENCIL_READ_ONLY_OPTIMAL by then.
+    //vk_depth_extent is the area at the image's origin that was rendered to, the pyramid only covers that. amat4_view_projection
+    //are the matrices the depth was rendered with, one per view. Returns false if the depth cannot be reduced, the pyramid
+    //keeps what it held then.
+    bool BRecordBuild(VkCommandBuffer vk_command_buffer, uint32_t un_depth_image_index, const VkExtent2D &vk_depth_extent,
+                      const Mat4 *amat4_view_projection);
+
+    //True once a build has been recorded
+    bool BBuilt() const { return mb_built; }
+
+    //What cull shaders need to test against the last recorded build
+    void FillOcclusionUniforms(OcclusionUniforms &out_occlusion_uniforms) const;
+
+    VkImage GetImage() const { return mvk_pyramid; }
+    VkImageSubresourceRange GetSubresourceRange() const;
+    VkImageView GetView() const { return mvk_pyramid_view; }
+    VkSampler GetSampler() const { return mvk_sampler; }
+
+private:
+    bool BInitReducePipeline(PipelineCache *p_pipeline_cache);
+    bool BInitDescriptorSets(const std::vector<VkImageView> &vvk_depth_views);
+
+    VkDevice mvk_device = VK_NULL_HANDLE;
+    GpuAllocator *mp_allocator = nullptr;
+
+    uint32_t mun_depth_image_count = 0;
+    bool mb_buildable = false;
+
+    uint32_t mun_depth_width = 0;
+    uint32_t mun_depth_height = 0;
+    uint32_t mun_view_count = 0;
+
+    VkImage mvk_pyramid = VK_NULL_HANDLE;
+    GpuAllocation m_pyramid_allocation;
+    VkImageView mvk_pyramid_view = VK_NULL_HANDLE;
+    std::vector<VkImageView> mv_level_views;
+    std::vector<VkExtent2D> mv_level_extents;
+    VkSampler mvk_sampler = VK_NULL_HANDLE;
+
+    VkDescriptorSetLayout mvk_reduce_set_layout = VK_NULL_HANDLE;
+    VkPipelineLayout mvk_reduce_pipeline_layout = VK_NULL_HANDLE;
+    VkPipeline mvk_reduce_pipeline = VK_NULL_HANDLE;
+
+    //one set per depth image reducing it into level 0, then one per level reducing the level before it
+    VkDescriptorPool mvk_descriptor_pool = VK_NULL_HANDLE;
+    std::vector<VkDescriptorSet> mv_depth_sets;
+    std::vector<VkDescriptorSet> mv_level_sets;
+
+    bool mb_built = false;
+    VkExtent2D mvk_built_extent{};
+    uint32_t mun_built_level_count = 0;
+    Mat4 ma_view_projections[2]{};
+};
@@ -0,0 +1,182 @@
+#include "init_graph.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
+
+#include <pthread.h>
+
+#include "log.h"
+
+static double DMilliseconds(std::chrono::steady_clock::duration duration) {
+    return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+InitGraph::TaskId InitGraph::AddTask(const char *pc_name, std::function<bool()> fn_task, std::initializer_list<TaskId> il_dependencies, bool b_calling_thread) {
+    const TaskId id = static_cast<TaskId>(mv_tasks.size());
+
+    Task &task = mv_tasks.emplace_back();
+    task.s_name = pc_name;
+    task.fn_task = std::move(fn_task);
+    task.v_dependencies = il_dependencies;
+    task.b_calling_thread = b_calling_thread;
+
+    //Dependencies can only refer to tasks added earlier, so the graph can never contain a cycle
+    for (TaskId id_dependency: il_dependencies) {
+        mv_tasks[id_dependency].v_dependents.push_back(id);
+    }
+
+    return id;
+}
+
+bool InitGraph::BRun(uint32_t un_worker_count) {
+    std::mutex mutex;
+    std::condition_variable cv;
+
+    std::deque<TaskId> dq_ready;
+    std::deque<TaskId> dq_ready_calling_thread;
+
+    size_t un_pending = mv_tasks.size();
+    bool b_failed = false;
+
+    auto MakeReady = [&](TaskId id) {
+        (mv_tasks[id].b_calling_thread ? dq_ready_calling_thread : dq_ready).push_back(id);
+    };
+
+    for (TaskId id = 0; id < mv_tasks.size(); id++) {
+        mv_tasks[id].un_remaining_dependencies = static_cast<uint32_t>(mv_tasks[id].v_dependencies.size());
+        if (mv_tasks[id].un_remaining_dependencies == 0) {
+            MakeReady(id);
+        }
+    }
+
+    const auto time_start = std::chrono::steady_clock::now();
+
+    auto Worker = [&](uint32_t un_thread) {
+        const bool b_calling_thread = un_thread == 0;
+
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            cv.wait(lock, [&] {
+                return b_failed || un_pending == 0 || !dq_ready.empty() || (b_calling_thread && !dq_ready_calling_thread.empty());
+            });
+
+            if (b_failed || un_pending == 0) {
+                break;
+            }
+
+            std::deque<TaskId> &dq_source = (b_calling_thread && !dq_ready_calling_thread.empty()) ? dq_ready_calling_thread : dq_ready;
+            const TaskId id = dq_source.front();
+            dq_source.pop_front();
+
+            Task &task = mv_tasks[id];
+
+            lock.unlock();
+
+            task.duration_start = std::chrono::steady_clock::now() - time_start;
+
+            bool b_succeeded;
+            try {
+                b_succeeded = task.fn_task();
+            } catch (const std::exception &e) {
+                Log(LogError, "[InitGraph] Task %s threw: %s", task.s_name.c_str(), e.what());
+                b_succeeded = false;
+            }
+
+            task.duration_end = std::chrono::steady_clock::now() - time_start;
+
+            lock.lock();
+
+            task.b_ran = true;
+            task.b_succeeded = b_succeeded;
+            task.un_thread = un_thread;
+            un_pending--;
+
+            if (!b_succeeded) {
+                Log(LogError, "[InitGraph] Task %s failed", task.s_name.c_str());
+                b_failed = true;
+            } else {
+                for (TaskId id_dependent: task.v_dependents) {
+                    if (--mv_tasks[id_dependent].un_remaining_dependencies == 0) {
+                        MakeReady(id_dependent);
+                    }
+                }
+            }
+
+            cv.notify_all();
+        }
+    };
+
+    std::vector<std::thread> v_workers;
+    v_workers.reserve(un_worker_count);
+    for (uint32_t i = 0; i < un_worker_count; i++) {
+        v_workers.emplace_back([&, i] {
+            pthread_setname_np(pthread_self(), "qov_init");
+            Worker(i + 1);
+        });
+    }
+
+    Worker(0);
+
+    for (std::thread &thread: v_workers) {
+        thread.join();
+    }
+
+    mduration_wall = std::chrono::steady_clock::now() - time_start;
+
+    return !b_failed;
+}
+
+void InitGraph::LogTimeline() const {
+    std::vector<TaskId> v_order;
+    for (TaskId id = 0; id < mv_tasks.size(); id++) {
+        if (mv_tasks[id].b_ran) {
+            v_order.push_back(id);
+        }
+    }
+    std::sort(v_order.begin(), v_order.end(), [&](TaskId a, TaskId b) { return mv_tasks[a].duration_start < mv_tasks[b].duration_start; });
+
+    std::chrono::steady_clock::duration duration_sum{};
+    for (TaskId id: v_order) {
+        const Task &task = mv_tasks[id];
+        duration_sum += task.duration_end - task.duration_start;
+
+        Log("[InitGraph] %-24s %8.2f -> %8.2f ms (%7.2f ms) thread %u%s", task.s_name.c_str(), DMilliseconds(task.duration_start),
+            DMilliseconds(task.duration_end), DMilliseconds(task.duration_end - task.duration_start), task.un_thread, task.b_succeeded ? "" : " FAILED");
+    }
+
+    //Longest chain of task durations through the dependency edges, tasks are already in topological order
+    std::vector<std::chrono::steady_clock::duration> v_path_length(mv_tasks.size());
+    std::vector<TaskId> v_path_previous(mv_tasks.size(), UINT32_MAX);
+
+    TaskId id_path_end = UINT32_MAX;
+    for (TaskId id = 0; id < mv_tasks.size(); id++) {
+        const Task &task = mv_tasks[id];
+        if (!task.b_ran) {
+            continue;
+        }
+
+        for (TaskId id_dependency: task.v_dependencies) {
+            if (v_path_length[id_dependency] > v_path_length[id]) {
+                v_path_length[id] = v_path_length[id_dependency];
+                v_path_previous[id] = id_dependency;
+            }
+        }
+        v_path_length[id] += task.duration_end - task.duration_start;
+
+        if (id_path_end == UINT32_MAX || v_path_length[id] > v_path_length[id_path_end]) {
+            id_path_end = id;
+        }
+    }
+
+    std::string s_path;
+    for (TaskId id = id_path_end; id != UINT32_MAX; id = v_path_previous[id]) {
+        s_path = mv_tasks[id].s_name + (s_path.empty() ? "" : " -> ") + s_path;
+    }
+
+    Log("[InitGraph] Wall time %.2f ms, task time %.2f ms, critical path %.2f ms: %s", DMilliseconds(mduration_wall), DMilliseconds(duration_sum),
+        id_path_end == UINT32_MAX ? 0.0 : DMilliseconds(v_path_length[id_path_end]), s_path.c_str());
+}
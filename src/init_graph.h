@@ -0,0 +1,44 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <initializer_list>
+#include <string>
+#include <vector>
+
+//Small dependency graph of startup tasks. Independent tasks run concurrently on a pool of threads,
+//and every run records a timeline so time to first frame can be tracked from the log.
+class InitGraph {
+public:
+    using TaskId = uint32_t;
+
+    //b_calling_thread pins a task to the thread calling BRun, for work that must stay on the JNI attached main thread
+    TaskId AddTask(const char *pc_name, std::function<bool()> fn_task, std::initializer_list<TaskId> il_dependencies = {}, bool b_calling_thread = false);
+
+    //Runs the graph on the calling thread plus un_worker_count workers. Once a task fails no new tasks are started.
+    bool BRun(uint32_t un_worker_count);
+
+    //Per task start/end offsets, the wall time of the whole graph and its critical path
+    void LogTimeline() const;
+
+private:
+    struct Task {
+        std::string s_name;
+        std::function<bool()> fn_task;
+        std::vector<TaskId> v_dependencies;
+        std::vector<TaskId> v_dependents;
+        bool b_calling_thread = false;
+
+        uint32_t un_remaining_dependencies = 0;
+
+        bool b_ran = false;
+        bool b_succeeded = false;
+        uint32_t un_thread = 0;
+        std::chrono::steady_clock::duration duration_start{};
+        std::chrono::steady_clock::duration duration_end{};
+    };
+
+    std::vector<Task> mv_tasks;
+    std::chrono::steady_clock::duration mduration_wall{};
+};
@@ -0,0 +1,389 @@
+#include "job_system.h"
+
+#include <algorithm>
+#include <cstdio>
+
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+#include "log.h"
+
+//Attempts at finding a job before an idle worker goes to sleep
+constexpr uint32_t k_un_idle_spins = 64;
+
+//Finished jobs a thread keeps for reuse, enough for a full deque. A fork larger than that allocates the rest and frees them
+//once they come back.
+constexpr size_t k_size_max_free_jobs = 1024;
+
+thread_local JobSystem::ThreadState *JobSystem::tp_thread_state = nullptr;
+
+bool JobSystem::WorkDeque::BPush(Job *p_job) {
+    const int64_t n_bottom = mn_bottom.load(std::memory_order_relaxed);
+    const int64_t n_top = mn_top.load(std::memory_order_acquire);
+    if (n_bottom - n_top >= k_n_capacity) {
+        return false;
+    }
+
+    //Published to thieves by the release on mn_bottom
+    map_jobs[n_bottom % k_n_capacity].store(p_job, std::memory_order_relaxed);
+    mn_bottom.store(n_bottom + 1, std::memory_order_release);
+
+    return true;
+}
+
+JobSystem::Job *JobSystem::WorkDeque::PPop() {
+    const int64_t n_bottom = mn_bottom.load(std::memory_order_relaxed) - 1;
+    mn_bottom.store(n_bottom, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t n_top = mn_top.load(std::memory_order_relaxed);
+
+    if (n_top > n_bottom) {
+        mn_bottom.store(n_bottom + 1, std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    Job *p_job = map_jobs[n_bottom % k_n_capacity].load(std::memory_order_relaxed);
+
+    //The last job left, thieves may be going for it as well
+    if (n_top == n_bottom) {
+        if (!mn_top.compare_exchange_strong(n_top, n_top + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+            p_job = nullptr;
+        }
+        mn_bottom.store(n_bottom + 1, std::memory_order_relaxed);
+    }
+
+    return p_job;
+}
+
+JobSystem::Job *JobSystem::WorkDeque::PSteal() {
+    int64_t n_top = mn_top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    const int64_t n_bottom = mn_bottom.load(std::memory_order_acquire);
+
+    if (n_top >= n_bottom) {
+        return nullptr;
+    }
+
+    Job *p_job = map_jobs[n_top % k_n_capacity].load(std::memory_order_acquire);
+    if (!mn_top.compare_exchange_strong(n_top, n_top + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+        return nullptr;
+    }
+
+    return p_job;
+}
+
+//CPUs of the fastest cluster on big.LITTLE SoCs, from the capacities the scheduler uses, their maximum clocks otherwise
+static std::vector<uint32_t> PerformanceCpus() {
+    const uint32_t un_cpu_count = static_cast<uint32_t>(std::max(sysconf(_SC_NPROCESSORS_CONF), 1l));
+
+    //Capacities already fold in how much more a big core does per clock, so halving them separates the clusters. Clocks
+    //do not, LITTLE cores reach well over half the top clock, so only CPUs within 15% of it count.
+    struct Source {
+        const char *pc_file;
+        uint32_t un_min_percent;
+    };
+    for (const Source &source: {Source{"cpu_capacity", 50}, Source{"cpufreq/cpuinfo_max_freq", 85}}) {
+        //Offline CPUs have neither and stay at 0
+        std::vector<unsigned long long> v_values(un_cpu_count, 0);
+        for (uint32_t un_cpu = 0; un_cpu < un_cpu_count; un_cpu++) {
+            char ac_path[128];
+            snprintf(ac_path, sizeof(ac_path), "/sys/devices/system/cpu/cpu%u/%s", un_cpu, source.pc_file);
+
+            FILE *p_file = fopen(ac_path, "r");
+            if (!p_file) {
+                continue;
+            }
+            if (fscanf(p_file, "%llu", &v_values[un_cpu]) != 1) {
+                v_values[un_cpu] = 0;
+            }
+            fclose(p_file);
+        }
+
+        const unsigned long long ull_max = *std::max_element(v_values.begin(), v_values.end());
+        if (ull_max == 0) {
+            continue;
+        }
+
+        std::vector<uint32_t> v_cpus;
+        for (uint32_t un_cpu = 0; un_cpu < un_cpu_count; un_cpu++) {
+            if (v_values[un_cpu] * 100 >= ull_max * source.un_min_percent) {
+                v_cpus.push_back(un_cpu);
+            }
+        }
+
+        Log("[JobSystem] %zu of %u CPUs are performance cores by %s", v_cpus.size(), un_cpu_count, source.pc_file);
+        return v_cpus;
+    }
+
+    Log(LogWarning, "[JobSystem] No CPU capacities or clocks to tell cores apart, using all %u CPUs", un_cpu_count);
+
+    std::vector<uint32_t> v_cpus(un_cpu_count);
+    for (uint32_t un_cpu = 0; un_cpu < un_cpu_count; un_cpu++) {
+        v_cpus[un_cpu] = un_cpu;
+    }
+
+    return v_cpus;
+}
+
+bool JobSystem::BInit() {
+    const std::vector<uint32_t> v_cpus = PerformanceCpus();
+
+    //The render thread helps with its own forks, and some states have to stay free for threads attaching later
+    const uint32_t un_worker_count = std::clamp(static_cast<uint32_t>(v_cpus.size()), 2u, k_un_max_threads / 2) - 1;
+
+    mb_running.store(true, std::memory_order_relaxed);
+
+    mv_threads.reserve(un_worker_count);
+    for (uint32_t i = 0; i < un_worker_count; i++) {
+        mv_threads.emplace_back(&JobSystem::WorkerMain, this, i, v_cpus);
+    }
+
+    Log("[JobSystem] Started %u workers", un_worker_count);
+
+    return true;
+}
+
+void JobSystem::Destroy() {
+    if (!mb_running.exchange(false)) {
+        return;
+    }
+
+    mun_epoch.fetch_add(1);
+    mun_epoch.notify_all();
+
+    for (std::thread &thread: mv_threads) {
+        thread.join();
+    }
+    mv_threads.clear();
+
+    const uint32_t un_state_count = std::min(mun_state_count.load(), k_un_max_threads);
+    for (uint32_t i = 0; i < un_state_count; i++) {
+        ThreadState *p_state = map_states[i].exchange(nullptr);
+        for (Job *p_job = p_state ? p_state->p_returned_jobs.load() : nullptr; p_job;) {
+            Job *p_next = p_job->p_next_returned;
+            delete p_job;
+            p_job = p_next;
+        }
+        delete p_state;
+    }
+    mun_state_count.store(0);
+    tp_thread_state = nullptr;
+}
+
+JobSystem::ThreadState *JobSystem::PAttach() {
+    if (tp_thread_state) {
+        return tp_thread_state;
+    }
+
+    //States of threads that detached are taken over as they are, their deques are empty
+    const uint32_t un_state_count = std::min(mun_state_count.load(std::memory_order_acquire), k_un_max_threads);
+    for (uint32_t i = 0; i < un_state_count; i++) {
+        ThreadState *p_state = map_states[i].load(std::memory_order_acquire);
+        bool b_in_use = false;
+        if (p_state && p_state->b_in_use.compare_exchange_strong(b_in_use, true)) {
+            tp_thread_state = p_state;
+            return p_state;
+        }
+    }
+
+    const uint32_t un_index = mun_state_count.fetch_add(1);
+    if (un_index >= k_un_max_threads) {
+        Log(LogError, "[JobSystem] More than %u threads attached, jobs of this one run where they are queued", k_un_max_threads);
+        return nullptr;
+    }
+
+    ThreadState *p_state = new ThreadState;
+    p_state->b_in_use.store(true, std::memory_order_relaxed);
+    p_state->un_next_victim = un_index + 1;
+    p_state->un_index = un_index;
+    map_states[un_index].store(p_state, std::memory_order_release);
+
+    tp_thread_state = p_state;
+    return p_state;
+}
+
+void JobSystem::AttachThread() {
+    PAttach();
+}
+
+void JobSystem::DetachThread() {
+    if (tp_thread_state) {
+        tp_thread_state->b_in_use.store(false, std::memory_order_release);
+        tp_thread_state = nullptr;
+    }
+}
+
+void JobSystem::Run(JobCounter &counter, JobFn fn_job) {
+    ThreadState *p_state = tp_thread_state;
+    if (!p_state || !mb_running.load(std::memory_order_relaxed)) {
+        fn_job();
+        return;
+    }
+
+    Job *p_job = PTakeFreeJob(*p_state);
+    p_job->fn = std::move(fn_job);
+    p_job->p_counter = &counter;
+
+    counter.un_pending.fetch_add(1, std::memory_order_relaxed);
+
+    if (!p_state->deque.BPush(p_job)) {
+        Execute(*p_state, p_job);
+        return;
+    }
+
+    //A worker about to sleep either sees the new epoch or is counted as sleeping here, see WorkerMain
+    mun_epoch.fetch_add(1);
+    if (mun_sleeping.load() > 0) {
+        mun_epoch.notify_one();
+    }
+}
+
+void JobSystem::Wait(JobCounter &counter) {
+    ThreadState *p_state = tp_thread_state;
+    while (counter.un_pending.load(std::memory_order_acquire) > 0) {
+        Job *p_job = p_state ? PFindJob(*p_state) : nullptr;
+        if (p_job) {
+            Execute(*p_state, p_job);
+        } else {
+            std::this_thread::yield();
+        }
+    }
+}
+
+void JobSystem::ParallelFor(uint32_t un_count, uint32_t un_batch_size, const RangeFn &fn) {
+    un_batch_size = std::max(un_batch_size, 1u);
+
+    JobCounter counter;
+    for (uint32_t un_begin = 0; un_begin < un_count; un_begin += un_batch_size) {
+        const uint32_t un_end = std::min(un_begin + un_batch_size, un_count);
+        Run(counter, [&fn, un_begin, un_end] { fn(un_begin, un_end); });
+    }
+
+    Wait(counter);
+}
+
+JobSystem::Job *JobSystem::PFindJob(ThreadState &state) {
+    if (Job *p_job = state.deque.PPop()) {
+        return p_job;
+    }
+
+    const uint32_t un_state_count = std::min(mun_state_count.load(std::memory_order_acquire), k_un_max_threads);
+    for (uint32_t i = 0; i < un_state_count; i++) {
+        const uint32_t un_victim = (state.un_next_victim + i) % un_state_count;
+        ThreadState *p_victim = map_states[un_victim].load(std::memory_order_acquire);
+        if (!p_victim || p_victim == &state) {
+            continue;
+        }
+
+        if (Job *p_job = p_victim->deque.PSteal()) {
+            state.un_next_victim = un_victim;
+            return p_job;
+        }
+    }
+    state.un_next_victim++;
+
+    return nullptr;
+}
+
+JobSystem::Job *JobSystem::PTakeFreeJob(ThreadState &state) {
+    if (state.v_free_jobs.empty()) {
+        //Pushed in any order by any thread, the whole stack is taken at once so no other taker can interfere
+        Job *p_returned = state.p_returned_jobs.exchange(nullptr, std::memory_order_acquire);
+        while (p_returned) {
+            Job *p_next = p_returned->p_next_returned;
+            if (state.v_free_jobs.size() < k_size_max_free_jobs) {
+                state.v_free_jobs.emplace_back(p_returned);
+            } else {
+                delete p_returned;
+            }
+            p_returned = p_next;
+        }
+    }
+
+    if (state.v_free_jobs.empty()) {
+        Job *p_job = new Job;
+        p_job->p_owner = &state;
+        return p_job;
+    }
+
+    Job *p_job = state.v_free_jobs.back().release();
+    state.v_free_jobs.pop_back();
+    return p_job;
+}
+
+void JobSystem::ReturnJob(ThreadState &state, Job *p_job) {
+    ThreadState &owner = *p_job->p_owner;
+    if (&owner == &state) {
+        if (state.v_free_jobs.size() < k_size_max_free_jobs) {
+            state.v_free_jobs.emplace_back(p_job);
+        } else {
+            delete p_job;
+        }
+        return;
+    }
+
+    p_job->p_next_returned = owner.p_returned_jobs.load(std::memory_order_relaxed);
+    while (!owner.p_returned_jobs.compare_exchange_weak(p_job->p_next_returned, p_job, std::memory_order_release, std::memory_order_relaxed)) {
+    }
+}
+
+void JobSystem::Execute(ThreadState &state, Job *p_job) {
+    p_job->fn();
+
+    //The owner may reuse the job as soon as it is back
+    JobCounter *p_counter = p_job->p_counter;
+    p_job->fn = nullptr;
+    ReturnJob(state, p_job);
+
+    //Last, the waiting thread may return and take the counter with it right after
+    p_counter->un_pending.fetch_sub(1, std::memory_order_acq_rel);
+}
+
+void JobSystem::WorkerMain(uint32_t un_worker, const std::vector<uint32_t> &v_cpus) {
+    char ac_name[16];
+    snprintf(ac_name, sizeof(ac_name), "qov_job%u", un_worker);
+    pthread_setname_np(pthread_self(), ac_name);
+
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    for (uint32_t un_cpu: v_cpus) {
+        CPU_SET(un_cpu, &cpu_set);
+    }
+    if (sched_setaffinity(0, sizeof(cpu_set), &cpu_set) != 0) {
+        Log(LogWarning, "[JobSystem] Could not pin worker %u to the performance cores", un_worker);
+    }
+
+    ThreadState *p_state = PAttach();
+    if (!p_state) {
+        return;
+    }
+
+    uint32_t un_idle = 0;
+    while (mb_running.load(std::memory_order_relaxed)) {
+        if (Job *p_job = PFindJob(*p_state)) {
+            Execute(*p_state, p_job);
+            un_idle = 0;
+            continue;
+        }
+
+        if (++un_idle < k_un_idle_spins) {
+            std::this_thread::yield();
+            continue;
+        }
+
+        //Counted as sleeping before the epoch is read, so Run either wakes this worker or queued its job before the read
+        mun_sleeping.fetch_add(1);
+        const uint32_t un_epoch = mun_epoch.load();
+        Job *p_job = PFindJob(*p_state);
+        if (!p_job && mb_running.load()) {
+            mun_epoch.wait(un_epoch);
+        }
+        mun_sleeping.fetch_sub(1);
+
+        if (p_job) {
+            Execute(*p_state, p_job);
+        }
+        un_idle = 0;
+    }
+}
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+//Jobs left to finish of one fork. Forked jobs decrement it as they finish, JobSystem::Wait joins on it reaching 0.
+struct JobCounter {
+    std::atomic<uint32_t> un_pending = 0;
+};
+
+//Fork-join job system on worker threads pinned to the performance cores. Every worker and every attached thread owns a
+//Chase-Lev deque: it pushes and pops its own jobs at the bottom, LIFO, while idle threads steal the oldest from the top of
+//the others'. A thread waiting on a counter runs jobs in the meantime instead of blocking, its own first, so forks nested
+//inside jobs cannot run out of threads.
+//
+//Performance cores are the CPUs whose cpu_capacity, or cpuinfo_max_freq where the kernel does not report capacities, is at
+//least half of the largest. Other Linux systems without either get every CPU.
+class JobSystem {
+public:
+    using JobFn = std::function<void()>;
+    using RangeFn = std::function<void(uint32_t un_begin, uint32_t un_end)>;
+
+    //Workers and attached threads together
+    static constexpr uint32_t k_un_max_threads = 32;
+
+    //Starts one worker per performance core minus the one the attached render thread runs on, at least one
+    bool BInit();
+    void Destroy();
+
+    //Gives the calling thread a deque of its own, without one its jobs run right where they are queued. Threads detach
+    //before they exit, with nothing of theirs queued anymore. Only one JobSystem at a time.
+    void AttachThread();
+    void DetachThread();
+
+    //Queues fn_job on the calling thread's deque, counted by counter. Runs it right away on threads that are not attached
+    //or whose deque is full.
+    void Run(JobCounter &counter, JobFn fn_job);
+
+    //Runs jobs until counter has reached 0
+    void Wait(JobCounter &counter);
+
+    //Calls fn for consecutive batches of un_batch_size covering [0, un_count) on every thread and returns once all are done.
+    //Batches are split the same way every time, only which thread runs them changes.
+    void ParallelFor(uint32_t un_count, uint32_t un_batch_size, const RangeFn &fn);
+
+    uint32_t UnWorkerCount() const { return static_cast<uint32_t>(mv_threads.size()); }
+
+    //Below k_un_max_threads and fixed while the calling thread stays attached, for jobs to pick per thread resources by. No two
+    //attached threads share one at the same time. Threads that are not attached get k_un_max_threads.
+    uint32_t UnThreadIndex() const { return tp_thread_state ? tp_thread_state->un_index : k_un_max_threads; }
+
+private:
+    struct ThreadState;
+
+    //Owned by the thread whose Run allocated it, and handed back to it by whichever thread ran it
+    struct Job {
+        JobFn fn;
+        JobCounter *p_counter = nullptr;
+        ThreadState *p_owner = nullptr;
+        Job *p_next_returned = nullptr;
+    };
+
+    //Fixed capacity Chase-Lev deque after Le et al., "Correct and Efficient Work-Stealing for Weak Memory Models"
+    class WorkDeque {
+    public:
+        static constexpr int64_t k_n_capacity = 1024;
+
+        //Owner only
+        bool BPush(Job *p_job);
+        Job *PPop();
+
+        //Any thread
+        Job *PSteal();
+
+    private:
+        std::atomic<int64_t> mn_top = 0;
+        std::atomic<int64_t> mn_bottom = 0;
+        std::atomic<Job *> map_jobs[k_n_capacity] = {};
+    };
+
+    struct ThreadState {
+        WorkDeque deque;
+        std::atomic<bool> b_in_use = false;
+
+        //finished jobs for this thread's next Run to reuse, only ever touched by this thread
+        std::vector<std::unique_ptr<Job>> v_free_jobs;
+
+        //jobs of this thread finished elsewhere, pushed by any thread and taken all at once by this one when v_free_jobs runs dry
+        std::atomic<Job *> p_returned_jobs = nullptr;
+
+        //where stealing starts, moves on after every attempt
+        uint32_t un_next_victim = 0;
+
+        //in map_states
+        uint32_t un_index = 0;
+    };
+
+    ThreadState *PAttach();
+    Job *PFindJob(ThreadState &state);
+    void Execute(ThreadState &state, Job *p_job);
+    static Job *PTakeFreeJob(ThreadState &state);
+    static void ReturnJob(ThreadState &state, Job *p_job);
+    void WorkerMain(uint32_t un_worker, const std::vector<uint32_t> &v_cpus);
+
+    //States of workers and attached threads, owned here. Never shrinks until Destroy so thieves can index it freely, states
+    //of detached threads are handed to the next thread attaching.
+    std::atomic<ThreadState *> map_states[k_un_max_threads] = {};
+    std::atomic<uint32_t> mun_state_count = 0;
+
+    static thread_local ThreadState *tp_thread_state;
+
+    std::vector<std::thread> mv_threads;
+    std::atomic<bool> mb_running = false;
+
+    //bumped whenever a job is queued, idle workers sleep on it
+    std::atomic<uint32_t> mun_epoch = 0;
+    std::atomic<uint32_t> mun_sleeping = 0;
+};
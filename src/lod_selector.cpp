@@ -0,0 +1,96 @@
+#include "lod_selector.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "simd.h"
+
+//Fraction of the threshold a coarser LOD has to get under before it replaces the current one
+constexpr float k_f_lod_hysteresis = 0.75f;
+
+//Views one selection considers, more are ignored
+constexpr uint32_t k_un_max_lod_views = 4;
+
+//Objects one job selects for, a multiple of k_un_float4_lanes
+constexpr uint32_t k_un_lod_batch_objects = 256;
+static_assert(k_un_lod_batch_objects % k_un_float4_lanes == 0);
+
+void LodSelector::SetMeshes(const std::vector<GpuMesh> &v_meshes) {
+    mv_mesh_lod_errors.assign(v_meshes.size() * k_un_max_mesh_lods, std::numeric_limits<float>::infinity());
+    for (size_t i = 0; i < v_meshes.size(); i++) {
+        const uint32_t un_lod_count = std::min(v_meshes[i].un_lod_count, k_un_max_mesh_lods);
+        for (uint32_t un_lod = 0; un_lod < un_lod_count; un_lod++) {
+            mv_mesh_lod_errors[i * k_un_max_mesh_lods + un_lod] = v_meshes[i].a_lods[un_lod].f_error;
+        }
+    }
+}
+
+void LodSelector::Select(JobSystem &job_system, Scene &scene, const XrView *pxr_views, const uint32_t *aun_image_widths, uint32_t un_view_count,
+                         float f_threshold_pixels, float f_near, uint8_t *pun_out_lods) {
+    un_view_count = std::min(un_view_count, k_un_max_lod_views);
+
+    //Eye positions and pixels covered by one meter at one meter distance, from each view's image width over its FOV's width
+    float af_eyes_x[k_un_max_lod_views], af_eyes_y[k_un_max_lod_views], af_eyes_z[k_un_max_lod_views];
+    float af_pixels_per_tangent[k_un_max_lod_views];
+    for (uint32_t un_view = 0; un_view < un_view_count; un_view++) {
+        const XrView &xr_view = pxr_views[un_view];
+        af_eyes_x[un_view] = xr_view.pose.position.x;
+        af_eyes_y[un_view] = xr_view.pose.position.y;
+        af_eyes_z[un_view] = xr_view.pose.position.z;
+        af_pixels_per_tangent[un_view] =
+                static_cast<float>(aun_image_widths[un_view]) / std::max(std::tan(xr_view.fov.angleRight) - std::tan(xr_view.fov.angleLeft), 1e-3f);
+    }
+
+    const float f_threshold_coarser = f_threshold_pixels * k_f_lod_hysteresis;
+
+    const float *af_centers_x = scene.PCentersX();
+    const float *af_centers_y = scene.PCentersY();
+    const float *af_centers_z = scene.PCentersZ();
+    const float *af_radii = scene.PRadii();
+    const float *af_error_scales = scene.PErrorScales();
+    const uint32_t *aun_meshes = scene.PMeshes();
+    const float *af_mesh_lod_errors = mv_mesh_lod_errors.data();
+    uint8_t *aun_lods = scene.PLods();
+
+    //Batches start on a multiple of the lane count so every one of them loads whole registers
+    const uint32_t un_object_count = scene.UnObjectCount();
+    job_system.ParallelFor(un_object_count, k_un_lod_batch_objects, [&](uint32_t un_begin, uint32_t un_end) {
+        for (uint32_t i = un_begin; i < un_end; i += k_un_float4_lanes) {
+            const Float4 f4_centers_x = Float4Load(af_centers_x + i);
+            const Float4 f4_centers_y = Float4Load(af_centers_y + i);
+            const Float4 f4_centers_z = Float4Load(af_centers_z + i);
+            const Float4 f4_radii = Float4Load(af_radii + i);
+
+            //Nearest point of the bounds in the view that sees the most of the object
+            Float4 f4_pixels_per_meter = Float4Splat(0.f);
+            for (uint32_t un_view = 0; un_view < un_view_count; un_view++) {
+                const Float4 f4_dx = Float4Sub(f4_centers_x, Float4Splat(af_eyes_x[un_view]));
+                const Float4 f4_dy = Float4Sub(f4_centers_y, Float4Splat(af_eyes_y[un_view]));
+                const Float4 f4_dz = Float4Sub(f4_centers_z, Float4Splat(af_eyes_z[un_view]));
+                const Float4 f4_distance_squared = Float4MulAdd(f4_dx, f4_dx, Float4MulAdd(f4_dy, f4_dy, Float4Mul(f4_dz, f4_dz)));
+                const Float4 f4_distance = Float4Max(Float4Sub(Float4Sqrt(f4_distance_squared), f4_radii), Float4Splat(f_near));
+                f4_pixels_per_meter = Float4Max(f4_pixels_per_meter, Float4Div(Float4Splat(af_pixels_per_tangent[un_view]), f4_distance));
+            }
+
+            float af_pixels_per_error[k_un_float4_lanes];
+            Float4Store(af_pixels_per_error, Float4Mul(f4_pixels_per_meter, Float4Load(af_error_scales + i)));
+
+            //Errors grow with the LOD, so the last one under its limit is the coarsest allowed. The errors come from each lane's
+            //own mesh, which leaves this part to one lane at a time.
+            const uint32_t un_lane_count = std::min(k_un_float4_lanes, un_end - i);
+            for (uint32_t un_lane = 0; un_lane < un_lane_count; un_lane++) {
+                const float *af_errors = af_mesh_lod_errors + aun_meshes[i + un_lane] * k_un_max_mesh_lods;
+                const uint32_t un_current = aun_lods[i + un_lane];
+                uint32_t un_lod = 0;
+                for (uint32_t un_candidate = 1; un_candidate < k_un_max_mesh_lods; un_candidate++) {
+                    const float f_limit = un_candidate > un_current ? f_threshold_coarser : f_threshold_pixels;
+                    un_lod = af_errors[un_candidate] * af_pixels_per_error[un_lane] <= f_limit ? un_candidate : un_lod;
+                }
+
+                aun_lods[i + un_lane] = static_cast<uint8_t>(un_lod);
+                pun_out_lods[i + un_lane] = static_cast<uint8_t>(un_lod);
+            }
+        }
+    });
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "openxr/openxr.h"
+
+#include "gpu_culling.h"
+#include "job_system.h"
+#include "scene.h"
+
+//Picks a level of detail per object on the CPU from the screen space error of its mesh's LODs. An object's projected error is
+//its LOD's error over its distance from the eye, in pixels of the view it covers most of, and the coarsest LOD that stays
+//under the threshold wins. Going coarser needs a margin below the threshold that going finer does not, so objects sitting
+//right at a switching distance do not flicker between two LODs as the head moves.
+//
+//Bounds and the LODs picked last come from the Scene's structure of arrays, so one frame's selection is a single pass over
+//tightly packed floats, four objects at a time, split into fixed batches across the job system's threads.
+class LodSelector {
+public:
+    void SetMeshes(const std::vector<GpuMesh> &v_meshes);
+
+    //Writes one LOD index per object of scene to pun_out_lods and keeps it as the scene's LOD state. aun_image_widths are the
+    //widths in pixels the views are rendered at, f_threshold_pixels the error a LOD may show on screen and f_near keeps
+    //objects around the eyes from dividing by nothing.
+    void Select(JobSystem &job_system, Scene &scene, const XrView *pxr_views, const uint32_t *aun_image_widths, uint32_t un_view_count,
+                float f_threshold_pixels, float f_near, uint8_t *pun_out_lods);
+
+private:
+    //k_un_max_mesh_lods per mesh, LODs a mesh does not have are never under the threshold
+    std::vector<float> mv_mesh_lod_errors;
+};
@@ -1,4 +1,6 @@
 #include <atomic>
+#include <chrono>
+#include <cstdlib>
 #include <stdexcept>
 #include <thread>
 
@@ -17,6 +19,12 @@
 struct android_app *g_app;
 app_state g_app_state;
 
+//Longest the main thread sleeps between ticks while the app runs. It only polls events then, frames are up to the frame
+//threads, which wake it early if they stop on their own.
+constexpr int k_n_ms_tick_interval = 10;
+
+constexpr std::chrono::seconds k_duration_property_poll{1};
+
 void app_handle_cmd(struct android_app *app, int32_t cmd) {
     switch (cmd) {
         case APP_CMD_START: {
@@ -51,6 +59,11 @@ void app_handle_cmd(struct android_app *app, int32_t cmd) {
             Log("[AndroidActivity] APP_CMD_PAUSE");
             g_app_state.b_app_running = false;
 
+            //A paused app may be killed without ever tearing down
+            if (app->userData) {
+                static_cast<Program *>(app->userData)->SavePipelineCaches();
+            }
+
             break;
         }
 
@@ -60,6 +73,15 @@ void app_handle_cmd(struct android_app *app, int32_t cmd) {
             break;
         }
 
+        case APP_CMD_SAVE_STATE: {
+            Log("[AndroidActivity] APP_CMD_SAVE_STATE");
+            if (app->userData) {
+                static_cast<Program *>(app->userData)->SavePipelineCaches();
+            }
+
+            break;
+        }
+
         case APP_CMD_RESUME: {
             Log("[AndroidActivity] APP_CMD_RESUME");
             g_app_state.b_app_running = true;
@@ -86,6 +108,19 @@ void android_main(struct android_app *app) {
     app->onAppCmd = app_handle_cmd;
 
     Program program = Program(g_app, &g_app_state);
+    app->userData = &program;
+
+    {//Per-title frames in flight override, e.g. adb shell setprop debug.qov.frames_in_flight 3
+        char pc_property[PROP_VALUE_MAX] = {};
+        if (__system_property_get("debug.qov.frames_in_flight", pc_property) > 0) {
+            program.SetFramesInFlight(static_cast<uint32_t>(atoi(pc_property)));
+        }
+    }
+
+    //Live MSAA override polled about once a second, e.g. adb shell setprop debug.qov.msaa 4. Unset or 0 keeps the runtime's
+    //recommendation.
+    uint32_t un_msaa_property = 0;
+    std::chrono::steady_clock::time_point time_property_poll{};
 
     if (!program.BInit()) {
         Log(LogError, "[android_main] Failed to initialize openxr program. Aborting.");
@@ -96,11 +131,27 @@ void android_main(struct android_app *app) {
     g_app_state.b_app_running = true;
 
     while (app->destroyRequested == 0) {
+        const std::chrono::steady_clock::time_point time_now = std::chrono::steady_clock::now();
+        if (time_now - time_property_poll >= k_duration_property_poll) {
+            time_property_poll = time_now;
+
+            char pc_property[PROP_VALUE_MAX] = {};
+            const uint32_t un_msaa = __system_property_get("debug.qov.msaa", pc_property) > 0 ? static_cast<uint32_t>(atoi(pc_property)) : 0;
+            if (un_msaa != un_msaa_property) {
+                un_msaa_property = un_msaa;
+                program.SetSampleCount(un_msaa);
+            }
+        }
+
+        //Sleeps until the next tick is due or an event comes in, then drains whatever else is pending
+        int n_ms_timeout = k_n_ms_tick_interval;
         while (true) {
             int events;
             struct android_poll_source *source;
 
-            const int n_ms_timeout = (!g_app_state.b_app_running && app->destroyRequested == 0) ? -1 : 0;
+            if (!g_app_state.b_app_running && app->destroyRequested == 0) {
+                n_ms_timeout = -1;
+            }
             if (ALooper_pollAll(n_ms_timeout, nullptr, &events, (void **) &source) < 0) {
                 break;
             }
@@ -108,12 +159,14 @@ void android_main(struct android_app *app) {
             if (source != nullptr) {
                 source->process(app, source);
             }
+            n_ms_timeout = 0;
         }
 
         program.Tick();
     }
 
     finish:
+    app->userData = nullptr;
     ANativeActivity_finish(app->activity);
     java_vm->DetachCurrentThread();
 }
\ No newline at end of file
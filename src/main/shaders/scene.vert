@@ -0,0 +1,37 @@
+#version 450
+#extension GL_EXT_multiview : require
+
+struct Vertex {
+    vec4 vec4_position;
+    vec4 vec4_color;
+};
+
+struct Object {
+    mat4 mat4_model;
+    vec4 vec4_bounding_sphere;
+    uint un_mesh;
+    uint aun_pad[3];
+};
+
+layout (set = 0, binding = 0) uniform ViewUniforms {
+    mat4 amat4_view_projection[2];
+} view_uniforms;
+
+//Vertices are pulled by index instead of going through vertex input state
+layout (set = 1, binding = 0) readonly buffer Vertices {
+    Vertex a_vertices[];
+};
+
+layout (set = 1, binding = 1) readonly buffer Objects {
+    Object a_objects[];
+};
+
+layout (location = 0) out vec3 vec3_frag_color;
+
+void main() {
+    Vertex vertex = a_vertices[gl_VertexIndex];
+    mat4 mat4_model = a_objects[gl_InstanceIndex].mat4_model;
+
+    gl_Position = view_uniforms.amat4_view_projection[gl_ViewIndex] * mat4_model * vec4(vertex.vec4_position.xyz, 1.0);
+    vec3_frag_color = vertex.vec4_color.rgb;
+}
@@ -1,11 +1,20 @@
 #version 450
+#extension GL_EXT_multiview : require
+
+layout (set = 0, binding = 0) uniform ViewUniforms {
+    mat4 amat4_view_projection[2];
+} view_uniforms;
+
+layout (set = 0, binding = 1) uniform DrawUniforms {
+    mat4 mat4_model;
+} draw_uniforms;
 
 layout (location = 0) out vec3 vec3_frag_color;
 
 vec2 vec2_positions[3] = vec2[](
-vec2(0.0, -0.5),
-vec2(0.5, 0.5),
-vec2(-0.5, 0.5)
+vec2(0.0, 0.25),
+vec2(0.25, -0.25),
+vec2(-0.25, -0.25)
 );
 
 vec3 vec3_colors[3] = vec3[](
@@ -15,6 +24,7 @@ vec3(0.0, 0.0, 1.0)
 );
 
 void main() {
-    gl_Position = vec4(vec2_positions[gl_VertexIndex], 0.0, 1.0);
+    vec4 vec4_world = draw_uniforms.mat4_model * vec4(vec2_positions[gl_VertexIndex], 0.0, 1.0);
+    gl_Position = view_uniforms.amat4_view_projection[gl_ViewIndex] * vec4_world;
     vec3_frag_color = vec3_colors[gl_VertexIndex];
-}
\ No newline at end of file
+}
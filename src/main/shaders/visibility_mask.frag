@@ -0,0 +1,5 @@
+#version 450
+
+//Only depth is written, the pipeline masks off every color channel
+void main() {
+}
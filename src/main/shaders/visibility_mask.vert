@@ -0,0 +1,12 @@
+#version 450
+#extension GL_EXT_multiview : require
+
+//Clip space position of a hidden area vertex and the view whose mesh it belongs to
+layout (location = 0) in vec2 vec2_position;
+layout (location = 1) in uint un_view;
+
+void main() {
+    //Every view draws every mesh, vertices of the other views' meshes collapse onto one point outside the clip volume so
+    //their triangles are dropped before rasterization. The rest lands on the near plane, at depth 1 with reversed depth.
+    gl_Position = un_view == uint(gl_ViewIndex) ? vec4(vec2_position, 1.0, 1.0) : vec4(2.0, 2.0, 2.0, 1.0);
+}
@@ -0,0 +1,136 @@
+#include "parallel_recorder.h"
+
+#include <algorithm>
+
+#include "log.h"
+#include "qualify.h"
+
+bool ParallelRecorder::BInit(VkDevice vk_device, uint32_t un_queue_family, uint32_t un_slot_count) {
+    mvk_device = vk_device;
+    mun_queue_family = un_queue_family;
+    mun_slot_count = un_slot_count;
+
+    //Every generation starts above the pools' 0, so the first recording of each resets what it is about to use anyway
+    mv_pools.assign(static_cast<size_t>(JobSystem::k_un_max_threads + 1) * un_slot_count, {});
+    mv_slot_generations.assign(un_slot_count, 1);
+
+    Log("[ParallelRecorder] Initialized for up to %u threads and %u frames in flight", JobSystem::k_un_max_threads + 1, un_slot_count);
+
+    return true;
+}
+
+void ParallelRecorder::Destroy() {
+    if (mvk_device == VK_NULL_HANDLE) {
+        return;
+    }
+
+    //Frees the secondaries with them
+    for (ThreadPool &pool: mv_pools) {
+        vkDestroyCommandPool(mvk_device, pool.vk_command_pool, nullptr);
+    }
+    mv_pools.clear();
+    mv_slot_generations.clear();
+    mv_secondaries.clear();
+
+    mvk_device = VK_NULL_HANDLE;
+}
+
+void ParallelRecorder::BeginFrame(uint32_t un_slot) {
+    if (un_slot < mun_slot_count) {
+        mv_slot_generations[un_slot]++;
+    }
+}
+
+bool ParallelRecorder::BRecord(JobSystem &job_system, uint32_t un_slot, uint32_t un_count, uint32_t un_range_size, VkRenderPass vk_render_pass,
+                               VkFramebuffer vk_framebuffer, const RecordFn &fn_record) {
+    if (un_slot >= mun_slot_count) {
+        Log(LogError, "[ParallelRecorder] No pools for slot %u", un_slot);
+        return false;
+    }
+
+    un_range_size = std::max(un_range_size, 1u);
+    const uint32_t un_range_count = (un_count + un_range_size - 1) / un_range_size;
+    const uint64_t un_generation = mv_slot_generations[un_slot];
+
+    mv_secondaries.assign(un_range_count, VK_NULL_HANDLE);
+
+    //One job per range, each writes only its own element of mv_secondaries and the pools of the thread it runs on
+    std::atomic<bool> b_failed = false;
+    job_system.ParallelFor(un_range_count, 1, [&](uint32_t un_first_range, uint32_t un_end_range) {
+        ThreadPool &pool = mv_pools[static_cast<size_t>(job_system.UnThreadIndex()) * mun_slot_count + un_slot];
+
+        for (uint32_t un_range = un_first_range; un_range < un_end_range; un_range++) {
+            const VkCommandBuffer vk_command_buffer = PBegin(pool, un_generation, vk_render_pass, vk_framebuffer);
+            if (vk_command_buffer == VK_NULL_HANDLE) {
+                b_failed.store(true, std::memory_order_relaxed);
+                return;
+            }
+
+            const uint32_t un_begin = un_range * un_range_size;
+            fn_record(vk_command_buffer, un_begin, std::min(un_begin + un_range_size, un_count));
+
+            if (vkEndCommandBuffer(vk_command_buffer) != VK_SUCCESS) {
+                b_failed.store(true, std::memory_order_relaxed);
+                return;
+            }
+            mv_secondaries[un_range] = vk_command_buffer;
+        }
+    });
+
+    if (b_failed.load(std::memory_order_relaxed)) {
+        Log(LogError, "[ParallelRecorder] Failed to record %u ranges of %u for slot %u", un_range_count, un_range_size, un_slot);
+        mv_secondaries.clear();
+        return false;
+    }
+
+    return true;
+}
+
+VkCommandBuffer ParallelRecorder::PBegin(ThreadPool &pool, uint64_t un_generation, VkRenderPass vk_render_pass, VkFramebuffer vk_framebuffer) {
+    if (pool.vk_command_pool == VK_NULL_HANDLE) {
+        //Transient, everything in it is re-recorded every frame and reset as a whole
+        VkCommandPoolCreateInfo vk_command_pool_create_info = {
+                .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+                .flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+                .queueFamilyIndex = mun_queue_family,
+        };
+        d_qualify_vk(vkCreateCommandPool(mvk_device, &vk_command_pool_create_info, nullptr, &pool.vk_command_pool));
+    }
+
+    if (pool.un_generation != un_generation) {
+        d_qualify_vk(vkResetCommandPool(mvk_device, pool.vk_command_pool, 0));
+        pool.un_used = 0;
+        pool.un_generation = un_generation;
+    }
+
+    if (pool.un_used == pool.vvk_command_buffers.size()) {
+        VkCommandBufferAllocateInfo vk_command_buffer_allocate_info = {
+                .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+                .commandPool = pool.vk_command_pool,
+                .level = VK_COMMAND_BUFFER_LEVEL_SECONDARY,
+                .commandBufferCount = 1,
+        };
+        VkCommandBuffer vk_command_buffer;
+        d_qualify_vk(vkAllocateCommandBuffers(mvk_device, &vk_command_buffer_allocate_info, &vk_command_buffer));
+        pool.vvk_command_buffers.push_back(vk_command_buffer);
+    }
+
+    const VkCommandBuffer vk_command_buffer = pool.vvk_command_buffers[pool.un_used];
+
+    VkCommandBufferInheritanceInfo vk_inheritance_info = {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO,
+            .renderPass = vk_render_pass,
+            .subpass = 0,
+            .framebuffer = vk_framebuffer,
+    };
+    VkCommandBufferBeginInfo vk_command_buffer_begin_info = {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+            .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT,
+            .pInheritanceInfo = &vk_inheritance_info,
+    };
+    d_qualify_vk(vkBeginCommandBuffer(vk_command_buffer, &vk_command_buffer_begin_info));
+
+    pool.un_used++;
+
+    return vk_command_buffer;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "vulkan/vulkan.h"
+
+#include "job_system.h"
+
+//Records one stretch of a render pass as secondary command buffers on the job system's threads, for the primary to execute
+//in order with vkCmdExecuteCommands. Command pools are externally synchronized, so every thread records from pools of its
+//own, one per frame in flight. A thread resets its pool for a slot the first time it records into it after the slot's
+//BeginFrame, by when the GPU is done with what the pool held.
+//
+//The stretch is split into fixed size ranges of items, so the same count always gives the same secondaries in the same
+//order, whichever thread ends up recording which.
+class ParallelRecorder {
+public:
+    using RecordFn = std::function<void(VkCommandBuffer vk_command_buffer, uint32_t un_begin, uint32_t un_end)>;
+
+    bool BInit(VkDevice vk_device, uint32_t un_queue_family, uint32_t un_slot_count);
+    void Destroy();
+
+    //Called once PBeginFrame has handed out un_slot again, lets the secondaries recorded for it before be recycled
+    void BeginFrame(uint32_t un_slot);
+
+    //Calls fn_record for consecutive ranges of un_range_size covering [0, un_count), each into a secondary begun for subpass 0
+    //of vk_render_pass and vk_framebuffer. Blocks until all are recorded, GetSecondaries then holds them in range order. May
+    //be called more than once per frame, each call's secondaries stay valid until the slot's next BeginFrame.
+    bool BRecord(JobSystem &job_system, uint32_t un_slot, uint32_t un_count, uint32_t un_range_size, VkRenderPass vk_render_pass,
+                 VkFramebuffer vk_framebuffer, const RecordFn &fn_record);
+
+    const std::vector<VkCommandBuffer> &GetSecondaries() const { return mv_secondaries; }
+
+private:
+    //Command buffers of one thread and slot, all allocated from vk_command_pool and handed out again after every reset
+    struct ThreadPool {
+        VkCommandPool vk_command_pool = VK_NULL_HANDLE;
+        std::vector<VkCommandBuffer> vvk_command_buffers;
+        uint32_t un_used = 0;
+        uint64_t un_generation = 0;
+    };
+
+    VkCommandBuffer PBegin(ThreadPool &pool, uint64_t un_generation, VkRenderPass vk_render_pass, VkFramebuffer vk_framebuffer);
+
+    VkDevice mvk_device = VK_NULL_HANDLE;
+    uint32_t mun_queue_family = 0;
+    uint32_t mun_slot_count = 0;
+
+    //thread major, created by their thread when it first records. The last thread index is for threads that are not attached,
+    //which only ever record on their own.
+    std::vector<ThreadPool> mv_pools;
+
+    //per slot, bumped by BeginFrame. Pools of an older generation are reset before they are recorded into.
+    std::vector<uint64_t> mv_slot_generations;
+
+    std::vector<VkCommandBuffer> mv_secondaries;
+};
@@ -0,0 +1,188 @@
+#include "pipeline_cache.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include <unistd.h>
+
+#include "log.h"
+#include "qualify.h"
+
+//Layout of VkPipelineCacheHeaderVersionOne, read field by field as the blob carries no alignment guarantees
+constexpr size_t k_size_header_version_one = 16 + VK_UUID_SIZE;
+
+bool PipelineCache::BInit(VkDevice vk_device, VkPhysicalDevice vk_physical_device, const std::string &s_path, bool b_creation_feedback_supported) {
+    mvk_device = vk_device;
+    ms_path = s_path;
+    mb_creation_feedback_supported = b_creation_feedback_supported;
+
+    vkGetPhysicalDeviceProperties(vk_physical_device, &mvk_physical_device_properties);
+
+    std::vector<uint8_t> v_data;
+    if (FILE *p_file = fopen(ms_path.c_str(), "rb")) {
+        fseek(p_file, 0, SEEK_END);
+        const long l_size = ftell(p_file);
+        fseek(p_file, 0, SEEK_SET);
+
+        if (l_size > 0) {
+            v_data.resize(l_size);
+            if (fread(v_data.data(), 1, v_data.size(), p_file) != v_data.size()) {
+                Log(LogWarning, "[PipelineCache] Failed to read %s, starting with an empty cache", ms_path.c_str());
+                v_data.clear();
+            }
+        }
+
+        fclose(p_file);
+    } else {
+        Log("[PipelineCache] No cache at %s, starting with an empty cache", ms_path.c_str());
+    }
+
+    if (!v_data.empty() && !BIsHeaderValid(v_data.data(), v_data.size())) {
+        Log(LogWarning, "[PipelineCache] Cache at %s was created by another device or driver, discarding it", ms_path.c_str());
+        v_data.clear();
+    }
+
+    msize_loaded = v_data.size();
+
+    VkPipelineCacheCreateInfo vk_pipeline_cache_create_info = {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+            .initialDataSize = v_data.size(),
+            .pInitialData = v_data.empty() ? nullptr : v_data.data(),
+    };
+    b_qualify_vk(vkCreatePipelineCache(mvk_device, &vk_pipeline_cache_create_info, nullptr, &mvk_pipeline_cache));
+
+    Log("[PipelineCache] Loaded %zu bytes from %s", msize_loaded, ms_path.c_str());
+
+    return true;
+}
+
+void PipelineCache::Destroy() {
+    if (mvk_pipeline_cache == VK_NULL_HANDLE) {
+        return;
+    }
+
+    BSaveIfDirty();
+
+    vkDestroyPipelineCache(mvk_device, mvk_pipeline_cache, nullptr);
+    mvk_pipeline_cache = VK_NULL_HANDLE;
+}
+
+bool PipelineCache::BIsHeaderValid(const uint8_t *pun_data, size_t size_data) const {
+    if (size_data < k_size_header_version_one) {
+        return false;
+    }
+
+    uint32_t un_header_size, un_header_version, un_vendor_id, un_device_id;
+    memcpy(&un_header_size, pun_data + 0, sizeof(uint32_t));
+    memcpy(&un_header_version, pun_data + 4, sizeof(uint32_t));
+    memcpy(&un_vendor_id, pun_data + 8, sizeof(uint32_t));
+    memcpy(&un_device_id, pun_data + 12, sizeof(uint32_t));
+
+    if (un_header_size < k_size_header_version_one || un_header_size > size_data) {
+        return false;
+    }
+
+    if (un_header_version != VK_PIPELINE_CACHE_HEADER_VERSION_ONE) {
+        return false;
+    }
+
+    if (un_vendor_id != mvk_physical_device_properties.vendorID || un_device_id != mvk_physical_device_properties.deviceID) {
+        return false;
+    }
+
+    return memcmp(pun_data + 16, mvk_physical_device_properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+template<typename TCreateInfo, typename FnCreate>
+VkResult PipelineCache::CreateWithFeedback(const TCreateInfo &create_info, FnCreate fn_create) {
+    TCreateInfo create_info_feedback = create_info;
+
+    VkPipelineCreationFeedbackEXT vk_pipeline_creation_feedback{};
+    VkPipelineCreationFeedbackCreateInfoEXT vk_creation_feedback_create_info = {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_CREATION_FEEDBACK_CREATE_INFO_EXT,
+            .pNext = create_info.pNext,
+            .pPipelineCreationFeedback = &vk_pipeline_creation_feedback,
+            .pipelineStageCreationFeedbackCount = 0,
+            .pPipelineStageCreationFeedbacks = nullptr,
+    };
+    if (mb_creation_feedback_supported) {
+        create_info_feedback.pNext = &vk_creation_feedback_create_info;
+    }
+
+    const auto time_start = std::chrono::steady_clock::now();
+    const VkResult vk_result = fn_create(create_info_feedback);
+    mun_ns_creating += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - time_start).count();
+
+    if (vk_result != VK_SUCCESS) {
+        return vk_result;
+    }
+
+    if (!(vk_pipeline_creation_feedback.flags & VK_PIPELINE_CREATION_FEEDBACK_VALID_BIT_EXT)) {
+        //No way to tell, assume the driver had to compile something new
+        mun_unknown++;
+        mb_dirty = true;
+    } else if (vk_pipeline_creation_feedback.flags & VK_PIPELINE_CREATION_FEEDBACK_APPLICATION_PIPELINE_CACHE_HIT_BIT_EXT) {
+        mun_hits++;
+    } else {
+        mun_misses++;
+        mb_dirty = true;
+    }
+
+    return vk_result;
+}
+
+VkResult PipelineCache::CreateGraphicsPipeline(const VkGraphicsPipelineCreateInfo &vk_graphics_pipeline_create_info, VkPipeline &out_vk_pipeline) {
+    return CreateWithFeedback(vk_graphics_pipeline_create_info, [&](const VkGraphicsPipelineCreateInfo &vk_create_info) {
+        return vkCreateGraphicsPipelines(mvk_device, mvk_pipeline_cache, 1, &vk_create_info, nullptr, &out_vk_pipeline);
+    });
+}
+
+VkResult PipelineCache::CreateComputePipeline(const VkComputePipelineCreateInfo &vk_compute_pipeline_create_info, VkPipeline &out_vk_pipeline) {
+    return CreateWithFeedback(vk_compute_pipeline_create_info, [&](const VkComputePipelineCreateInfo &vk_create_info) {
+        return vkCreateComputePipelines(mvk_device, mvk_pipeline_cache, 1, &vk_create_info, nullptr, &out_vk_pipeline);
+    });
+}
+
+bool PipelineCache::BSaveIfDirty() {
+    std::lock_guard<std::mutex> lock(mmutex_save);
+
+    if (!mb_dirty.exchange(false)) {
+        return true;
+    }
+
+    size_t size_data = 0;
+    b_qualify_vk(vkGetPipelineCacheData(mvk_device, mvk_pipeline_cache, &size_data, nullptr));
+
+    std::vector<uint8_t> v_data(size_data);
+    b_qualify_vk(vkGetPipelineCacheData(mvk_device, mvk_pipeline_cache, &size_data, v_data.data()));
+
+    //Write next to the real file and rename over it, so a crash mid-write never leaves a truncated cache behind
+    const std::string s_path_temp = ms_path + ".tmp";
+
+    FILE *p_file = fopen(s_path_temp.c_str(), "wb");
+    if (!p_file) {
+        Log(LogError, "[PipelineCache] Failed to open %s for writing", s_path_temp.c_str());
+        return false;
+    }
+
+    const bool b_written = fwrite(v_data.data(), 1, size_data, p_file) == size_data && fflush(p_file) == 0 && fsync(fileno(p_file)) == 0;
+    fclose(p_file);
+
+    if (!b_written || rename(s_path_temp.c_str(), ms_path.c_str()) != 0) {
+        Log(LogError, "[PipelineCache] Failed to write %s", ms_path.c_str());
+        unlink(s_path_temp.c_str());
+        return false;
+    }
+
+    Log("[PipelineCache] Saved %zu bytes to %s", size_data, ms_path.c_str());
+
+    return true;
+}
+
+void PipelineCache::LogStatistics() const {
+    Log("[PipelineCache] %s cache (%zu bytes): %u hits, %u misses, %u unknown, %.2f ms creating pipelines",
+        msize_loaded > 0 ? "Warm" : "Cold", msize_loaded, mun_hits.load(), mun_misses.load(), mun_unknown.load(),
+        static_cast<double>(mun_ns_creating.load()) / 1e6);
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+#include "vulkan/vulkan.h"
+
+//VkPipelineCache persisted to disk between launches. All pipeline creation goes through it so hits and misses can be counted.
+class PipelineCache {
+public:
+    //Loads s_path if it exists and its header matches this device, otherwise starts empty
+    bool BInit(VkDevice vk_device, VkPhysicalDevice vk_physical_device, const std::string &s_path, bool b_creation_feedback_supported);
+    void Destroy();
+
+    VkResult CreateGraphicsPipeline(const VkGraphicsPipelineCreateInfo &vk_graphics_pipeline_create_info, VkPipeline &out_vk_pipeline);
+    VkResult CreateComputePipeline(const VkComputePipelineCreateInfo &vk_compute_pipeline_create_info, VkPipeline &out_vk_pipeline);
+
+    //Writes the cache back through a temporary file and rename if pipelines were compiled since the last save
+    bool BSaveIfDirty();
+
+    void LogStatistics() const;
+
+    VkPipelineCache GetVkPipelineCache() const { return mvk_pipeline_cache; }
+
+private:
+    bool BIsHeaderValid(const uint8_t *pun_data, size_t size_data) const;
+
+    //Wraps one vkCreate*Pipelines call with creation feedback and timing
+    template<typename TCreateInfo, typename FnCreate>
+    VkResult CreateWithFeedback(const TCreateInfo &create_info, FnCreate fn_create);
+
+    VkDevice mvk_device = VK_NULL_HANDLE;
+    VkPipelineCache mvk_pipeline_cache = VK_NULL_HANDLE;
+    VkPhysicalDeviceProperties mvk_physical_device_properties{};
+
+    std::string ms_path;
+    bool mb_creation_feedback_supported = false;
+
+    std::mutex mmutex_save;
+    std::atomic<bool> mb_dirty = false;
+
+    size_t msize_loaded = 0;
+    std::atomic<uint32_t> mun_hits = 0;
+    std::atomic<uint32_t> mun_misses = 0;
+    std::atomic<uint32_t> mun_unknown = 0;
+    std::atomic<uint64_t> mun_ns_creating = 0;
+};
@@ -0,0 +1,382 @@
+#include "pipeline_variants.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iterator>
+#include <mutex>
+
+#include <unistd.h>
+
+#include "log.h"
+
+constexpr uint32_t k_un_manifest_magic = 0x4d505651; //"QVPM"
+constexpr uint32_t k_un_manifest_version = 3;
+
+uint64_t PipelineDesc::UnHash() const {
+    //Word-at-a-time multiply/xorshift hash with a murmur finalizer, the desc is small and 32-bit aligned
+    const uint32_t *pun_words = reinterpret_cast<const uint32_t *>(this);
+    constexpr size_t k_un_word_count = sizeof(PipelineDesc) / sizeof(uint32_t);
+
+    uint64_t un_hash = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < k_un_word_count; i++) {
+        un_hash = (un_hash ^ pun_words[i]) * 0x9e3779b97f4a7c15ull;
+        un_hash ^= un_hash >> 29;
+    }
+
+    un_hash ^= un_hash >> 33;
+    un_hash *= 0xff51afd7ed558ccdull;
+    un_hash ^= un_hash >> 33;
+    un_hash *= 0xc4ceb9fe1a85ec53ull;
+    un_hash ^= un_hash >> 33;
+
+    return un_hash;
+}
+
+bool PipelineDesc::operator==(const PipelineDesc &other) const {
+    return memcmp(this, &other, sizeof(PipelineDesc)) == 0;
+}
+
+bool PipelineVariantCache::BInit(VkDevice vk_device, PipelineCache *p_pipeline_cache, const std::string &s_manifest_path) {
+    mvk_device = vk_device;
+    mp_pipeline_cache = p_pipeline_cache;
+    ms_manifest_path = s_manifest_path;
+
+    FILE *p_file = fopen(ms_manifest_path.c_str(), "rb");
+    if (!p_file) {
+        Log("[PipelineVariantCache] No manifest at %s, variants will be created on first use", ms_manifest_path.c_str());
+        return true;
+    }
+
+    uint32_t aun_header[3] = {};
+    if (fread(aun_header, sizeof(aun_header), 1, p_file) == 1 && aun_header[0] == k_un_manifest_magic && aun_header[1] == k_un_manifest_version) {
+        mv_manifest.resize(aun_header[2]);
+        if (fread(mv_manifest.data(), sizeof(PipelineDesc), mv_manifest.size(), p_file) != mv_manifest.size()) {
+            Log(LogWarning, "[PipelineVariantCache] Manifest %s is truncated, ignoring it", ms_manifest_path.c_str());
+            mv_manifest.clear();
+        }
+    } else {
+        Log(LogWarning, "[PipelineVariantCache] Manifest %s has an unknown format, ignoring it", ms_manifest_path.c_str());
+    }
+
+    fclose(p_file);
+
+    return true;
+}
+
+void PipelineVariantCache::Destroy() {
+    if (mvk_device == VK_NULL_HANDLE) {
+        return;
+    }
+
+    BWriteManifestIfDirty();
+
+    for (auto &[desc, vk_pipeline]: mmap_pipelines) {
+        vkDestroyPipeline(mvk_device, vk_pipeline, nullptr);
+    }
+    mmap_pipelines.clear();
+    mmap_base_pipelines.clear();
+
+    for (auto &[un_id, shader_program]: mmap_shader_programs) {
+        vkDestroyShaderModule(mvk_device, shader_program.vksm_vertex, nullptr);
+        vkDestroyShaderModule(mvk_device, shader_program.vksm_fragment, nullptr);
+    }
+    mmap_shader_programs.clear();
+
+    mvk_device = VK_NULL_HANDLE;
+}
+
+void PipelineVariantCache::RegisterShaderProgram(uint32_t un_id, const ShaderProgram &shader_program) {
+    mmap_shader_programs[un_id] = shader_program;
+}
+
+void PipelineVariantCache::RegisterRenderPass(uint32_t un_id, VkRenderPass vk_render_pass, VkSampleCountFlagBits vk_sample_count) {
+    mmap_render_passes[un_id] = {vk_render_pass, vk_sample_count};
+}
+
+const ShaderProgram *PipelineVariantCache::PGetShaderProgram(uint32_t un_id) const {
+    auto it = mmap_shader_programs.find(un_id);
+    return it != mmap_shader_programs.end() ? &it->second : nullptr;
+}
+
+void PipelineVariantCache::Prewarm() {
+    //Variants of sample counts switched away from would otherwise be prewarmed on every launch from now on
+    std::vector<PipelineDesc> v_prewarm;
+    size_t un_dropped;
+    {
+        std::unique_lock<std::shared_mutex> lock(mmutex_pipelines);
+
+        const size_t un_manifest_size = mv_manifest.size();
+        std::erase_if(mv_manifest, [&](const PipelineDesc &desc) {
+            auto it_render_pass = mmap_render_passes.find(desc.un_render_pass);
+            return !mmap_shader_programs.contains(desc.un_shader_program) || it_render_pass == mmap_render_passes.end() ||
+                   it_render_pass->second.vk_sample_count != static_cast<VkSampleCountFlagBits>(desc.e_sample_count);
+        });
+        un_dropped = un_manifest_size - mv_manifest.size();
+        if (un_dropped > 0) {
+            mb_manifest_dirty = true;
+        }
+
+        v_prewarm = mv_manifest;
+    }
+
+    uint32_t un_created = 0;
+    for (const PipelineDesc &desc: v_prewarm) {
+        if (GetPipeline(desc) != VK_NULL_HANDLE) {
+            un_created++;
+        }
+    }
+
+    Log("[PipelineVariantCache] Prewarmed %u of %zu manifest variants, dropped %zu that no longer match", un_created, v_prewarm.size(), un_dropped);
+}
+
+VkPipeline PipelineVariantCache::GetPipeline(const PipelineDesc &desc) {
+    {
+        std::shared_lock<std::shared_mutex> lock(mmutex_pipelines);
+
+        auto it = mmap_pipelines.find(desc);
+        if (it != mmap_pipelines.end()) {
+            return it->second;
+        }
+    }
+
+    std::unique_lock<std::shared_mutex> lock(mmutex_pipelines);
+
+    //another thread may have created it while we waited for the lock
+    auto it = mmap_pipelines.find(desc);
+    if (it != mmap_pipelines.end()) {
+        return it->second;
+    }
+
+    VkPipeline vk_pipeline = CreatePipeline(desc);
+    if (vk_pipeline == VK_NULL_HANDLE) {
+        return VK_NULL_HANDLE;
+    }
+
+    mmap_pipelines.emplace(desc, vk_pipeline);
+
+    return vk_pipeline;
+}
+
+VkPipeline PipelineVariantCache::CreatePipeline(const PipelineDesc &desc) {
+    auto it_shader_program = mmap_shader_programs.find(desc.un_shader_program);
+    auto it_render_pass = mmap_render_passes.find(desc.un_render_pass);
+    if (it_shader_program == mmap_shader_programs.end() || it_render_pass == mmap_render_passes.end()) {
+        Log(LogError, "[PipelineVariantCache] Variant references unregistered shader program %u or render pass %u", desc.un_shader_program,
+            desc.un_render_pass);
+        return VK_NULL_HANDLE;
+    }
+    if (it_render_pass->second.vk_sample_count != static_cast<VkSampleCountFlagBits>(desc.e_sample_count)) {
+        Log(LogError, "[PipelineVariantCache] Variant has %u samples, render pass %u has %u", desc.e_sample_count, desc.un_render_pass,
+            static_cast<uint32_t>(it_render_pass->second.vk_sample_count));
+        return VK_NULL_HANDLE;
+    }
+
+    const ShaderProgram &shader_program = it_shader_program->second;
+
+    VkSpecializationMapEntry vk_specialization_map_entries[PipelineDesc::k_un_max_spec_constants];
+    for (uint32_t i = 0; i < PipelineDesc::k_un_max_spec_constants; i++) {
+        vk_specialization_map_entries[i] = {
+                .constantID = i,
+                .offset = static_cast<uint32_t>(i * sizeof(uint32_t)),
+                .size = sizeof(uint32_t),
+        };
+    }
+
+    VkSpecializationInfo vk_specialization_info = {
+            .mapEntryCount = desc.un_spec_constant_count,
+            .pMapEntries = vk_specialization_map_entries,
+            .dataSize = desc.un_spec_constant_count * sizeof(uint32_t),
+            .pData = desc.aun_spec_constants,
+    };
+
+    VkPipelineShaderStageCreateInfo vk_pipeline_shader_stage_create_info[] = {
+            {
+                    .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+                    .stage = VK_SHADER_STAGE_VERTEX_BIT,
+                    .module = shader_program.vksm_vertex,
+                    .pName = "main",
+                    .pSpecializationInfo = desc.un_spec_constant_count > 0 ? &vk_specialization_info : nullptr,
+            },
+            {
+                    .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+                    .stage = VK_SHADER_STAGE_FRAGMENT_BIT,
+                    .module = shader_program.vksm_fragment,
+                    .pName = "main",
+                    .pSpecializationInfo = desc.un_spec_constant_count > 0 ? &vk_specialization_info : nullptr,
+            }
+    };
+
+    std::vector<VkDynamicState> vvk_dynamic_states = {
+            VK_DYNAMIC_STATE_VIEWPORT,
+            VK_DYNAMIC_STATE_SCISSOR,
+    };
+
+    VkPipelineDynamicStateCreateInfo vk_pipeline_dynamic_state_create_info = {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
+            .dynamicStateCount = static_cast<uint32_t>(vvk_dynamic_states.size()),
+            .pDynamicStates = vvk_dynamic_states.data()
+    };
+
+    VkPipelineVertexInputStateCreateInfo vk_pipeline_vertex_input_state_create_info = {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
+            .vertexBindingDescriptionCount = static_cast<uint32_t>(shader_program.v_vertex_bindings.size()),
+            .pVertexBindingDescriptions = shader_program.v_vertex_bindings.data(),
+            .vertexAttributeDescriptionCount = static_cast<uint32_t>(shader_program.v_vertex_attributes.size()),
+            .pVertexAttributeDescriptions = shader_program.v_vertex_attributes.data(),
+    };
+
+    VkPipelineInputAssemblyStateCreateInfo vk_input_assembly_create_info = {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
+            .topology = static_cast<VkPrimitiveTopology>(desc.e_topology),
+            .primitiveRestartEnable = VK_FALSE,
+    };
+
+    //Both are set with vkCmdSetViewport and vkCmdSetScissor, so only the counts matter here
+    VkPipelineViewportStateCreateInfo vk_viewport_state_create_info = {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
+            .viewportCount = 1,
+            .pViewports = nullptr,
+            .scissorCount = 1,
+            .pScissors = nullptr,
+    };
+
+    VkPipelineRasterizationStateCreateInfo vk_rasterization_state_create_info = {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
+            .depthClampEnable = VK_FALSE,
+            .polygonMode = static_cast<VkPolygonMode>(desc.e_polygon_mode),
+            .cullMode = desc.un_cull_mode,
+            .frontFace = static_cast<VkFrontFace>(desc.e_front_face),
+            .depthBiasEnable = VK_FALSE,
+            .lineWidth = 1.f,
+    };
+
+    VkPipelineMultisampleStateCreateInfo vk_multisample_state_create_info = {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO,
+            .rasterizationSamples = static_cast<VkSampleCountFlagBits>(desc.e_sample_count),
+    };
+
+    VkPipelineDepthStencilStateCreateInfo vk_depth_stencil_state_create_info = {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO,
+            .depthTestEnable = desc.b_depth_test,
+            .depthWriteEnable = desc.b_depth_write,
+            .depthCompareOp = static_cast<VkCompareOp>(desc.e_depth_compare_op),
+            .depthBoundsTestEnable = VK_FALSE,
+            .stencilTestEnable = VK_FALSE,
+            .front = {
+                    .failOp = VK_STENCIL_OP_KEEP,
+                    .passOp = VK_STENCIL_OP_KEEP,
+                    .depthFailOp = VK_STENCIL_OP_KEEP,
+                    .compareOp = VK_COMPARE_OP_ALWAYS,
+            },
+            .back = {
+                    .failOp = VK_STENCIL_OP_KEEP,
+                    .passOp = VK_STENCIL_OP_KEEP,
+                    .depthFailOp = VK_STENCIL_OP_KEEP,
+                    .compareOp = VK_COMPARE_OP_ALWAYS,
+            }
+    };
+
+    VkPipelineColorBlendAttachmentState vk_color_blend_attachment_state = {
+            .blendEnable = desc.b_blend,
+            .srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA,
+            .dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA,
+            .colorBlendOp = VK_BLEND_OP_ADD,
+            .srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE,
+            .dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA,
+            .alphaBlendOp = VK_BLEND_OP_ADD,
+            .colorWriteMask = desc.un_color_write_mask,
+    };
+
+    VkPipelineColorBlendStateCreateInfo vk_color_blend_state_create_info = {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
+            .logicOpEnable = VK_FALSE,
+            .attachmentCount = 1,
+            .pAttachments = &vk_color_blend_attachment_state,
+    };
+
+    //The first variant of a shader program becomes the parent of every later one, which lets drivers share compiled state
+    auto it_base_pipeline = mmap_base_pipelines.find(desc.un_shader_program);
+    const bool b_derivative = it_base_pipeline != mmap_base_pipelines.end();
+
+    VkGraphicsPipelineCreateInfo vk_graphics_pipeline_create_info = {
+            .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+            .flags = b_derivative ? static_cast<VkPipelineCreateFlags>(VK_PIPELINE_CREATE_DERIVATIVE_BIT)
+                                  : static_cast<VkPipelineCreateFlags>(VK_PIPELINE_CREATE_ALLOW_DERIVATIVES_BIT),
+            .stageCount = static_cast<uint32_t>(std::size(vk_pipeline_shader_stage_create_info)),
+            .pStages = vk_pipeline_shader_stage_create_info,
+            .pVertexInputState = &vk_pipeline_vertex_input_state_create_info,
+            .pInputAssemblyState = &vk_input_assembly_create_info,
+            .pViewportState = &vk_viewport_state_create_info,
+            .pRasterizationState = &vk_rasterization_state_create_info,
+            .pMultisampleState = &vk_multisample_state_create_info,
+            .pDepthStencilState = &vk_depth_stencil_state_create_info,
+            .pColorBlendState = &vk_color_blend_state_create_info,
+            .pDynamicState = &vk_pipeline_dynamic_state_create_info,
+            .layout = shader_program.vk_pipeline_layout,
+            .renderPass = it_render_pass->second.vk_render_pass,
+            .subpass = desc.un_subpass,
+            .basePipelineHandle = b_derivative ? it_base_pipeline->second : VK_NULL_HANDLE,
+            .basePipelineIndex = -1,
+    };
+
+    VkPipeline vk_pipeline = VK_NULL_HANDLE;
+    VkResult vk_result = mp_pipeline_cache->CreateGraphicsPipeline(vk_graphics_pipeline_create_info, vk_pipeline);
+    if (vk_result != VK_SUCCESS) {
+        Log(LogError, "[PipelineVariantCache] Failed to create variant %016llx: %i", static_cast<unsigned long long>(desc.UnHash()), vk_result);
+        return VK_NULL_HANDLE;
+    }
+
+    if (!b_derivative) {
+        mmap_base_pipelines[desc.un_shader_program] = vk_pipeline;
+    }
+
+    if (std::find(mv_manifest.begin(), mv_manifest.end(), desc) == mv_manifest.end()) {
+        mv_manifest.push_back(desc);
+        mb_manifest_dirty = true;
+    }
+
+    Log("[PipelineVariantCache] Created variant %016llx%s", static_cast<unsigned long long>(desc.UnHash()), b_derivative ? " (derivative)" : "");
+
+    return vk_pipeline;
+}
+
+bool PipelineVariantCache::BWriteManifestIfDirty() {
+    std::lock_guard<std::mutex> lock_write(mmutex_manifest_write);
+
+    if (!mb_manifest_dirty.exchange(false)) {
+        return true;
+    }
+
+    //Copied so variants created meanwhile do not wait for the disk, they mark the manifest dirty again
+    std::vector<PipelineDesc> v_manifest;
+    {
+        std::shared_lock<std::shared_mutex> lock(mmutex_pipelines);
+        v_manifest = mv_manifest;
+    }
+
+    const std::string s_path_temp = ms_manifest_path + ".tmp";
+
+    FILE *p_file = fopen(s_path_temp.c_str(), "wb");
+    if (!p_file) {
+        Log(LogError, "[PipelineVariantCache] Failed to open %s for writing", s_path_temp.c_str());
+        mb_manifest_dirty = true;
+        return false;
+    }
+
+    const uint32_t aun_header[3] = {k_un_manifest_magic, k_un_manifest_version, static_cast<uint32_t>(v_manifest.size())};
+
+    bool b_written = fwrite(aun_header, sizeof(aun_header), 1, p_file) == 1;
+    b_written = b_written && fwrite(v_manifest.data(), sizeof(PipelineDesc), v_manifest.size(), p_file) == v_manifest.size();
+    b_written = b_written && fflush(p_file) == 0 && fsync(fileno(p_file)) == 0;
+    fclose(p_file);
+
+    if (!b_written || rename(s_path_temp.c_str(), ms_manifest_path.c_str()) != 0) {
+        Log(LogError, "[PipelineVariantCache] Failed to write %s", ms_manifest_path.c_str());
+        unlink(s_path_temp.c_str());
+        mb_manifest_dirty = true;
+        return false;
+    }
+
+    return true;
+}
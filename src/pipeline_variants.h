@@ -0,0 +1,116 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include "vulkan/vulkan.h"
+
+#include "pipeline_cache.h"
+
+//Fixed function state and specialization constants that make up one graphics pipeline variant. Viewport and scissor are
+//dynamic, one variant draws at any resolution.
+//Only 32-bit fields so the struct has no padding and can be hashed, compared and written to disk byte for byte.
+struct PipelineDesc {
+    static constexpr uint32_t k_un_max_spec_constants = 8;
+
+    uint32_t un_shader_program = 0; //id passed to PipelineVariantCache::RegisterShaderProgram
+    uint32_t un_render_pass = 0;    //id passed to PipelineVariantCache::RegisterRenderPass
+    uint32_t un_subpass = 0;
+
+    uint32_t e_topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+    uint32_t e_polygon_mode = VK_POLYGON_MODE_FILL;
+    uint32_t un_cull_mode = VK_CULL_MODE_BACK_BIT;
+    uint32_t e_front_face = VK_FRONT_FACE_CLOCKWISE;
+    uint32_t e_sample_count = VK_SAMPLE_COUNT_1_BIT;
+
+    uint32_t b_depth_test = VK_TRUE;
+    uint32_t b_depth_write = VK_TRUE;
+    uint32_t e_depth_compare_op = VK_COMPARE_OP_GREATER; //depth is reversed, see Mat4ProjectionFromFov
+
+    uint32_t b_blend = VK_FALSE;
+    uint32_t un_color_write_mask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+
+    //value of specialization constant_id i, for i < un_spec_constant_count
+    uint32_t un_spec_constant_count = 0;
+    uint32_t aun_spec_constants[k_un_max_spec_constants] = {};
+
+    uint64_t UnHash() const;
+
+    bool operator==(const PipelineDesc &other) const;
+};
+
+static_assert(std::has_unique_object_representations_v<PipelineDesc>, "PipelineDesc must not contain padding");
+
+struct PipelineDescHasher {
+    size_t operator()(const PipelineDesc &desc) const { return desc.UnHash(); }
+};
+
+struct ShaderProgram {
+    VkShaderModule vksm_vertex = VK_NULL_HANDLE;
+    VkShaderModule vksm_fragment = VK_NULL_HANDLE;
+    VkPipelineLayout vk_pipeline_layout = VK_NULL_HANDLE;
+
+    std::vector<VkVertexInputBindingDescription> v_vertex_bindings;
+    std::vector<VkVertexInputAttributeDescription> v_vertex_attributes;
+};
+
+//Lazily populated map from PipelineDesc to VkPipeline. Variants are compiled on first use, or up front from the
+//manifest of variants used by the previous run. Later variants of a shader program are created as derivatives of its first.
+//The manifest only keeps variants of the shader programs and render passes registered when it is prewarmed, those of other
+//sample counts are compiled again should they be needed.
+class PipelineVariantCache {
+public:
+    bool BInit(VkDevice vk_device, PipelineCache *p_pipeline_cache, const std::string &s_manifest_path);
+
+    //Writes the manifest and destroys every pipeline and shader module owned by the cache
+    void Destroy();
+
+    //Writes the manifest back through a temporary file and rename if variants were created or dropped since the last write.
+    //Can be called from any thread.
+    bool BWriteManifestIfDirty();
+
+    //Takes ownership of the shader modules, the pipeline layout stays owned by the caller
+    void RegisterShaderProgram(uint32_t un_id, const ShaderProgram &shader_program);
+    //vk_sample_count is what the render pass's attachments have, variants of it have to match
+    void RegisterRenderPass(uint32_t un_id, VkRenderPass vk_render_pass, VkSampleCountFlagBits vk_sample_count);
+
+    //Drops every variant from the manifest whose shader program or render pass is not registered, or whose sample count is
+    //not its render pass's, and creates the rest
+    void Prewarm();
+
+    //Returns VK_NULL_HANDLE if the variant could not be created
+    VkPipeline GetPipeline(const PipelineDesc &desc);
+
+    const ShaderProgram *PGetShaderProgram(uint32_t un_id) const;
+
+private:
+    VkPipeline CreatePipeline(const PipelineDesc &desc);
+
+    VkDevice mvk_device = VK_NULL_HANDLE;
+    PipelineCache *mp_pipeline_cache = nullptr;
+    std::string ms_manifest_path;
+
+    std::unordered_map<uint32_t, ShaderProgram> mmap_shader_programs;
+    struct RenderPass {
+        VkRenderPass vk_render_pass = VK_NULL_HANDLE;
+        VkSampleCountFlagBits vk_sample_count = VK_SAMPLE_COUNT_1_BIT;
+    };
+    std::unordered_map<uint32_t, RenderPass> mmap_render_passes;
+
+    //first pipeline created per shader program, used as the base for its derivatives
+    std::unordered_map<uint32_t, VkPipeline> mmap_base_pipelines;
+
+    std::shared_mutex mmutex_pipelines;
+    std::unordered_map<PipelineDesc, VkPipeline, PipelineDescHasher> mmap_pipelines;
+
+    //guarded by mmutex_pipelines like the variants it lists
+    std::vector<PipelineDesc> mv_manifest;
+    std::atomic<bool> mb_manifest_dirty = false;
+    std::mutex mmutex_manifest_write;
+};
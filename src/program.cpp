@@ -1,9 +1,25 @@
 #include "program.h"
 
+#include <algorithm>
+#include <cmath>
+#include <cstring>
 #include <string>
 #include <vector>
 
+#include <pthread.h>
+
+#include "frustum.h"
+#include "init_graph.h"
 #include "log.h"
+#include "qualify.h"
+#include "shader_uniforms.h"
+
+#include "shaders/cull_comp.h"
+#include "shaders/scene_vert.h"
+#include "shaders/shader_frag.h"
+#include "shaders/shader_vert.h"
+#include "shaders/visibility_mask_frag.h"
+#include "shaders/visibility_mask_vert.h"
 
 constexpr XrPosef k_xr_pose_identity = {
         .orientation = {
@@ -11,45 +27,57 @@ constexpr XrPosef k_xr_pose_identity = {
         },
 };
 
-#define b_qualify_xr(x) do {                                            \
-        XrResult ret = x;                                               \
-        if(XR_FAILED(ret)) {                                            \
-            Log(LogError, "[QualifyXR] %s failed with: %i", #x, ret);   \
-            return false;                                               \
-        }                                                               \
-    } while(0)                                                          \
-
-#define v_qualify_xr(x) do {                                             \
-        XrResult ret = x;                                               \
-        if(XR_FAILED(ret)) {                                            \
-            Log(LogError, "[QualifyXR] %s failed with: %i", #x, ret);   \
-            return;                                                     \
-        }                                                               \
-    } while(0)                                                          \
-
-#define b_qualify_vk(x) do {                                              \
-        VkResult ret = x;                                               \
-        if(ret != VK_SUCCESS) {                                         \
-            Log(LogError, "[QualifyVK] %s failed with: %i", #x, ret);   \
-            return false;                                               \
-        }                                                               \
-    } while(0)                                                          \
-
-#define d_qualify_vk(x) do {                                            \
-        VkResult ret = x;                                               \
-        if(ret != VK_SUCCESS) {                                         \
-            Log(LogError, "[DQualifyVK] %s failed with: %i", #x, ret);  \
-            return {};                                                  \
-        }                                                               \
-    } while(0)                                                          \
-
-#define xr_get_proc(instance, name) do {                                                    \
-        b_qualify_xr(xrGetInstanceProcAddr(instance, #name, (PFN_xrVoidFunction *) &name)); \
-    } while(0)                                                                              \
-
-#define vk_get_proc(instance, name) do {                                                    \
-        name = (PFN_##name) vkGetInstanceProcAddr(instance, #name);                         \
-    } while(0)
+constexpr XrReferenceSpaceType k_xr_app_space_type = XR_REFERENCE_SPACE_TYPE_LOCAL_FLOOR_EXT;
+
+constexpr VkDeviceSize k_size_frame_transient = 1024 * 1024;
+constexpr VkDeviceSize k_size_upload_staging = 32 * 1024 * 1024;
+
+constexpr float k_f_near_z = 0.05f;
+constexpr float k_f_far_z = 100.f;
+
+//128x128 spheres spread over 160 m, enough that culling and LODs dominate what reaches the rasterizer
+constexpr uint32_t k_un_scene_grid_size = 128;
+constexpr float k_f_scene_grid_spacing = 1.25f;
+
+//screen space error in pixels a mesh LOD may show before a finer one is drawn
+constexpr float k_f_lod_error_pixels = 1.f;
+
+//objects per secondary when the scene's draws are recorded across threads, fixed so the split is the same every frame
+constexpr uint32_t k_un_scene_draws_per_secondary = 256;
+
+//lowest render resolution relative to the recommended size, and the granularity rendered sizes snap to so the resolution
+//does not change with every frame's measurement
+constexpr float k_f_min_resolution_scale = 0.6f;
+constexpr uint32_t k_un_resolution_alignment = 16;
+
+//HUD layer swapchain size, small enough to rewrite from the CPU whenever it changes
+constexpr uint32_t k_un_hud_width = 256;
+constexpr uint32_t k_un_hud_height = 16;
+
+//threads BInit spreads independent startup work over, next to the calling thread
+constexpr uint32_t k_un_init_worker_count = 3;
+
+//how often Tick writes pipelines compiled since the last save, the check itself is just an atomic flag
+constexpr std::chrono::seconds k_duration_pipeline_cache_save{10};
+
+static ERenderPass ERenderPassForSamples(VkSampleCountFlagBits vk_sample_count) {
+    switch (vk_sample_count) {
+        case VK_SAMPLE_COUNT_2_BIT:
+            return RenderPassMainMsaa2;
+        case VK_SAMPLE_COUNT_4_BIT:
+            return RenderPassMainMsaa4;
+        case VK_SAMPLE_COUNT_8_BIT:
+            return RenderPassMainMsaa8;
+        default:
+            return RenderPassMain;
+    }
+}
+
+//Folds one more input into a cached command buffer's version, mixed like PipelineDesc::UnHash
+static uint64_t UnHashCombine(uint64_t un_hash, uint64_t un_value) {
+    un_hash = (un_hash ^ un_value) * 0x9e3779b97f4a7c15ull;
+    return un_hash ^ (un_hash >> 29);
+}
 
 static VKAPI_ATTR VkBool32 VKAPI_CALL VkDebugCallback(
         VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity,
@@ -107,654 +135,2278 @@ static XRAPI_ATTR XrBool32 XRAPI_CALL XrDebugCallback(
 
 Program::Program(android_app *p_app, app_state *p_app_state) : mp_android_app(p_app), mp_app_state(p_app_state) {}
 
-bool Program::BInit() {
-    {//Initialize loader
-        xr_get_proc(XR_NULL_HANDLE, xrInitializeLoaderKHR);
+void Program::SetFramesInFlight(uint32_t un_frames_in_flight) {
+    mun_frames_in_flight = std::clamp(un_frames_in_flight, FrameContextRing::k_un_min_depth, FrameContextRing::k_un_max_depth);
+}
 
-        XrLoaderInitInfoAndroidKHR xr_loader_init_info = {
-                .type = XR_TYPE_LOADER_INIT_INFO_ANDROID_KHR,
-                .applicationVM = mp_android_app->activity->vm,
-                .applicationContext = mp_android_app->activity->clazz,
-        };
-        b_qualify_xr(xrInitializeLoaderKHR((XrLoaderInitInfoBaseHeaderKHR *) &xr_loader_init_info));
+void Program::SetSampleCount(uint32_t un_sample_count) {
+    mun_requested_sample_count = un_sample_count;
+    mb_sample_count_changed = true;
+}
+
+bool Program::BInit() {
+    InitGraph init_graph;
+
+    //OpenXR instance setup talks to the runtime through JNI, so it stays on the attached calling thread
+    auto loader = init_graph.AddTask("xr_loader", [this] { return BInitLoader(); }, {}, true);
+    auto instance = init_graph.AddTask("xr_instance", [this] { return BInitInstance(); }, {loader}, true);
+    auto system = init_graph.AddTask("xr_system", [this] { return BInitSystem(); }, {instance});
+    auto view_configuration = init_graph.AddTask("xr_view_configuration", [this] { return BInitViewConfiguration(); }, {system});
+
+    auto vulkan_instance = init_graph.AddTask("vk_instance", [this] { return BInitVulkanInstance(); }, {system});
+    auto vulkan_device = init_graph.AddTask("vk_device", [this] { return BInitVulkanDevice(); }, {vulkan_instance});
+
+    auto session = init_graph.AddTask("xr_session", [this] { return BInitSession(); }, {vulkan_device});
+    auto swapchain_formats = init_graph.AddTask("xr_swapchain_formats", [this] { return BSelectSwapchainFormats(); }, {session, view_configuration});
+    auto swapchain_color = init_graph.AddTask("xr_swapchain_color", [this] { return BInitColorSwapchain(); }, {swapchain_formats});
+    auto swapchain_depth = init_graph.AddTask("xr_swapchain_depth", [this] { return BInitDepthSwapchain(); }, {swapchain_formats});
+
+    auto pipeline_cache = init_graph.AddTask("vk_pipeline_cache", [this] { return BInitPipelineCache(); }, {vulkan_device});
+    auto pipeline_layout = init_graph.AddTask("vk_pipeline_layout", [this] { return BInitPipelineLayout(); }, {vulkan_device});
+    auto render_pass = init_graph.AddTask("vk_render_pass", [this] { return BInitRenderPass(); }, {swapchain_formats});
+    init_graph.AddTask("vk_pipelines", [this] { return BInitPipelines(); }, {render_pass, pipeline_cache, pipeline_layout});
+    auto gpu_allocator = init_graph.AddTask("vk_gpu_allocator", [this] { return BInitGpuAllocator(); }, {vulkan_device});
+    init_graph.AddTask("vk_framebuffers", [this] { return BInitFramebuffers(); }, {render_pass, swapchain_color, swapchain_depth, gpu_allocator});
+    auto frame_ring = init_graph.AddTask("vk_frame_ring", [this] { return BInitFrameRing(); }, {gpu_allocator});
+    init_graph.AddTask("vk_render_graph", [this] { return BInitRenderGraph(); }, {frame_ring});
+    init_graph.AddTask("vk_uniform_sets", [this] { return BInitUniformSets(); }, {frame_ring, pipeline_layout});
+    auto upload_manager = init_graph.AddTask("vk_upload_manager", [this] { return BInitUploadManager(); }, {gpu_allocator});
+    auto hiz_pyramid = init_graph.AddTask("vk_hiz_pyramid", [this] { return BInitHiZPyramid(); }, {gpu_allocator, pipeline_cache, swapchain_depth, render_pass});
+    init_graph.AddTask("vk_gpu_culling", [this] { return BInitGpuCulling(); }, {upload_manager, pipeline_cache, pipeline_layout, hiz_pyramid});
+    init_graph.AddTask("xr_visibility_mask", [this] { return BInitVisibilityMask(); }, {session, view_configuration});
+    init_graph.AddTask("xr_composition_layers", [this] { return BInitCompositionLayers(); }, {swapchain_formats});
+    init_graph.AddTask("vk_command_buffer_cache", [this] { return BInitCommandBufferCache(); }, {frame_ring, swapchain_color, swapchain_depth});
+    init_graph.AddTask("vk_async_compute", [this] { return BInitAsyncCompute(); }, {frame_ring});
+    init_graph.AddTask("vk_parallel_recorder", [this] { return BInitParallelRecorder(); }, {frame_ring});
+    init_graph.AddTask("job_system", [this] { return m_job_system.BInit(); });
+
+    const bool b_succeeded = init_graph.BRun(k_un_init_worker_count);
+
+    init_graph.LogTimeline();
+
+    if (!b_succeeded) {
+        return false;
     }
 
-    {//OpenXR Instance
-        std::vector<const char *> v_cs_enabled_extensions = {
-                XR_EXT_LOCAL_FLOOR_EXTENSION_NAME,
-                XR_KHR_ANDROID_CREATE_INSTANCE_EXTENSION_NAME,
-                XR_KHR_VULKAN_ENABLE2_EXTENSION_NAME,
-                XR_EXT_DEBUG_UTILS_EXTENSION_NAME,
-        };
-        XrInstanceCreateInfoAndroidKHR xr_instance_create_info_android = {
-                .type = XR_TYPE_INSTANCE_CREATE_INFO_ANDROID_KHR,
-                .applicationVM = mp_android_app->activity->vm,
-                .applicationActivity = mp_android_app->activity->clazz,
-        };
-        XrInstanceCreateInfo xr_instance_create_info = {
-                .type = XR_TYPE_INSTANCE_CREATE_INFO,
-                .next = &xr_instance_create_info_android,
-                .applicationInfo = {
-                        .applicationName = "danwillm's vulkan test",
-                        .applicationVersion = 1,
-                        .engineName = "danwillm",
-                        .engineVersion = 1,
-                        .apiVersion = XR_API_VERSION_1_0,
-                },
-                .enabledExtensionCount = static_cast<uint32_t>(v_cs_enabled_extensions.size()),
-                .enabledExtensionNames = v_cs_enabled_extensions.data(),
+    mv_views.resize(mv_view_config_views.size(), {XR_TYPE_VIEW});
+
+    m_pipeline_cache.LogStatistics();
+    SavePipelineCaches();
+
+    m_gpu_allocator.LogStatistics();
+
+    return true;
+}
+
+bool Program::BInitLoader() {
+    xr_get_proc(XR_NULL_HANDLE, xrInitializeLoaderKHR);
+
+    XrLoaderInitInfoAndroidKHR xr_loader_init_info = {
+            .type = XR_TYPE_LOADER_INIT_INFO_ANDROID_KHR,
+            .applicationVM = mp_android_app->activity->vm,
+            .applicationContext = mp_android_app->activity->clazz,
+    };
+    b_qualify_xr(xrInitializeLoaderKHR((XrLoaderInitInfoBaseHeaderKHR *) &xr_loader_init_info));
+
+    return true;
+}
+
+bool Program::BInitInstance() {
+    std::vector<const char *> v_cs_enabled_extensions = {
+            XR_EXT_LOCAL_FLOOR_EXTENSION_NAME,
+            XR_KHR_ANDROID_CREATE_INSTANCE_EXTENSION_NAME,
+            XR_KHR_VULKAN_ENABLE2_EXTENSION_NAME,
+            XR_EXT_DEBUG_UTILS_EXTENSION_NAME,
+    };
+
+    {//Optional extensions
+        uint32_t un_extension_count = 0;
+        b_qualify_xr(xrEnumerateInstanceExtensionProperties(nullptr, 0, &un_extension_count, nullptr));
+
+        std::vector<XrExtensionProperties> v_available_extensions(un_extension_count, {XR_TYPE_EXTENSION_PROPERTIES});
+        b_qualify_xr(xrEnumerateInstanceExtensionProperties(nullptr, un_extension_count, &un_extension_count, v_available_extensions.data()));
+
+        auto BIsExtensionSupported = [&](const char *pc_extension_name) -> bool {
+            auto it = std::find_if(v_available_extensions.begin(), v_available_extensions.end(), [&](const XrExtensionProperties &xr_extension_properties) {
+                return strcmp(pc_extension_name, xr_extension_properties.extensionName) == 0;
+            });
+
+            return it != v_available_extensions.end();
         };
-        b_qualify_xr(xrCreateInstance(&xr_instance_create_info, &mxr_instance));
 
-        //OpenXR Function bindings
-        xr_get_proc(mxr_instance, xrCreateDebugUtilsMessengerEXT);
-        xr_get_proc(mxr_instance, xrGetVulkanGraphicsRequirements2KHR);
-        xr_get_proc(mxr_instance, xrCreateVulkanInstanceKHR);
-        xr_get_proc(mxr_instance, xrGetVulkanGraphicsDevice2KHR);
-        xr_get_proc(mxr_instance, xrCreateVulkanDeviceKHR);
+        mb_visibility_mask_supported = BIsExtensionSupported(XR_KHR_VISIBILITY_MASK_EXTENSION_NAME);
+        if (mb_visibility_mask_supported) {
+            v_cs_enabled_extensions.push_back(XR_KHR_VISIBILITY_MASK_EXTENSION_NAME);
+        }
 
-        XrDebugUtilsMessengerCreateInfoEXT xr_debug_info{XR_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT};
-        xr_debug_info.messageSeverities = XR_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT | XR_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT;
+        mb_cylinder_supported = BIsExtensionSupported(XR_KHR_COMPOSITION_LAYER_CYLINDER_EXTENSION_NAME);
+        if (mb_cylinder_supported) {
+            v_cs_enabled_extensions.push_back(XR_KHR_COMPOSITION_LAYER_CYLINDER_EXTENSION_NAME);
+        }
+    }
+    XrInstanceCreateInfoAndroidKHR xr_instance_create_info_android = {
+            .type = XR_TYPE_INSTANCE_CREATE_INFO_ANDROID_KHR,
+            .applicationVM = mp_android_app->activity->vm,
+            .applicationActivity = mp_android_app->activity->clazz,
+    };
+    XrInstanceCreateInfo xr_instance_create_info = {
+            .type = XR_TYPE_INSTANCE_CREATE_INFO,
+            .next = &xr_instance_create_info_android,
+            .applicationInfo = {
+                    .applicationName = "danwillm's vulkan test",
+                    .applicationVersion = 1,
+                    .engineName = "danwillm",
+                    .engineVersion = 1,
+                    .apiVersion = XR_API_VERSION_1_0,
+            },
+            .enabledExtensionCount = static_cast<uint32_t>(v_cs_enabled_extensions.size()),
+            .enabledExtensionNames = v_cs_enabled_extensions.data(),
+    };
+    b_qualify_xr(xrCreateInstance(&xr_instance_create_info, &mxr_instance));
+
+    //OpenXR Function bindings
+    xr_get_proc(mxr_instance, xrCreateDebugUtilsMessengerEXT);
+    xr_get_proc(mxr_instance, xrGetVulkanGraphicsRequirements2KHR);
+    xr_get_proc(mxr_instance, xrCreateVulkanInstanceKHR);
+    xr_get_proc(mxr_instance, xrGetVulkanGraphicsDevice2KHR);
+    xr_get_proc(mxr_instance, xrCreateVulkanDeviceKHR);
+
+    XrDebugUtilsMessengerCreateInfoEXT xr_debug_info{XR_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT};
+    xr_debug_info.messageSeverities = XR_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT | XR_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT;
 #if !defined(NDEBUG)
-        xr_debug_info.messageSeverities |=
-                VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT;
+    xr_debug_info.messageSeverities |=
+            VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT;
 #endif
-        xr_debug_info.messageTypes = XR_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT | XR_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT |
-                                     XR_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT;
-        xr_debug_info.userCallback = XrDebugCallback;
-        b_qualify_xr(xrCreateDebugUtilsMessengerEXT(mxr_instance, &xr_debug_info, &mxr_debug_utils_messenger));
-    }
+    xr_debug_info.messageTypes = XR_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT | XR_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT |
+                                 XR_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT;
+    xr_debug_info.userCallback = XrDebugCallback;
+    b_qualify_xr(xrCreateDebugUtilsMessengerEXT(mxr_instance, &xr_debug_info, &mxr_debug_utils_messenger));
 
-    {//OpenXR System Properties
-        XrSystemGetInfo xr_system_get_info = {
-                .type = XR_TYPE_SYSTEM_GET_INFO,
-                .formFactor = XR_FORM_FACTOR_HEAD_MOUNTED_DISPLAY,
-        };
-        b_qualify_xr(xrGetSystem(mxr_instance, &xr_system_get_info, &mxr_system_id));
+    return true;
+}
 
-        XrSystemProperties xr_system_properties = {XR_TYPE_SYSTEM_PROPERTIES};
-        b_qualify_xr(xrGetSystemProperties(mxr_instance, mxr_system_id, &xr_system_properties));
-    }
+bool Program::BInitSystem() {
+    XrSystemGetInfo xr_system_get_info = {
+            .type = XR_TYPE_SYSTEM_GET_INFO,
+            .formFactor = XR_FORM_FACTOR_HEAD_MOUNTED_DISPLAY,
+    };
+    b_qualify_xr(xrGetSystem(mxr_instance, &xr_system_get_info, &mxr_system_id));
+
+    XrSystemProperties xr_system_properties = {XR_TYPE_SYSTEM_PROPERTIES};
+    b_qualify_xr(xrGetSystemProperties(mxr_instance, mxr_system_id, &xr_system_properties));
+
+    return true;
+}
 
-    {//Vulkan Initialization
-        XrGraphicsRequirementsVulkan2KHR xr_graphics_requirements_vulkan{XR_TYPE_GRAPHICS_REQUIREMENTS_VULKAN2_KHR};
-        b_qualify_xr(xrGetVulkanGraphicsRequirements2KHR(mxr_instance, mxr_system_id, &xr_graphics_requirements_vulkan));
+bool Program::BInitVulkanInstance() {
+    XrGraphicsRequirementsVulkan2KHR xr_graphics_requirements_vulkan{XR_TYPE_GRAPHICS_REQUIREMENTS_VULKAN2_KHR};
+    b_qualify_xr(xrGetVulkanGraphicsRequirements2KHR(mxr_instance, mxr_system_id, &xr_graphics_requirements_vulkan));
 
-        std::vector<const char *> v_enabled_layers{};
+    std::vector<const char *> v_enabled_layers{};
 
-        {//Vulkan Validation Layers
+    {//Vulkan Validation Layers
 #if !defined(NDEBUG)
-            const char *s_validation_layer_name = []() -> const char * { //Get Vulkan Validation Layer
-                uint32_t un_layer_count;
-                d_qualify_vk(vkEnumerateInstanceLayerProperties(&un_layer_count, nullptr));
+        const char *s_validation_layer_name = []() -> const char * { //Get Vulkan Validation Layer
+            uint32_t un_layer_count;
+            d_qualify_vk(vkEnumerateInstanceLayerProperties(&un_layer_count, nullptr));
 
-                std::vector<VkLayerProperties> v_available_layers(un_layer_count);
-                d_qualify_vk(vkEnumerateInstanceLayerProperties(&un_layer_count, v_available_layers.data()));
+            std::vector<VkLayerProperties> v_available_layers(un_layer_count);
+            d_qualify_vk(vkEnumerateInstanceLayerProperties(&un_layer_count, v_available_layers.data()));
 
-                std::vector<const char *> v_validation_layer_names = {
-                        "VK_LAYER_KHRONOS_validation",
-                        "VK_LAYER_LUNARG_standard_validation"
-                };
+            std::vector<const char *> v_validation_layer_names = {
+                    "VK_LAYER_KHRONOS_validation",
+                    "VK_LAYER_LUNARG_standard_validation"
+            };
 
-                for (const auto &s_validation_layer_name: v_validation_layer_names) {
-                    for (const auto &layer_properties: v_available_layers) {
-                        if (strcmp(s_validation_layer_name, layer_properties.layerName) == 0) {
-                            return s_validation_layer_name;
-                        }
+            for (const auto &s_validation_layer_name: v_validation_layer_names) {
+                for (const auto &layer_properties: v_available_layers) {
+                    if (strcmp(s_validation_layer_name, layer_properties.layerName) == 0) {
+                        return s_validation_layer_name;
                     }
                 }
+            }
 
-                Log(LogWarning, "[XrProgram] Could not find a validation layer!");
-                return nullptr;
-            }();
+            Log(LogWarning, "[XrProgram] Could not find a validation layer!");
+            return nullptr;
+        }();
 
-            if (s_validation_layer_name) {
-                v_enabled_layers.push_back(s_validation_layer_name);
-            }
-#endif
+        if (s_validation_layer_name) {
+            v_enabled_layers.push_back(s_validation_layer_name);
         }
+#endif
+    }
 
-        std::vector<const char *> v_requested_extensions = {};
+    std::vector<const char *> v_requested_extensions = {};
 
-        {//Vulkan Extensions
-            uint32_t un_extension_count = 0;
-            b_qualify_vk(vkEnumerateInstanceExtensionProperties(nullptr, &un_extension_count, nullptr));
+    {//Vulkan Extensions
+        uint32_t un_extension_count = 0;
+        b_qualify_vk(vkEnumerateInstanceExtensionProperties(nullptr, &un_extension_count, nullptr));
 
-            std::vector<VkExtensionProperties> v_available_extensions(un_extension_count);
-            b_qualify_vk(vkEnumerateInstanceExtensionProperties(nullptr, &un_extension_count, v_available_extensions.data()));
+        std::vector<VkExtensionProperties> v_available_extensions(un_extension_count);
+        b_qualify_vk(vkEnumerateInstanceExtensionProperties(nullptr, &un_extension_count, v_available_extensions.data()));
 
-            auto BIsExtensionSupported = [&](const char *pc_extension_name) -> bool {
-                auto it = std::find_if(v_available_extensions.begin(), v_available_extensions.end(), [&](const VkExtensionProperties &vk_extension_properties) {
-                    return strcmp(pc_extension_name, vk_extension_properties.extensionName) == 0;
-                });
+        auto BIsExtensionSupported = [&](const char *pc_extension_name) -> bool {
+            auto it = std::find_if(v_available_extensions.begin(), v_available_extensions.end(), [&](const VkExtensionProperties &vk_extension_properties) {
+                return strcmp(pc_extension_name, vk_extension_properties.extensionName) == 0;
+            });
 
-                return it != v_available_extensions.end();
-            };
+            return it != v_available_extensions.end();
+        };
 
-            if (BIsExtensionSupported(VK_EXT_DEBUG_UTILS_EXTENSION_NAME)) {
-                v_requested_extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
-            }
+        if (BIsExtensionSupported(VK_EXT_DEBUG_UTILS_EXTENSION_NAME)) {
+            v_requested_extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
         }
+    }
 
-        VkApplicationInfo vk_application_info = {
-                .sType = VK_STRUCTURE_TYPE_APPLICATION_INFO,
-                .pApplicationName = "Demo Vulkan",
-                .applicationVersion = 1,
-                .pEngineName = "danwillm",
-                .engineVersion = 1,
-                .apiVersion = VK_API_VERSION_1_1,
-        };
+    VkApplicationInfo vk_application_info = {
+            .sType = VK_STRUCTURE_TYPE_APPLICATION_INFO,
+            .pApplicationName = "Demo Vulkan",
+            .applicationVersion = 1,
+            .pEngineName = "danwillm",
+            .engineVersion = 1,
+            .apiVersion = VK_API_VERSION_1_1,
+    };
+
+    VkInstanceCreateInfo vk_instance_info = {
+            .pApplicationInfo = &vk_application_info,
+            .enabledLayerCount = static_cast<uint32_t>(v_enabled_layers.size()),
+            .ppEnabledLayerNames = v_enabled_layers.data(),
+            .enabledExtensionCount = static_cast<uint32_t>(v_requested_extensions.size()),
+            .ppEnabledExtensionNames = v_requested_extensions.data()
+    };
+
+    XrVulkanInstanceCreateInfoKHR xr_vulkan_instance_create_info = {
+            .systemId = mxr_system_id,
+            .pfnGetInstanceProcAddr = &vkGetInstanceProcAddr,
+            .vulkanCreateInfo = &vk_instance_info,
+            .vulkanAllocator = nullptr,
+    };
+
+    {//Create Vulkan Instance
+        VkResult vk_error;
+        b_qualify_xr(xrCreateVulkanInstanceKHR(mxr_instance, &xr_vulkan_instance_create_info, &mvk_instance, &vk_error));
+        b_qualify_vk(vk_error);
+
+        vk_get_proc(mvk_instance, vkCreateDebugUtilsMessengerEXT);
+        vk_get_proc(mvk_instance, vkDestroyDebugUtilsMessengerEXT);
+
+        VkDebugUtilsMessengerCreateInfoEXT vk_debug_info{VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT};
+        vk_debug_info.messageSeverity =
+                VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT;
+#if !defined(NDEBUG)
+        vk_debug_info.messageSeverity |=
+                VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT;
+#endif
+        vk_debug_info.messageType = VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT |
+                                    VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT;
+        vk_debug_info.pfnUserCallback = VkDebugCallback;
+        vk_debug_info.pUserData = this;
+        b_qualify_vk(vkCreateDebugUtilsMessengerEXT(mvk_instance, &vk_debug_info, nullptr, &mvk_debug_utils_messenger));
+    }
 
-        VkInstanceCreateInfo vk_instance_info = {
-                .pApplicationInfo = &vk_application_info,
-                .enabledLayerCount = static_cast<uint32_t>(v_enabled_layers.size()),
-                .ppEnabledLayerNames = v_enabled_layers.data(),
-                .enabledExtensionCount = static_cast<uint32_t>(v_requested_extensions.size()),
-                .ppEnabledExtensionNames = v_requested_extensions.data()
-        };
+    return true;
+}
 
-        XrVulkanInstanceCreateInfoKHR xr_vulkan_instance_create_info = {
-                .systemId = mxr_system_id,
-                .pfnGetInstanceProcAddr = &vkGetInstanceProcAddr,
-                .vulkanCreateInfo = &vk_instance_info,
-                .vulkanAllocator = nullptr,
-        };
+bool Program::BInitVulkanDevice() {
+    XrVulkanGraphicsDeviceGetInfoKHR xr_vk_device_info = {
+            .type = XR_TYPE_VULKAN_GRAPHICS_DEVICE_GET_INFO_KHR,
+            .systemId = mxr_system_id,
+            .vulkanInstance = mvk_instance,
+    };
+    b_qualify_xr(xrGetVulkanGraphicsDevice2KHR(mxr_instance, &xr_vk_device_info, &mvk_physical_device));
 
-        {//Create Vulkan Instance
-            VkResult vk_error;
-            b_qualify_xr(xrCreateVulkanInstanceKHR(mxr_instance, &xr_vulkan_instance_create_info, &mvk_instance, &vk_error));
-            b_qualify_vk(vk_error);
+    uint32_t un_queue_family_count = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(mvk_physical_device, &un_queue_family_count, nullptr);
 
-            vk_get_proc(mvk_instance, vkCreateDebugUtilsMessengerEXT);
-            vk_get_proc(mvk_instance, vkDestroyDebugUtilsMessengerEXT);
+    std::vector<VkQueueFamilyProperties> v_queue_family_properties(un_queue_family_count);
+    vkGetPhysicalDeviceQueueFamilyProperties(mvk_physical_device, &un_queue_family_count, v_queue_family_properties.data());
 
-            VkDebugUtilsMessengerCreateInfoEXT vk_debug_info{VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT};
-            vk_debug_info.messageSeverity =
-                    VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT;
-#if !defined(NDEBUG)
-            vk_debug_info.messageSeverity |=
-                    VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT;
-#endif
-            vk_debug_info.messageType = VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT |
-                                        VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT;
-            vk_debug_info.pfnUserCallback = VkDebugCallback;
-            vk_debug_info.pUserData = this;
-            b_qualify_vk(vkCreateDebugUtilsMessengerEXT(mvk_instance, &vk_debug_info, nullptr, &mvk_debug_utils_messenger));
+    for (uint32_t i = 0; i < v_queue_family_properties.size(); i++) {
+        if (v_queue_family_properties[i].queueFlags & VK_QUEUE_GRAPHICS_BIT) {
+            mvkindex_queue_family = i;
+            break;
         }
     }
 
-    {//Vulkan device creation
-        XrVulkanGraphicsDeviceGetInfoKHR xr_vk_device_info = {
-                .type = XR_TYPE_VULKAN_GRAPHICS_DEVICE_GET_INFO_KHR,
-                .systemId = mxr_system_id,
-                .vulkanInstance = mvk_instance,
-        };
-        b_qualify_xr(xrGetVulkanGraphicsDevice2KHR(mxr_instance, &xr_vk_device_info, &mvk_physical_device));
+    //Uploads go to a transfer-only family (a DMA engine) if there is one, else to a second graphics queue at a lower priority.
+    //Devices exposing a single queue share the graphics queue, with submissions serialised through mmutex_graphics_queue.
+    const float af_queue_priorities[] = {1.f, 0.5f};
+    std::vector<float> v_graphics_family_priorities = {af_queue_priorities[0]};
+    std::vector<VkDeviceQueueCreateInfo> v_queue_infos = {
+            {
+                    .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+                    .queueFamilyIndex = mvkindex_queue_family,
+                    .queueCount = 1,
+            },
+    };
+
+    {//Transfer queue
+        mvkindex_transfer_queue_family = mvkindex_queue_family;
+        mun_transfer_queue_index = 0;
+
+        auto it = std::find_if(v_queue_family_properties.begin(), v_queue_family_properties.end(), [](const VkQueueFamilyProperties &vk_properties) {
+            return (vk_properties.queueFlags & VK_QUEUE_TRANSFER_BIT) && !(vk_properties.queueFlags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT));
+        });
+
+        if (it != v_queue_family_properties.end()) {
+            mvkindex_transfer_queue_family = static_cast<uint32_t>(std::distance(v_queue_family_properties.begin(), it));
+            v_queue_infos.push_back({
+                    .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+                    .queueFamilyIndex = mvkindex_transfer_queue_family,
+                    .queueCount = 1,
+                    .pQueuePriorities = &af_queue_priorities[1],
+            });
+        } else if (v_queue_family_properties[mvkindex_queue_family].queueCount > 1) {
+            mun_transfer_queue_index = 1;
+            v_graphics_family_priorities.push_back(af_queue_priorities[1]);
+        }
+    }
 
-        uint32_t un_queue_family_count = 0;
-        vkGetPhysicalDeviceQueueFamilyProperties(mvk_physical_device, &un_queue_family_count, nullptr);
+    {//Async compute queue
+        //Another queue of the graphics family, at the graphics queue's priority as the frame waits on what runs there. A
+        //compute-only family would need every resource its work touches shared with it or handed over, so it is not used.
+        //Without a queue to spare compute work is recorded into the graphics queue's command buffers.
+        const uint32_t un_next_index = static_cast<uint32_t>(v_graphics_family_priorities.size());
+        if (v_queue_family_properties[mvkindex_queue_family].queueCount > un_next_index) {
+            mun_compute_queue_index = un_next_index;
+            v_graphics_family_priorities.push_back(af_queue_priorities[0]);
+        }
+    }
+    v_queue_infos.front().queueCount = static_cast<uint32_t>(v_graphics_family_priorities.size());
+    v_queue_infos.front().pQueuePriorities = v_graphics_family_priorities.data();
 
-        std::vector<VkQueueFamilyProperties> v_queue_family_properties(un_queue_family_count);
-        vkGetPhysicalDeviceQueueFamilyProperties(mvk_physical_device, &un_queue_family_count, v_queue_family_properties.data());
+    std::vector<const char *> v_device_extensions;
 
-        for (uint32_t i = 0; i < v_queue_family_properties.size(); i++) {
-            if (v_queue_family_properties[i].queueFlags & VK_QUEUE_GRAPHICS_BIT) {
-                mvkindex_queue_family = i;
-                break;
-            }
-        }
+    {//Vulkan Device Extensions
+        uint32_t un_extension_count = 0;
+        b_qualify_vk(vkEnumerateDeviceExtensionProperties(mvk_physical_device, nullptr, &un_extension_count, nullptr));
+
+        std::vector<VkExtensionProperties> v_available_extensions(un_extension_count);
+        b_qualify_vk(vkEnumerateDeviceExtensionProperties(mvk_physical_device, nullptr, &un_extension_count, v_available_extensions.data()));
 
-        float f_queue_priorities = 1.f;
-        VkDeviceQueueCreateInfo vk_queue_info = {
-                .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
-                .queueFamilyIndex = mvkindex_queue_family,
-                .queueCount = 1,
-                .pQueuePriorities = &f_queue_priorities,
+        auto BIsExtensionSupported = [&](const char *pc_extension_name) -> bool {
+            auto it = std::find_if(v_available_extensions.begin(), v_available_extensions.end(), [&](const VkExtensionProperties &vk_extension_properties) {
+                return strcmp(pc_extension_name, vk_extension_properties.extensionName) == 0;
+            });
+
+            return it != v_available_extensions.end();
         };
 
-        std::vector<const char *> v_device_extensions;
+        //Frame completion is tracked with a timeline semaphore, which is not core until Vulkan 1.2
+        if (!BIsExtensionSupported(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME)) {
+            Log(LogError, "[XrProgram] Device does not support %s", VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME);
+            return false;
+        }
+        v_device_extensions.push_back(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME);
 
-        VkPhysicalDeviceFeatures vk_physical_device_features{};
+        //Optional, only used to report pipeline cache hits and misses
+        mb_pipeline_creation_feedback_supported = BIsExtensionSupported(VK_EXT_PIPELINE_CREATION_FEEDBACK_EXTENSION_NAME);
+        if (mb_pipeline_creation_feedback_supported) {
+            v_device_extensions.push_back(VK_EXT_PIPELINE_CREATION_FEEDBACK_EXTENSION_NAME);
+        }
 
-        VkPhysicalDeviceMultiviewFeatures vk_multiview_features = {
-                .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MULTIVIEW_FEATURES,
-                .multiview = VK_TRUE,
-        };
-        VkDeviceCreateInfo vk_device_create_info = {
-                .sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
-                .pNext = &vk_multiview_features,
-                .queueCreateInfoCount = 1,
-                .pQueueCreateInfos = &vk_queue_info,
-                .enabledLayerCount = 0,
-                .ppEnabledLayerNames = nullptr,
-                .enabledExtensionCount = static_cast<uint32_t>(v_device_extensions.size()),
-                .ppEnabledExtensionNames = v_device_extensions.data(),
-                .pEnabledFeatures = &vk_physical_device_features
-        };
+        //Optional, lets GPU culling compact its draws instead of issuing one indirect command per object
+        m_gpu_culling_features.b_draw_indirect_count = BIsExtensionSupported(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+        if (m_gpu_culling_features.b_draw_indirect_count) {
+            v_device_extensions.push_back(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+        }
+    }
 
-        XrVulkanDeviceCreateInfoKHR xr_vulkan_device_create_info = {
-                .type = XR_TYPE_VULKAN_DEVICE_CREATE_INFO_KHR,
-                .systemId = mxr_system_id,
-                .pfnGetInstanceProcAddr = &vkGetInstanceProcAddr,
-                .vulkanPhysicalDevice = mvk_physical_device,
-                .vulkanCreateInfo = &vk_device_create_info,
-                .vulkanAllocator = nullptr
-        };
+    VkPhysicalDeviceFeatures vk_physical_device_features{};
+
+    {//Vulkan Device Features
+        VkPhysicalDeviceFeatures vk_supported_features;
+        vkGetPhysicalDeviceFeatures(mvk_physical_device, &vk_supported_features);
+
+        VkPhysicalDeviceProperties vk_physical_device_properties;
+        vkGetPhysicalDeviceProperties(mvk_physical_device, &vk_physical_device_properties);
 
-        VkResult vk_err;
-        b_qualify_xr(xrCreateVulkanDeviceKHR(mxr_instance, &xr_vulkan_device_create_info, &mvk_device, &vk_err));
-        b_qualify_vk(vk_err);
+        //Indirect draws pass the object index through firstInstance, and draw every object in one call with multiDrawIndirect
+        vk_physical_device_features.drawIndirectFirstInstance = vk_supported_features.drawIndirectFirstInstance;
+        vk_physical_device_features.multiDrawIndirect = vk_supported_features.multiDrawIndirect;
 
-        vkGetDeviceQueue(mvk_device, mvkindex_queue_family, 0, &mvk_queue);
+        m_gpu_culling_features.b_draw_indirect_first_instance = vk_supported_features.drawIndirectFirstInstance;
+        m_gpu_culling_features.un_max_draw_indirect_count =
+                vk_supported_features.multiDrawIndirect ? vk_physical_device_properties.limits.maxDrawIndirectCount : 1;
     }
 
-    {//Create OpenXR Session
-        XrGraphicsBindingVulkanKHR xr_graphics_binding_vulkan = {
-                .type = XR_TYPE_GRAPHICS_BINDING_VULKAN2_KHR,
-                .instance = mvk_instance,
-                .physicalDevice = mvk_physical_device,
-                .device = mvk_device,
-                .queueFamilyIndex = mvkindex_queue_family,
-                .queueIndex = 0
-        };
-        XrSessionCreateInfo xr_session_create_info = {
-                .type = XR_TYPE_SESSION_CREATE_INFO,
-                .next = &xr_graphics_binding_vulkan,
-                .createFlags = 0,
-                .systemId = mxr_system_id
+    VkPhysicalDeviceTimelineSemaphoreFeaturesKHR vk_timeline_semaphore_features = {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR,
+            .timelineSemaphore = VK_TRUE,
+    };
+
+    VkPhysicalDeviceMultiviewFeatures vk_multiview_features = {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MULTIVIEW_FEATURES,
+            .pNext = &vk_timeline_semaphore_features,
+            .multiview = VK_TRUE,
+    };
+    VkDeviceCreateInfo vk_device_create_info = {
+            .sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
+            .pNext = &vk_multiview_features,
+            .queueCreateInfoCount = static_cast<uint32_t>(v_queue_infos.size()),
+            .pQueueCreateInfos = v_queue_infos.data(),
+            .enabledLayerCount = 0,
+            .ppEnabledLayerNames = nullptr,
+            .enabledExtensionCount = static_cast<uint32_t>(v_device_extensions.size()),
+            .ppEnabledExtensionNames = v_device_extensions.data(),
+            .pEnabledFeatures = &vk_physical_device_features
+    };
+
+    XrVulkanDeviceCreateInfoKHR xr_vulkan_device_create_info = {
+            .type = XR_TYPE_VULKAN_DEVICE_CREATE_INFO_KHR,
+            .systemId = mxr_system_id,
+            .pfnGetInstanceProcAddr = &vkGetInstanceProcAddr,
+            .vulkanPhysicalDevice = mvk_physical_device,
+            .vulkanCreateInfo = &vk_device_create_info,
+            .vulkanAllocator = nullptr
+    };
+
+    VkResult vk_err;
+    b_qualify_xr(xrCreateVulkanDeviceKHR(mxr_instance, &xr_vulkan_device_create_info, &mvk_device, &vk_err));
+    b_qualify_vk(vk_err);
+
+    vkGetDeviceQueue(mvk_device, mvkindex_queue_family, 0, &mvk_queue);
+    vkGetDeviceQueue(mvk_device, mvkindex_transfer_queue_family, mun_transfer_queue_index, &mvk_transfer_queue);
+    if (mun_compute_queue_index != UINT32_MAX) {
+        vkGetDeviceQueue(mvk_device, mvkindex_queue_family, mun_compute_queue_index, &mvk_compute_queue);
+    }
+
+    return true;
+}
+
+bool Program::BInitSession() {
+    XrGraphicsBindingVulkanKHR xr_graphics_binding_vulkan = {
+            .type = XR_TYPE_GRAPHICS_BINDING_VULKAN2_KHR,
+            .instance = mvk_instance,
+            .physicalDevice = mvk_physical_device,
+            .device = mvk_device,
+            .queueFamilyIndex = mvkindex_queue_family,
+            .queueIndex = 0
+    };
+    XrSessionCreateInfo xr_session_create_info = {
+            .type = XR_TYPE_SESSION_CREATE_INFO,
+            .next = &xr_graphics_binding_vulkan,
+            .createFlags = 0,
+            .systemId = mxr_system_id
+    };
+    b_qualify_xr(xrCreateSession(mxr_instance, &xr_session_create_info, &mxr_session));
+
+    for (XrReferenceSpaceType xr_reference_space_type: {XR_REFERENCE_SPACE_TYPE_VIEW,
+                                                        XR_REFERENCE_SPACE_TYPE_STAGE,
+                                                        XR_REFERENCE_SPACE_TYPE_LOCAL_FLOOR_EXT}) {//Create OpenXR Reference spaces
+        XrReferenceSpaceCreateInfo xr_reference_space_create_info = {
+                .type = XR_TYPE_REFERENCE_SPACE_CREATE_INFO,
+                .referenceSpaceType = xr_reference_space_type,
+                .poseInReferenceSpace = k_xr_pose_identity,
         };
-        b_qualify_xr(xrCreateSession(mxr_instance, &xr_session_create_info, &mxr_session));
-
-        for (XrReferenceSpaceType xr_reference_space_type: {XR_REFERENCE_SPACE_TYPE_VIEW,
-                                                            XR_REFERENCE_SPACE_TYPE_STAGE,
-                                                            XR_REFERENCE_SPACE_TYPE_LOCAL_FLOOR_EXT}) {//Create OpenXR Reference spaces
-            XrReferenceSpaceCreateInfo xr_reference_space_create_info = {
-                    .type = XR_TYPE_REFERENCE_SPACE_CREATE_INFO,
-                    .referenceSpaceType = xr_reference_space_type,
-                    .poseInReferenceSpace = k_xr_pose_identity,
-            };
 
-            b_qualify_xr(xrCreateReferenceSpace(mxr_session, &xr_reference_space_create_info, &mmap_reference_spaces[xr_reference_space_type]));
-        }
+        b_qualify_xr(xrCreateReferenceSpace(mxr_session, &xr_reference_space_create_info, &mmap_reference_spaces[xr_reference_space_type]));
     }
 
-    {//OpenXR View configuration
-        uint32_t un_view_config_count;
-        b_qualify_xr(xrEnumerateViewConfigurations(mxr_instance, mxr_system_id, 0, &un_view_config_count, nullptr));
+    mxr_app_space = mmap_reference_spaces[k_xr_app_space_type];
 
-        std::vector<XrViewConfigurationType> v_view_config_types(un_view_config_count);
-        b_qualify_xr(xrEnumerateViewConfigurations(mxr_instance, mxr_system_id, v_view_config_types.size(), &un_view_config_count, v_view_config_types.data()));
+    return true;
+}
 
-        me_app_view_type = XR_VIEW_CONFIGURATION_TYPE_PRIMARY_STEREO;
+bool Program::BInitViewConfiguration() {
+    uint32_t un_view_config_count;
+    b_qualify_xr(xrEnumerateViewConfigurations(mxr_instance, mxr_system_id, 0, &un_view_config_count, nullptr));
 
-        if (std::find(v_view_config_types.begin(), v_view_config_types.end(), XR_VIEW_CONFIGURATION_TYPE_PRIMARY_STEREO) == v_view_config_types.end()) {
-            throw std::runtime_error("[XrProgram] View configuration STEREO was not supported on runtime");
-        }
+    std::vector<XrViewConfigurationType> v_view_config_types(un_view_config_count);
+    b_qualify_xr(xrEnumerateViewConfigurations(mxr_instance, mxr_system_id, v_view_config_types.size(), &un_view_config_count, v_view_config_types.data()));
 
-        uint32_t un_view_config_views_count;
-        b_qualify_xr(xrEnumerateViewConfigurationViews(mxr_instance, mxr_system_id, me_app_view_type, 0, &un_view_config_views_count, nullptr));
+    me_app_view_type = XR_VIEW_CONFIGURATION_TYPE_PRIMARY_STEREO;
 
-        mv_view_config_views.resize(un_view_config_views_count, {XR_TYPE_VIEW_CONFIGURATION_VIEW});
-        b_qualify_xr(xrEnumerateViewConfigurationViews(mxr_instance, mxr_system_id, me_app_view_type, mv_view_config_views.size(), &un_view_config_views_count,
-                                                       mv_view_config_views.data()));
+    if (std::find(v_view_config_types.begin(), v_view_config_types.end(), XR_VIEW_CONFIGURATION_TYPE_PRIMARY_STEREO) == v_view_config_types.end()) {
+        throw std::runtime_error("[XrProgram] View configuration STEREO was not supported on runtime");
     }
 
-    {//Create swapchains
-        uint32_t un_swapchain_formats_count;
-        b_qualify_xr(xrEnumerateSwapchainFormats(mxr_session, 0, &un_swapchain_formats_count, nullptr));
+    uint32_t un_view_config_views_count;
+    b_qualify_xr(xrEnumerateViewConfigurationViews(mxr_instance, mxr_system_id, me_app_view_type, 0, &un_view_config_views_count, nullptr));
+
+    mv_view_config_views.resize(un_view_config_views_count, {XR_TYPE_VIEW_CONFIGURATION_VIEW});
+    b_qualify_xr(xrEnumerateViewConfigurationViews(mxr_instance, mxr_system_id, me_app_view_type, mv_view_config_views.size(), &un_view_config_views_count,
+                                                   mv_view_config_views.data()));
 
-        std::vector<int64_t> v_swapchain_formats(un_swapchain_formats_count);
-        b_qualify_xr(xrEnumerateSwapchainFormats(mxr_session, v_swapchain_formats.size(), &un_swapchain_formats_count, v_swapchain_formats.data()));
+    return true;
+}
 
-        auto GetSupportedSwapchainFormat = [](const std::vector<VkFormat> &vVkSupportedFormats, std::vector<int64_t> &vLAvailableFormats) -> uint64_t {
-            auto it = std::find_first_of(vLAvailableFormats.begin(), vLAvailableFormats.end(), std::begin(vVkSupportedFormats), std::end(vVkSupportedFormats));
+bool Program::BSelectSwapchainFormats() {
+    uint32_t un_swapchain_formats_count;
+    b_qualify_xr(xrEnumerateSwapchainFormats(mxr_session, 0, &un_swapchain_formats_count, nullptr));
 
-            if (it == vLAvailableFormats.end()) {
-                return 0;
-            }
+    std::vector<int64_t> v_swapchain_formats(un_swapchain_formats_count);
+    b_qualify_xr(xrEnumerateSwapchainFormats(mxr_session, v_swapchain_formats.size(), &un_swapchain_formats_count, v_swapchain_formats.data()));
 
-            return *it;
-        };
+    auto GetSupportedSwapchainFormat = [](const std::vector<VkFormat> &vVkSupportedFormats, std::vector<int64_t> &vLAvailableFormats) -> uint64_t {
+        auto it = std::find_first_of(vLAvailableFormats.begin(), vLAvailableFormats.end(), std::begin(vVkSupportedFormats), std::end(vVkSupportedFormats));
 
-        const std::vector<VkFormat> vvk_color_formats = {
-                VK_FORMAT_B8G8R8A8_SRGB,
-                VK_FORMAT_R8G8B8A8_SRGB,
-                VK_FORMAT_B8G8R8A8_UNORM,
-                VK_FORMAT_R8G8B8A8_UNORM
-        };
-        const std::vector<VkFormat> vvk_depth_formats = {
-                VK_FORMAT_D32_SFLOAT,
-                VK_FORMAT_D16_UNORM
-        };
+        if (it == vLAvailableFormats.end()) {
+            return 0;
+        }
 
-        int64_t l_supported_color_format = GetSupportedSwapchainFormat(vvk_color_formats, v_swapchain_formats);
-        int64_t l_supported_depth_format = GetSupportedSwapchainFormat(vvk_color_formats, v_swapchain_formats);
-
-        if (l_supported_color_format == 0 || l_supported_depth_format == 0) {
-            throw std::runtime_error("[XrProgram] No supported swapchain format for depth or color was supported!");
-        }
-
-        {//Color swapchain
-            XrSwapchainCreateInfo xr_swapchain_color_create_info = {
-                    .type = XR_TYPE_SWAPCHAIN_CREATE_INFO,
-                    .createFlags = 0,
-                    .usageFlags = XR_SWAPCHAIN_USAGE_SAMPLED_BIT | XR_SWAPCHAIN_USAGE_COLOR_ATTACHMENT_BIT,
-                    .format = l_supported_color_format,
-                    .sampleCount = mv_view_config_views.front().recommendedSwapchainSampleCount,
-                    .width = mv_view_config_views.front().recommendedImageRectWidth, //assume same
-                    .height = mv_view_config_views.front().recommendedImageRectHeight,
-                    .faceCount = 1,
-                    .arraySize = static_cast<uint32_t>(mv_view_config_views.size()),
-                    .mipCount = 1,
-            };
-            b_qualify_xr(xrCreateSwapchain(mxr_session, &xr_swapchain_color_create_info, &mswapchain_color.swapchain));
+        return *it;
+    };
+
+    const std::vector<VkFormat> vvk_color_formats = {
+            VK_FORMAT_B8G8R8A8_SRGB,
+            VK_FORMAT_R8G8B8A8_SRGB,
+            VK_FORMAT_B8G8R8A8_UNORM,
+            VK_FORMAT_R8G8B8A8_UNORM
+    };
+    const std::vector<VkFormat> vvk_depth_formats = {
+            VK_FORMAT_D32_SFLOAT,
+            VK_FORMAT_D16_UNORM
+    };
+
+    int64_t l_supported_color_format = GetSupportedSwapchainFormat(vvk_color_formats, v_swapchain_formats);
+    int64_t l_supported_depth_format = GetSupportedSwapchainFormat(vvk_depth_formats, v_swapchain_formats);
+
+    if (l_supported_color_format == 0 || l_supported_depth_format == 0) {
+        throw std::runtime_error("[XrProgram] No supported swapchain format for depth or color was supported!");
+    }
 
-            uint32_t un_swapchain_image_count;
-            b_qualify_xr(xrEnumerateSwapchainImages(mswapchain_color.swapchain, 0, &un_swapchain_image_count, nullptr));
+    mswapchain_color.vk_format = static_cast<VkFormat>(l_supported_color_format);
+    mswapchain_depth.vk_format = static_cast<VkFormat>(l_supported_depth_format);
 
-            auto &swapchain_images = mswapchain_color.v_images;
-            swapchain_images.resize(un_swapchain_image_count, {XR_TYPE_SWAPCHAIN_IMAGE_VULKAN2_KHR});
-            b_qualify_xr(xrEnumerateSwapchainImages(mswapchain_color.swapchain, swapchain_images.size(), &un_swapchain_image_count,
-                                                    reinterpret_cast<XrSwapchainImageBaseHeader *>(swapchain_images.data())));
+    //assume every view has the same sizes. Swapchains are allocated at the largest size and frames render to a sub-rect of it,
+    //scaled around the recommended size by how much GPU time there is to spare.
+    const XrViewConfigurationView &xr_view_config_view = mv_view_config_views.front();
+    mswapchain_color.un_width = mswapchain_depth.un_width = xr_view_config_view.maxImageRectWidth;
+    mswapchain_color.un_height = mswapchain_depth.un_height = xr_view_config_view.maxImageRectHeight;
 
-            mswapchain_color.vk_format = static_cast<VkFormat>(l_supported_color_format);
+    const float f_max_scale = std::min(static_cast<float>(xr_view_config_view.maxImageRectWidth) / xr_view_config_view.recommendedImageRectWidth,
+                                       static_cast<float>(xr_view_config_view.maxImageRectHeight) / xr_view_config_view.recommendedImageRectHeight);
+    m_resolution_controller.Reset(std::min(k_f_min_resolution_scale, f_max_scale), f_max_scale);
 
-            mswapchain_color.v_image_views.resize(mswapchain_color.v_images.size());
-            for (uint32_t i = 0; i < mswapchain_color.v_images.size(); i++) {
-                VkImageViewCreateInfo vk_image_view_create_info = {
-                        .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
-                        .image = mswapchain_color.v_images[i].image,
-                        .viewType = VK_IMAGE_VIEW_TYPE_2D_ARRAY,
-                        .format = mswapchain_color.vk_format,
-                        .components = {
-                                .r = VK_COMPONENT_SWIZZLE_R,
-                                .g = VK_COMPONENT_SWIZZLE_G,
-                                .b = VK_COMPONENT_SWIZZLE_B,
-                                .a = VK_COMPONENT_SWIZZLE_A
-                        },
-                        .subresourceRange = {
-                                .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-                                .baseMipLevel = 0,
-                                .levelCount = 1,
-                                .baseArrayLayer = 0,
-                                .layerCount = static_cast<uint32_t>(mv_view_config_views.size()),
-                        }
-                };
-                b_qualify_vk(vkCreateImageView(mvk_device, &vk_image_view_create_info, nullptr, &mswapchain_color.v_image_views[i]));
-            }
-        }
-
-        {//Depth swapchain
-            XrSwapchainCreateInfo xr_swapchain_depth_create_info = {
-                    .type = XR_TYPE_SWAPCHAIN_CREATE_INFO,
-                    .createFlags = 0,
-                    .usageFlags = XR_SWAPCHAIN_USAGE_SAMPLED_BIT | XR_SWAPCHAIN_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
-                    .format = l_supported_depth_format,
-                    .sampleCount = mv_view_config_views.front().recommendedSwapchainSampleCount,
-                    .width = mv_view_config_views.front().recommendedImageRectWidth, //assume same
-                    .height = mv_view_config_views.front().recommendedImageRectHeight,
-                    .faceCount = 1,
-                    .arraySize = static_cast<uint32_t>(mv_view_config_views.size()),
-                    .mipCount = 1,
-            };
-            b_qualify_xr(xrCreateSwapchain(mxr_session, &xr_swapchain_depth_create_info, &mswapchain_depth.swapchain));
-
-            uint32_t un_swapchain_image_count;
-            b_qualify_xr(xrEnumerateSwapchainImages(mswapchain_depth.swapchain, 0, &un_swapchain_image_count, nullptr));
-
-            auto &swapchain_images = mswapchain_depth.v_images;
-            swapchain_images.resize(un_swapchain_image_count, {XR_TYPE_SWAPCHAIN_IMAGE_VULKAN2_KHR});
-            b_qualify_xr(xrEnumerateSwapchainImages(mswapchain_depth.swapchain, swapchain_images.size(), &un_swapchain_image_count,
-                                                    reinterpret_cast<XrSwapchainImageBaseHeader *>(swapchain_images.data())));
-
-            mswapchain_depth.vk_format = static_cast<VkFormat>(l_supported_depth_format);
-
-            mswapchain_depth.v_image_views.resize(mswapchain_depth.v_images.size());
-            for (uint32_t i = 0; i < mswapchain_depth.v_images.size(); i++) {
-                VkImageViewCreateInfo vk_image_view_create_info = {
-                        .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
-                        .image = mswapchain_depth.v_images[i].image,
-                        .viewType = VK_IMAGE_VIEW_TYPE_2D_ARRAY,
-                        .format = mswapchain_depth.vk_format,
-                        .components = {
-                                .r = VK_COMPONENT_SWIZZLE_R,
-                                .g = VK_COMPONENT_SWIZZLE_G,
-                                .b = VK_COMPONENT_SWIZZLE_B,
-                                .a = VK_COMPONENT_SWIZZLE_A
-                        },
-                        .subresourceRange = {
-                                .aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT,
-                                .baseMipLevel = 0,
-                                .levelCount = 1,
-                                .baseArrayLayer = 0,
-                                .layerCount = static_cast<uint32_t>(mv_view_config_views.size()),
-                        }
-                };
-                b_qualify_vk(vkCreateImageView(mvk_device, &vk_image_view_create_info, nullptr, &mswapchain_depth.v_image_views[i]));
+    return true;
+}
+
+bool Program::BInitColorSwapchain() {
+    //Always single sampled, with MSAA it is the resolve target of the main pass and nothing else
+    XrSwapchainCreateInfo xr_swapchain_color_create_info = {
+            .type = XR_TYPE_SWAPCHAIN_CREATE_INFO,
+            .createFlags = 0,
+            .usageFlags = XR_SWAPCHAIN_USAGE_COLOR_ATTACHMENT_BIT,
+            .format = mswapchain_color.vk_format,
+            .sampleCount = 1,
+            .width = mswapchain_color.un_width,
+            .height = mswapchain_color.un_height,
+            .faceCount = 1,
+            .arraySize = static_cast<uint32_t>(mv_view_config_views.size()),
+            .mipCount = 1,
+    };
+    b_qualify_xr(xrCreateSwapchain(mxr_session, &xr_swapchain_color_create_info, &mswapchain_color.swapchain));
+
+    uint32_t un_swapchain_image_count;
+    b_qualify_xr(xrEnumerateSwapchainImages(mswapchain_color.swapchain, 0, &un_swapchain_image_count, nullptr));
+
+    auto &swapchain_images = mswapchain_color.v_images;
+    swapchain_images.resize(un_swapchain_image_count, {XR_TYPE_SWAPCHAIN_IMAGE_VULKAN2_KHR});
+    b_qualify_xr(xrEnumerateSwapchainImages(mswapchain_color.swapchain, swapchain_images.size(), &un_swapchain_image_count,
+                                            reinterpret_cast<XrSwapchainImageBaseHeader *>(swapchain_images.data())));
+
+    mswapchain_color.un_image_count = un_swapchain_image_count;
+
+    mswapchain_color.v_image_views.resize(mswapchain_color.v_images.size());
+    for (uint32_t i = 0; i < mswapchain_color.v_images.size(); i++) {
+        VkImageViewCreateInfo vk_image_view_create_info = {
+                .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+                .image = mswapchain_color.v_images[i].image,
+                .viewType = VK_IMAGE_VIEW_TYPE_2D_ARRAY,
+                .format = mswapchain_color.vk_format,
+                .components = {
+                        .r = VK_COMPONENT_SWIZZLE_R,
+                        .g = VK_COMPONENT_SWIZZLE_G,
+                        .b = VK_COMPONENT_SWIZZLE_B,
+                        .a = VK_COMPONENT_SWIZZLE_A
+                },
+                .subresourceRange = {
+                        .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                        .baseMipLevel = 0,
+                        .levelCount = 1,
+                        .baseArrayLayer = 0,
+                        .layerCount = static_cast<uint32_t>(mv_view_config_views.size()),
+                }
+        };
+        b_qualify_vk(vkCreateImageView(mvk_device, &vk_image_view_create_info, nullptr, &mswapchain_color.v_image_views[i]));
+    }
+
+    return true;
+}
+
+bool Program::BInitDepthSwapchain() {
+    //Only the single sampled pass renders into it, sampled by the depth pyramid build afterwards
+    XrSwapchainCreateInfo xr_swapchain_depth_create_info = {
+            .type = XR_TYPE_SWAPCHAIN_CREATE_INFO,
+            .createFlags = 0,
+            .usageFlags = XR_SWAPCHAIN_USAGE_SAMPLED_BIT | XR_SWAPCHAIN_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
+            .format = mswapchain_depth.vk_format,
+            .sampleCount = 1,
+            .width = mswapchain_depth.un_width,
+            .height = mswapchain_depth.un_height,
+            .faceCount = 1,
+            .arraySize = static_cast<uint32_t>(mv_view_config_views.size()),
+            .mipCount = 1,
+    };
+    b_qualify_xr(xrCreateSwapchain(mxr_session, &xr_swapchain_depth_create_info, &mswapchain_depth.swapchain));
+
+    uint32_t un_swapchain_image_count;
+    b_qualify_xr(xrEnumerateSwapchainImages(mswapchain_depth.swapchain, 0, &un_swapchain_image_count, nullptr));
+
+    auto &swapchain_images = mswapchain_depth.v_images;
+    swapchain_images.resize(un_swapchain_image_count, {XR_TYPE_SWAPCHAIN_IMAGE_VULKAN2_KHR});
+    b_qualify_xr(xrEnumerateSwapchainImages(mswapchain_depth.swapchain, swapchain_images.size(), &un_swapchain_image_count,
+                                            reinterpret_cast<XrSwapchainImageBaseHeader *>(swapchain_images.data())));
+
+    mswapchain_depth.un_image_count = un_swapchain_image_count;
+
+    mswapchain_depth.v_image_views.resize(mswapchain_depth.v_images.size());
+    for (uint32_t i = 0; i < mswapchain_depth.v_images.size(); i++) {
+        VkImageViewCreateInfo vk_image_view_create_info = {
+                .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+                .image = mswapchain_depth.v_images[i].image,
+                .viewType = VK_IMAGE_VIEW_TYPE_2D_ARRAY,
+                .format = mswapchain_depth.vk_format,
+                .components = {
+                        .r = VK_COMPONENT_SWIZZLE_R,
+                        .g = VK_COMPONENT_SWIZZLE_G,
+                        .b = VK_COMPONENT_SWIZZLE_B,
+                        .a = VK_COMPONENT_SWIZZLE_A
+                },
+                .subresourceRange = {
+                        .aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT,
+                        .baseMipLevel = 0,
+                        .levelCount = 1,
+                        .baseArrayLayer = 0,
+                        .layerCount = static_cast<uint32_t>(mv_view_config_views.size()),
+                }
+        };
+        b_qualify_vk(vkCreateImageView(mvk_device, &vk_image_view_create_info, nullptr, &mswapchain_depth.v_image_views[i]));
+    }
+
+    return true;
+}
+
+bool Program::BInitRenderPass() {
+    //Both eyes are rendered in one pass: the view mask broadcasts every draw to each layer of the 2D_ARRAY attachments
+    const uint32_t un_view_mask = (1u << mv_view_config_views.size()) - 1;
+
+    VkRenderPassMultiviewCreateInfo vk_render_pass_multiview_create_info = {
+            .sType = VK_STRUCTURE_TYPE_RENDER_PASS_MULTIVIEW_CREATE_INFO,
+            .subpassCount = 1,
+            .pViewMasks = &un_view_mask,
+            .correlationMaskCount = 1,
+            .pCorrelationMasks = &un_view_mask,
+    };
+
+    {//Sample count, the largest the device supports for both attachments that does not exceed the request
+        VkPhysicalDeviceProperties vk_physical_device_properties;
+        vkGetPhysicalDeviceProperties(mvk_physical_device, &vk_physical_device_properties);
+
+        const uint32_t un_requested = mun_requested_sample_count != 0 ? mun_requested_sample_count.load()
+                                                                       : mv_view_config_views.front().recommendedSwapchainSampleCount;
+        const VkSampleCountFlags vk_supported = vk_physical_device_properties.limits.framebufferColorSampleCounts &
+                                                vk_physical_device_properties.limits.framebufferDepthSampleCounts;
+
+        mvk_sample_count = VK_SAMPLE_COUNT_1_BIT;
+        for (uint32_t un_samples = VK_SAMPLE_COUNT_8_BIT; un_samples > VK_SAMPLE_COUNT_1_BIT; un_samples >>= 1) {
+            if (un_samples <= un_requested && (vk_supported & un_samples) != 0) {
+                mvk_sample_count = static_cast<VkSampleCountFlagBits>(un_samples);
+                break;
             }
         }
+        Log("[XrProgram] Rendering with %u samples per pixel (%u requested)", static_cast<uint32_t>(mvk_sample_count), un_requested);
+    }
+    const bool b_multisampled = mvk_sample_count != VK_SAMPLE_COUNT_1_BIT;
+
+    //Multisampled attachments are cleared on load and dropped on store, so they never leave tile memory: color reaches the
+    //swapchain through the resolve at the end of the subpass. Single sampled, depth is stored for the depth pyramid.
+    VkAttachmentDescription vk_attachment_descriptions[] = {
+            {//Color
+                    .format = mswapchain_color.vk_format,
+                    .samples = mvk_sample_count,
+                    .loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+                    .storeOp = b_multisampled ? VK_ATTACHMENT_STORE_OP_DONT_CARE : VK_ATTACHMENT_STORE_OP_STORE,
+                    .stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+                    .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+                    .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+                    .finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+            },
+            {//Depth
+                    .format = mswapchain_depth.vk_format,
+                    .samples = mvk_sample_count,
+                    .loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+                    .storeOp = b_multisampled ? VK_ATTACHMENT_STORE_OP_DONT_CARE : VK_ATTACHMENT_STORE_OP_STORE,
+                    .stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+                    .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+                    .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+                    .finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+            },
+            {//Resolve, every pixel of the render area is overwritten so the previous contents are never loaded
+                    .format = mswapchain_color.vk_format,
+                    .samples = VK_SAMPLE_COUNT_1_BIT,
+                    .loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+                    .storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+                    .stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+                    .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+                    .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+                    .finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+            },
+    };
+
+    VkAttachmentReference vk_color_attachment_reference = {
+            .attachment = 0,
+            .layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+    };
+    VkAttachmentReference vk_depth_attachment_reference = {
+            .attachment = 1,
+            .layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+    };
+    VkAttachmentReference vk_resolve_attachment_reference = {
+            .attachment = 2,
+            .layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+    };
+
+    VkSubpassDescription vk_subpass_description = {
+            .pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS,
+            .colorAttachmentCount = 1,
+            .pColorAttachments = &vk_color_attachment_reference,
+            .pResolveAttachments = b_multisampled ? &vk_resolve_attachment_reference : nullptr,
+            .pDepthStencilAttachment = &vk_depth_attachment_reference,
+    };
+
+    //Also orders the previous frame's use of the shared multisampled attachments before this one's clear
+    VkSubpassDependency vk_subpass_dependency = {
+            .srcSubpass = VK_SUBPASS_EXTERNAL,
+            .dstSubpass = 0,
+            .srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+            .dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT,
+            .srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+            .dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
+                             VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+    };
+
+    VkRenderPassCreateInfo vk_render_pass_create_info = {
+            .sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO,
+            .pNext = &vk_render_pass_multiview_create_info,
+            .attachmentCount = b_multisampled ? 3u : 2u,
+            .pAttachments = vk_attachment_descriptions,
+            .subpassCount = 1,
+            .pSubpasses = &vk_subpass_description,
+            .dependencyCount = 1,
+            .pDependencies = &vk_subpass_dependency,
+    };
+    b_qualify_vk(vkCreateRenderPass(mvk_device, &vk_render_pass_create_info, nullptr, &mvk_render_pass));
+
+    //Nothing is stored to resume from with MSAA, the late cull phase needs the depth pyramid that is missing then as well
+    if (b_multisampled) {
+        return true;
     }
 
-    {//Vulkan pipeline setup
-        auto CreateShaderModule = [](VkDevice device, size_t size_buffer, const uint32_t *pun_buffer, VkShaderModule &out_vk_shader_module) {
-            VkShaderModuleCreateInfo vk_shader_module_create_info = {
-                    .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
-                    .codeSize = size_buffer,
-                    .pCode = pun_buffer,
-            };
+    //Same attachments picking up where mvk_render_pass left them, for draws after the depth pyramid has been rebuilt mid frame.
+    //Load ops and layouts do not affect render pass compatibility, pipelines and framebuffers work with both.
+    vk_attachment_descriptions[0].loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+    vk_attachment_descriptions[0].initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    vk_attachment_descriptions[1].loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+    vk_attachment_descriptions[1].initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 
-            b_qualify_vk(vkCreateShaderModule(device, &vk_shader_module_create_info, nullptr, &out_vk_shader_module));
+    vk_subpass_dependency.dstAccessMask |= VK_ACCESS_COLOR_ATTACHMENT_READ_BIT;
 
-            return true;
-        };
+    b_qualify_vk(vkCreateRenderPass(mvk_device, &vk_render_pass_create_info, nullptr, &mvk_render_pass_resume));
 
-        VkShaderModule vksm_vertex;
-        VkShaderModule vksm_fragment;
+    return true;
+}
 
-        {//Vertex shader
-            AAsset *passet_vertex = AAssetManager_open(mp_android_app->activity->assetManager, "shaders/shader.vert.spv", AASSET_MODE_BUFFER);
-            if (!CreateShaderModule(mvk_device, AAsset_getLength(passet_vertex), static_cast<const uint32_t *>(AAsset_getBuffer(passet_vertex)), vksm_vertex)) {
-                Log(LogError, "[XrProgram] Failed to create vertex shader!");
+bool Program::BInitPipelineCache() {
+    const std::string s_pipeline_cache_path = std::string(mp_android_app->activity->internalDataPath) + "/pipeline_cache.bin";
+    if (!m_pipeline_cache.BInit(mvk_device, mvk_physical_device, s_pipeline_cache_path, mb_pipeline_creation_feedback_supported)) {
+        Log(LogError, "[XrProgram] Failed to create pipeline cache!");
+        return false;
+    }
 
-                AAsset_close(passet_vertex);
-                return false;
-            }
+    return true;
+}
 
-            AAsset_close(passet_vertex);
+bool Program::BInitPipelineLayout() {
+    //Push constant ranges come straight from the reflection data generated alongside the embedded SPIR-V. Every layout
+    //gets the same ranges, otherwise they would not stay compatible for the frame set bound once per frame.
+    std::vector<VkPushConstantRange> v_push_constant_ranges;
+    for (const ShaderBlob *p_shader: {&k_shader_shader_vert, &k_shader_shader_frag, &k_shader_scene_vert}) {
+        if (p_shader->un_push_constant_size > 0) {
+            v_push_constant_ranges.push_back({
+                    .stageFlags = static_cast<VkShaderStageFlags>(p_shader->vk_stage),
+                    .offset = p_shader->un_push_constant_offset,
+                    .size = p_shader->un_push_constant_size,
+            });
         }
+    }
 
-        {//Fragment shader
-            AAsset *passet_fragment = AAssetManager_open(mp_android_app->activity->assetManager, "shaders/shader.frag.spv", AASSET_MODE_BUFFER);
-            if (!CreateShaderModule(mvk_device, AAsset_getLength(passet_fragment), static_cast<const uint32_t *>(AAsset_getBuffer(passet_fragment)), vksm_fragment)) {
-                Log(LogError, "[XrProgram] Failed to create fragment shader!");
+    {//Per frame set, uniform blocks in it are addressed through dynamic offsets into the frame's transient buffer
+        std::vector<VkDescriptorSetLayoutBinding> v_bindings =
+                CollectSetBindings({&k_shader_shader_vert, &k_shader_shader_frag, &k_shader_scene_vert, &k_shader_cull_comp}, k_un_frame_set);
 
-                AAsset_close(passet_fragment);
+        for (VkDescriptorSetLayoutBinding &vk_binding: v_bindings) {
+            if (vk_binding.descriptorType != VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER || vk_binding.binding >= std::size(k_asize_frame_uniform_ranges)) {
+                Log(LogError, "[XrProgram] Binding %u of the frame set has to be a uniform block listed in shader_uniforms.h", vk_binding.binding);
                 return false;
             }
+            vk_binding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+        }
 
-            AAsset_close(passet_fragment);
+        if (v_bindings.size() != std::size(k_asize_frame_uniform_ranges)) {
+            Log(LogError, "[XrProgram] Shaders declare %zu of the %zu frame set bindings", v_bindings.size(), std::size(k_asize_frame_uniform_ranges));
+            return false;
         }
 
-        VkPipelineShaderStageCreateInfo vk_pipeline_shader_stage_create_info[] = {
-                {
-                        .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
-                        .stage = VK_SHADER_STAGE_VERTEX_BIT,
-                        .module = vksm_vertex,
-                        .pName = "main"
-                },
-                {
-                        .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
-                        .stage = VK_SHADER_STAGE_FRAGMENT_BIT,
-                        .module = vksm_fragment,
-                        .pName = "main"
-                }
+        VkDescriptorSetLayoutCreateInfo vk_descriptor_set_layout_create_info = {
+                .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+                .bindingCount = static_cast<uint32_t>(v_bindings.size()),
+                .pBindings = v_bindings.data(),
         };
+        b_qualify_vk(vkCreateDescriptorSetLayout(mvk_device, &vk_descriptor_set_layout_create_info, nullptr, &mvk_frame_set_layout));
+    }
 
-        std::vector<VkDynamicState> vvk_dynamic_states = {
-        };
+    {//Scene set, the object and vertex buffers GpuCulling draws from
+        std::vector<VkDescriptorSetLayoutBinding> v_bindings = CollectSetBindings({&k_shader_scene_vert}, k_un_scene_set);
 
-        VkPipelineDynamicStateCreateInfo vk_pipeline_dynamic_state_create_info = {
-                .sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
-                .dynamicStateCount = static_cast<uint32_t>(vvk_dynamic_states.size()),
-                .pDynamicStates = vvk_dynamic_states.data()
+        VkDescriptorSetLayoutCreateInfo vk_descriptor_set_layout_create_info = {
+                .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+                .bindingCount = static_cast<uint32_t>(v_bindings.size()),
+                .pBindings = v_bindings.data(),
         };
+        b_qualify_vk(vkCreateDescriptorSetLayout(mvk_device, &vk_descriptor_set_layout_create_info, nullptr, &mvk_scene_set_layout));
+    }
 
+    VkPipelineLayoutCreateInfo vk_pipeline_layout_create_info = {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+            .setLayoutCount = 1,
+            .pSetLayouts = &mvk_frame_set_layout,
+            .pushConstantRangeCount = static_cast<uint32_t>(v_push_constant_ranges.size()),
+            .pPushConstantRanges = v_push_constant_ranges.data(),
+    };
+    b_qualify_vk(vkCreatePipelineLayout(mvk_device, &vk_pipeline_layout_create_info, nullptr, &mvk_pipeline_layout));
 
-        VkPipelineVertexInputStateCreateInfo vk_pipeline_vertex_input_state_create_info = {
-                .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
-                .vertexBindingDescriptionCount = 0,
-                .pVertexBindingDescriptions = nullptr,
-                .vertexAttributeDescriptionCount = 0,
-                .pVertexAttributeDescriptions = nullptr,
-        };
+    const VkDescriptorSetLayout avk_scene_set_layouts[] = {mvk_frame_set_layout, mvk_scene_set_layout};
+    vk_pipeline_layout_create_info.setLayoutCount = static_cast<uint32_t>(std::size(avk_scene_set_layouts));
+    vk_pipeline_layout_create_info.pSetLayouts = avk_scene_set_layouts;
+    b_qualify_vk(vkCreatePipelineLayout(mvk_device, &vk_pipeline_layout_create_info, nullptr, &mvk_scene_pipeline_layout));
 
-        VkPipelineInputAssemblyStateCreateInfo vk_input_assembly_create_info = {
-                .sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
-                .topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
-                .primitiveRestartEnable = VK_FALSE,
-        };
+    return true;
+}
 
-        VkPipelineRasterizationStateCreateInfo vk_rasterization_state_create_info = {
-                .sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
-                .depthClampEnable = VK_FALSE,
-                .polygonMode = VK_POLYGON_MODE_FILL,
-                .cullMode = VK_CULL_MODE_BACK_BIT,
-                .frontFace = VK_FRONT_FACE_CLOCKWISE,
-                .depthBiasEnable = VK_FALSE,
-                .lineWidth = 1.f,
+bool Program::BInitPipelines() {
+    auto CreateShaderModule = [](VkDevice device, const ShaderBlob &shader, VkShaderModule &out_vk_shader_module) {
+        VkShaderModuleCreateInfo vk_shader_module_create_info = {
+                .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+                .codeSize = shader.size_spirv,
+                .pCode = shader.pun_spirv,
         };
 
-        VkPipelineMultisampleStateCreateInfo vk_multisample_state_create_info = {
-                .sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO,
-                .rasterizationSamples = VK_SAMPLE_COUNT_1_BIT,
-        };
+        b_qualify_vk(vkCreateShaderModule(device, &vk_shader_module_create_info, nullptr, &out_vk_shader_module));
 
-        VkPipelineDepthStencilStateCreateInfo vk_depth_stencil_state_create_info = {
-                .sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO,
-                .depthTestEnable = VK_TRUE,
-                .depthWriteEnable = VK_TRUE,
-                .depthCompareOp = VK_COMPARE_OP_LESS,
-                .depthBoundsTestEnable = VK_FALSE,
-                .stencilTestEnable = VK_FALSE,
-                .front = {
-                        .failOp = VK_STENCIL_OP_KEEP,
-                        .passOp = VK_STENCIL_OP_KEEP,
-                        .depthFailOp = VK_STENCIL_OP_KEEP,
-                        .compareOp = VK_COMPARE_OP_ALWAYS,
-                },
-                .back = {
-                        .failOp = VK_STENCIL_OP_KEEP,
-                        .passOp = VK_STENCIL_OP_KEEP,
-                        .depthFailOp = VK_STENCIL_OP_KEEP,
-                        .compareOp = VK_COMPARE_OP_ALWAYS,
-                }
-        };
+        return true;
+    };
 
-        VkPipelineColorBlendAttachmentState vk_color_blend_attachment_state = {
-                .blendEnable = VK_FALSE,
-                .colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT,
-        };
+    VkShaderModule vksm_vertex;
+    VkShaderModule vksm_fragment;
 
-        VkPipelineLayoutCreateInfo vk_pipeline_layout_create_info = {
-                .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
-                .setLayoutCount = 0,
-                .pSetLayouts = nullptr,
-                .pushConstantRangeCount = 0,
-                .pPushConstantRanges = nullptr,
-        };
-        b_qualify_vk(vkCreatePipelineLayout(mvk_device, &vk_pipeline_layout_create_info, nullptr, &mvk_pipeline_layout));
+    if (!CreateShaderModule(mvk_device, k_shader_shader_vert, vksm_vertex)) {
+        Log(LogError, "[XrProgram] Failed to create vertex shader!");
+        return false;
     }
 
-    return true;
-}
-
-void Program::Tick() {
-    XrEventDataBuffer xr_event_buffer{XR_TYPE_EVENT_DATA_BUFFER};
-    while (XrResult result = xrPollEvent(mxr_instance, &xr_event_buffer)) {
-        switch (xr_event_buffer.type) {
-            case XR_TYPE_EVENT_DATA_SESSION_STATE_CHANGED: {
-                XrEventDataSessionStateChanged *pxr_session_state_changed = reinterpret_cast<XrEventDataSessionStateChanged *>(&xr_event_buffer);
-                if (pxr_session_state_changed->session != mxr_session) {
-                    Log("[XrProgram] Received session state changed for unknown session?!");
-                    break;
-                }
+    if (!CreateShaderModule(mvk_device, k_shader_shader_frag, vksm_fragment)) {
+        Log(LogError, "[XrProgram] Failed to create fragment shader!");
+        return false;
+    }
 
-                switch (pxr_session_state_changed->state) {
-                    case XR_SESSION_STATE_READY: {
-                        XrSessionBeginInfo xr_session_begin_info = {
-                                .type = XR_TYPE_SESSION_BEGIN_INFO,
-                                .primaryViewConfigurationType = me_app_view_type
-                        };
-                        v_qualify_xr(xrBeginSession(mxr_session, &xr_session_begin_info));
+    //Every shader program owns its modules, so the scene gets its own copy of the fragment shader
+    VkShaderModule vksm_scene_vertex;
+    VkShaderModule vksm_scene_fragment;
 
-                        break;
-                    }
+    if (!CreateShaderModule(mvk_device, k_shader_scene_vert, vksm_scene_vertex) ||
+        !CreateShaderModule(mvk_device, k_shader_shader_frag, vksm_scene_fragment)) {
+        Log(LogError, "[XrProgram] Failed to create scene shaders!");
+        return false;
+    }
 
-                    case XR_SESSION_STATE_STOPPING: {
-                        v_qualify_xr(xrEndSession(mxr_session));
-                        mb_session_running = false;
+    VkShaderModule vksm_visibility_mask_vertex;
+    VkShaderModule vksm_visibility_mask_fragment;
 
-                        break;
-                    }
+    if (!CreateShaderModule(mvk_device, k_shader_visibility_mask_vert, vksm_visibility_mask_vertex) ||
+        !CreateShaderModule(mvk_device, k_shader_visibility_mask_frag, vksm_visibility_mask_fragment)) {
+        Log(LogError, "[XrProgram] Failed to create visibility mask shaders!");
+        return false;
+    }
 
-                    case XR_SESSION_STATE_EXITING: {
-                        mb_session_running = false;
-                        mp_app_state->b_app_running = false;
+    //Sized every frame for the rendered resolution, pipelines take both as dynamic state
+    vvk_viewports = {
+            {
+                    .x = 0.f,
+                    .y = 0.f,
+                    .width = static_cast<float>(mswapchain_color.un_width),
+                    .height = static_cast<float>(mswapchain_color.un_height),
+                    .minDepth = 0.f,
+                    .maxDepth = 1.f,
+            }
+    };
+    vvk_scissors = {
+            {
+                    .offset = {0, 0},
+                    .extent = {mswapchain_color.un_width, mswapchain_color.un_height},
+            }
+    };
 
-                        break;
-                    }
+    const std::string s_manifest_path = std::string(mp_android_app->activity->internalDataPath) + "/pipeline_manifest.bin";
+    if (!m_pipeline_variants.BInit(mvk_device, &m_pipeline_cache, s_manifest_path)) {
+        Log(LogError, "[XrProgram] Failed to create pipeline variant cache!");
+        return false;
+    }
 
-                    case XR_SESSION_STATE_LOSS_PENDING: {
-                        mb_session_running = false;
-                        mp_app_state->b_app_running = false;
+    m_pipeline_variants.RegisterShaderProgram(ShaderProgramTriangle, {
+            .vksm_vertex = vksm_vertex,
+            .vksm_fragment = vksm_fragment,
+            .vk_pipeline_layout = mvk_pipeline_layout,
+    });
+    m_pipeline_variants.RegisterShaderProgram(ShaderProgramScene, {
+            .vksm_vertex = vksm_scene_vertex,
+            .vksm_fragment = vksm_scene_fragment,
+            .vk_pipeline_layout = mvk_scene_pipeline_layout,
+    });
+    m_pipeline_variants.RegisterShaderProgram(ShaderProgramVisibilityMask, {
+            .vksm_vertex = vksm_visibility_mask_vertex,
+            .vksm_fragment = vksm_visibility_mask_fragment,
+            .vk_pipeline_layout = mvk_pipeline_layout,
+            .v_vertex_bindings = {VisibilityMask::k_vk_vertex_binding},
+            .v_vertex_attributes = {std::begin(VisibilityMask::k_avk_vertex_attributes), std::end(VisibilityMask::k_avk_vertex_attributes)},
+    });
+    m_pipeline_variants.RegisterRenderPass(ERenderPassForSamples(mvk_sample_count), mvk_render_pass, mvk_sample_count);
+
+    m_pipeline_desc_main = {
+            .un_shader_program = ShaderProgramTriangle,
+            .un_render_pass = ERenderPassForSamples(mvk_sample_count),
+            .e_sample_count = mvk_sample_count,
+    };
+
+    //Variants drawn last run are compiled now, anything new is compiled on first use
+    m_pipeline_variants.Prewarm();
+
+    m_pipeline_desc_scene = m_pipeline_desc_main;
+    m_pipeline_desc_scene.un_shader_program = ShaderProgramScene;
+
+    //Pushes the hidden area to the near plane regardless of what is there, the runtime's winding is not specified
+    m_pipeline_desc_visibility_mask = m_pipeline_desc_main;
+    m_pipeline_desc_visibility_mask.un_shader_program = ShaderProgramVisibilityMask;
+    m_pipeline_desc_visibility_mask.un_cull_mode = VK_CULL_MODE_NONE;
+    m_pipeline_desc_visibility_mask.e_depth_compare_op = VK_COMPARE_OP_ALWAYS;
+    m_pipeline_desc_visibility_mask.un_color_write_mask = 0;
+
+    if (m_pipeline_variants.GetPipeline(m_pipeline_desc_main) == VK_NULL_HANDLE ||
+        m_pipeline_variants.GetPipeline(m_pipeline_desc_scene) == VK_NULL_HANDLE) {
+        Log(LogError, "[XrProgram] Failed to create main pipeline!");
+        return false;
+    }
 
-                        break;
-                    }
+    return true;
+}
 
-                    default: {
-                        Log(LogWarning, "[XrProgram] SESSION_STATE_CHANGED: Unhandled event: %i", pxr_session_state_changed->state);
-                        break;
-                    }
-                }
+bool Program::BInitFramebuffers() {
+    const bool b_multisampled = mvk_sample_count != VK_SAMPLE_COUNT_1_BIT;
 
-                break;
-            }
+    //Waits for the frame graph to have placed the multisampled attachments
+    if (b_multisampled && (mvk_msaa_color_view == VK_NULL_HANDLE || mvk_msaa_depth_view == VK_NULL_HANDLE)) {
+        return true;
+    }
 
-            case XR_TYPE_EVENT_DATA_EVENTS_LOST: {
-                XrEventDataEventsLost *p_events_lost = reinterpret_cast<XrEventDataEventsLost *>(&xr_event_buffer);
-                Log(LogWarning, "[XrProgram] EVENTS_LOST: Lost events: %i", p_events_lost->lostEventCount);
-                break;
-            }
+    const uint32_t un_depth_images = UnFramebufferDepthImages();
+    mv_framebuffers.resize(mswapchain_color.un_image_count * un_depth_images);
+    for (uint32_t i = 0; i < mv_framebuffers.size(); i++) {
+        const uint32_t un_color_image = i / un_depth_images;
+        const uint32_t un_depth_image = i % un_depth_images;
+        VkImageView vk_attachments[] = {
+                mswapchain_color.v_image_views[un_color_image],
+                mswapchain_depth.v_image_views[un_depth_image],
+        };
+        VkImageView vk_multisampled_attachments[] = {
+                mvk_msaa_color_view,
+                mvk_msaa_depth_view,
+                mswapchain_color.v_image_views[un_color_image],
+        };
 
-            case XR_TYPE_EVENT_DATA_INSTANCE_LOSS_PENDING: {
-                XrEventDataInstanceLossPending *pxr_instance_loss_pending = reinterpret_cast<XrEventDataInstanceLossPending *>(&xr_event_buffer);
+        //multiview framebuffers have a single layer, the view mask selects the array layers
+        VkFramebufferCreateInfo vk_framebuffer_create_info = {
+                .sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,
+                .renderPass = mvk_render_pass,
+                .attachmentCount = b_multisampled ? static_cast<uint32_t>(std::size(vk_multisampled_attachments))
+                                                  : static_cast<uint32_t>(std::size(vk_attachments)),
+                .pAttachments = b_multisampled ? vk_multisampled_attachments : vk_attachments,
+                .width = mswapchain_color.un_width,
+                .height = mswapchain_color.un_height,
+                .layers = 1,
+        };
+        b_qualify_vk(vkCreateFramebuffer(mvk_device, &vk_framebuffer_create_info, nullptr, &mv_framebuffers[i]));
+    }
 
-                mp_app_state->b_app_running = false;
-                mb_session_running = false;
-                break;
-            }
+    return true;
+}
 
-            default: {
-                break;
-            }
-        }
+void Program::DestroyFramebuffers() {
+    for (VkFramebuffer vk_framebuffer: mv_framebuffers) {
+        vkDestroyFramebuffer(mvk_device, vk_framebuffer, nullptr);
     }
+    mv_framebuffers.clear();
 
-    Log("hi");
+    //The views stay the render graph's
+    mvk_msaa_color_view = mvk_msaa_depth_view = VK_NULL_HANDLE;
+    mun_msaa_placement_generation = UINT64_MAX;
+}
 
-    XrFrameState xr_frame_state{XR_TYPE_FRAME_STATE};
-    {//Wait frame
-        XrFrameWaitInfo xr_frame_wait_info = {
-                .type = XR_TYPE_FRAME_WAIT_INFO,
-        };
-        v_qualify_xr(xrWaitFrame(mxr_session, &xr_frame_wait_info, &xr_frame_state));
+bool Program::BApplySampleCount() {
+    //Every frame still in flight renders through what is about to be destroyed
+    if (!m_frame_ring.BWaitIdle()) {
+        return false;
+    }
+
+    //The recreated pass and framebuffers may well reuse the destroyed handles, so versions cannot tell them apart
+    m_command_buffer_cache.Invalidate();
+
+    //The current targets are set aside while those for the new sample count are created, and stay if that fails
+    VkSampleCountFlagBits vk_sample_count = VK_SAMPLE_COUNT_1_BIT;
+    VkRenderPass vk_render_pass = VK_NULL_HANDLE;
+    VkRenderPass vk_render_pass_resume = VK_NULL_HANDLE;
+    std::vector<VkFramebuffer> vvk_framebuffers;
+    VkImageView vk_msaa_color_view = VK_NULL_HANDLE;
+    VkImageView vk_msaa_depth_view = VK_NULL_HANDLE;
+    uint64_t un_msaa_placement_generation = UINT64_MAX;
+    auto SwapTargets = [&] {
+        std::swap(mvk_sample_count, vk_sample_count);
+        std::swap(mvk_render_pass, vk_render_pass);
+        std::swap(mvk_render_pass_resume, vk_render_pass_resume);
+        std::swap(mv_framebuffers, vvk_framebuffers);
+        std::swap(mvk_msaa_color_view, vk_msaa_color_view);
+        std::swap(mvk_msaa_depth_view, vk_msaa_depth_view);
+        std::swap(mun_msaa_placement_generation, un_msaa_placement_generation);
+    };
+    auto DestroyTargets = [&] {
+        DestroyFramebuffers();
+        vkDestroyRenderPass(mvk_device, mvk_render_pass, nullptr);
+        vkDestroyRenderPass(mvk_device, mvk_render_pass_resume, nullptr);
+        mvk_render_pass = mvk_render_pass_resume = VK_NULL_HANDLE;
+    };
+
+    SwapTargets();
+    if (!BInitRenderPass() || !BInitFramebuffers()) {
+        Log(LogError, "[XrProgram] Failed to switch to %u samples per pixel, keeping %u", static_cast<uint32_t>(mvk_sample_count),
+            static_cast<uint32_t>(vk_sample_count));
+        DestroyTargets();
+        SwapTargets();
+        return false;
     }
 
-    {
+    //Only the old targets go, the new ones are back in place after
+    SwapTargets();
+    DestroyTargets();
+    SwapTargets();
 
+    //Depth is only stored, and so only reduced, without MSAA
+    m_hiz_pyramid.SetDepthSamples(mvk_sample_count);
+
+    //Pipelines already created for a sample count stay compatible with the pass recreated for it
+    m_pipeline_variants.RegisterRenderPass(ERenderPassForSamples(mvk_sample_count), mvk_render_pass, mvk_sample_count);
+    for (PipelineDesc *p_desc: {&m_pipeline_desc_main, &m_pipeline_desc_scene, &m_pipeline_desc_visibility_mask}) {
+        p_desc->un_render_pass = ERenderPassForSamples(mvk_sample_count);
+        p_desc->e_sample_count = mvk_sample_count;
     }
+
+    return true;
 }
 
-Program::~Program() {
+bool Program::BInitGpuAllocator() {
+    if (!m_gpu_allocator.BInit(mvk_device, mvk_physical_device)) {
+        Log(LogError, "[XrProgram] Failed to create GPU allocator!");
+        return false;
+    }
+
+    return true;
+}
+
+bool Program::BInitFrameRing() {
+    if (!m_frame_ring.BInit(mvk_device, &m_gpu_allocator, mvkindex_queue_family, mun_frames_in_flight, k_size_frame_transient)) {
+        Log(LogError, "[XrProgram] Failed to create frame contexts!");
+        return false;
+    }
+
+    {//GPU frame times drive the render resolution, without them it stays at the recommended size
+        VkPhysicalDeviceProperties vk_physical_device_properties;
+        vkGetPhysicalDeviceProperties(mvk_physical_device, &vk_physical_device_properties);
+
+        uint32_t un_queue_family_count = 0;
+        vkGetPhysicalDeviceQueueFamilyProperties(mvk_physical_device, &un_queue_family_count, nullptr);
+        std::vector<VkQueueFamilyProperties> v_queue_family_properties(un_queue_family_count);
+        vkGetPhysicalDeviceQueueFamilyProperties(mvk_physical_device, &un_queue_family_count, v_queue_family_properties.data());
+
+        m_frame_ring.BInitTimestamps(vk_physical_device_properties.limits.timestampPeriod,
+                                     v_queue_family_properties[mvkindex_queue_family].timestampValidBits);
+    }
+
+    return true;
+}
+
+bool Program::BInitRenderGraph() {
+    if (!m_render_graph.BInit(mvk_device, &m_gpu_allocator, &m_frame_ring)) {
+        Log(LogError, "[XrProgram] Failed to create render graph!");
+        return false;
+    }
+
+    return true;
+}
+
+bool Program::BInitUniformSets() {
+    VkPhysicalDeviceProperties vk_physical_device_properties;
+    vkGetPhysicalDeviceProperties(mvk_physical_device, &vk_physical_device_properties);
+
+    const uint32_t un_binding_count = static_cast<uint32_t>(std::size(k_asize_frame_uniform_ranges));
+    if (!m_frame_ring.BInitUniformSets(mvk_frame_set_layout, k_asize_frame_uniform_ranges, un_binding_count,
+                                       vk_physical_device_properties.limits.minUniformBufferOffsetAlignment)) {
+        Log(LogError, "[XrProgram] Failed to create per frame descriptor sets!");
+        return false;
+    }
+
+    return true;
+}
+
+bool Program::BInitUploadManager() {
+    std::mutex *p_queue_mutex = mvk_transfer_queue == mvk_queue ? &mmutex_graphics_queue : nullptr;
+    if (!m_upload_manager.BInit(mvk_device, &m_gpu_allocator, mvkindex_transfer_queue_family, mvk_transfer_queue, mvkindex_queue_family, p_queue_mutex,
+                                k_size_upload_staging)) {
+        Log(LogError, "[XrProgram] Failed to create upload manager!");
+        return false;
+    }
+
+    return true;
+}
+
+bool Program::BInitHiZPyramid() {
+    if (!m_hiz_pyramid.BInit(mvk_device, &m_gpu_allocator, &m_pipeline_cache, mswapchain_depth.v_image_views, mvk_sample_count,
+                             mswapchain_depth.un_width, mswapchain_depth.un_height, static_cast<uint32_t>(mv_view_config_views.size()))) {
+        Log(LogError, "[XrProgram] Failed to create the depth pyramid!");
+        return false;
+    }
+
+    return true;
+}
+
+bool Program::BInitGpuCulling() {
+    if (!m_gpu_culling.BInit(mvk_device, &m_gpu_allocator, &m_upload_manager, &m_pipeline_cache, mvk_frame_set_layout, mvk_scene_set_layout,
+                             &m_hiz_pyramid, m_gpu_culling_features, mun_frames_in_flight)) {
+        Log(LogError, "[XrProgram] Failed to create GPU culling!");
+        return false;
+    }
+
+    std::vector<GpuVertex> v_vertices;
+    std::vector<uint32_t> v_indices;
+    GpuMesh mesh = {.n_vertex_offset = 0};
+
+    {//Sphere of diameter 1, one LOD per tessellation with half the segments of the one before
+        const uint32_t aun_lod_segments[k_un_max_mesh_lods] = {48, 24, 12, 6};
+
+        for (uint32_t un_segments: aun_lod_segments) {
+            const uint32_t un_rings = un_segments / 2;
+            const uint32_t un_first_vertex = static_cast<uint32_t>(v_vertices.size());
+
+            //Ring 0 is the top pole, segment 0 and un_segments overlap so that every ring closes with its own vertex
+            for (uint32_t un_ring = 0; un_ring <= un_rings; un_ring++) {
+                const float f_theta = k_f_pi * static_cast<float>(un_ring) / static_cast<float>(un_rings);
+                for (uint32_t un_segment = 0; un_segment <= un_segments; un_segment++) {
+                    const float f_phi = 2.f * k_f_pi * static_cast<float>(un_segment) / static_cast<float>(un_segments);
+                    const float af_normal[3] = {std::sin(f_theta) * std::cos(f_phi), std::cos(f_theta), std::sin(f_theta) * std::sin(f_phi)};
+
+                    v_vertices.push_back({
+                            .af_position = {af_normal[0] * 0.5f, af_normal[1] * 0.5f, af_normal[2] * 0.5f, 1.f},
+                            .af_color = {0.5f + af_normal[0] * 0.4f, 0.5f + af_normal[1] * 0.4f, 0.5f + af_normal[2] * 0.4f, 1.f},
+                    });
+                }
+            }
+
+            //Seen from outside, segments run counter-clockwise against the rings, front faces are clockwise. Triangles
+            //collapsing into a pole are left out.
+            GpuMeshLod &lod = mesh.a_lods[mesh.un_lod_count++];
+            lod.un_first_index = static_cast<uint32_t>(v_indices.size());
+
+            const uint32_t un_row = un_segments + 1;
+            for (uint32_t un_ring = 0; un_ring < un_rings; un_ring++) {
+                for (uint32_t un_segment = 0; un_segment < un_segments; un_segment++) {
+                    const uint32_t un_a = un_first_vertex + un_ring * un_row + un_segment;
+                    const uint32_t un_b = un_a + 1;
+                    const uint32_t un_c = un_a + un_row + 1;
+                    const uint32_t un_d = un_a + un_row;
+
+                    if (un_ring > 0) {
+                        v_indices.insert(v_indices.end(), {un_a, un_c, un_b});
+                    }
+                    if (un_ring < un_rings - 1) {
+                        v_indices.insert(v_indices.end(), {un_a, un_d, un_c});
+                    }
+                }
+            }
+            lod.un_index_count = static_cast<uint32_t>(v_indices.size()) - lod.un_first_index;
+
+            //Faces span pi / un_segments both ways, their centers sit deepest below the surface
+            const float f_half_angle_cos = std::cos(k_f_pi / static_cast<float>(un_segments));
+            lod.f_error = mesh.un_lod_count == 1 ? 0.f : 0.5f * (1.f - f_half_angle_cos * f_half_angle_cos);
+        }
+    }
+
+    const std::vector<GpuMesh> v_meshes = {mesh};
+
+    {//Grid of spheres on the floor around the origin, most of it outside the view at any time
+        const float f_half_extent = (k_un_scene_grid_size - 1) * k_f_scene_grid_spacing * 0.5f;
+        const SceneNode grid_node = m_scene.CreateNode(Scene::k_un_no_node, k_xr_pose_identity, 1.f);
+
+        for (uint32_t un_z = 0; un_z < k_un_scene_grid_size; un_z++) {
+            for (uint32_t un_x = 0; un_x < k_un_scene_grid_size; un_x++) {
+                const float f_x = un_x * k_f_scene_grid_spacing - f_half_extent;
+                const float f_z = un_z * k_f_scene_grid_spacing - f_half_extent;
+
+                //Leave room around the user
+                if (std::abs(f_x) < 1.f && std::abs(f_z) < 1.f) {
+                    continue;
+                }
+
+                //Cheap hash for sizes between 0.2 and 0.6 m
+                const uint32_t un_hash = (un_x * 73856093u) ^ (un_z * 19349663u);
+                const float f_scale = 0.2f + static_cast<float>(un_hash % 1024) / 1023.f * 0.4f;
+
+                const XrPosef xr_pose = {.orientation = {0.f, 0.f, 0.f, 1.f}, .position = {f_x, f_scale * 0.5f, f_z}};
+                m_scene.CreateObject(grid_node, xr_pose, f_scale, 0, {0.f, 0.f, 0.f, 0.5f});
+            }
+        }
+    }
+    m_scene.Update();
+
+    std::vector<GpuObject> v_objects(m_scene.UnObjectCount());
+    for (uint32_t i = 0; i < m_scene.UnObjectCount(); i++) {
+        v_objects[i] = {
+                .mat4_model = m_scene.GetWorldMatrix(m_scene.GetObjectNode(i)),
+                .af_bounding_sphere = {m_scene.PCentersX()[i], m_scene.PCentersY()[i], m_scene.PCentersZ()[i], m_scene.PRadii()[i]},
+                .un_mesh = m_scene.PMeshes()[i],
+        };
+    }
+
+    if (!m_gpu_culling.BSetScene(v_vertices, v_indices, v_meshes, v_objects)) {
+        Log(LogError, "[XrProgram] Failed to set up the scene!");
+        return false;
+    }
+
+    m_lod_selector.SetMeshes(v_meshes);
+
+    return true;
+}
+
+bool Program::BInitVisibilityMask() {
+    if (!mb_visibility_mask_supported) {
+        Log(LogWarning, "[XrProgram] %s is not supported, hidden areas are shaded", XR_KHR_VISIBILITY_MASK_EXTENSION_NAME);
+        return true;
+    }
+
+    //Only an optimization, frames render the same without it
+    if (!m_visibility_mask.BInit(mxr_instance, mxr_session, me_app_view_type, static_cast<uint32_t>(mv_view_config_views.size()))) {
+        Log(LogWarning, "[XrProgram] Failed to fetch the hidden area meshes, hidden areas are shaded");
+    }
+
+    return true;
+}
+
+bool Program::BInitCompositionLayers() {
+    if (!m_composition_layers.BInit(mxr_session, mswapchain_color.vk_format, mb_cylinder_supported)) {
+        Log(LogError, "[XrProgram] Failed to create composition layers!");
+        return false;
+    }
+
+    //Resolution scale readout in front of the user, a bar that is full at the recommended resolution
+    mun_hud_layer = m_composition_layers.UnAdd({
+            .e_shape = CompositionLayerQuad,
+            .un_width = k_un_hud_width,
+            .un_height = k_un_hud_height,
+            .xr_space = mxr_app_space,
+            .xr_pose = {.orientation = {0.f, 0.f, 0.f, 1.f}, .position = {0.f, 0.9f, -1.f}},
+            .xr_size = {0.4f, 0.4f * k_un_hud_height / k_un_hud_width},
+            .record = [this](VkCommandBuffer vk_command_buffer, VkImage vk_image, const VkExtent2D &vk_extent) {
+                RecordHud(vk_command_buffer, vk_image, vk_extent);
+            },
+    });
+    if (mun_hud_layer == UINT32_MAX) {
+        Log(LogWarning, "[XrProgram] Failed to create the HUD layer, running without it");
+    }
+
+    return true;
+}
+
+bool Program::BInitCommandBufferCache() {
+    if (!m_command_buffer_cache.BInit(mvk_device, mvkindex_queue_family, mswapchain_color.un_image_count * mswapchain_depth.un_image_count,
+                                      m_frame_ring.UnDepth())) {
+        Log(LogError, "[XrProgram] Failed to create command buffer cache!");
+        return false;
+    }
+
+    return true;
+}
+
+bool Program::BInitParallelRecorder() {
+    if (!m_parallel_recorder.BInit(mvk_device, mvkindex_queue_family, m_frame_ring.UnDepth())) {
+        Log(LogError, "[XrProgram] Failed to create parallel recorder!");
+        return false;
+    }
+
+    return true;
+}
+
+bool Program::BInitAsyncCompute() {
+    if (mvk_compute_queue == VK_NULL_HANDLE) {
+        Log("[XrProgram] No queue left for async compute, culling runs on the graphics queue");
+        return true;
+    }
+
+    //Not fatal, compute work falls back to the graphics queue
+    mb_async_compute = m_async_compute.BInit(mvk_device, mvkindex_queue_family, mvk_compute_queue, m_frame_ring.UnDepth());
+    if (!mb_async_compute) {
+        Log(LogWarning, "[XrProgram] Failed to set up async compute, culling runs on the graphics queue");
+        m_async_compute.Destroy();
+    }
+
+    return true;
+}
+
+void Program::Tick() {
+    XrEventDataBuffer xr_event_buffer{XR_TYPE_EVENT_DATA_BUFFER};
+    while (xrPollEvent(mxr_instance, &xr_event_buffer) == XR_SUCCESS) {
+        switch (xr_event_buffer.type) {
+            case XR_TYPE_EVENT_DATA_SESSION_STATE_CHANGED: {
+                XrEventDataSessionStateChanged *pxr_session_state_changed = reinterpret_cast<XrEventDataSessionStateChanged *>(&xr_event_buffer);
+                if (pxr_session_state_changed->session != mxr_session) {
+                    Log("[XrProgram] Received session state changed for unknown session?!");
+                    break;
+                }
+
+                switch (pxr_session_state_changed->state) {
+                    case XR_SESSION_STATE_READY: {
+                        XrSessionBeginInfo xr_session_begin_info = {
+                                .type = XR_TYPE_SESSION_BEGIN_INFO,
+                                .primaryViewConfigurationType = me_app_view_type
+                        };
+                        v_qualify_xr(xrBeginSession(mxr_session, &xr_session_begin_info));
+                        mb_session_running = true;
+
+                        StartFrameThreads();
+
+                        break;
+                    }
+
+                    case XR_SESSION_STATE_STOPPING: {
+                        StopFrameThreads();
+
+                        v_qualify_xr(xrEndSession(mxr_session));
+                        mb_session_running = false;
+
+                        break;
+                    }
+
+                    case XR_SESSION_STATE_EXITING: {
+                        StopFrameThreads();
+                        mb_session_running = false;
+                        mp_app_state->b_app_running = false;
+
+                        break;
+                    }
+
+                    case XR_SESSION_STATE_LOSS_PENDING: {
+                        StopFrameThreads();
+                        mb_session_running = false;
+                        mp_app_state->b_app_running = false;
+
+                        break;
+                    }
+
+                    default: {
+                        Log(LogWarning, "[XrProgram] SESSION_STATE_CHANGED: Unhandled event: %i", pxr_session_state_changed->state);
+                        break;
+                    }
+                }
+
+                break;
+            }
+
+            case XR_TYPE_EVENT_DATA_VISIBILITY_MASK_CHANGED_KHR: {
+                XrEventDataVisibilityMaskChangedKHR *pxr_visibility_mask_changed = reinterpret_cast<XrEventDataVisibilityMaskChangedKHR *>(&xr_event_buffer);
+                if (pxr_visibility_mask_changed->session == mxr_session && pxr_visibility_mask_changed->viewConfigurationType == me_app_view_type) {
+                    m_visibility_mask.MarkChanged(pxr_visibility_mask_changed->viewIndex);
+                }
+                break;
+            }
+
+            case XR_TYPE_EVENT_DATA_EVENTS_LOST: {
+                XrEventDataEventsLost *p_events_lost = reinterpret_cast<XrEventDataEventsLost *>(&xr_event_buffer);
+                Log(LogWarning, "[XrProgram] EVENTS_LOST: Lost events: %i", p_events_lost->lostEventCount);
+                break;
+            }
+
+            case XR_TYPE_EVENT_DATA_INSTANCE_LOSS_PENDING: {
+                XrEventDataInstanceLossPending *pxr_instance_loss_pending = reinterpret_cast<XrEventDataInstanceLossPending *>(&xr_event_buffer);
+
+                StopFrameThreads();
+                mp_app_state->b_app_running = false;
+                mb_session_running = false;
+                break;
+            }
+
+            default: {
+                break;
+            }
+        }
+
+        xr_event_buffer = {XR_TYPE_EVENT_DATA_BUFFER};
+    }
+
+    //The simulation thread stops on its own once it cannot wait for frames anymore, while the session still expects them
+    if (mb_session_running && !mb_frame_threads_running) {
+        Log(LogWarning, "[XrProgram] Frame threads stopped while the session is running, restarting them");
+        StartFrameThreads();
+    }
+
+    //Pipelines compiled on first use after startup, like those of another sample count
+    if (std::chrono::steady_clock::now() - mtime_pipeline_caches_saved >= k_duration_pipeline_cache_save) {
+        SavePipelineCaches();
+    }
+}
+
+void Program::SavePipelineCaches() {
+    mtime_pipeline_caches_saved = std::chrono::steady_clock::now();
+
+    m_pipeline_cache.BSaveIfDirty();
+    m_pipeline_variants.BWriteManifestIfDirty();
+}
+
+void Program::StartFrameThreads() {
+    if (mb_frame_threads_running) {
+        return;
+    }
+
+    //Joins threads that stopped on their own
+    StopFrameThreads();
+
+    m_frame_exchange.Reset();
+    mb_frame_threads_running = true;
+
+    mthread_render = std::thread(&Program::RenderThreadMain, this);
+    mthread_simulation = std::thread(&Program::SimulationThreadMain, this);
+}
+
+void Program::StopFrameThreads() {
+    //The simulation thread finishes its current frame and closes the exchange, the render thread then drains it. Both may
+    //have stopped already.
+    mb_frame_threads_running = false;
+
+    if (mthread_simulation.joinable()) {
+        mthread_simulation.join();
+    }
+    if (mthread_render.joinable()) {
+        mthread_render.join();
+    }
+}
+
+void Program::SimulationThreadMain() {
+    pthread_setname_np(pthread_self(), "qov_simulation");
+
+    uint64_t un_frame_index = 0;
+    while (mb_frame_threads_running) {
+        XrFrameState xr_frame_state{XR_TYPE_FRAME_STATE};
+        {//Wait frame
+            XrFrameWaitInfo xr_frame_wait_info = {
+                    .type = XR_TYPE_FRAME_WAIT_INFO,
+            };
+
+            XrResult xr_result = xrWaitFrame(mxr_session, &xr_frame_wait_info, &xr_frame_state);
+            if (XR_FAILED(xr_result)) {
+                Log(LogError, "[XrProgram] xrWaitFrame failed with: %i", xr_result);
+                break;
+            }
+        }
+
+        //A waited frame is handed on even if a stop came in meanwhile, the runtime expects it to be begun and ended. The render
+        //thread does both for every frame published before Close.
+        //Blocks only if the render thread still holds every slot
+        FrameData *p_frame_data = m_frame_exchange.PAcquireWrite();
+
+        p_frame_data->un_frame_index = un_frame_index++;
+        p_frame_data->xr_frame_state = xr_frame_state;
+
+        Simulate(*p_frame_data);
+
+        m_frame_exchange.Publish();
+    }
+
+    //Also when leaving on an error, so the main thread sees the frame threads have stopped. Woken up right away, it restarts
+    //or joins them on its next tick.
+    const bool b_stopped_on_own = mb_frame_threads_running.exchange(false);
+    m_frame_exchange.Close();
+    if (b_stopped_on_own) {
+        ALooper_wake(mp_android_app->looper);
+    }
+}
+
+void Program::Simulate(FrameData &frame_data) {
+    //Game state is advanced to the time the frame will be displayed, not the time it is simulated
+    frame_data.d_sim_time_s = static_cast<double>(frame_data.xr_frame_state.predictedDisplayTime) * 1e-9;
+}
+
+void Program::RenderThreadMain() {
+    pthread_setname_np(pthread_self(), "qov_render");
+
+    //Waits on its forks by running their jobs alongside the workers
+    m_job_system.AttachThread();
+
+    while (FrameData *p_frame_data = m_frame_exchange.PAcquireRead()) {
+        RenderFrame(*p_frame_data);
+
+        m_frame_exchange.ReleaseRead();
+    }
+
+    m_job_system.DetachThread();
+}
+
+void Program::RenderFrame(const FrameData &frame_data) {
+    const XrFrameState &xr_frame_state = frame_data.xr_frame_state;
+
+    {//Begin frame
+        XrFrameBeginInfo xr_frame_begin_info = {
+                .type = XR_TYPE_FRAME_BEGIN_INFO,
+        };
+        //The runtime may submit to the graphics queue in here, which uploads can share
+        std::lock_guard<std::mutex> lock_queue(mmutex_graphics_queue);
+        v_qualify_xr(xrBeginFrame(mxr_session, &xr_frame_begin_info));
+    }
+
+    std::vector<XrCompositionLayerBaseHeader *> v_layers;
+    std::vector<XrCompositionLayerProjectionView> v_projection_views(mv_views.size(), {XR_TYPE_COMPOSITION_LAYER_PROJECTION_VIEW});
+
+    XrCompositionLayerProjection xr_layer_projection = {
+            .type = XR_TYPE_COMPOSITION_LAYER_PROJECTION,
+            .space = mxr_app_space,
+            .viewCount = static_cast<uint32_t>(v_projection_views.size()),
+            .views = v_projection_views.data(),
+    };
+
+    if (xr_frame_state.shouldRender && BRenderFrame(frame_data, v_projection_views)) {
+        v_layers.push_back(reinterpret_cast<XrCompositionLayerBaseHeader *>(&xr_layer_projection));
+    }
+
+    //Layers that did not change resubmit the image they released last
+    if (xr_frame_state.shouldRender) {
+        m_composition_layers.AppendLayers(v_layers);
+    }
+
+    {//End frame
+        XrFrameEndInfo xr_frame_end_info = {
+                .type = XR_TYPE_FRAME_END_INFO,
+                .displayTime = xr_frame_state.predictedDisplayTime,
+                .environmentBlendMode = XR_ENVIRONMENT_BLEND_MODE_OPAQUE,
+                .layerCount = static_cast<uint32_t>(v_layers.size()),
+                .layers = v_layers.data(),
+        };
+        std::lock_guard<std::mutex> lock_queue(mmutex_graphics_queue);
+        v_qualify_xr(xrEndFrame(mxr_session, &xr_frame_end_info));
+    }
+}
+
+bool Program::BRenderFrame(const FrameData &frame_data, std::vector<XrCompositionLayerProjectionView> &v_projection_views) {
+    if (mb_sample_count_changed.exchange(false) && !BApplySampleCount()) {
+        return false;
+    }
+
+    {//Locate views
+        XrViewLocateInfo xr_view_locate_info = {
+                .type = XR_TYPE_VIEW_LOCATE_INFO,
+                .viewConfigurationType = me_app_view_type,
+                .displayTime = frame_data.xr_frame_state.predictedDisplayTime,
+                .space = mxr_app_space,
+        };
+        XrViewState xr_view_state{XR_TYPE_VIEW_STATE};
+
+        uint32_t un_view_count;
+        b_qualify_xr(xrLocateViews(mxr_session, &xr_view_locate_info, &xr_view_state, mv_views.size(), &un_view_count, mv_views.data()));
+
+        if ((xr_view_state.viewStateFlags & XR_VIEW_STATE_POSITION_VALID_BIT) == 0 ||
+            (xr_view_state.viewStateFlags & XR_VIEW_STATE_ORIENTATION_VALID_BIT) == 0) {
+            return false;
+        }
+    }
+
+    //Whichever return leaves the frame from here on, what it acquired goes back and no command buffer is left recording
+    struct FrameCleanup {
+        Program &program;
+        bool b_color_acquired = false;
+        bool b_depth_acquired = false;
+        VkCommandBuffer vk_recording_command_buffer = VK_NULL_HANDLE;
+        bool b_submitted = false;
+
+        ~FrameCleanup() {
+            if (vk_recording_command_buffer != VK_NULL_HANDLE) {
+                vkEndCommandBuffer(vk_recording_command_buffer);
+            }
+
+            XrSwapchainImageReleaseInfo xr_release_info{XR_TYPE_SWAPCHAIN_IMAGE_RELEASE_INFO};
+            if (b_color_acquired && XR_FAILED(xrReleaseSwapchainImage(program.mswapchain_color.swapchain, &xr_release_info))) {
+                Log(LogError, "[XrProgram] Failed to release the color image of a dropped frame");
+            }
+            if (b_depth_acquired && XR_FAILED(xrReleaseSwapchainImage(program.mswapchain_depth.swapchain, &xr_release_info))) {
+                Log(LogError, "[XrProgram] Failed to release the depth image of a dropped frame");
+            }
+
+            //Acquires that never reached the queue are recorded again by the next frame
+            if (!b_submitted) {
+                program.m_composition_layers.ReleaseUnsubmitted();
+                program.m_upload_manager.RollbackGraphicsAcquires();
+            }
+        }
+    } frame_cleanup{*this};
+
+    //Multisampled depth never leaves tile memory, the depth swapchain only takes part without MSAA
+    const bool b_depth_stored = mvk_sample_count == VK_SAMPLE_COUNT_1_BIT;
+
+    uint32_t un_color_image_index;
+    uint32_t un_depth_image_index = 0;
+    {//Acquire swapchain images
+        XrSwapchainImageAcquireInfo xr_acquire_info{XR_TYPE_SWAPCHAIN_IMAGE_ACQUIRE_INFO};
+        XrSwapchainImageWaitInfo xr_wait_info = {
+                .type = XR_TYPE_SWAPCHAIN_IMAGE_WAIT_INFO,
+                .timeout = XR_INFINITE_DURATION,
+        };
+
+        b_qualify_xr(xrAcquireSwapchainImage(mswapchain_color.swapchain, &xr_acquire_info, &un_color_image_index));
+        frame_cleanup.b_color_acquired = true;
+        b_qualify_xr(xrWaitSwapchainImage(mswapchain_color.swapchain, &xr_wait_info));
+
+        if (b_depth_stored) {
+            b_qualify_xr(xrAcquireSwapchainImage(mswapchain_depth.swapchain, &xr_acquire_info, &un_depth_image_index));
+            frame_cleanup.b_depth_acquired = true;
+            b_qualify_xr(xrWaitSwapchainImage(mswapchain_depth.swapchain, &xr_wait_info));
+        }
+    }
+    const uint32_t un_framebuffer_index = UnFramebufferIndex(un_color_image_index, un_depth_image_index);
+
+    FrameContext *p_frame_context = m_frame_ring.PBeginFrame();
+    if (!p_frame_context) {
+        return false;
+    }
+    m_parallel_recorder.BeginFrame(m_frame_ring.UnCurrentSlot());
+
+    VkCommandBuffer vk_command_buffer = p_frame_context->vk_command_buffer;
+
+    {//Pick the render resolution, from a GPU time that lags this frame by the depth of the frame ring
+        float f_gpu_ms;
+        if (m_frame_ring.BTakeGpuTime(f_gpu_ms)) {
+            m_resolution_controller.FUpdate(f_gpu_ms, static_cast<float>(frame_data.xr_frame_state.predictedDisplayPeriod) * 1e-6f);
+        }
+
+        const XrViewConfigurationView &xr_view_config_view = mv_view_config_views.front();
+        auto ScaledSize = [&](uint32_t un_recommended, uint32_t un_max) {
+            const float f_size = static_cast<float>(un_recommended) * m_resolution_controller.FScale();
+            const uint32_t un_size = static_cast<uint32_t>(f_size / k_un_resolution_alignment + 0.5f) * k_un_resolution_alignment;
+            return std::clamp(un_size, k_un_resolution_alignment, un_max);
+        };
+
+        vvk_scissors.front().extent = {
+                ScaledSize(xr_view_config_view.recommendedImageRectWidth, mswapchain_color.un_width),
+                ScaledSize(xr_view_config_view.recommendedImageRectHeight, mswapchain_color.un_height),
+        };
+        vvk_viewports.front().width = static_cast<float>(vvk_scissors.front().extent.width);
+        vvk_viewports.front().height = static_cast<float>(vvk_scissors.front().extent.height);
+
+        const uint32_t un_hud_percent = static_cast<uint32_t>(m_resolution_controller.FScale() * 100.f + 0.5f);
+        if (un_hud_percent != mun_hud_percent) {
+            mun_hud_percent = un_hud_percent;
+            m_composition_layers.MarkDirty(mun_hud_layer);
+        }
+    }
+    const VkExtent2D vk_render_extent = vvk_scissors.front().extent;
+
+    {//Record multiview pass
+        VkCommandBufferBeginInfo vk_command_buffer_begin_info = {
+                .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+                .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+        };
+        b_qualify_vk(vkBeginCommandBuffer(vk_command_buffer, &vk_command_buffer_begin_info));
+        frame_cleanup.vk_recording_command_buffer = vk_command_buffer;
+        m_frame_ring.RecordGpuTimeBegin(vk_command_buffer);
+
+        //Takes ownership of everything the upload queue has finished since the last frame. Async compute only sees what an earlier
+        //frame acquired, its submission runs ahead of this frame's acquires.
+        const uint64_t un_compute_visible_value = m_upload_manager.UnGraphicsVisibleValue();
+        const uint64_t un_upload_wait_value = m_upload_manager.UnRecordGraphicsAcquires(vk_command_buffer);
+
+        Mat4 amat4_view_projection[2] = {Mat4Identity(), Mat4Identity()};
+        for (uint32_t i = 0; i < std::min<size_t>(mv_views.size(), std::size(amat4_view_projection)); i++) {
+            amat4_view_projection[i] = Mat4Multiply(Mat4ProjectionFromFov(mv_views[i].fov, k_f_near_z, k_f_far_z), Mat4ViewFromPose(mv_views[i].pose));
+        }
+
+        uint32_t un_view_offset;
+        ViewUniforms *p_view_uniforms = static_cast<ViewUniforms *>(m_frame_ring.PAllocateUniform(sizeof(ViewUniforms), un_view_offset));
+        if (!p_view_uniforms) {
+            Log(LogError, "[XrProgram] Out of transient memory for view uniforms");
+            return false;
+        }
+        std::copy(std::begin(amat4_view_projection), std::end(amat4_view_projection), p_view_uniforms->amat4_view_projection);
+
+        //Bindings a pass does not read still need a valid dynamic offset, any allocation's will do
+        auto AllocateOcclusionUniforms = [&](uint32_t &out_offset) {
+            OcclusionUniforms *p_occlusion_uniforms =
+                    static_cast<OcclusionUniforms *>(m_frame_ring.PAllocateUniform(sizeof(OcclusionUniforms), out_offset));
+            if (p_occlusion_uniforms) {
+                m_hiz_pyramid.FillOcclusionUniforms(*p_occlusion_uniforms);
+            }
+            return p_occlusion_uniforms != nullptr;
+        };
+
+        //World bounds of whatever moved since the last frame, for the LOD selection and CPU culling below
+        m_scene.Update();
+
+        //Culls against one volume enclosing both eyes, so the multiview pass below draws the survivors once for every view
+        const bool b_scene_ready = m_gpu_culling.BReady(m_upload_manager.UnGraphicsVisibleValue());
+        if (b_scene_ready) {
+            std::vector<uint32_t> v_image_widths(mv_views.size());
+            for (size_t i = 0; i < mv_views.size(); i++) {
+                v_image_widths[i] = vk_render_extent.width;
+            }
+            m_lod_selector.Select(m_job_system, m_scene, mv_views.data(), v_image_widths.data(), static_cast<uint32_t>(mv_views.size()), k_f_lod_error_pixels,
+                                  k_f_near_z, m_gpu_culling.PNextLods());
+        }
+        const bool b_scene_culled = b_scene_ready && m_gpu_culling.BCulls();
+        const Frustum frustum = FrustumFromViews(mv_views.data(), static_cast<uint32_t>(mv_views.size()), k_f_near_z, k_f_far_z);
+        if (b_scene_ready && !b_scene_culled) {
+            m_gpu_culling.CullDirect(m_job_system, frustum, m_scene);
+        }
+
+        //Occlusion needs last frame's pyramid, until there is one the early phase draws everything in the frustum. With MSAA
+        //there is no stored depth to build one from.
+        bool b_occlusion = false;
+        uint32_t un_early_occlusion_offset = un_view_offset;
+        if (b_scene_culled) {
+            b_occlusion = b_depth_stored && m_hiz_pyramid.BBuilt() && AllocateOcclusionUniforms(un_early_occlusion_offset);
+        }
+
+        //The early cull goes to the compute queue, where it overlaps with what the last frame submitted after its handoff. Falls
+        //back to the graphics queue's command buffer if it cannot be submitted.
+        uint64_t un_compute_wait_value = 0;
+        if (mb_async_compute && b_scene_culled && m_gpu_culling.BReady(un_compute_visible_value)) {
+            const VkCommandBuffer vk_compute_command_buffer = m_async_compute.GetCommandBuffer(m_frame_ring.UnCurrentSlot());
+            if (vk_compute_command_buffer != VK_NULL_HANDLE) {
+                const uint32_t aun_dynamic_offsets[] = {un_view_offset, un_view_offset, un_early_occlusion_offset};
+                m_gpu_culling.RecordCull(vk_compute_command_buffer, frustum, CullPhaseEarly, b_occlusion, p_frame_context->vk_uniform_set,
+                                         static_cast<uint32_t>(std::size(aun_dynamic_offsets)), aun_dynamic_offsets);
+
+                m_frame_ring.FlushTransient();
+                un_compute_wait_value = m_async_compute.UnSubmit();
+            }
+        }
+
+        VkClearValue vk_clear_values[] = {
+                {.color = {.float32 = {0.f, 0.f, 0.f, 1.f}}},
+                {.depthStencil = {.depth = 0.f, .stencil = 0}}, //reversed depth, 0 is the far plane
+        };
+
+        //Allocated in the same order every frame, so their offsets and the commands recorded with them stay the same too
+        VisibilityMaskDraw visibility_mask_draw;
+        const bool b_visibility_mask = m_visibility_mask.BPrepare(m_frame_ring, mv_views.data(), visibility_mask_draw);
+
+        uint32_t un_draw_offset;
+        DrawUniforms *p_draw_uniforms = static_cast<DrawUniforms *>(m_frame_ring.PAllocateUniform(sizeof(DrawUniforms), un_draw_offset));
+        if (p_draw_uniforms) {
+            p_draw_uniforms->mat4_model = Mat4Translation(0.f, 1.5f, -1.5f);
+        }
+
+        //Everything below up to the end of the early pass only changes with its pipelines, extent, draws and uniform offsets.
+        //It is replayed from a secondary recorded with the same of those, the uniforms themselves are rewritten every frame.
+        const VkPipeline vk_pipeline_visibility_mask = b_visibility_mask ? m_pipeline_variants.GetPipeline(m_pipeline_desc_visibility_mask) : VK_NULL_HANDLE;
+        const VkPipeline vk_pipeline_main = m_pipeline_variants.GetPipeline(m_pipeline_desc_main);
+        const VkPipeline vk_pipeline_scene = b_scene_ready ? m_pipeline_variants.GetPipeline(m_pipeline_desc_scene) : VK_NULL_HANDLE;
+
+        //Draws the CPU builds per object are too many for one thread, they go to secondaries of their own recorded across the
+        //job system every frame and leave the rest of the pass cached
+        const bool b_scene_draws_split = b_scene_ready && m_gpu_culling.BDrawsPerObject();
+
+        auto RecordEarlyPass = [&](VkCommandBuffer vk_pass_command_buffer, bool b_scene_draws) {
+            //Every pipeline takes these as dynamic state, which a secondary neither inherits nor leaves behind
+            vkCmdSetViewport(vk_pass_command_buffer, 0, static_cast<uint32_t>(vvk_viewports.size()), vvk_viewports.data());
+            vkCmdSetScissor(vk_pass_command_buffer, 0, static_cast<uint32_t>(vvk_scissors.size()), vvk_scissors.data());
+
+            //First in the pass, so the early depth test rejects everything drawn beneath the hidden area afterwards
+            if (b_visibility_mask) {
+                vkCmdBindPipeline(vk_pass_command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, vk_pipeline_visibility_mask);
+                m_visibility_mask.RecordDraw(vk_pass_command_buffer, visibility_mask_draw);
+            }
+
+            if (!p_draw_uniforms) {
+                return;
+            }
+
+            //One draw stream, broadcast to every view by the render pass view mask
+            vkCmdBindPipeline(vk_pass_command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, vk_pipeline_main);
+
+            //Per draw data is a pointer bump and a copy, the set itself stays the same for the whole frame
+            const uint32_t aun_dynamic_offsets[] = {un_view_offset, un_draw_offset, un_view_offset};
+            vkCmdBindDescriptorSets(vk_pass_command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, mvk_pipeline_layout, k_un_frame_set, 1,
+                                    &p_frame_context->vk_uniform_set, static_cast<uint32_t>(std::size(aun_dynamic_offsets)), aun_dynamic_offsets);
+            vkCmdDraw(vk_pass_command_buffer, 3, 1, 0, 0);
+
+            //The frame set bound above stays bound, both pipeline layouts share it
+            if (b_scene_ready && b_scene_draws) {
+                vkCmdBindPipeline(vk_pass_command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, vk_pipeline_scene);
+                m_gpu_culling.RecordDraws(vk_pass_command_buffer, mvk_scene_pipeline_layout, CullPhaseEarly);
+            }
+        };
+
+        uint64_t un_early_pass_version = 0;
+        for (uint64_t un_value: {static_cast<uint64_t>(vk_render_extent.width), static_cast<uint64_t>(vk_render_extent.height),
+                                 reinterpret_cast<uint64_t>(vk_pipeline_visibility_mask), reinterpret_cast<uint64_t>(vk_pipeline_main),
+                                 reinterpret_cast<uint64_t>(vk_pipeline_scene), reinterpret_cast<uint64_t>(visibility_mask_draw.vk_buffer),
+                                 visibility_mask_draw.size_vertex_offset, visibility_mask_draw.size_index_offset,
+                                 static_cast<uint64_t>(visibility_mask_draw.un_index_count), static_cast<uint64_t>(un_view_offset),
+                                 static_cast<uint64_t>(p_draw_uniforms ? un_draw_offset : UINT32_MAX)}) {
+            un_early_pass_version = UnHashCombine(un_early_pass_version, un_value);
+        }
+
+        un_early_pass_version = UnHashCombine(un_early_pass_version, b_scene_draws_split);
+
+        //Indirect draws read the cull slice PNextLods moved to, which only follows the frame ring while every frame selects LODs
+        if (b_scene_ready) {
+            un_early_pass_version = UnHashCombine(un_early_pass_version, reinterpret_cast<uint64_t>(m_gpu_culling.GetCullOutput()));
+        }
+
+        //Multisampled framebuffers may only be built once the frame graph has placed their attachments, after the secondaries are
+        //recorded. Naming the framebuffer is only a hint, they are begun without it then.
+        const VkFramebuffer vk_inherited_framebuffer = b_depth_stored ? mv_framebuffers[un_framebuffer_index] : VK_NULL_HANDLE;
+
+        bool b_record_early_pass = false;
+        const VkCommandBuffer vk_early_pass_command_buffer =
+                m_command_buffer_cache.GetSecondary(un_framebuffer_index, m_frame_ring.UnCurrentSlot(), un_early_pass_version, mvk_render_pass,
+                                                    vk_inherited_framebuffer, b_record_early_pass);
+        if (b_record_early_pass) {
+            RecordEarlyPass(vk_early_pass_command_buffer, !b_scene_draws_split);
+            if (!m_command_buffer_cache.BEnd(vk_early_pass_command_buffer)) {
+                return false;
+            }
+        }
+
+        //Executed right after the cached part, in the order of their objects. Without a cached part the pass is recorded inline
+        //and the scene draws with it.
+        std::vector<VkCommandBuffer> vvk_early_pass_secondaries;
+        if (vk_early_pass_command_buffer != VK_NULL_HANDLE) {
+            vvk_early_pass_secondaries.push_back(vk_early_pass_command_buffer);
+
+            if (b_scene_draws_split && p_draw_uniforms) {
+                const bool b_recorded = m_parallel_recorder.BRecord(
+                        m_job_system, m_frame_ring.UnCurrentSlot(), m_gpu_culling.UnObjectCount(), k_un_scene_draws_per_secondary, mvk_render_pass,
+                        vk_inherited_framebuffer, [&](VkCommandBuffer vk_range_command_buffer, uint32_t un_begin, uint32_t un_end) {
+                            //Nothing is inherited from the cached part or the primary
+                            const uint32_t aun_dynamic_offsets[] = {un_view_offset, un_draw_offset, un_view_offset};
+                            vkCmdSetViewport(vk_range_command_buffer, 0, static_cast<uint32_t>(vvk_viewports.size()), vvk_viewports.data());
+                            vkCmdSetScissor(vk_range_command_buffer, 0, static_cast<uint32_t>(vvk_scissors.size()), vvk_scissors.data());
+                            vkCmdBindPipeline(vk_range_command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, vk_pipeline_scene);
+                            vkCmdBindDescriptorSets(vk_range_command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, mvk_scene_pipeline_layout, k_un_frame_set, 1,
+                                                    &p_frame_context->vk_uniform_set, static_cast<uint32_t>(std::size(aun_dynamic_offsets)),
+                                                    aun_dynamic_offsets);
+                            m_gpu_culling.RecordDrawRange(vk_range_command_buffer, mvk_scene_pipeline_layout, un_begin, un_end);
+                        });
+                if (!b_recorded) {
+                    return false;
+                }
+
+                const std::vector<VkCommandBuffer> &vvk_scene_secondaries = m_parallel_recorder.GetSecondaries();
+                vvk_early_pass_secondaries.insert(vvk_early_pass_secondaries.end(), vvk_scene_secondaries.begin(), vvk_scene_secondaries.end());
+            }
+        }
+
+        //This frame's depth so far becomes the pyramid for the late phase and for next frame's early phase. It misses what the
+        //late phase draws, which only makes next frame's tests more conservative.
+        const bool b_pyramid_built = b_scene_culled && b_depth_stored && m_hiz_pyramid.BCanBuild(un_depth_image_index, vk_render_extent);
+
+        //Splitting the pass costs a store and load of the attachments, so it only happens when the early phase could have
+        //rejected something that is visible now. The uniforms are filled once the pyramid they describe has been recorded.
+        uint32_t un_late_occlusion_offset;
+        OcclusionUniforms *p_late_occlusion_uniforms = nullptr;
+        if (b_occlusion && b_pyramid_built && p_draw_uniforms) {
+            p_late_occlusion_uniforms =
+                    static_cast<OcclusionUniforms *>(m_frame_ring.PAllocateUniform(sizeof(OcclusionUniforms), un_late_occlusion_offset));
+        }
+        const bool b_late_phase = p_late_occlusion_uniforms != nullptr;
+
+        {//Build the frame graph
+            m_render_graph.Reset();
+
+            //Swapchain images come back from the runtime with undefined contents every frame
+            RenderGraphState color_state;
+            const RenderGraphResource color = m_render_graph.ImportImage(mswapchain_color.v_images[un_color_image_index].image,
+                                                                         {
+                                                                                 .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                                                                                 .baseMipLevel = 0,
+                                                                                 .levelCount = 1,
+                                                                                 .baseArrayLayer = 0,
+                                                                                 .layerCount = static_cast<uint32_t>(mv_views.size()),
+                                                                         },
+                                                                         &color_state);
+            m_render_graph.SetFinalAccess(color, RenderGraphColorAttachment);
+
+            //Layout transitions of combined formats have to cover both aspects
+            const bool b_stencil = mswapchain_depth.vk_format == VK_FORMAT_D24_UNORM_S8_UINT || mswapchain_depth.vk_format == VK_FORMAT_D32_SFLOAT_S8_UINT;
+            const VkImageAspectFlags vk_depth_aspects = VK_IMAGE_ASPECT_DEPTH_BIT | (b_stencil ? VK_IMAGE_ASPECT_STENCIL_BIT : 0u);
+
+            //Multisampled passes keep depth in their transient attachment, the swapchain's is only used without MSAA
+            RenderGraphState depth_state;
+            RenderGraphResource depth = RenderGraph::k_un_no_resource;
+            if (b_depth_stored) {
+                depth = m_render_graph.ImportImage(mswapchain_depth.v_images[un_depth_image_index].image,
+                                                   {
+                                                           .aspectMask = vk_depth_aspects,
+                                                           .baseMipLevel = 0,
+                                                           .levelCount = 1,
+                                                           .baseArrayLayer = 0,
+                                                           .layerCount = static_cast<uint32_t>(mv_views.size()),
+                                                   },
+                                                   &depth_state);
+                m_render_graph.SetFinalAccess(depth, RenderGraphDepthAttachment);
+            }
+
+            //The multisampled attachments only live through the main pass, in memory the graph lets them share with anything else
+            //of the frame they do not overlap. Lazily allocated, they never leave tile memory.
+            RenderGraphResource msaa_color = RenderGraph::k_un_no_resource;
+            RenderGraphResource msaa_depth = RenderGraph::k_un_no_resource;
+            if (!b_depth_stored) {
+                VkImageCreateInfo vk_image_create_info = {
+                        .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+                        .imageType = VK_IMAGE_TYPE_2D,
+                        .format = mswapchain_color.vk_format,
+                        .extent = {mswapchain_color.un_width, mswapchain_color.un_height, 1},
+                        .mipLevels = 1,
+                        .arrayLayers = static_cast<uint32_t>(mv_views.size()),
+                        .samples = mvk_sample_count,
+                        .tiling = VK_IMAGE_TILING_OPTIMAL,
+                        .usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT,
+                };
+                msaa_color = m_render_graph.CreateImage(vk_image_create_info, VK_IMAGE_ASPECT_COLOR_BIT);
+
+                vk_image_create_info.format = mswapchain_depth.vk_format;
+                vk_image_create_info.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+                msaa_depth = m_render_graph.CreateImage(vk_image_create_info, vk_depth_aspects);
+            }
+
+            //Both cull phases write this frame's draw and count buffers, which stand in for all of them. A cull that ran on the compute
+            //queue is ordered before everything here by the semaphore the submission waits on.
+            RenderGraphResource pyramid = RenderGraph::k_un_no_resource;
+            RenderGraphResource cull_output = RenderGraph::k_un_no_resource;
+            if (b_scene_culled) {
+                if (un_compute_wait_value > 0) {
+                    m_cull_output_state = {};
+                }
+
+                pyramid = m_render_graph.ImportImage(m_hiz_pyramid.GetImage(), m_hiz_pyramid.GetSubresourceRange(), &m_hiz_pyramid_state);
+                cull_output = m_render_graph.ImportBuffer(m_gpu_culling.GetCullOutput(), &m_cull_output_state);
+            }
+
+            //The cull fills the draw buffers before its dispatch writes them
+            const auto il_cull_uses = {RenderGraphUse{cull_output, RenderGraphTransferWrite}, RenderGraphUse{cull_output, RenderGraphComputeWrite},
+                                       RenderGraphUse{pyramid, RenderGraphComputeRead}};
+            const auto il_main_uses = {RenderGraphUse{color, RenderGraphColorAttachment}, RenderGraphUse{depth, RenderGraphDepthAttachment},
+                                       RenderGraphUse{msaa_color, RenderGraphColorAttachment}, RenderGraphUse{msaa_depth, RenderGraphDepthAttachment},
+                                       RenderGraphUse{cull_output, RenderGraphIndirectRead}};
+
+            if (b_scene_culled && un_compute_wait_value == 0) {
+                m_render_graph.AddPass("cull_early", il_cull_uses, [&](VkCommandBuffer vk_pass_command_buffer) {
+                    const uint32_t aun_dynamic_offsets[] = {un_view_offset, un_view_offset, un_early_occlusion_offset};
+                    m_gpu_culling.RecordCull(vk_pass_command_buffer, frustum, CullPhaseEarly, b_occlusion, p_frame_context->vk_uniform_set,
+                                             static_cast<uint32_t>(std::size(aun_dynamic_offsets)), aun_dynamic_offsets);
+                });
+            }
+
+            VkRenderPassBeginInfo vk_render_pass_begin_info = {
+                    .sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
+                    .renderPass = mvk_render_pass,
+                    .renderArea = vvk_scissors.front(),
+                    .clearValueCount = static_cast<uint32_t>(std::size(vk_clear_values)),
+                    .pClearValues = vk_clear_values,
+            };
+
+            m_render_graph.AddPass("main_early", il_main_uses, [&](VkCommandBuffer vk_pass_command_buffer) {
+                //A secondary that could not be begun leaves the pass to be recorded inline as before
+                if (!vvk_early_pass_secondaries.empty()) {
+                    vkCmdBeginRenderPass(vk_pass_command_buffer, &vk_render_pass_begin_info,
+                                         VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+                    vkCmdExecuteCommands(vk_pass_command_buffer, static_cast<uint32_t>(vvk_early_pass_secondaries.size()),
+                                         vvk_early_pass_secondaries.data());
+                } else {
+                    vkCmdBeginRenderPass(vk_pass_command_buffer, &vk_render_pass_begin_info, VK_SUBPASS_CONTENTS_INLINE);
+                    RecordEarlyPass(vk_pass_command_buffer, true);
+                }
+
+                vkCmdEndRenderPass(vk_pass_command_buffer);
+            });
+
+            if (b_pyramid_built) {
+                const auto il_build_uses = {RenderGraphUse{depth, RenderGraphDepthSampled}, RenderGraphUse{pyramid, RenderGraphComputeWrite}};
+                m_render_graph.AddPass("hiz_build", il_build_uses, [&](VkCommandBuffer vk_pass_command_buffer) {
+                    if (m_hiz_pyramid.BRecordBuild(vk_pass_command_buffer, un_depth_image_index, vk_render_extent, amat4_view_projection) &&
+                        p_late_occlusion_uniforms) {
+                        m_hiz_pyramid.FillOcclusionUniforms(*p_late_occlusion_uniforms);
+                    }
+                });
+            }
+
+            //The next frame's early cull waits for everything up to here, the pyramid it reads is done and its uploads acquired.
+            //What follows overlaps with it.
+            if (mb_async_compute) {
+                m_render_graph.EndSubmission();
+            }
+
+            if (b_late_phase) {
+                m_render_graph.AddPass("cull_late", il_cull_uses, [&](VkCommandBuffer vk_pass_command_buffer) {
+                    const uint32_t aun_dynamic_offsets[] = {un_view_offset, un_view_offset, un_late_occlusion_offset};
+                    m_gpu_culling.RecordCull(vk_pass_command_buffer, frustum, CullPhaseLate, true, p_frame_context->vk_uniform_set,
+                                             static_cast<uint32_t>(std::size(aun_dynamic_offsets)), aun_dynamic_offsets);
+                });
+
+                m_render_graph.AddPass("main_late", il_main_uses, [&](VkCommandBuffer vk_pass_command_buffer) {
+                    VkRenderPassBeginInfo vk_resume_begin_info = vk_render_pass_begin_info;
+                    vk_resume_begin_info.renderPass = mvk_render_pass_resume;
+                    vk_resume_begin_info.clearValueCount = 0;
+                    vk_resume_begin_info.pClearValues = nullptr;
+                    vkCmdBeginRenderPass(vk_pass_command_buffer, &vk_resume_begin_info, VK_SUBPASS_CONTENTS_INLINE);
+
+                    const uint32_t aun_dynamic_offsets[] = {un_view_offset, un_view_offset, un_late_occlusion_offset};
+                    vkCmdSetViewport(vk_pass_command_buffer, 0, static_cast<uint32_t>(vvk_viewports.size()), vvk_viewports.data());
+                    vkCmdSetScissor(vk_pass_command_buffer, 0, static_cast<uint32_t>(vvk_scissors.size()), vvk_scissors.data());
+                    vkCmdBindPipeline(vk_pass_command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, vk_pipeline_scene);
+                    vkCmdBindDescriptorSets(vk_pass_command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, mvk_scene_pipeline_layout, k_un_frame_set, 1,
+                                            &p_frame_context->vk_uniform_set, static_cast<uint32_t>(std::size(aun_dynamic_offsets)), aun_dynamic_offsets);
+                    m_gpu_culling.RecordDraws(vk_pass_command_buffer, mvk_scene_pipeline_layout, CullPhaseLate);
+
+                    vkCmdEndRenderPass(vk_pass_command_buffer);
+                });
+            }
+
+            if (!m_render_graph.BCompile()) {
+                return false;
+            }
+
+            //Placing the attachments anew waited for every frame that could still use the framebuffers over the old ones
+            if (msaa_color != RenderGraph::k_un_no_resource && m_render_graph.UnPlacementGeneration() != mun_msaa_placement_generation) {
+                DestroyFramebuffers();
+                mvk_msaa_color_view = m_render_graph.GetImageView(msaa_color);
+                mvk_msaa_depth_view = m_render_graph.GetImageView(msaa_depth);
+                if (!BInitFramebuffers()) {
+                    return false;
+                }
+                mun_msaa_placement_generation = m_render_graph.UnPlacementGeneration();
+            }
+            vk_render_pass_begin_info.framebuffer = mv_framebuffers[un_framebuffer_index];
+
+            m_render_graph.Execute(vk_command_buffer);
+        }
+
+        //Already signalled by the time we get here, the wait only orders the acquires after the upload queue's release
+        VkSemaphore avk_wait_semaphores[2];
+        uint64_t aun_wait_values[2];
+        VkPipelineStageFlags avk_wait_stages[2];
+        uint32_t un_wait_count = 0;
+        if (un_upload_wait_value > 0) {
+            avk_wait_semaphores[un_wait_count] = m_upload_manager.GetTimelineSemaphore();
+            aun_wait_values[un_wait_count] = un_upload_wait_value;
+            avk_wait_stages[un_wait_count++] = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+        }
+
+        //Draws read what the compute queue culled, and the pyramid build overwrites what it tested against
+        if (un_compute_wait_value > 0) {
+            avk_wait_semaphores[un_wait_count] = m_async_compute.GetTimelineSemaphore();
+            aun_wait_values[un_wait_count] = un_compute_wait_value;
+            avk_wait_stages[un_wait_count++] = VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+        }
+
+        VkCommandBuffer vk_last_command_buffer = vk_command_buffer;
+        if (mb_async_compute) {
+            //A command buffer that failed to end is invalid, there is nothing left to end
+            frame_cleanup.vk_recording_command_buffer = VK_NULL_HANDLE;
+            b_qualify_vk(vkEndCommandBuffer(vk_command_buffer));
+            m_frame_ring.FlushTransient();
+
+            const VkSemaphore vk_handoff_semaphore = m_async_compute.GetHandoffSemaphore();
+            const uint64_t un_handoff_value = m_async_compute.UnNextHandoffValue();
+
+            VkTimelineSemaphoreSubmitInfoKHR vk_timeline_submit_info = {
+                    .sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO_KHR,
+                    .waitSemaphoreValueCount = un_wait_count,
+                    .pWaitSemaphoreValues = aun_wait_values,
+                    .signalSemaphoreValueCount = 1,
+                    .pSignalSemaphoreValues = &un_handoff_value,
+            };
+            VkSubmitInfo vk_submit_info = {
+                    .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+                    .pNext = &vk_timeline_submit_info,
+                    .waitSemaphoreCount = un_wait_count,
+                    .pWaitSemaphores = avk_wait_semaphores,
+                    .pWaitDstStageMask = avk_wait_stages,
+                    .commandBufferCount = 1,
+                    .pCommandBuffers = &vk_command_buffer,
+                    .signalSemaphoreCount = 1,
+                    .pSignalSemaphores = &vk_handoff_semaphore,
+            };
+
+            {
+                std::lock_guard<std::mutex> lock_queue(mmutex_graphics_queue);
+                b_qualify_vk(vkQueueSubmit(mvk_queue, 1, &vk_submit_info, VK_NULL_HANDLE));
+            }
+            m_upload_manager.CommitGraphicsAcquires();
+            m_async_compute.HandoffSubmitted();
+
+            //The rest of the frame goes into a second submission, queue order keeps it after the first
+            un_wait_count = 0;
+            vk_last_command_buffer = p_frame_context->vk_tail_command_buffer;
+
+            VkCommandBufferBeginInfo vk_command_buffer_begin_info = {
+                    .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+                    .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+            };
+            b_qualify_vk(vkBeginCommandBuffer(vk_last_command_buffer, &vk_command_buffer_begin_info));
+            frame_cleanup.vk_recording_command_buffer = vk_last_command_buffer;
+            m_render_graph.Execute(vk_last_command_buffer);
+        }
+
+        //Last, so the transient memory it takes does not move the offsets the early pass was recorded with
+        m_composition_layers.RecordUpdates(vk_last_command_buffer);
+
+        m_frame_ring.RecordGpuTimeEnd(vk_last_command_buffer);
+        frame_cleanup.vk_recording_command_buffer = VK_NULL_HANDLE;
+        b_qualify_vk(vkEndCommandBuffer(vk_last_command_buffer));
+
+        const VkSemaphore vk_timeline_semaphore = m_frame_ring.GetTimelineSemaphore();
+
+        VkSubmitInfo vk_submit_info = {
+                .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+                .pNext = &m_frame_ring.TimelineSubmitInfo(un_wait_count, aun_wait_values),
+                .waitSemaphoreCount = un_wait_count,
+                .pWaitSemaphores = avk_wait_semaphores,
+                .pWaitDstStageMask = avk_wait_stages,
+                .commandBufferCount = 1,
+                .pCommandBuffers = &vk_last_command_buffer,
+                .signalSemaphoreCount = 1,
+                .pSignalSemaphores = &vk_timeline_semaphore,
+        };
+
+        {
+            std::lock_guard<std::mutex> lock_queue(mmutex_graphics_queue);
+            b_qualify_vk(vkQueueSubmit(mvk_queue, 1, &vk_submit_info, VK_NULL_HANDLE));
+        }
+        m_frame_ring.CommitSubmit();
+        frame_cleanup.b_submitted = true;
+
+        //Outside the queue lock, uploads sharing the graphics queue take it while holding their own
+        m_upload_manager.CommitGraphicsAcquires();
+    }
+
+    {//Release swapchain images
+        m_composition_layers.ReleaseUpdated();
+
+        XrSwapchainImageReleaseInfo xr_release_info{XR_TYPE_SWAPCHAIN_IMAGE_RELEASE_INFO};
+        frame_cleanup.b_color_acquired = false;
+        b_qualify_xr(xrReleaseSwapchainImage(mswapchain_color.swapchain, &xr_release_info));
+        if (b_depth_stored) {
+            frame_cleanup.b_depth_acquired = false;
+            b_qualify_xr(xrReleaseSwapchainImage(mswapchain_depth.swapchain, &xr_release_info));
+        }
+    }
+
+    for (uint32_t i = 0; i < v_projection_views.size(); i++) {
+        v_projection_views[i] = {
+                .type = XR_TYPE_COMPOSITION_LAYER_PROJECTION_VIEW,
+                .pose = mv_views[i].pose,
+                .fov = mv_views[i].fov,
+                .subImage = {
+                        .swapchain = mswapchain_color.swapchain,
+                        .imageRect = {
+                                .offset = {0, 0},
+                                .extent = {static_cast<int32_t>(vk_render_extent.width), static_cast<int32_t>(vk_render_extent.height)},
+                        },
+                        .imageArrayIndex = i,
+                },
+        };
+    }
+
+    return true;
+}
+
+void Program::RecordHud(VkCommandBuffer vk_command_buffer, VkImage vk_image, const VkExtent2D &vk_extent) {
+    VkDeviceSize size_offset;
+    uint32_t *pun_pixels = static_cast<uint32_t *>(
+            m_frame_ring.PAllocateTransient(vk_extent.width * vk_extent.height * sizeof(uint32_t), sizeof(uint32_t), size_offset));
+    if (!pun_pixels) {
+        Log(LogError, "[XrProgram] Out of transient memory for the HUD");
+        return;
+    }
+
+    //Red and blue match, so the colors read the same in every 8 bit color format the swapchains pick from
+    constexpr uint32_t k_un_bar_color = 0xff40c040;
+    constexpr uint32_t k_un_background_color = 0xff202020;
+
+    const uint32_t un_filled = std::min(vk_extent.width * mun_hud_percent / 100, vk_extent.width);
+    for (uint32_t un_y = 0; un_y < vk_extent.height; un_y++) {
+        std::fill_n(pun_pixels + un_y * vk_extent.width, un_filled, k_un_bar_color);
+        std::fill_n(pun_pixels + un_y * vk_extent.width + un_filled, vk_extent.width - un_filled, k_un_background_color);
+    }
+
+    VkBufferImageCopy vk_buffer_image_copy = {
+            .bufferOffset = size_offset,
+            .imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1},
+            .imageExtent = {vk_extent.width, vk_extent.height, 1},
+    };
+    vkCmdCopyBufferToImage(vk_command_buffer, m_frame_ring.GetCurrent().transient_page.GetBuffer(), vk_image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1,
+                           &vk_buffer_image_copy);
+}
+
+Program::~Program() {
+    StopFrameThreads();
+    m_job_system.Destroy();
+
+    if (mvk_device == VK_NULL_HANDLE) {
+        return;
+    }
+
+    vkDeviceWaitIdle(mvk_device);
+
+    m_frame_ring.Destroy();
+    m_render_graph.Destroy();
+    m_command_buffer_cache.Destroy();
+    m_parallel_recorder.Destroy();
+    m_async_compute.Destroy();
+    m_composition_layers.Destroy();
+    m_gpu_culling.Destroy();
+    m_hiz_pyramid.Destroy();
+    m_upload_manager.Destroy();
+
+    DestroyFramebuffers();
+
+    m_pipeline_variants.Destroy();
+    m_pipeline_cache.Destroy();
+    vkDestroyRenderPass(mvk_device, mvk_render_pass, nullptr);
+    vkDestroyRenderPass(mvk_device, mvk_render_pass_resume, nullptr);
+    vkDestroyPipelineLayout(mvk_device, mvk_pipeline_layout, nullptr);
+    vkDestroyPipelineLayout(mvk_device, mvk_scene_pipeline_layout, nullptr);
+    vkDestroyDescriptorSetLayout(mvk_device, mvk_frame_set_layout, nullptr);
+    vkDestroyDescriptorSetLayout(mvk_device, mvk_scene_set_layout, nullptr);
+
+    for (VkImageView vk_image_view: mswapchain_color.v_image_views) {
+        vkDestroyImageView(mvk_device, vk_image_view, nullptr);
+    }
+    for (VkImageView vk_image_view: mswapchain_depth.v_image_views) {
+        vkDestroyImageView(mvk_device, vk_image_view, nullptr);
+    }
 
+    m_gpu_allocator.Destroy();
 }
\ No newline at end of file
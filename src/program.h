@@ -1,11 +1,33 @@
 #pragma once
 
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
 #include <unordered_map>
 #include <vector>
 
 #include "android_native_app_glue.h"
 
+#include "async_compute.h"
+#include "command_buffer_cache.h"
+#include "composition_layers.h"
+#include "frame_context.h"
+#include "frame_exchange.h"
+#include "gpu_allocator.h"
+#include "gpu_culling.h"
+#include "hiz_pyramid.h"
+#include "job_system.h"
+#include "lod_selector.h"
 #include "main.h"
+#include "parallel_recorder.h"
+#include "pipeline_cache.h"
+#include "pipeline_variants.h"
+#include "render_graph.h"
+#include "resolution_controller.h"
+#include "scene.h"
+#include "upload_manager.h"
+#include "visibility_mask.h"
 
 #include "vulkan/vulkan.h"
 
@@ -25,43 +47,225 @@ struct SwapchainInfo {
     uint32_t un_height = 0;
 };
 
+//Everything the render thread needs to present one frame, produced by the simulation thread
+struct FrameData {
+    uint64_t un_frame_index = 0;
+    XrFrameState xr_frame_state{XR_TYPE_FRAME_STATE};
+
+    double d_sim_time_s = 0.0;
+};
+
+//Stable ids for PipelineVariantCache, they are persisted in the pipeline manifest so never renumber them
+enum EShaderProgram : uint32_t {
+    ShaderProgramTriangle = 0,
+    ShaderProgramScene = 1,
+    ShaderProgramVisibilityMask = 2,
+};
+
+//One main pass per sample count, a pipeline variant is only compatible with the pass of its own sample count
+enum ERenderPass : uint32_t {
+    RenderPassMain = 0,      //single sampled, straight into the swapchain images
+    RenderPassMainMsaa2 = 1, //transient multisampled attachments resolved into the swapchain images
+    RenderPassMainMsaa4 = 2,
+    RenderPassMainMsaa8 = 3,
+};
+
 class Program {
 public:
     Program(android_app *p_app, app_state *p_app_state);
 
+    //Number of frames the CPU may run ahead of the GPU: 2 favours latency, 3 favours throughput. Must be set before BInit.
+    void SetFramesInFlight(uint32_t un_frames_in_flight);
+
+    //MSAA samples of the main pass, rounded down to what the device supports. 0 picks the runtime's recommendation. Can be
+    //called from any thread at any time, the render thread switches over before its next frame.
+    void SetSampleCount(uint32_t un_sample_count);
+
     bool BInit();
 
     void Tick();
 
+    //Writes the pipeline cache and the variant manifest if pipelines were created since they were last written. Tick does so
+    //every now and then as well, Android mostly kills the app instead of letting it tear down.
+    void SavePipelineCaches();
+
     ~Program();
 
 private:
+    //BInit phases, run as a dependency graph by BInit
+    bool BInitLoader();
+    bool BInitInstance();
+    bool BInitSystem();
+    bool BInitViewConfiguration();
+    bool BInitVulkanInstance();
+    bool BInitVulkanDevice();
+    bool BInitSession();
+    bool BSelectSwapchainFormats();
+    bool BInitColorSwapchain();
+    bool BInitDepthSwapchain();
+    bool BInitPipelineCache();
+    bool BInitPipelineLayout();
+    bool BInitRenderPass();
+    bool BInitPipelines();
+    bool BInitFramebuffers();
+    void DestroyFramebuffers();
+    bool BApplySampleCount();
+    bool BInitGpuAllocator();
+    bool BInitFrameRing();
+    bool BInitRenderGraph();
+    bool BInitUniformSets();
+    bool BInitUploadManager();
+    bool BInitHiZPyramid();
+    bool BInitGpuCulling();
+    bool BInitVisibilityMask();
+    bool BInitCompositionLayers();
+    bool BInitCommandBufferCache();
+    bool BInitAsyncCompute();
+    bool BInitParallelRecorder();
+
+    void StartFrameThreads();
+    void StopFrameThreads();
+
+    //Simulation thread: owns xrWaitFrame and advances game state for the next frame
+    void SimulationThreadMain();
+    void Simulate(FrameData &frame_data);
+
+    //Render thread: owns xrBeginFrame, command recording, queue submission and xrEndFrame
+    void RenderThreadMain();
+    void RenderFrame(const FrameData &frame_data);
+    bool BRenderFrame(const FrameData &frame_data, std::vector<XrCompositionLayerProjectionView> &v_projection_views);
+    void RecordHud(VkCommandBuffer vk_command_buffer, VkImage vk_image, const VkExtent2D &vk_extent);
+
     android_app *mp_android_app;
     app_state *mp_app_state;
 
-    XrInstance mxr_instance;
+    XrInstance mxr_instance = XR_NULL_HANDLE;
     XrSystemId mxr_system_id;
-    XrSession mxr_session;
+    XrSession mxr_session = XR_NULL_HANDLE;
     bool mb_session_running = false;
 
+    std::atomic<bool> mb_frame_threads_running = false;
+    std::thread mthread_simulation;
+    std::thread mthread_render;
+
+    //two slots: the simulation thread fills frame N+1 while the render thread submits frame N
+    FrameExchange<FrameData, 2> m_frame_exchange;
+
     XrViewConfigurationType me_app_view_type;
     std::vector<XrViewConfigurationView> mv_view_config_views;
     std::unordered_map<XrReferenceSpaceType, XrSpace> mmap_reference_spaces;
+    XrSpace mxr_app_space = XR_NULL_HANDLE;
+    std::vector<XrView> mv_views;
 
     SwapchainInfo mswapchain_color{};
     SwapchainInfo mswapchain_depth{};
 
     XrDebugUtilsMessengerEXT mxr_debug_utils_messenger;
 
-    VkInstance mvk_instance;
-    VkPhysicalDevice mvk_physical_device;
-    VkDevice mvk_device;
-    VkQueue mvk_queue;
-    VkPipelineLayout mvk_pipeline_layout;
+    VkInstance mvk_instance = VK_NULL_HANDLE;
+    VkPhysicalDevice mvk_physical_device = VK_NULL_HANDLE;
+    VkDevice mvk_device = VK_NULL_HANDLE;
+    VkQueue mvk_queue = VK_NULL_HANDLE;
+    VkQueue mvk_transfer_queue = VK_NULL_HANDLE;
+    VkQueue mvk_compute_queue = VK_NULL_HANDLE; //VK_NULL_HANDLE if the graphics family has no queue left for async compute
+
+    //held around every use of mvk_queue, which uploads fall back to when the device has no queue to spare
+    std::mutex mmutex_graphics_queue;
+    VkDescriptorSetLayout mvk_frame_set_layout = VK_NULL_HANDLE;
+    VkPipelineLayout mvk_pipeline_layout = VK_NULL_HANDLE;
+    VkDescriptorSetLayout mvk_scene_set_layout = VK_NULL_HANDLE;
+    VkPipelineLayout mvk_scene_pipeline_layout = VK_NULL_HANDLE;
+    VkRenderPass mvk_render_pass = VK_NULL_HANDLE;
+    VkRenderPass mvk_render_pass_resume = VK_NULL_HANDLE; //mvk_render_pass loading instead of clearing, for the late cull phase
+
+    //With more than one sample the main pass renders into transient attachments and resolves color into the swapchain.
+    //Depth is then never stored, which leaves nothing to build the depth pyramid from and turns occlusion culling off.
+    std::atomic<uint32_t> mun_requested_sample_count = 0;
+    std::atomic<bool> mb_sample_count_changed = false;
+    VkSampleCountFlagBits mvk_sample_count = VK_SAMPLE_COUNT_1_BIT;
+
+    //The multisampled attachments are transient images of m_render_graph, placed when a frame's graph is compiled. Their
+    //framebuffers are only built then, over the views of this placement generation of the graph.
+    VkImageView mvk_msaa_color_view = VK_NULL_HANDLE;
+    VkImageView mvk_msaa_depth_view = VK_NULL_HANDLE;
+    uint64_t mun_msaa_placement_generation = UINT64_MAX;
+
+    PipelineCache m_pipeline_cache;
+    bool mb_pipeline_creation_feedback_supported = false;
+    std::chrono::steady_clock::time_point mtime_pipeline_caches_saved{};
+
+    PipelineVariantCache m_pipeline_variants;
+    PipelineDesc m_pipeline_desc_main{};
+    PipelineDesc m_pipeline_desc_scene{};
+    PipelineDesc m_pipeline_desc_visibility_mask{};
+
+    //one framebuffer per pair of color and depth swapchain images, color major, each covering every view through the 2D_ARRAY
+    //image views. The runtime hands out the two swapchains' images independently. With MSAA the depth swapchain is left out,
+    //so there is one per color image.
+    std::vector<VkFramebuffer> mv_framebuffers;
+    uint32_t UnFramebufferDepthImages() const {
+        return mvk_sample_count == VK_SAMPLE_COUNT_1_BIT ? mswapchain_depth.un_image_count : 1;
+    }
+    uint32_t UnFramebufferIndex(uint32_t un_color_image, uint32_t un_depth_image) const {
+        return un_color_image * UnFramebufferDepthImages() + un_depth_image;
+    }
+
+    uint32_t mun_frames_in_flight = FrameContextRing::k_un_min_depth;
+    FrameContextRing m_frame_ring;
+
+    //the early main pass as secondaries, replayed until something they were recorded with changes
+    CommandBufferCache m_command_buffer_cache;
+
+    //scene draws built on the CPU, recorded into per thread secondaries of the early main pass every frame
+    ParallelRecorder m_parallel_recorder;
+
+    //rebuilt every frame, orders the passes of the frame's command buffer. The states are where the last frame left what
+    //outlives it, swapchain images start out fresh every frame.
+    RenderGraph m_render_graph;
+    RenderGraphState m_hiz_pyramid_state;
+    RenderGraphState m_cull_output_state;
+
+    //runs the early cull of a frame on mvk_compute_queue next to the late phase of the frame before, if there is one
+    bool mb_async_compute = false;
+    AsyncCompute m_async_compute;
+
+    //every buffer and image memory allocation goes through here
+    GpuAllocator m_gpu_allocator;
+
+    //streams buffer and image contents in on mvk_transfer_queue
+    UploadManager m_upload_manager;
+
+    //forks per object CPU work of the render thread out to the performance cores
+    JobSystem m_job_system;
+
+    //transforms and bounds of the scene, CPU side
+    Scene m_scene;
+
+    //culls and draws the static scene without per object CPU work
+    GpuCulling m_gpu_culling;
+    HiZPyramid m_hiz_pyramid;
+    LodSelector m_lod_selector;
+    GpuCullingFeatures m_gpu_culling_features;
+
+    //masks the lens corners out of depth before the scene is drawn, only if the runtime has XR_KHR_visibility_mask
+    bool mb_visibility_mask_supported = false;
+    VisibilityMask m_visibility_mask;
+
+    //quad and cylinder layers over the projection layer, only redrawn when their content changes
+    bool mb_cylinder_supported = false;
+    CompositionLayers m_composition_layers;
+    uint32_t mun_hud_layer = UINT32_MAX;
+    uint32_t mun_hud_percent = UINT32_MAX; //resolution scale the HUD shows
 
+    //rendered sub-rect of the swapchain images, resized every frame by m_resolution_controller
+    ResolutionController m_resolution_controller;
     std::vector<VkViewport> vvk_viewports{};
+    std::vector<VkRect2D> vvk_scissors{};
 
     uint32_t mvkindex_queue_family;
+    uint32_t mvkindex_transfer_queue_family;
+    uint32_t mun_transfer_queue_index;
+    uint32_t mun_compute_queue_index = UINT32_MAX;
     VkDebugUtilsMessengerEXT mvk_debug_utils_messenger;
 
     PFN_vkCreateDebugUtilsMessengerEXT vkCreateDebugUtilsMessengerEXT;
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "log.h"
+
+#define b_qualify_xr(x) do {                                            \
+        XrResult ret = x;                                               \
+        if(XR_FAILED(ret)) {                                            \
+            Log(LogError, "[QualifyXR] %s failed with: %i", #x, ret);   \
+            return false;                                               \
+        }                                                               \
+    } while(0)                                                          \
+
+#define v_qualify_xr(x) do {                                             \
+        XrResult ret = x;                                               \
+        if(XR_FAILED(ret)) {                                            \
+            Log(LogError, "[QualifyXR] %s failed with: %i", #x, ret);   \
+            return;                                                     \
+        }                                                               \
+    } while(0)                                                          \
+
+#define b_qualify_vk(x) do {                                              \
+        VkResult ret = x;                                               \
+        if(ret != VK_SUCCESS) {                                         \
+            Log(LogError, "[QualifyVK] %s failed with: %i", #x, ret);   \
+            return false;                                               \
+        }                                                               \
+    } while(0)                                                          \
+
+#define d_qualify_vk(x) do {                                            \
+        VkResult ret = x;                                               \
+        if(ret != VK_SUCCESS) {                                         \
+            Log(LogError, "[DQualifyVK] %s failed with: %i", #x, ret);  \
+            return {};                                                  \
+        }                                                               \
+    } while(0)                                                          \
+
+#define xr_get_proc(instance, name) do {                                                    \
+        b_qualify_xr(xrGetInstanceProcAddr(instance, #name, (PFN_xrVoidFunction *) &name)); \
+    } while(0)                                                                              \
+
+#define vk_get_proc(instance, name) do {                                                    \
+        name = (PFN_##name) vkGetInstanceProcAddr(instance, #name);                         \
+    } while(0)
+
+#define vk_get_device_proc(device, name) do {                                               \
+        name = (PFN_##name) vkGetDeviceProcAddr(device, #name);                             \
+    } while(0)
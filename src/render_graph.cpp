@@ -0,0 +1,498 @@
+#include "render_graph.h"
+
+#include <algorithm>
+#include <utility>
+
+#include "log.h"
+#include "qualify.h"
+
+struct RenderGraphAccessInfo {
+    VkPipelineStageFlags vk_stages;
+    VkAccessFlags vk_access;
+    VkImageLayout vk_layout;
+    bool b_write;
+    bool b_attachment;
+};
+
+constexpr VkAccessFlags k_vk_write_access = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+                                            VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_HOST_WRITE_BIT |
+                                            VK_ACCESS_MEMORY_WRITE_BIT;
+
+static RenderGraphAccessInfo AccessInfo(ERenderGraphAccess e_access) {
+    switch (e_access) {
+        case RenderGraphColorAttachment:
+            return {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+                    VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, true, true};
+        case RenderGraphDepthAttachment:
+            return {VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+                    VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+                    VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, true, true};
+        case RenderGraphDepthSampled:
+            return {VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL, false, false};
+        case RenderGraphComputeRead:
+            return {VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_GENERAL, false, false};
+        case RenderGraphComputeWrite:
+            return {VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL, true, false};
+        case RenderGraphTransferWrite:
+            return {VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, true, false};
+        case RenderGraphIndirectRead:
+            return {VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED, false, false};
+    }
+
+    return {VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL, true, false};
+}
+
+//Everything a placed image depends on, pNext chains are not supported
+static bool BSameImage(const VkImageCreateInfo &a, const VkImageCreateInfo &b) {
+    return a.flags == b.flags && a.imageType == b.imageType && a.format == b.format && a.extent.width == b.extent.width &&
+           a.extent.height == b.extent.height && a.extent.depth == b.extent.depth && a.mipLevels == b.mipLevels && a.arrayLayers == b.arrayLayers &&
+           a.samples == b.samples && a.tiling == b.tiling && a.usage == b.usage;
+}
+
+bool RenderGraph::BInit(VkDevice vk_device, GpuAllocator *p_allocator, FrameContextRing *p_frame_ring) {
+    mvk_device = vk_device;
+    mp_allocator = p_allocator;
+    mp_frame_ring = p_frame_ring;
+
+    return true;
+}
+
+void RenderGraph::Destroy() {
+    if (mvk_device == VK_NULL_HANDLE) {
+        return;
+    }
+
+    DestroyTransientImages();
+
+    mvk_device = VK_NULL_HANDLE;
+}
+
+void RenderGraph::Reset() {
+    mv_resources.clear();
+    mv_passes.clear();
+    mv_uses.clear();
+    mv_image_barriers.clear();
+    mv_requested_images.clear();
+    m_final_pass = {};
+    mv_submission_starts.clear();
+    mun_next_pass = 0;
+}
+
+RenderGraphResource RenderGraph::ImportImage(VkImage vk_image, const VkImageSubresourceRange &vk_range, RenderGraphState *p_state) {
+    Resource resource;
+    resource.b_image = true;
+    resource.vk_image = vk_image;
+    resource.vk_range = vk_range;
+    resource.p_imported_state = p_state;
+    mv_resources.push_back(resource);
+
+    return static_cast<RenderGraphResource>(mv_resources.size() - 1);
+}
+
+RenderGraphResource RenderGraph::ImportBuffer(VkBuffer vk_buffer, RenderGraphState *p_state) {
+    Resource resource;
+    resource.vk_buffer = vk_buffer;
+    resource.p_imported_state = p_state;
+    mv_resources.push_back(resource);
+
+    return static_cast<RenderGraphResource>(mv_resources.size() - 1);
+}
+
+RenderGraphResource RenderGraph::CreateImage(const VkImageCreateInfo &vk_image_create_info, VkImageAspectFlags vk_aspects) {
+    TransientImage image;
+    image.vk_image_create_info = vk_image_create_info;
+    image.vk_image_create_info.pNext = nullptr;
+    image.vk_image_create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    image.vk_image_create_info.queueFamilyIndexCount = 0;
+    image.vk_image_create_info.pQueueFamilyIndices = nullptr;
+    image.vk_image_create_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    image.vk_aspects = vk_aspects;
+    mv_requested_images.push_back(image);
+
+    Resource resource;
+    resource.b_image = true;
+    resource.b_transient = true;
+    resource.vk_range = {
+            .aspectMask = vk_aspects,
+            .baseMipLevel = 0,
+            .levelCount = vk_image_create_info.mipLevels,
+            .baseArrayLayer = 0,
+            .layerCount = vk_image_create_info.arrayLayers,
+    };
+    resource.un_transient = static_cast<uint32_t>(mv_requested_images.size() - 1);
+    mv_resources.push_back(resource);
+
+    return static_cast<RenderGraphResource>(mv_resources.size() - 1);
+}
+
+void RenderGraph::SetFinalAccess(RenderGraphResource resource, ERenderGraphAccess e_access) {
+    if (resource < mv_resources.size() && mv_resources[resource].p_imported_state) {
+        mv_resources[resource].b_final_access = true;
+        mv_resources[resource].e_final_access = e_access;
+    }
+}
+
+void RenderGraph::AddPass(const char *pc_name, std::initializer_list<RenderGraphUse> il_uses, RecordFn fn_record) {
+    Pass pass;
+    pass.pc_name = pc_name;
+    pass.un_first_use = static_cast<uint32_t>(mv_uses.size());
+    pass.fn_record = std::move(fn_record);
+
+    for (const RenderGraphUse &use: il_uses) {
+        if (use.resource == k_un_no_resource) {
+            continue;
+        }
+        if (use.resource >= mv_resources.size()) {
+            Log(LogError, "[RenderGraph] Pass %s uses unknown resource %u", pc_name, use.resource);
+            continue;
+        }
+        mv_uses.push_back(use);
+        pass.un_use_count++;
+    }
+
+    mv_passes.push_back(std::move(pass));
+}
+
+bool RenderGraph::BCompile() {
+    {//Culling, back to front: a pass is kept if it writes what outlives the frame or what a kept pass after it uses
+        std::vector<bool> v_needed(mv_resources.size(), false);
+        for (size_t i = mv_passes.size(); i-- > 0;) {
+            Pass &pass = mv_passes[i];
+            pass.b_kept = false;
+            for (uint32_t u = pass.un_first_use; u < pass.un_first_use + pass.un_use_count; u++) {
+                const Resource &resource = mv_resources[mv_uses[u].resource];
+                if (AccessInfo(mv_uses[u].e_access).b_write && (!resource.b_transient || v_needed[mv_uses[u].resource])) {
+                    pass.b_kept = true;
+                }
+            }
+
+            if (!pass.b_kept) {
+                continue;
+            }
+            for (uint32_t u = pass.un_first_use; u < pass.un_first_use + pass.un_use_count; u++) {
+                v_needed[mv_uses[u].resource] = true;
+            }
+        }
+    }
+
+    {//Transient lifetimes, in kept passes
+        for (uint32_t i = 0; i < mv_passes.size(); i++) {
+            const Pass &pass = mv_passes[i];
+            if (!pass.b_kept) {
+                continue;
+            }
+            for (uint32_t u = pass.un_first_use; u < pass.un_first_use + pass.un_use_count; u++) {
+                Resource &resource = mv_resources[mv_uses[u].resource];
+                resource.un_first_pass = std::min(resource.un_first_pass, i);
+                resource.un_last_pass = std::max(resource.un_last_pass, i);
+            }
+        }
+
+        if (!BPlaceTransientImages()) {
+            return false;
+        }
+    }
+
+    for (Resource &resource: mv_resources) {
+        if (resource.p_imported_state) {
+            resource.vk_layout = resource.p_imported_state->vk_layout;
+            resource.vk_write_stages = resource.p_imported_state->vk_stages;
+            resource.vk_write_access = resource.p_imported_state->vk_access;
+        }
+    }
+
+    //A pass using one resource several ways waits for everything before it once, with the union of those ways
+    std::vector<std::pair<RenderGraphResource, RenderGraphAccessInfo>> v_merged;
+    for (Pass &pass: mv_passes) {
+        if (!pass.b_kept) {
+            continue;
+        }
+
+        v_merged.clear();
+        for (uint32_t u = pass.un_first_use; u < pass.un_first_use + pass.un_use_count; u++) {
+            const RenderGraphAccessInfo access_info = AccessInfo(mv_uses[u].e_access);
+            auto it = std::find_if(v_merged.begin(), v_merged.end(), [&](const auto &merged) { return merged.first == mv_uses[u].resource; });
+            if (it == v_merged.end()) {
+                v_merged.emplace_back(mv_uses[u].resource, access_info);
+                continue;
+            }
+
+            if (mv_resources[it->first].b_image && it->second.vk_layout != access_info.vk_layout) {
+                Log(LogError, "[RenderGraph] Pass %s uses an image in two layouts", pass.pc_name);
+            }
+            it->second.vk_stages |= access_info.vk_stages;
+            it->second.vk_access |= access_info.vk_access;
+            it->second.b_write |= access_info.b_write;
+            it->second.b_attachment &= access_info.b_attachment;
+        }
+
+        pass.un_first_image_barrier = static_cast<uint32_t>(mv_image_barriers.size());
+        for (const auto &[resource, access_info]: v_merged) {
+            AddBarrier(pass, mv_resources[resource], access_info);
+        }
+    }
+
+    m_final_pass.un_first_image_barrier = static_cast<uint32_t>(mv_image_barriers.size());
+    for (Resource &resource: mv_resources) {
+        if (resource.b_final_access) {
+            AddBarrier(m_final_pass, resource, AccessInfo(resource.e_final_access));
+        }
+    }
+
+    return true;
+}
+
+void RenderGraph::AddBarrier(Pass &pass, Resource &resource, const RenderGraphAccessInfo &access_info) {
+    //The first use of a transient image waits for whatever used its memory last
+    if (resource.b_transient && resource.vk_image != VK_NULL_HANDLE && resource.un_first_pass != UINT32_MAX &&
+        &pass == &mv_passes[resource.un_first_pass]) {
+        resource.vk_write_stages = mv_slots[mv_transient_images[resource.un_transient].un_slot].vk_last_stages;
+    }
+
+    const bool b_transition = resource.b_image && resource.vk_layout != access_info.vk_layout;
+
+    //Render passes take attachments out of UNDEFINED themselves, with nothing to wait for there is nothing to add to that
+    const bool b_render_pass_transition = b_transition && access_info.b_attachment && resource.vk_layout == VK_IMAGE_LAYOUT_UNDEFINED &&
+                                          resource.vk_write_stages == 0 && resource.vk_read_stages == 0;
+
+    VkPipelineStageFlags vk_src_stages = 0;
+    VkAccessFlags vk_src_access = 0;
+    if (b_transition || access_info.b_write) {
+        //Writes and transitions wait for every use since the last write, reads included. Nothing to wait for with a render pass transition.
+        vk_src_stages = resource.vk_write_stages | resource.vk_read_stages;
+        vk_src_access = resource.vk_write_access;
+    } else if (resource.vk_write_stages != 0 &&
+               ((access_info.vk_stages & ~resource.vk_read_stages) != 0 || (access_info.vk_access & ~resource.vk_read_access) != 0)) {
+        //Reads only wait if no earlier read already had the last write made visible to them
+        vk_src_stages = resource.vk_write_stages;
+        vk_src_access = resource.vk_write_access;
+    }
+
+    if (vk_src_stages != 0 || (b_transition && !b_render_pass_transition)) {
+        pass.vk_src_stages |= vk_src_stages != 0 ? vk_src_stages : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+        pass.vk_dst_stages |= access_info.vk_stages;
+
+        //Buffers go into the one global memory barrier, which is no coarser than buffer barriers on the GPUs we target
+        if (b_transition) {
+            mv_image_barriers.push_back({
+                    .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+                    .srcAccessMask = vk_src_access,
+                    .dstAccessMask = access_info.vk_access,
+                    .oldLayout = resource.vk_layout,
+                    .newLayout = access_info.vk_layout,
+                    .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                    .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                    .image = resource.vk_image,
+                    .subresourceRange = resource.vk_range,
+            });
+            pass.un_image_barrier_count++;
+        } else {
+            pass.vk_memory_barrier.srcAccessMask |= vk_src_access;
+            pass.vk_memory_barrier.dstAccessMask |= access_info.vk_access;
+        }
+    }
+
+    if (access_info.b_write || b_transition) {
+        //A transition is done by the time the barrier's destination stages run, later uses only have to wait for those
+        resource.vk_layout = resource.b_image ? access_info.vk_layout : resource.vk_layout;
+        resource.vk_write_stages = access_info.vk_stages;
+        resource.vk_write_access = access_info.b_write ? access_info.vk_access & k_vk_write_access : 0;
+        resource.vk_read_stages = access_info.b_write ? 0 : access_info.vk_stages;
+        resource.vk_read_access = access_info.b_write ? 0 : access_info.vk_access;
+    } else {
+        resource.vk_read_stages |= access_info.vk_stages;
+        resource.vk_read_access |= access_info.vk_access;
+    }
+
+    if (resource.b_transient && resource.vk_image != VK_NULL_HANDLE) {
+        mv_slots[mv_transient_images[resource.un_transient].un_slot].vk_last_stages = resource.vk_write_stages | resource.vk_read_stages;
+    }
+}
+
+void RenderGraph::RecordBarriers(VkCommandBuffer vk_command_buffer, const Pass &pass) {
+    if (pass.vk_src_stages == 0) {
+        return;
+    }
+
+    const bool b_memory_barrier = pass.vk_memory_barrier.srcAccessMask != 0 || pass.vk_memory_barrier.dstAccessMask != 0;
+    vkCmdPipelineBarrier(vk_command_buffer, pass.vk_src_stages, pass.vk_dst_stages, 0, b_memory_barrier ? 1 : 0, &pass.vk_memory_barrier, 0, nullptr,
+                         pass.un_image_barrier_count, mv_image_barriers.data() + pass.un_first_image_barrier);
+}
+
+void RenderGraph::EndSubmission() {
+    mv_submission_starts.push_back(static_cast<uint32_t>(mv_passes.size()));
+}
+
+void RenderGraph::Execute(VkCommandBuffer vk_command_buffer) {
+    auto it_end = std::upper_bound(mv_submission_starts.begin(), mv_submission_starts.end(), mun_next_pass);
+    const bool b_last = it_end == mv_submission_starts.end();
+    const uint32_t un_end = b_last ? static_cast<uint32_t>(mv_passes.size()) : *it_end;
+
+    for (; mun_next_pass < un_end; mun_next_pass++) {
+        const Pass &pass = mv_passes[mun_next_pass];
+        if (!pass.b_kept) {
+            continue;
+        }
+
+        RecordBarriers(vk_command_buffer, pass);
+        pass.fn_record(vk_command_buffer);
+    }
+
+    if (!b_last) {
+        return;
+    }
+    RecordBarriers(vk_command_buffer, m_final_pass);
+
+    for (const Resource &resource: mv_resources) {
+        if (resource.p_imported_state) {
+            *resource.p_imported_state = {
+                    .vk_layout = resource.vk_layout,
+                    .vk_stages = resource.vk_write_stages | resource.vk_read_stages,
+                    .vk_access = resource.vk_write_access,
+            };
+        }
+    }
+}
+
+VkImage RenderGraph::GetImage(RenderGraphResource resource) const {
+    return resource < mv_resources.size() ? mv_resources[resource].vk_image : VK_NULL_HANDLE;
+}
+
+VkImageView RenderGraph::GetImageView(RenderGraphResource resource) const {
+    return resource < mv_resources.size() ? mv_resources[resource].vk_image_view : VK_NULL_HANDLE;
+}
+
+bool RenderGraph::BPlaceTransientImages() {
+    //Images used by no kept pass get no memory, and count as a different shape than the same image in use
+    std::vector<std::pair<uint32_t, uint32_t>> v_lifetimes(mv_requested_images.size(), {UINT32_MAX, 0});
+    for (const Resource &resource: mv_resources) {
+        if (resource.b_transient) {
+            v_lifetimes[resource.un_transient] = {resource.un_first_pass, resource.un_last_pass};
+        }
+    }
+
+    bool b_same = v_lifetimes == mv_placed_lifetimes && mv_requested_images.size() == mv_transient_images.size();
+    for (size_t i = 0; i < mv_requested_images.size() && b_same; i++) {
+        b_same = BSameImage(mv_requested_images[i].vk_image_create_info, mv_transient_images[i].vk_image_create_info) &&
+                 mv_requested_images[i].vk_aspects == mv_transient_images[i].vk_aspects;
+    }
+
+    if (!b_same) {
+        //Frames in flight may still be using the old placement
+        if (!mv_transient_images.empty() && !mp_frame_ring->BWaitIdle()) {
+            return false;
+        }
+        DestroyTransientImages();
+        mun_placement_generation++;
+
+        mv_transient_images = mv_requested_images;
+        mv_placed_lifetimes = v_lifetimes;
+
+        std::vector<VkMemoryRequirements> v_memory_requirements(mv_transient_images.size());
+        std::vector<uint32_t> v_order;
+        for (uint32_t i = 0; i < mv_transient_images.size(); i++) {
+            if (v_lifetimes[i].first == UINT32_MAX) {
+                continue;
+            }
+            b_qualify_vk(vkCreateImage(mvk_device, &mv_transient_images[i].vk_image_create_info, nullptr, &mv_transient_images[i].vk_image));
+            vkGetImageMemoryRequirements(mvk_device, mv_transient_images[i].vk_image, &v_memory_requirements[i]);
+            v_order.push_back(i);
+        }
+
+        //Largest first, each into the first slot whose images it neither overlaps in time nor in memory types
+        std::sort(v_order.begin(), v_order.end(), [&](uint32_t a, uint32_t b) { return v_memory_requirements[a].size > v_memory_requirements[b].size; });
+
+        VkDeviceSize size_unaliased = 0;
+        for (uint32_t i: v_order) {
+            const VkMemoryRequirements &vk_memory_requirements = v_memory_requirements[i];
+            size_unaliased += vk_memory_requirements.size;
+
+            auto BFits = [&](const MemorySlot &slot) {
+                if ((slot.vk_memory_requirements.memoryTypeBits & vk_memory_requirements.memoryTypeBits) == 0) {
+                    return false;
+                }
+                return std::none_of(slot.v_lifetimes.begin(), slot.v_lifetimes.end(), [&](const std::pair<uint32_t, uint32_t> &lifetime) {
+                    return lifetime.first <= v_lifetimes[i].second && v_lifetimes[i].first <= lifetime.second;
+                });
+            };
+            auto it = std::find_if(mv_slots.begin(), mv_slots.end(), BFits);
+            if (it == mv_slots.end()) {
+                mv_slots.emplace_back();
+                it = mv_slots.end() - 1;
+                it->vk_memory_requirements = vk_memory_requirements;
+            }
+
+            it->vk_memory_requirements.size = std::max(it->vk_memory_requirements.size, vk_memory_requirements.size);
+            it->vk_memory_requirements.alignment = std::max(it->vk_memory_requirements.alignment, vk_memory_requirements.alignment);
+            it->vk_memory_requirements.memoryTypeBits &= vk_memory_requirements.memoryTypeBits;
+            it->v_lifetimes.push_back(v_lifetimes[i]);
+            mv_transient_images[i].un_slot = static_cast<uint32_t>(it - mv_slots.begin());
+        }
+
+        VkDeviceSize size_aliased = 0;
+        for (uint32_t un_slot = 0; un_slot < mv_slots.size(); un_slot++) {
+            MemorySlot &slot = mv_slots[un_slot];
+
+            //Lazily allocated memory only if every image in the slot stays in tile memory
+            const bool b_tile_only = std::all_of(v_order.begin(), v_order.end(), [&](uint32_t i) {
+                return mv_transient_images[i].un_slot != un_slot ||
+                       (mv_transient_images[i].vk_image_create_info.usage & VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT) != 0;
+            });
+            if (!mp_allocator->BAllocate(slot.vk_memory_requirements, b_tile_only ? GpuMemoryTransient : GpuMemoryDeviceLocal, true, false, slot.allocation)) {
+                Log(LogError, "[RenderGraph] Failed to allocate %llu bytes for transient images",
+                    static_cast<unsigned long long>(slot.vk_memory_requirements.size));
+                return false;
+            }
+            size_aliased += slot.vk_memory_requirements.size;
+        }
+
+        for (uint32_t i: v_order) {
+            TransientImage &image = mv_transient_images[i];
+            const GpuAllocation &allocation = mv_slots[image.un_slot].allocation;
+            b_qualify_vk(vkBindImageMemory(mvk_device, image.vk_image, allocation.vk_memory, allocation.size_offset));
+
+            VkImageViewCreateInfo vk_image_view_create_info = {
+                    .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+                    .image = image.vk_image,
+                    .viewType = VK_IMAGE_VIEW_TYPE_2D_ARRAY,
+                    .format = image.vk_image_create_info.format,
+                    .subresourceRange = {
+                            .aspectMask = image.vk_aspects,
+                            .baseMipLevel = 0,
+                            .levelCount = image.vk_image_create_info.mipLevels,
+                            .baseArrayLayer = 0,
+                            .layerCount = image.vk_image_create_info.arrayLayers,
+                    },
+            };
+            b_qualify_vk(vkCreateImageView(mvk_device, &vk_image_view_create_info, nullptr, &image.vk_image_view));
+        }
+
+        Log("[RenderGraph] Placed %zu transient images in %zu allocations, %llu bytes instead of %llu", v_order.size(), mv_slots.size(),
+            static_cast<unsigned long long>(size_aliased), static_cast<unsigned long long>(size_unaliased));
+    }
+
+    for (Resource &resource: mv_resources) {
+        if (resource.b_transient) {
+            resource.vk_image = mv_transient_images[resource.un_transient].vk_image;
+            resource.vk_image_view = mv_transient_images[resource.un_transient].vk_image_view;
+        }
+    }
+
+    return true;
+}
+
+void RenderGraph::DestroyTransientImages() {
+    for (TransientImage &image: mv_transient_images) {
+        vkDestroyImageView(mvk_device, image.vk_image_view, nullptr);
+        vkDestroyImage(mvk_device, image.vk_image, nullptr);
+    }
+    for (MemorySlot &slot: mv_slots) {
+        if (slot.allocation.BValid()) {
+            mp_allocator->Free(slot.allocation);
+        }
+    }
+
+    mv_transient_images.clear();
+    mv_placed_lifetimes.clear();
+    mv_slots.clear();
+}
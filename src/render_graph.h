@@ -0,0 +1,184 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <initializer_list>
+#include <vector>
+
+#include "vulkan/vulkan.h"
+
+#include "frame_context.h"
+#include "gpu_allocator.h"
+
+using RenderGraphResource = uint32_t;
+
+//How a pass uses a resource, each one stands for the stages, accesses and image layout barriers are built from
+enum ERenderGraphAccess : uint32_t {
+    RenderGraphColorAttachment = 0, //written by a render pass. Transitions out of UNDEFINED are left to its initialLayout.
+    RenderGraphDepthAttachment,     //tested and written by a render pass, same as above
+    RenderGraphDepthSampled,        //depth read by compute in DEPTH_STENCIL_READ_ONLY_OPTIMAL
+    RenderGraphComputeRead,         //storage buffer or image read by compute, images in GENERAL
+    RenderGraphComputeWrite,        //storage buffer or image read and written by compute, images in GENERAL
+    RenderGraphTransferWrite,       //filled or copied into
+    RenderGraphIndirectRead,        //indirect draw commands and counts
+};
+
+struct RenderGraphAccessInfo;
+
+struct RenderGraphUse {
+    RenderGraphResource resource;
+    ERenderGraphAccess e_access;
+};
+
+//Last use of a resource the graph does not own. Whoever owns it keeps this across frames, the graph picks up from it and
+//writes back where the frame left the resource.
+struct RenderGraphState {
+    VkImageLayout vk_layout = VK_IMAGE_LAYOUT_UNDEFINED; //ignored for buffers
+    VkPipelineStageFlags vk_stages = 0;
+    VkAccessFlags vk_access = 0; //writes not made visible yet
+};
+
+//Frame graph of the render thread's command buffer. Passes declare which images and buffers they use and how, the graph
+//then derives every barrier and layout transition between them and records them batched into one vkCmdPipelineBarrier
+//in front of each pass that needs one. Barriers inside a pass, like between the levels of a reduction, stay the pass's own.
+//
+//Imported resources outlive the frame, so passes writing them are always kept. A pass whose writes only go to transient
+//images no kept pass reads is culled. Transient images are created by the graph and share memory with others whose
+//passes they do not overlap, the placement is redone whenever the set of transient images or their lifetimes change.
+//
+//Rebuilt by the render thread every frame: Reset, import and create resources, add passes in submission order, BCompile, Execute.
+//A frame split into several submissions on one queue calls EndSubmission between their passes and Execute once per submission.
+class RenderGraph {
+public:
+    using RecordFn = std::function<void(VkCommandBuffer vk_command_buffer)>;
+
+    //Uses of it are skipped, for resources a pass only has in some frames
+    static constexpr RenderGraphResource k_un_no_resource = UINT32_MAX;
+
+    //Transient images are only replaced once p_frame_ring has no frame in flight that could still be using them
+    bool BInit(VkDevice vk_device, GpuAllocator *p_allocator, FrameContextRing *p_frame_ring);
+    void Destroy();
+
+    void Reset();
+
+    RenderGraphResource ImportImage(VkImage vk_image, const VkImageSubresourceRange &vk_range, RenderGraphState *p_state);
+    RenderGraphResource ImportBuffer(VkBuffer vk_buffer, RenderGraphState *p_state);
+
+    //Image that only lives within this frame, with a 2D_ARRAY view over all of it. The contents are undefined on first use.
+    RenderGraphResource CreateImage(const VkImageCreateInfo &vk_image_create_info, VkImageAspectFlags vk_aspects);
+
+    //Layout and access an imported image has to be left in once the frame is done, for images handed on to the runtime
+    void SetFinalAccess(RenderGraphResource resource, ERenderGraphAccess e_access);
+
+    //Passes run in the order they are added. A pass using one resource in several ways has to order those itself.
+    void AddPass(const char *pc_name, std::initializer_list<RenderGraphUse> il_uses, RecordFn fn_record);
+
+    //Passes added from now on go into the next submission. Barriers stay valid across it, as long as both go to the same queue.
+    void EndSubmission();
+
+    //Culls passes, places transient images and builds the barriers. Returns false if transient images could not be allocated.
+    bool BCompile();
+
+    //Records the kept passes of the next submission with their barriers. The last one also records the final transitions and
+    //writes the imported resources' states back.
+    void Execute(VkCommandBuffer vk_command_buffer);
+
+    //Only valid for transient images once BCompile succeeded
+    VkImage GetImage(RenderGraphResource resource) const;
+    VkImageView GetImageView(RenderGraphResource resource) const;
+
+    //Changes whenever BCompile moved the transient images, anything built over their views has to be rebuilt then. Handles of
+    //destroyed images may come back for new ones, so they cannot tell.
+    uint64_t UnPlacementGeneration() const { return mun_placement_generation; }
+
+private:
+    struct Resource {
+        bool b_image = false;
+        bool b_transient = false;
+
+        VkImage vk_image = VK_NULL_HANDLE;
+        VkImageView vk_image_view = VK_NULL_HANDLE;
+        VkBuffer vk_buffer = VK_NULL_HANDLE;
+        VkImageSubresourceRange vk_range{};
+
+        RenderGraphState *p_imported_state = nullptr;
+        bool b_final_access = false;
+        ERenderGraphAccess e_final_access = RenderGraphColorAttachment;
+
+        //transient images: index into mv_transient_images, and the first and last kept pass using it
+        uint32_t un_transient = UINT32_MAX;
+        uint32_t un_first_pass = UINT32_MAX;
+        uint32_t un_last_pass = 0;
+
+        //while compiling
+        VkImageLayout vk_layout = VK_IMAGE_LAYOUT_UNDEFINED;
+        VkPipelineStageFlags vk_write_stages = 0;
+        VkAccessFlags vk_write_access = 0;
+        VkPipelineStageFlags vk_read_stages = 0;
+        VkAccessFlags vk_read_access = 0;
+    };
+
+    struct Pass {
+        const char *pc_name = nullptr;
+        uint32_t un_first_use = 0;
+        uint32_t un_use_count = 0;
+        RecordFn fn_record;
+        bool b_kept = false;
+
+        //barrier batch recorded in front of the pass
+        VkPipelineStageFlags vk_src_stages = 0;
+        VkPipelineStageFlags vk_dst_stages = 0;
+        VkMemoryBarrier vk_memory_barrier{VK_STRUCTURE_TYPE_MEMORY_BARRIER};
+        uint32_t un_first_image_barrier = 0;
+        uint32_t un_image_barrier_count = 0;
+    };
+
+    struct TransientImage {
+        VkImageCreateInfo vk_image_create_info{};
+        VkImageAspectFlags vk_aspects = 0;
+        VkImage vk_image = VK_NULL_HANDLE;
+        VkImageView vk_image_view = VK_NULL_HANDLE;
+        uint32_t un_slot = UINT32_MAX;
+    };
+
+    //Memory shared by transient images with disjoint lifetimes
+    struct MemorySlot {
+        GpuAllocation allocation;
+        VkMemoryRequirements vk_memory_requirements{};
+        std::vector<std::pair<uint32_t, uint32_t>> v_lifetimes;
+
+        //stages the last image placed in it was used in, which the next one's first use has to wait for. Carries over
+        //into the next frame, where it orders the first use after the previous frame's last.
+        VkPipelineStageFlags vk_last_stages = 0;
+    };
+
+    //Adds what resource needs before the pass's use of it to the pass's batch, and moves its state past that use
+    void AddBarrier(Pass &pass, Resource &resource, const RenderGraphAccessInfo &access_info);
+    void RecordBarriers(VkCommandBuffer vk_command_buffer, const Pass &pass);
+
+    bool BPlaceTransientImages();
+    void DestroyTransientImages();
+
+    VkDevice mvk_device = VK_NULL_HANDLE;
+    GpuAllocator *mp_allocator = nullptr;
+    FrameContextRing *mp_frame_ring = nullptr;
+
+    std::vector<Resource> mv_resources;
+    std::vector<Pass> mv_passes;
+    std::vector<RenderGraphUse> mv_uses;
+    std::vector<VkImageMemoryBarrier> mv_image_barriers;
+
+    //transient image descs of this frame in CreateImage order, compared against the ones placed last to reuse them
+    std::vector<TransientImage> mv_requested_images;
+    std::vector<TransientImage> mv_transient_images;
+    std::vector<std::pair<uint32_t, uint32_t>> mv_placed_lifetimes;
+    std::vector<MemorySlot> mv_slots;
+    uint64_t mun_placement_generation = 0;
+
+    //transitions into the final accesses, recorded after the last pass
+    Pass m_final_pass;
+
+    //index of the first pass of every submission after the first, and the next pass Execute records
+    std::vector<uint32_t> mv_submission_starts;
+    uint32_t mun_next_pass = 0;
+};
@@ -0,0 +1,55 @@
+#include "resolution_controller.h"
+
+#include <algorithm>
+
+//Share of the display period the GPU time is steered towards, the rest absorbs spikes and the compositor's own work
+constexpr float k_f_gpu_budget_fraction = 0.85f;
+
+//Gains on the error as a fraction of the budget, per measured frame. GPU time grows with the square of the scale, so these
+//stay small enough for the integral term to settle without overshooting.
+constexpr float k_f_gain_proportional = 0.2f;
+constexpr float k_f_gain_integral = 0.08f;
+constexpr float k_f_gain_derivative = 0.05f;
+
+//Weight of the newest measurement in the smoothed GPU time
+constexpr float k_f_gpu_time_smoothing = 0.3f;
+
+void ResolutionController::Reset(float f_min_scale, float f_max_scale) {
+    mf_min_scale = f_min_scale;
+    mf_max_scale = std::max(f_max_scale, f_min_scale);
+    mf_scale = std::clamp(1.f, mf_min_scale, mf_max_scale);
+
+    mf_filtered_gpu_ms = 0.f;
+    mf_error_previous = 0.f;
+    mf_error_before_previous = 0.f;
+    mb_measured = false;
+}
+
+float ResolutionController::FUpdate(float f_gpu_ms, float f_display_period_ms) {
+    if (f_display_period_ms <= 0.f) {
+        return mf_scale;
+    }
+
+    mf_filtered_gpu_ms = mb_measured ? mf_filtered_gpu_ms + (f_gpu_ms - mf_filtered_gpu_ms) * k_f_gpu_time_smoothing : f_gpu_ms;
+
+    //Positive while there is time to spare
+    const float f_budget_ms = f_display_period_ms * k_f_gpu_budget_fraction;
+    const float f_error = (f_budget_ms - mf_filtered_gpu_ms) / f_budget_ms;
+
+    if (!mb_measured) {
+        mf_error_previous = mf_error_before_previous = f_error;
+        mb_measured = true;
+    }
+
+    //Velocity form, the output changes by the PID terms instead of being them. Clamping the output then cannot wind the
+    //integral up while the scale sits at a limit.
+    const float f_delta = k_f_gain_proportional * (f_error - mf_error_previous) + k_f_gain_integral * f_error +
+                          k_f_gain_derivative * (f_error - 2.f * mf_error_previous + mf_error_before_previous);
+
+    mf_error_before_previous = mf_error_previous;
+    mf_error_previous = f_error;
+
+    mf_scale = std::clamp(mf_scale + f_delta, mf_min_scale, mf_max_scale);
+
+    return mf_scale;
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstdint>
+
+//Picks the scale frames are rendered at from how long the GPU took for earlier ones. An incremental PID controller steers the
+//measured GPU time towards a fraction of the display period, so heavy scenes lose resolution before they lose frames and
+//light ones get it back. The scale is relative to the runtime's recommended image size and applies to both axes.
+class ResolutionController {
+public:
+    //f_max_scale lets light scenes render above the recommended size, up to what the swapchain was allocated at
+    void Reset(float f_min_scale, float f_max_scale);
+
+    //Feeds the GPU time of one frame and the display period it had to fit in, both in milliseconds. Returns the new scale.
+    float FUpdate(float f_gpu_ms, float f_display_period_ms);
+
+    float FScale() const { return mf_scale; }
+
+private:
+    float mf_min_scale = 1.f;
+    float mf_max_scale = 1.f;
+    float mf_scale = 1.f;
+
+    float mf_filtered_gpu_ms = 0.f;
+    float mf_error_previous = 0.f;
+    float mf_error_before_previous = 0.f;
+    bool mb_measured = false;
+};
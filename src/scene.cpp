@@ -0,0 +1,130 @@
+#include "scene.h"
+
+#include <algorithm>
+
+#include "log.h"
+#include "simd.h"
+
+SceneNode Scene::CreateNode(SceneNode parent, const XrPosef &xr_pose, float f_scale) {
+    const SceneNode node = UnNodeCount();
+    if (parent != k_un_no_node && parent >= node) {
+        Log(LogError, "[Scene] Parent %u of node %u does not exist, attaching it to the root", parent, node);
+        parent = k_un_no_node;
+    }
+
+    mv_parents.push_back(parent);
+    mv_first_children.push_back(k_un_no_node);
+    mv_next_siblings.push_back(k_un_no_node);
+    mv_local_poses.push_back(xr_pose);
+    mv_local_scales.push_back(f_scale);
+    mv_world_matrices.push_back(Mat4Identity());
+    mv_world_scales.push_back(1.f);
+    mv_node_objects.push_back(k_un_no_object);
+    mv_dirty.push_back(0);
+
+    if (parent != k_un_no_node) {
+        mv_next_siblings[node] = mv_first_children[parent];
+        mv_first_children[parent] = node;
+    }
+
+    MarkDirty(node);
+
+    return node;
+}
+
+SceneNode Scene::CreateObject(SceneNode parent, const XrPosef &xr_pose, float f_scale, uint32_t un_mesh, const XrVector4f &xr_mesh_sphere) {
+    const SceneNode node = CreateNode(parent, xr_pose, f_scale);
+    const uint32_t un_object = UnObjectCount();
+    mv_node_objects[node] = un_object;
+    mv_object_nodes.push_back(node);
+
+    if (un_object == mv_centers_x.size()) {
+        const size_t size_padded_count = un_object + k_un_float4_lanes;
+        for (std::vector<float> *pv: {&mv_centers_x, &mv_centers_y, &mv_centers_z, &mv_radii, &mv_error_scales}) {
+            pv->resize(size_padded_count, 0.f);
+        }
+        mv_mesh_spheres.resize(size_padded_count, {0.f, 0.f, 0.f, 0.f});
+        mv_meshes.resize(size_padded_count, 0);
+        mv_lods.resize(size_padded_count, 0);
+    }
+
+    mv_mesh_spheres[un_object] = xr_mesh_sphere;
+    mv_meshes[un_object] = un_mesh;
+
+    return node;
+}
+
+void Scene::SetLocalTransform(SceneNode node, const XrPosef &xr_pose, float f_scale) {
+    mv_local_poses[node] = xr_pose;
+    mv_local_scales[node] = f_scale;
+    MarkDirty(node);
+}
+
+void Scene::MarkDirty(SceneNode node) {
+    if (!mv_dirty[node]) {
+        mv_dirty[node] = 1;
+        mv_dirty_nodes.push_back(node);
+    }
+}
+
+void Scene::Update() {
+    mv_changed_objects.clear();
+    if (mv_dirty_nodes.empty()) {
+        return;
+    }
+
+    //Everything below a marked node moves with it. The list grows while it is walked, so children added to it get their own
+    //children added in turn.
+    for (size_t i = 0; i < mv_dirty_nodes.size(); i++) {
+        for (SceneNode child = mv_first_children[mv_dirty_nodes[i]]; child != k_un_no_node; child = mv_next_siblings[child]) {
+            MarkDirty(child);
+        }
+    }
+
+    //Parents come first in index order, so going through the nodes in that order finds every parent's world matrix done
+    std::sort(mv_dirty_nodes.begin(), mv_dirty_nodes.end());
+
+    const uint32_t un_dirty_count = static_cast<uint32_t>(mv_dirty_nodes.size());
+    mv_update_poses.resize(un_dirty_count);
+    mv_update_matrices.resize(un_dirty_count);
+    for (uint32_t i = 0; i < un_dirty_count; i++) {
+        mv_update_poses[i] = mv_local_poses[mv_dirty_nodes[i]];
+    }
+    Mat4FromPoses(mv_update_poses.data(), un_dirty_count, mv_update_matrices.data());
+
+    for (uint32_t i = 0; i < un_dirty_count; i++) {
+        const SceneNode node = mv_dirty_nodes[i];
+        const SceneNode parent = mv_parents[node];
+        const float f_scale = mv_local_scales[node];
+
+        Mat4 &mat4_local = mv_update_matrices[i];
+        for (int n_element = 0; n_element < 12; n_element++) {
+            mat4_local.af[n_element] *= f_scale;
+        }
+
+        if (parent == k_un_no_node) {
+            mv_world_matrices[node] = mat4_local;
+            mv_world_scales[node] = f_scale;
+        } else {
+            mv_world_matrices[node] = Mat4Multiply(mv_world_matrices[parent], mat4_local);
+            mv_world_scales[node] = mv_world_scales[parent] * f_scale;
+        }
+        mv_dirty[node] = 0;
+
+        const uint32_t un_object = mv_node_objects[node];
+        if (un_object == k_un_no_object) {
+            continue;
+        }
+
+        const XrVector4f &xr_mesh_sphere = mv_mesh_spheres[un_object];
+        const XrVector3f xr_center = Mat4TransformPoint(mv_world_matrices[node], {xr_mesh_sphere.x, xr_mesh_sphere.y, xr_mesh_sphere.z});
+        mv_centers_x[un_object] = xr_center.x;
+        mv_centers_y[un_object] = xr_center.y;
+        mv_centers_z[un_object] = xr_center.z;
+        mv_radii[un_object] = xr_mesh_sphere.w * mv_world_scales[node];
+        mv_error_scales[un_object] = mv_world_scales[node];
+        mv_changed_objects.push_back(un_object);
+    }
+
+    mv_dirty_nodes.clear();
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "openxr/openxr.h"
+
+#include "xr_math.h"
+
+using SceneNode = uint32_t;
+
+//Transform hierarchy and the objects drawn from it, kept as structure of arrays. A node is a local pose and uniform scale
+//under its parent, an object is a node with a mesh and a bounding sphere in the mesh's space.
+//
+//Nodes are only ever appended and a parent has to exist before its children, so index order always has every parent in
+//front of its children and a node's index doubles as its handle. Objects are numbered the same way in order of creation,
+//which is the order GpuCulling and LodSelector index them in.
+//
+//Changing a local transform only marks the node. Update then recomputes the world matrices of the marked nodes and
+//everything below them, and the world bounds of the objects among those, so a frame where nothing moved costs nothing.
+//Object arrays are padded to a multiple of k_un_float4_lanes with spheres of radius 0 at the origin.
+class Scene {
+public:
+    static constexpr SceneNode k_un_no_node = UINT32_MAX;
+    static constexpr uint32_t k_un_no_object = UINT32_MAX;
+
+    SceneNode CreateNode(SceneNode parent, const XrPosef &xr_pose, float f_scale);
+    SceneNode CreateObject(SceneNode parent, const XrPosef &xr_pose, float f_scale, uint32_t un_mesh, const XrVector4f &xr_mesh_sphere);
+
+    void SetLocalTransform(SceneNode node, const XrPosef &xr_pose, float f_scale);
+
+    //Brings world matrices and bounds up to date with every SetLocalTransform since the last update
+    void Update();
+
+    //Objects whose world matrix or bounds the last Update changed, in ascending order. Only mirrors of them need refreshing.
+    const std::vector<uint32_t> &GetChangedObjects() const { return mv_changed_objects; }
+
+    uint32_t UnNodeCount() const { return static_cast<uint32_t>(mv_parents.size()); }
+    uint32_t UnObjectCount() const { return static_cast<uint32_t>(mv_object_nodes.size()); }
+
+    uint32_t UnObject(SceneNode node) const { return mv_node_objects[node]; }
+    SceneNode GetObjectNode(uint32_t un_object) const { return mv_object_nodes[un_object]; }
+
+    //As of the last Update
+    const Mat4 &GetWorldMatrix(SceneNode node) const { return mv_world_matrices[node]; }
+
+    //Per object, as of the last Update. Error scales are the world scales LOD errors in mesh units are multiplied by.
+    const float *PCentersX() const { return mv_centers_x.data(); }
+    const float *PCentersY() const { return mv_centers_y.data(); }
+    const float *PCentersZ() const { return mv_centers_z.data(); }
+    const float *PRadii() const { return mv_radii.data(); }
+    const float *PErrorScales() const { return mv_error_scales.data(); }
+    const uint32_t *PMeshes() const { return mv_meshes.data(); }
+
+    //LOD each object was last drawn with, owned by LodSelector
+    uint8_t *PLods() { return mv_lods.data(); }
+
+private:
+    void MarkDirty(SceneNode node);
+
+    //Per node
+    std::vector<SceneNode> mv_parents;
+    std::vector<SceneNode> mv_first_children;
+    std::vector<SceneNode> mv_next_siblings;
+    std::vector<XrPosef> mv_local_poses;
+    std::vector<float> mv_local_scales;
+    std::vector<Mat4> mv_world_matrices;
+    std::vector<float> mv_world_scales;
+    std::vector<uint32_t> mv_node_objects;
+    std::vector<uint8_t> mv_dirty;
+
+    //Per object, padded
+    std::vector<SceneNode> mv_object_nodes;
+    std::vector<XrVector4f> mv_mesh_spheres;
+    std::vector<float> mv_centers_x;
+    std::vector<float> mv_centers_y;
+    std::vector<float> mv_centers_z;
+    std::vector<float> mv_radii;
+    std::vector<float> mv_error_scales;
+    std::vector<uint32_t> mv_meshes;
+    std::vector<uint8_t> mv_lods;
+
+    //nodes marked since the last Update, then everything below them as well
+    std::vector<SceneNode> mv_dirty_nodes;
+    std::vector<XrPosef> mv_update_poses;
+    std::vector<Mat4> mv_update_matrices;
+    std::vector<uint32_t> mv_changed_objects;
+};
@@ -0,0 +1,37 @@
+#include "shader_reflection.h"
+
+#include <algorithm>
+
+std::vector<VkDescriptorSetLayoutBinding> CollectSetBindings(std::initializer_list<const ShaderBlob *> shaders, uint32_t un_set) {
+    std::vector<VkDescriptorSetLayoutBinding> v_bindings;
+
+    for (const ShaderBlob *p_shader: shaders) {
+        for (uint32_t i = 0; i < p_shader->un_binding_count; i++) {
+            const ShaderBinding &binding = p_shader->p_bindings[i];
+            if (binding.un_set != un_set) {
+                continue;
+            }
+
+            auto it = std::find_if(v_bindings.begin(), v_bindings.end(), [&](const VkDescriptorSetLayoutBinding &vk_binding) {
+                return vk_binding.binding == binding.un_binding;
+            });
+            if (it != v_bindings.end()) {
+                it->stageFlags |= p_shader->vk_stage;
+                continue;
+            }
+
+            v_bindings.push_back({
+                    .binding = binding.un_binding,
+                    .descriptorType = binding.vk_descriptor_type,
+                    .descriptorCount = std::max(binding.un_descriptor_count, 1u),
+                    .stageFlags = static_cast<VkShaderStageFlags>(p_shader->vk_stage),
+            });
+        }
+    }
+
+    std::sort(v_bindings.begin(), v_bindings.end(), [](const VkDescriptorSetLayoutBinding &a, const VkDescriptorSetLayoutBinding &b) {
+        return a.binding < b.binding;
+    });
+
+    return v_bindings;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <vector>
+
+#include "vulkan/vulkan.h"
+
+//Descriptor binding declared by a shader, reflected from its SPIR-V at build time
+struct ShaderBinding {
+    uint32_t un_set;
+    uint32_t un_binding;
+    VkDescriptorType vk_descriptor_type;
+    uint32_t un_descriptor_count; //0 for runtime sized arrays
+};
+
+//SPIR-V embedded into the library by qov_add_shaders (cmake/Shaders.cmake), together with the layout it expects
+struct ShaderBlob {
+    const uint32_t *pun_spirv;
+    size_t size_spirv; //in bytes, as VkShaderModuleCreateInfo::codeSize wants it
+    VkShaderStageFlagBits vk_stage;
+
+    const ShaderBinding *p_bindings;
+    uint32_t un_binding_count;
+
+    //un_push_constant_size is 0 if the shader has no push constant block
+    uint32_t un_push_constant_offset;
+    uint32_t un_push_constant_size;
+};
+
+//Bindings every shader in shaders declares in descriptor set un_set, in binding order. Bindings declared by several
+//shaders are merged into one with the union of their stages.
+std::vector<VkDescriptorSetLayoutBinding> CollectSetBindings(std::initializer_list<const ShaderBlob *> shaders, uint32_t un_set);
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+
+#include "vulkan/vulkan.h"
+
+#include "xr_math.h"
+
+//CPU mirrors of the uniform blocks declared in src/main/shaders, std140 layout. Keep them in sync with the GLSL.
+
+//Descriptor set 0 is the per frame set, every binding in it is a UNIFORM_BUFFER_DYNAMIC into the frame's transient buffer
+constexpr uint32_t k_un_frame_set = 0;
+
+//set 0, binding 0: written once per frame, indexed with gl_ViewIndex
+struct ViewUniforms {
+    Mat4 amat4_view_projection[2];
+};
+
+//set 0, binding 1: written once per draw
+struct DrawUniforms {
+    Mat4 mat4_model;
+};
+
+//set 0, binding 2: written once per cull pass, the depth pyramid it tests against and the matrices it was built with
+struct OcclusionUniforms {
+    Mat4 amat4_view_projection[2];
+    float af_depth_size[2]; //depth attachment size the pyramid was reduced from, in texels
+    uint32_t un_level_count;
+    uint32_t un_view_count;
+};
+
+//descriptor range of each binding in set 0, in binding order
+constexpr VkDeviceSize k_asize_frame_uniform_ranges[] = {
+        sizeof(ViewUniforms),
+        sizeof(DrawUniforms),
+        sizeof(OcclusionUniforms),
+};
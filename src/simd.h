@@ -0,0 +1,176 @@
+#pragma once
+
+#include <cstdint>
+
+//Four float lanes in one register: NEON on arm64, which every Quest is, and SSE2 on x86_64 hosts. Anything else gets plain
+//arrays the compiler may or may not vectorize. Masks hold all bits set for true lanes and none for false ones.
+//QOV_SIMD_SCALAR picks the plain arrays on any target, so the tests can check them against the vector paths.
+#if defined(__aarch64__) && !defined(QOV_SIMD_SCALAR)
+#define QOV_SIMD_NEON
+#elif defined(__SSE2__) && !defined(QOV_SIMD_SCALAR)
+#define QOV_SIMD_SSE2
+#endif
+
+#if defined(QOV_SIMD_NEON)
+#include <arm_neon.h>
+
+using Float4 = float32x4_t;
+using Mask4 = uint32x4_t;
+#elif defined(QOV_SIMD_SSE2)
+#include <emmintrin.h>
+
+using Float4 = __m128;
+using Mask4 = __m128;
+#else
+struct Float4 {
+    float af[4];
+};
+struct Mask4 {
+    uint32_t aun[4];
+};
+#endif
+
+constexpr uint32_t k_un_float4_lanes = 4;
+
+#if defined(QOV_SIMD_NEON)
+
+inline Float4 Float4Load(const float *af) { return vld1q_f32(af); }
+inline void Float4Store(float *af, Float4 f4) { vst1q_f32(af, f4); }
+inline Float4 Float4Splat(float f) { return vdupq_n_f32(f); }
+inline Float4 Float4Set(float f_x, float f_y, float f_z, float f_w) {
+    const float af[] = {f_x, f_y, f_z, f_w};
+    return vld1q_f32(af);
+}
+
+inline Float4 Float4Add(Float4 f4_a, Float4 f4_b) { return vaddq_f32(f4_a, f4_b); }
+inline Float4 Float4Sub(Float4 f4_a, Float4 f4_b) { return vsubq_f32(f4_a, f4_b); }
+inline Float4 Float4Mul(Float4 f4_a, Float4 f4_b) { return vmulq_f32(f4_a, f4_b); }
+inline Float4 Float4Div(Float4 f4_a, Float4 f4_b) { return vdivq_f32(f4_a, f4_b); }
+//f4_a * f4_b + f4_c, fused where the ISA has it
+inline Float4 Float4MulAdd(Float4 f4_a, Float4 f4_b, Float4 f4_c) { return vfmaq_f32(f4_c, f4_a, f4_b); }
+inline Float4 Float4Min(Float4 f4_a, Float4 f4_b) { return vminq_f32(f4_a, f4_b); }
+inline Float4 Float4Max(Float4 f4_a, Float4 f4_b) { return vmaxq_f32(f4_a, f4_b); }
+inline Float4 Float4Sqrt(Float4 f4) { return vsqrtq_f32(f4); }
+
+inline Mask4 Float4GreaterEqual(Float4 f4_a, Float4 f4_b) { return vcgeq_f32(f4_a, f4_b); }
+inline Mask4 Float4LessEqual(Float4 f4_a, Float4 f4_b) { return vcleq_f32(f4_a, f4_b); }
+inline Mask4 Mask4And(Mask4 m4_a, Mask4 m4_b) { return vandq_u32(m4_a, m4_b); }
+inline Mask4 Mask4All() { return vdupq_n_u32(UINT32_MAX); }
+
+//Lanes of f4_true where m4 is set, of f4_false elsewhere
+inline Float4 Float4Select(Mask4 m4, Float4 f4_true, Float4 f4_false) { return vbslq_f32(m4, f4_true, f4_false); }
+
+//Bit i set if lane i of m4 is
+inline uint32_t UnMask4Bits(Mask4 m4) {
+    const uint32_t aun_bits[] = {1u, 2u, 4u, 8u};
+    return vaddvq_u32(vandq_u32(m4, vld1q_u32(aun_bits)));
+}
+
+//Rows become columns: lane j of f4_i ends up in lane i of the j-th argument
+inline void Float4Transpose(Float4 &f4_a, Float4 &f4_b, Float4 &f4_c, Float4 &f4_d) {
+    const float32x4x2_t f4x2_ab = vtrnq_f32(f4_a, f4_b);
+    const float32x4x2_t f4x2_cd = vtrnq_f32(f4_c, f4_d);
+    f4_a = vcombine_f32(vget_low_f32(f4x2_ab.val[0]), vget_low_f32(f4x2_cd.val[0]));
+    f4_b = vcombine_f32(vget_low_f32(f4x2_ab.val[1]), vget_low_f32(f4x2_cd.val[1]));
+    f4_c = vcombine_f32(vget_high_f32(f4x2_ab.val[0]), vget_high_f32(f4x2_cd.val[0]));
+    f4_d = vcombine_f32(vget_high_f32(f4x2_ab.val[1]), vget_high_f32(f4x2_cd.val[1]));
+}
+
+#elif defined(QOV_SIMD_SSE2)
+
+inline Float4 Float4Load(const float *af) { return _mm_loadu_ps(af); }
+inline void Float4Store(float *af, Float4 f4) { _mm_storeu_ps(af, f4); }
+inline Float4 Float4Splat(float f) { return _mm_set1_ps(f); }
+inline Float4 Float4Set(float f_x, float f_y, float f_z, float f_w) { return _mm_setr_ps(f_x, f_y, f_z, f_w); }
+
+inline Float4 Float4Add(Float4 f4_a, Float4 f4_b) { return _mm_add_ps(f4_a, f4_b); }
+inline Float4 Float4Sub(Float4 f4_a, Float4 f4_b) { return _mm_sub_ps(f4_a, f4_b); }
+inline Float4 Float4Mul(Float4 f4_a, Float4 f4_b) { return _mm_mul_ps(f4_a, f4_b); }
+inline Float4 Float4Div(Float4 f4_a, Float4 f4_b) { return _mm_div_ps(f4_a, f4_b); }
+inline Float4 Float4MulAdd(Float4 f4_a, Float4 f4_b, Float4 f4_c) { return _mm_add_ps(_mm_mul_ps(f4_a, f4_b), f4_c); }
+inline Float4 Float4Min(Float4 f4_a, Float4 f4_b) { return _mm_min_ps(f4_a, f4_b); }
+inline Float4 Float4Max(Float4 f4_a, Float4 f4_b) { return _mm_max_ps(f4_a, f4_b); }
+inline Float4 Float4Sqrt(Float4 f4) { return _mm_sqrt_ps(f4); }
+
+inline Mask4 Float4GreaterEqual(Float4 f4_a, Float4 f4_b) { return _mm_cmpge_ps(f4_a, f4_b); }
+inline Mask4 Float4LessEqual(Float4 f4_a, Float4 f4_b) { return _mm_cmple_ps(f4_a, f4_b); }
+inline Mask4 Mask4And(Mask4 m4_a, Mask4 m4_b) { return _mm_and_ps(m4_a, m4_b); }
+inline Mask4 Mask4All() { return _mm_castsi128_ps(_mm_set1_epi32(-1)); }
+
+inline Float4 Float4Select(Mask4 m4, Float4 f4_true, Float4 f4_false) { return _mm_or_ps(_mm_and_ps(m4, f4_true), _mm_andnot_ps(m4, f4_false)); }
+
+inline uint32_t UnMask4Bits(Mask4 m4) { return static_cast<uint32_t>(_mm_movemask_ps(m4)); }
+
+inline void Float4Transpose(Float4 &f4_a, Float4 &f4_b, Float4 &f4_c, Float4 &f4_d) { _MM_TRANSPOSE4_PS(f4_a, f4_b, f4_c, f4_d); }
+
+#else
+
+template<typename Fn>
+inline Float4 Float4Lanes(Fn fn) {
+    Float4 f4_result;
+    for (uint32_t i = 0; i < k_un_float4_lanes; i++) {
+        f4_result.af[i] = fn(i);
+    }
+    return f4_result;
+}
+
+template<typename Fn>
+inline Mask4 Mask4Lanes(Fn fn) {
+    Mask4 m4_result;
+    for (uint32_t i = 0; i < k_un_float4_lanes; i++) {
+        m4_result.aun[i] = fn(i) ? UINT32_MAX : 0u;
+    }
+    return m4_result;
+}
+
+inline Float4 Float4Load(const float *af) { return Float4Lanes([&](uint32_t i) { return af[i]; }); }
+inline void Float4Store(float *af, Float4 f4) {
+    for (uint32_t i = 0; i < k_un_float4_lanes; i++) {
+        af[i] = f4.af[i];
+    }
+}
+inline Float4 Float4Splat(float f) { return {{f, f, f, f}}; }
+inline Float4 Float4Set(float f_x, float f_y, float f_z, float f_w) { return {{f_x, f_y, f_z, f_w}}; }
+
+inline Float4 Float4Add(Float4 f4_a, Float4 f4_b) { return Float4Lanes([&](uint32_t i) { return f4_a.af[i] + f4_b.af[i]; }); }
+inline Float4 Float4Sub(Float4 f4_a, Float4 f4_b) { return Float4Lanes([&](uint32_t i) { return f4_a.af[i] - f4_b.af[i]; }); }
+inline Float4 Float4Mul(Float4 f4_a, Float4 f4_b) { return Float4Lanes([&](uint32_t i) { return f4_a.af[i] * f4_b.af[i]; }); }
+inline Float4 Float4Div(Float4 f4_a, Float4 f4_b) { return Float4Lanes([&](uint32_t i) { return f4_a.af[i] / f4_b.af[i]; }); }
+inline Float4 Float4MulAdd(Float4 f4_a, Float4 f4_b, Float4 f4_c) { return Float4Add(Float4Mul(f4_a, f4_b), f4_c); }
+inline Float4 Float4Min(Float4 f4_a, Float4 f4_b) {
+    return Float4Lanes([&](uint32_t i) { return f4_a.af[i] < f4_b.af[i] ? f4_a.af[i] : f4_b.af[i]; });
+}
+inline Float4 Float4Max(Float4 f4_a, Float4 f4_b) {
+    return Float4Lanes([&](uint32_t i) { return f4_a.af[i] > f4_b.af[i] ? f4_a.af[i] : f4_b.af[i]; });
+}
+inline Float4 Float4Sqrt(Float4 f4) { return Float4Lanes([&](uint32_t i) { return __builtin_sqrtf(f4.af[i]); }); }
+
+inline Mask4 Float4GreaterEqual(Float4 f4_a, Float4 f4_b) { return Mask4Lanes([&](uint32_t i) { return f4_a.af[i] >= f4_b.af[i]; }); }
+inline Mask4 Float4LessEqual(Float4 f4_a, Float4 f4_b) { return Mask4Lanes([&](uint32_t i) { return f4_a.af[i] <= f4_b.af[i]; }); }
+inline Mask4 Mask4And(Mask4 m4_a, Mask4 m4_b) { return Mask4Lanes([&](uint32_t i) { return (m4_a.aun[i] & m4_b.aun[i]) != 0u; }); }
+inline Mask4 Mask4All() { return {{UINT32_MAX, UINT32_MAX, UINT32_MAX, UINT32_MAX}}; }
+
+inline Float4 Float4Select(Mask4 m4, Float4 f4_true, Float4 f4_false) {
+    return Float4Lanes([&](uint32_t i) { return m4.aun[i] != 0u ? f4_true.af[i] : f4_false.af[i]; });
+}
+
+inline uint32_t UnMask4Bits(Mask4 m4) {
+    uint32_t un_bits = 0;
+    for (uint32_t i = 0; i < k_un_float4_lanes; i++) {
+        un_bits |= m4.aun[i] != 0u ? 1u << i : 0u;
+    }
+    return un_bits;
+}
+
+inline void Float4Transpose(Float4 &f4_a, Float4 &f4_b, Float4 &f4_c, Float4 &f4_d) {
+    Float4 *apf4[] = {&f4_a, &f4_b, &f4_c, &f4_d};
+    for (uint32_t un_row = 0; un_row < k_un_float4_lanes; un_row++) {
+        for (uint32_t un_col = un_row + 1; un_col < k_un_float4_lanes; un_col++) {
+            const float f = apf4[un_row]->af[un_col];
+            apf4[un_row]->af[un_col] = apf4[un_col]->af[un_row];
+            apf4[un_col]->af[un_row] = f;
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,476 @@
+#include "upload_manager.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "log.h"
+#include "qualify.h"
+
+//keeps every copy source aligned for any texel block size and for vkCmdCopyBufferToImage's 4 byte rule
+constexpr VkDeviceSize k_size_staging_alignment = 16;
+
+bool UploadManager::BInit(VkDevice vk_device, GpuAllocator *p_allocator, uint32_t un_queue_family, VkQueue vk_queue, uint32_t un_graphics_queue_family,
+                          std::mutex *p_queue_mutex, VkDeviceSize size_staging) {
+    mvk_device = vk_device;
+    mp_allocator = p_allocator;
+    mun_queue_family = un_queue_family;
+    mun_graphics_queue_family = un_graphics_queue_family;
+    mvk_queue = vk_queue;
+    mp_queue_mutex = p_queue_mutex;
+
+    vk_get_device_proc(mvk_device, vkWaitSemaphoresKHR);
+    vk_get_device_proc(mvk_device, vkGetSemaphoreCounterValueKHR);
+    if (!vkWaitSemaphoresKHR || !vkGetSemaphoreCounterValueKHR) {
+        Log(LogError, "[UploadManager] VK_KHR_timeline_semaphore entry points are not available");
+        return false;
+    }
+
+    {//Timeline semaphore
+        VkSemaphoreTypeCreateInfoKHR vk_semaphore_type_create_info = {
+                .sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO_KHR,
+                .semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE_KHR,
+                .initialValue = 0,
+        };
+        VkSemaphoreCreateInfo vk_semaphore_create_info = {
+                .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+                .pNext = &vk_semaphore_type_create_info,
+        };
+        b_qualify_vk(vkCreateSemaphore(mvk_device, &vk_semaphore_create_info, nullptr, &mvk_timeline_semaphore));
+    }
+
+    {//Staging ring
+        VkBufferCreateInfo vk_buffer_create_info = {
+                .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+                .size = size_staging,
+                .usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+        };
+        if (!mp_allocator->BCreateBuffer(vk_buffer_create_info, GpuMemoryUpload, mvk_staging_buffer, m_staging_allocation)) {
+            Log(LogError, "[UploadManager] Failed to allocate %llu byte staging ring", static_cast<unsigned long long>(size_staging));
+            return false;
+        }
+        msize_staging = size_staging;
+    }
+
+    Log("[UploadManager] Uploading on queue family %u%s, %llu KiB staging ring", mun_queue_family,
+        BOwnershipTransfer() ? " with ownership transfers" : (mp_queue_mutex ? " sharing the graphics queue" : ""),
+        static_cast<unsigned long long>(msize_staging / 1024));
+
+    return true;
+}
+
+void UploadManager::Destroy() {
+    if (mvk_device == VK_NULL_HANDLE) {
+        return;
+    }
+
+    if (mvk_timeline_semaphore != VK_NULL_HANDLE) {
+        VkSemaphoreWaitInfoKHR vk_semaphore_wait_info = {
+                .sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO_KHR,
+                .semaphoreCount = 1,
+                .pSemaphores = &mvk_timeline_semaphore,
+                .pValues = &mun_timeline_next,
+        };
+        vkWaitSemaphoresKHR(mvk_device, &vk_semaphore_wait_info, UINT64_MAX);
+    }
+
+    auto DestroyBatch = [&](std::unique_ptr<Batch> &p_batch) {
+        if (p_batch) {
+            vkDestroyCommandPool(mvk_device, p_batch->vk_command_pool, nullptr);
+        }
+    };
+    DestroyBatch(mp_recording);
+    std::for_each(mdq_batches.begin(), mdq_batches.end(), DestroyBatch);
+    std::for_each(mv_free_batches.begin(), mv_free_batches.end(), DestroyBatch);
+    mp_recording.reset();
+    mdq_batches.clear();
+    mv_free_batches.clear();
+
+    if (mvk_staging_buffer != VK_NULL_HANDLE) {
+        mp_allocator->DestroyBuffer(mvk_staging_buffer, m_staging_allocation);
+        mvk_staging_buffer = VK_NULL_HANDLE;
+    }
+
+    vkDestroySemaphore(mvk_device, mvk_timeline_semaphore, nullptr);
+    mvk_timeline_semaphore = VK_NULL_HANDLE;
+
+    mvk_device = VK_NULL_HANDLE;
+}
+
+uint64_t UploadManager::UnCompletedValue() const {
+    uint64_t un_value = 0;
+    vkGetSemaphoreCounterValueKHR(mvk_device, mvk_timeline_semaphore, &un_value);
+
+    return un_value;
+}
+
+void UploadManager::Retire() {
+    const uint64_t un_completed = UnCompletedValue();
+
+    //Batches complete in submission order, so the staging ring is free up to the end of the newest completed one
+    for (const std::unique_ptr<Batch> &p_batch: mdq_batches) {
+        if (p_batch->un_timeline_value > un_completed) {
+            break;
+        }
+        msize_tail = std::max(msize_tail, p_batch->size_ring_end);
+    }
+
+    while (!mdq_batches.empty() && mdq_batches.front()->un_timeline_value <= un_completed && mdq_batches.front()->b_acquired) {
+        mv_free_batches.push_back(std::move(mdq_batches.front()));
+        mdq_batches.pop_front();
+    }
+}
+
+bool UploadManager::BAllocateStaging(std::unique_lock<std::mutex> &lock, VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize &out_offset) {
+    if (size > msize_staging) {
+        Log(LogError, "[UploadManager] %llu bytes do not fit the staging ring", static_cast<unsigned long long>(size));
+        return false;
+    }
+
+    while (true) {
+        //Ranges never wrap around the end of the ring, skip to its start instead
+        VkDeviceSize size_position = (msize_head + alignment - 1) & ~(alignment - 1);
+        if (size_position % msize_staging + size > msize_staging) {
+            size_position = (size_position / msize_staging + 1) * msize_staging;
+        }
+
+        if (size_position + size - msize_tail <= msize_staging) {
+            msize_head = size_position + size;
+            out_offset = size_position % msize_staging;
+            return true;
+        }
+
+        Retire();
+        if (size_position + size - msize_tail <= msize_staging) {
+            continue;
+        }
+
+        //Still full: wait for the oldest batch holding staging space, or submit the batch being recorded so it can complete
+        auto it = std::find_if(mdq_batches.begin(), mdq_batches.end(), [&](const std::unique_ptr<Batch> &p_batch) {
+            return p_batch->size_ring_end > msize_tail;
+        });
+        if (it == mdq_batches.end()) {
+            if (!mp_recording || UnSubmitRecording() == 0) {
+                Log(LogError, "[UploadManager] Staging ring exhausted with nothing in flight");
+                return false;
+            }
+            continue;
+        }
+
+        const uint64_t un_wait_value = (*it)->un_timeline_value;
+        VkSemaphoreWaitInfoKHR vk_semaphore_wait_info = {
+                .sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO_KHR,
+                .semaphoreCount = 1,
+                .pSemaphores = &mvk_timeline_semaphore,
+                .pValues = &un_wait_value,
+        };
+        lock.unlock();
+        const VkResult vk_result = vkWaitSemaphoresKHR(mvk_device, &vk_semaphore_wait_info, UINT64_MAX);
+        lock.lock();
+
+        if (vk_result != VK_SUCCESS) {
+            Log(LogError, "[UploadManager] vkWaitSemaphoresKHR failed with: %i", vk_result);
+            return false;
+        }
+    }
+}
+
+UploadManager::Batch *UploadManager::PRecordingBatch() {
+    if (mp_recording) {
+        return mp_recording.get();
+    }
+
+    if (!mv_free_batches.empty()) {
+        mp_recording = std::move(mv_free_batches.back());
+        mv_free_batches.pop_back();
+
+        d_qualify_vk(vkResetCommandPool(mvk_device, mp_recording->vk_command_pool, 0));
+        mp_recording->v_buffer_barriers.clear();
+        mp_recording->v_image_barriers.clear();
+        mp_recording->b_acquired = false;
+    } else {
+        auto p_batch = std::make_unique<Batch>();
+
+        VkCommandPoolCreateInfo vk_command_pool_create_info = {
+                .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+                .flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+                .queueFamilyIndex = mun_queue_family,
+        };
+        d_qualify_vk(vkCreateCommandPool(mvk_device, &vk_command_pool_create_info, nullptr, &p_batch->vk_command_pool));
+
+        VkCommandBufferAllocateInfo vk_command_buffer_allocate_info = {
+                .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+                .commandPool = p_batch->vk_command_pool,
+                .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+                .commandBufferCount = 1,
+        };
+        if (vkAllocateCommandBuffers(mvk_device, &vk_command_buffer_allocate_info, &p_batch->vk_command_buffer) != VK_SUCCESS) {
+            Log(LogError, "[UploadManager] Failed to allocate a command buffer");
+            vkDestroyCommandPool(mvk_device, p_batch->vk_command_pool, nullptr);
+            return nullptr;
+        }
+
+        mp_recording = std::move(p_batch);
+    }
+
+    VkCommandBufferBeginInfo vk_command_buffer_begin_info = {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+            .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+    };
+    d_qualify_vk(vkBeginCommandBuffer(mp_recording->vk_command_buffer, &vk_command_buffer_begin_info));
+
+    return mp_recording.get();
+}
+
+bool UploadManager::BUploadBuffer(VkBuffer vk_buffer, VkDeviceSize size_offset, const void *p_data, VkDeviceSize size) {
+    std::unique_lock<std::mutex> lock(mmutex);
+
+    //Chunks of a quarter of the ring let the next chunk be written while earlier ones are still being copied
+    const VkDeviceSize size_chunk_max = std::max<VkDeviceSize>(msize_staging / 4, k_size_staging_alignment);
+
+    for (VkDeviceSize size_done = 0; size_done < size;) {
+        const VkDeviceSize size_chunk = std::min(size - size_done, size_chunk_max);
+
+        VkDeviceSize size_staging_offset;
+        if (!BAllocateStaging(lock, size_chunk, k_size_staging_alignment, size_staging_offset)) {
+            return false;
+        }
+        memcpy(m_staging_allocation.pun_mapped + size_staging_offset, static_cast<const uint8_t *>(p_data) + size_done, size_chunk);
+
+        Batch *p_batch = PRecordingBatch();
+        if (!p_batch) {
+            return false;
+        }
+
+        VkBufferCopy vk_buffer_copy = {
+                .srcOffset = size_staging_offset,
+                .dstOffset = size_offset + size_done,
+                .size = size_chunk,
+        };
+        vkCmdCopyBuffer(p_batch->vk_command_buffer, mvk_staging_buffer, vk_buffer, 1, &vk_buffer_copy);
+
+        size_done += size_chunk;
+    }
+
+    //Buffers only need a barrier of their own to change queue family, otherwise the semaphore covers them
+    if (BOwnershipTransfer() && size > 0) {
+        mp_recording->v_buffer_barriers.push_back({
+                .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+                .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+                .dstAccessMask = 0,
+                .srcQueueFamilyIndex = mun_queue_family,
+                .dstQueueFamilyIndex = mun_graphics_queue_family,
+                .buffer = vk_buffer,
+                .offset = size_offset,
+                .size = size,
+        });
+    }
+
+    return true;
+}
+
+bool UploadManager::BUploadImage(VkImage vk_image, VkImageAspectFlags vk_aspect, uint32_t un_mip, uint32_t un_layer_count, VkExtent3D vk_extent,
+                                 const void *p_data, VkDeviceSize size, VkImageLayout vk_final_layout) {
+    std::unique_lock<std::mutex> lock(mmutex);
+
+    VkDeviceSize size_staging_offset;
+    if (!BAllocateStaging(lock, size, k_size_staging_alignment, size_staging_offset)) {
+        return false;
+    }
+    memcpy(m_staging_allocation.pun_mapped + size_staging_offset, p_data, size);
+
+    Batch *p_batch = PRecordingBatch();
+    if (!p_batch) {
+        return false;
+    }
+
+    const VkImageSubresourceRange vk_subresource_range = {
+            .aspectMask = vk_aspect,
+            .baseMipLevel = un_mip,
+            .levelCount = 1,
+            .baseArrayLayer = 0,
+            .layerCount = un_layer_count,
+    };
+
+    VkImageMemoryBarrier vk_to_transfer_barrier = {
+            .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+            .srcAccessMask = 0,
+            .dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+            .oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+            .newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .image = vk_image,
+            .subresourceRange = vk_subresource_range,
+    };
+    vkCmdPipelineBarrier(p_batch->vk_command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1,
+                         &vk_to_transfer_barrier);
+
+    VkBufferImageCopy vk_buffer_image_copy = {
+            .bufferOffset = size_staging_offset,
+            .bufferRowLength = 0,
+            .bufferImageHeight = 0,
+            .imageSubresource = {
+                    .aspectMask = vk_aspect,
+                    .mipLevel = un_mip,
+                    .baseArrayLayer = 0,
+                    .layerCount = un_layer_count,
+            },
+            .imageOffset = {0, 0, 0},
+            .imageExtent = vk_extent,
+    };
+    vkCmdCopyBufferToImage(p_batch->vk_command_buffer, mvk_staging_buffer, vk_image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &vk_buffer_image_copy);
+
+    //Moves the image to its final layout, and to the graphics queue family if the copy ran on another one
+    p_batch->v_image_barriers.push_back({
+            .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+            .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+            .dstAccessMask = 0,
+            .oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            .newLayout = vk_final_layout,
+            .srcQueueFamilyIndex = BOwnershipTransfer() ? mun_queue_family : VK_QUEUE_FAMILY_IGNORED,
+            .dstQueueFamilyIndex = BOwnershipTransfer() ? mun_graphics_queue_family : VK_QUEUE_FAMILY_IGNORED,
+            .image = vk_image,
+            .subresourceRange = vk_subresource_range,
+    });
+
+    return true;
+}
+
+uint64_t UploadManager::UnFlush() {
+    std::lock_guard<std::mutex> lock(mmutex);
+
+    return UnSubmitRecording();
+}
+
+uint64_t UploadManager::UnSubmitRecording() {
+    if (!mp_recording) {
+        return 0;
+    }
+
+    Batch &batch = *mp_recording;
+
+    //Release half of the ownership transfers, or just the final layout transitions when staying on one queue family
+    if (!batch.v_buffer_barriers.empty() || !batch.v_image_barriers.empty()) {
+        vkCmdPipelineBarrier(batch.vk_command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr,
+                             static_cast<uint32_t>(batch.v_buffer_barriers.size()), batch.v_buffer_barriers.data(),
+                             static_cast<uint32_t>(batch.v_image_barriers.size()), batch.v_image_barriers.data());
+    }
+
+    d_qualify_vk(vkEndCommandBuffer(batch.vk_command_buffer));
+
+    batch.un_timeline_value = ++mun_timeline_next;
+    batch.size_ring_end = msize_head;
+
+    //The staging ring is coherent on every device we run on, this only matters elsewhere
+    mp_allocator->Flush(m_staging_allocation);
+
+    VkTimelineSemaphoreSubmitInfoKHR vk_timeline_submit_info = {
+            .sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO_KHR,
+            .signalSemaphoreValueCount = 1,
+            .pSignalSemaphoreValues = &batch.un_timeline_value,
+    };
+    VkSubmitInfo vk_submit_info = {
+            .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+            .pNext = &vk_timeline_submit_info,
+            .commandBufferCount = 1,
+            .pCommandBuffers = &batch.vk_command_buffer,
+            .signalSemaphoreCount = 1,
+            .pSignalSemaphores = &mvk_timeline_semaphore,
+    };
+
+    VkResult vk_result;
+    if (mp_queue_mutex) {
+        std::lock_guard<std::mutex> lock_queue(*mp_queue_mutex);
+        vk_result = vkQueueSubmit(mvk_queue, 1, &vk_submit_info, VK_NULL_HANDLE);
+    } else {
+        vk_result = vkQueueSubmit(mvk_queue, 1, &vk_submit_info, VK_NULL_HANDLE);
+    }
+
+    if (vk_result != VK_SUCCESS) {
+        Log(LogError, "[UploadManager] vkQueueSubmit failed with: %i", vk_result);
+        mun_timeline_next--;
+        mv_free_batches.push_back(std::move(mp_recording));
+        return 0;
+    }
+
+    mdq_batches.push_back(std::move(mp_recording));
+
+    return batch.un_timeline_value;
+}
+
+uint64_t UploadManager::UnRecordGraphicsAcquires(VkCommandBuffer vk_command_buffer) {
+    std::lock_guard<std::mutex> lock(mmutex);
+
+    const uint64_t un_completed = UnCompletedValue();
+
+    std::vector<VkBufferMemoryBarrier> v_buffer_barriers;
+    std::vector<VkImageMemoryBarrier> v_image_barriers;
+    uint64_t un_wait_value = 0;
+
+    for (std::unique_ptr<Batch> &p_batch: mdq_batches) {
+        if (p_batch->un_timeline_value > un_completed) {
+            break;
+        }
+        if (p_batch->b_acquired || p_batch->b_acquire_recorded) {
+            continue;
+        }
+
+        //Acquire barriers repeat the release barriers' queue families and layouts, with the access on the graphics side
+        if (BOwnershipTransfer()) {
+            for (VkBufferMemoryBarrier vk_barrier: p_batch->v_buffer_barriers) {
+                vk_barrier.srcAccessMask = 0;
+                vk_barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+                v_buffer_barriers.push_back(vk_barrier);
+            }
+            for (VkImageMemoryBarrier vk_barrier: p_batch->v_image_barriers) {
+                vk_barrier.srcAccessMask = 0;
+                vk_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_MEMORY_READ_BIT;
+                v_image_barriers.push_back(vk_barrier);
+            }
+        }
+
+        p_batch->b_acquire_recorded = true;
+        un_wait_value = p_batch->un_timeline_value;
+    }
+
+    if (!v_buffer_barriers.empty() || !v_image_barriers.empty()) {
+        vkCmdPipelineBarrier(vk_command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr,
+                             static_cast<uint32_t>(v_buffer_barriers.size()), v_buffer_barriers.data(), static_cast<uint32_t>(v_image_barriers.size()),
+                             v_image_barriers.data());
+    }
+
+    if (un_wait_value > 0) {
+        mun_graphics_visible_recorded = un_wait_value;
+    }
+
+    return un_wait_value;
+}
+
+void UploadManager::CommitGraphicsAcquires() {
+    std::lock_guard<std::mutex> lock(mmutex);
+
+    //Until now the batches still belonged to the upload queue, their resources must not be reused or read
+    for (std::unique_ptr<Batch> &p_batch: mdq_batches) {
+        if (p_batch->b_acquire_recorded) {
+            p_batch->b_acquire_recorded = false;
+            p_batch->b_acquired = true;
+        }
+    }
+
+    if (mun_graphics_visible_recorded > 0) {
+        mun_graphics_visible.store(mun_graphics_visible_recorded, std::memory_order_release);
+        mun_graphics_visible_recorded = 0;
+    }
+
+    Retire();
+}
+
+void UploadManager::RollbackGraphicsAcquires() {
+    std::lock_guard<std::mutex> lock(mmutex);
+
+    for (std::unique_ptr<Batch> &p_batch: mdq_batches) {
+        p_batch->b_acquire_recorded = false;
+    }
+    mun_graphics_visible_recorded = 0;
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "vulkan/vulkan.h"
+
+#include "gpu_allocator.h"
+
+//Copies data into device local buffers and images on a queue of its own, so streaming content never queues work in
+//front of a frame. Copies go through a persistently mapped staging ring and are batched into one submission per flush.
+//
+//Resources filled on a transfer-only queue family change hands with a queue family ownership transfer: the release
+//half is recorded with the copies, the acquire half is recorded by the render thread through UnRecordGraphicsAcquires.
+class UploadManager {
+public:
+    //p_queue_mutex guards vk_queue when the device has no queue to spare and it is the graphics queue, nullptr otherwise
+    bool BInit(VkDevice vk_device, GpuAllocator *p_allocator, uint32_t un_queue_family, VkQueue vk_queue, uint32_t un_graphics_queue_family,
+               std::mutex *p_queue_mutex, VkDeviceSize size_staging);
+    void Destroy();
+
+    //Queues a copy into vk_buffer. Uploads larger than the staging ring are split into several copies.
+    bool BUploadBuffer(VkBuffer vk_buffer, VkDeviceSize size_offset, const void *p_data, VkDeviceSize size);
+
+    //Queues a copy into mip level un_mip of vk_image and leaves it in vk_final_layout. The image must be in the
+    //UNDEFINED layout, tightly packed texel data for the whole level is expected.
+    bool BUploadImage(VkImage vk_image, VkImageAspectFlags vk_aspect, uint32_t un_mip, uint32_t un_layer_count, VkExtent3D vk_extent,
+                      const void *p_data, VkDeviceSize size, VkImageLayout vk_final_layout);
+
+    //Ends the current batch. Returns the timeline value reached once its copies are done, or 0 if nothing was queued.
+    uint64_t UnFlush();
+
+    //Called by the render thread before recording anything that reads uploaded data. Records the acquire barriers of every batch that
+    //has finished on the upload queue and returns the value of GetTimelineSemaphore() the graphics submission has to wait on, 0 if none.
+    //Never waits for batches still in flight, so a long upload never stalls a frame. The acquires only count once
+    //CommitGraphicsAcquires confirms vk_command_buffer was submitted, RollbackGraphicsAcquires has them recorded again.
+    uint64_t UnRecordGraphicsAcquires(VkCommandBuffer vk_command_buffer);
+    void CommitGraphicsAcquires();
+    void RollbackGraphicsAcquires();
+
+    //Uploads whose UnFlush value is at or below this can be used by graphics submissions recorded from now on
+    uint64_t UnGraphicsVisibleValue() const { return mun_graphics_visible.load(std::memory_order_acquire); }
+
+    VkSemaphore GetTimelineSemaphore() const { return mvk_timeline_semaphore; }
+    uint64_t UnCompletedValue() const;
+
+private:
+    struct Batch {
+        VkCommandPool vk_command_pool = VK_NULL_HANDLE;
+        VkCommandBuffer vk_command_buffer = VK_NULL_HANDLE;
+
+        uint64_t un_timeline_value = 0;
+
+        //staging ring position one past the last byte this batch copies from
+        VkDeviceSize size_ring_end = 0;
+
+        std::vector<VkBufferMemoryBarrier> v_buffer_barriers;
+        std::vector<VkImageMemoryBarrier> v_image_barriers;
+
+        //recorded by UnRecordGraphicsAcquires into a command buffer that has not been submitted yet
+        bool b_acquire_recorded = false;
+        bool b_acquired = false;
+    };
+
+    //Returns the offset into the staging buffer of size free bytes, flushing and waiting for old batches if the ring is full.
+    //lock is released while waiting so the render thread can keep recording acquires.
+    bool BAllocateStaging(std::unique_lock<std::mutex> &lock, VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize &out_offset);
+
+    Batch *PRecordingBatch();
+    uint64_t UnSubmitRecording();
+    void Retire();
+
+    bool BOwnershipTransfer() const { return mun_queue_family != mun_graphics_queue_family; }
+
+    VkDevice mvk_device = VK_NULL_HANDLE;
+    GpuAllocator *mp_allocator = nullptr;
+
+    uint32_t mun_queue_family = 0;
+    uint32_t mun_graphics_queue_family = 0;
+    VkQueue mvk_queue = VK_NULL_HANDLE;
+    std::mutex *mp_queue_mutex = nullptr;
+
+    std::mutex mmutex;
+
+    VkBuffer mvk_staging_buffer = VK_NULL_HANDLE;
+    GpuAllocation m_staging_allocation;
+    VkDeviceSize msize_staging = 0;
+
+    //Monotonic byte counters, the ring offset is the counter modulo msize_staging
+    VkDeviceSize msize_head = 0;
+    VkDeviceSize msize_tail = 0;
+
+    VkSemaphore mvk_timeline_semaphore = VK_NULL_HANDLE;
+    uint64_t mun_timeline_next = 0;
+    std::atomic<uint64_t> mun_graphics_visible = 0;
+    uint64_t mun_graphics_visible_recorded = 0;
+
+    //batch currently being recorded, then every batch in flight or waiting for its acquire, oldest first
+    std::unique_ptr<Batch> mp_recording;
+    std::deque<std::unique_ptr<Batch>> mdq_batches;
+    std::vector<std::unique_ptr<Batch>> mv_free_batches;
+
+    PFN_vkWaitSemaphoresKHR vkWaitSemaphoresKHR = nullptr;
+    PFN_vkGetSemaphoreCounterValueKHR vkGetSemaphoreCounterValueKHR = nullptr;
+};
@@ -0,0 +1,153 @@
+#include "visibility_mask.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
+#include "log.h"
+#include "qualify.h"
+
+bool VisibilityMask::BInit(XrInstance xr_instance, XrSession xr_session, XrViewConfigurationType xr_view_configuration_type, uint32_t un_view_count) {
+    mxr_session = xr_session;
+    mxr_view_configuration_type = xr_view_configuration_type;
+
+    if (un_view_count > k_un_max_views) {
+        Log(LogError, "[VisibilityMask] %u views do not fit the changed view mask", un_view_count);
+        return false;
+    }
+
+    xr_get_proc(xr_instance, xrGetVisibilityMaskKHR);
+
+    mvv_vertices.resize(un_view_count);
+    mvv_indices.resize(un_view_count);
+    mun_changed_views = (1u << un_view_count) - 1;
+
+    //Fetched here already so a runtime that fails to provide them is caught before the first frame
+    for (uint32_t un_view = 0; un_view < un_view_count; un_view++) {
+        if (!BFetch(un_view)) {
+            return false;
+        }
+    }
+
+    mb_enabled = true;
+
+    return true;
+}
+
+void VisibilityMask::MarkChanged(uint32_t un_view) {
+    if (un_view < mvv_vertices.size()) {
+        mun_changed_views |= 1u << un_view;
+    }
+}
+
+bool VisibilityMask::BFetch(uint32_t un_view) {
+    mun_changed_views &= ~(1u << un_view);
+
+    std::vector<XrVector2f> &v_vertices = mvv_vertices[un_view];
+    std::vector<uint32_t> &v_indices = mvv_indices[un_view];
+    v_vertices.clear();
+    v_indices.clear();
+
+    XrVisibilityMaskKHR xr_visibility_mask{XR_TYPE_VISIBILITY_MASK_KHR};
+    b_qualify_xr(xrGetVisibilityMaskKHR(mxr_session, mxr_view_configuration_type, un_view, XR_VISIBILITY_MASK_TYPE_HIDDEN_TRIANGLE_MESH_KHR,
+                                        &xr_visibility_mask));
+
+    v_vertices.resize(xr_visibility_mask.vertexCountOutput);
+    v_indices.resize(xr_visibility_mask.indexCountOutput);
+    xr_visibility_mask.vertexCapacityInput = static_cast<uint32_t>(v_vertices.size());
+    xr_visibility_mask.vertices = v_vertices.data();
+    xr_visibility_mask.indexCapacityInput = static_cast<uint32_t>(v_indices.size());
+    xr_visibility_mask.indices = v_indices.data();
+
+    const XrResult xr_result = xrGetVisibilityMaskKHR(mxr_session, mxr_view_configuration_type, un_view, XR_VISIBILITY_MASK_TYPE_HIDDEN_TRIANGLE_MESH_KHR,
+                                                      &xr_visibility_mask);
+
+    //A mesh that is not what the runtime has now could hide visible pixels, without one the view just is not masked
+    if (XR_FAILED(xr_result)) {
+        Log(LogError, "[VisibilityMask] Failed to fetch the hidden area mesh of view %u: %i", un_view, xr_result);
+        v_vertices.clear();
+        v_indices.clear();
+    } else {
+        v_vertices.resize(xr_visibility_mask.vertexCountOutput);
+        v_indices.resize(xr_visibility_mask.indexCountOutput - xr_visibility_mask.indexCountOutput % 3);
+    }
+
+    //Rebuilds the combined index list, every view's indices move past the vertices of the views before it
+    mv_indices.clear();
+    mun_vertex_count = 0;
+    for (size_t i = 0; i < mvv_vertices.size(); i++) {
+        for (uint32_t un_index: mvv_indices[i]) {
+            if (un_index < mvv_vertices[i].size()) {
+                mv_indices.push_back(mun_vertex_count + un_index);
+            } else {
+                mv_indices.push_back(mun_vertex_count);
+            }
+        }
+        mun_vertex_count += static_cast<uint32_t>(mvv_vertices[i].size());
+    }
+
+    Log("[VisibilityMask] View %u hides %zu triangles", un_view, v_indices.size() / 3);
+
+    return !XR_FAILED(xr_result);
+}
+
+bool VisibilityMask::BPrepare(FrameContextRing &frame_ring, const XrView *pxr_views, VisibilityMaskDraw &out_draw) {
+    if (!mb_enabled) {
+        return false;
+    }
+
+    for (uint32_t un_changed = mun_changed_views.load(); un_changed != 0; un_changed &= un_changed - 1) {
+        BFetch(static_cast<uint32_t>(std::countr_zero(un_changed)));
+    }
+
+    if (mv_indices.empty()) {
+        return false;
+    }
+
+    VkDeviceSize size_vertex_offset;
+    VkDeviceSize size_index_offset;
+    auto *p_vertices = static_cast<VisibilityMaskVertex *>(
+            frame_ring.PAllocateTransient(mun_vertex_count * sizeof(VisibilityMaskVertex), alignof(VisibilityMaskVertex), size_vertex_offset));
+    auto *pun_indices = static_cast<uint32_t *>(frame_ring.PAllocateTransient(mv_indices.size() * sizeof(uint32_t), sizeof(uint32_t), size_index_offset));
+    if (!p_vertices || !pun_indices) {
+        Log(LogError, "[VisibilityMask] Out of transient memory for the hidden area meshes");
+        return false;
+    }
+
+    //Same mapping from tangents to clip space as Mat4ProjectionFromFov, for points on the z = -1 plane
+    for (uint32_t un_view = 0; un_view < mvv_vertices.size(); un_view++) {
+        const XrFovf &xr_fov = pxr_views[un_view].fov;
+        const float f_tan_left = std::tan(xr_fov.angleLeft);
+        const float f_tan_right = std::tan(xr_fov.angleRight);
+        const float f_tan_up = std::tan(xr_fov.angleUp);
+        const float f_tan_down = std::tan(xr_fov.angleDown);
+
+        const float f_scale_x = 2.f / (f_tan_right - f_tan_left);
+        const float f_scale_y = 2.f / (f_tan_down - f_tan_up);
+        const float f_offset_x = -(f_tan_right + f_tan_left) / (f_tan_right - f_tan_left);
+        const float f_offset_y = -(f_tan_up + f_tan_down) / (f_tan_down - f_tan_up);
+
+        for (const XrVector2f &xr_vertex: mvv_vertices[un_view]) {
+            *p_vertices++ = {
+                    .af_position = {xr_vertex.x * f_scale_x + f_offset_x, xr_vertex.y * f_scale_y + f_offset_y},
+                    .un_view = un_view,
+            };
+        }
+    }
+    std::copy(mv_indices.begin(), mv_indices.end(), pun_indices);
+
+    out_draw = {
+            .vk_buffer = frame_ring.GetCurrent().transient_page.GetBuffer(),
+            .size_vertex_offset = size_vertex_offset,
+            .size_index_offset = size_index_offset,
+            .un_index_count = static_cast<uint32_t>(mv_indices.size()),
+    };
+
+    return true;
+}
+
+void VisibilityMask::RecordDraw(VkCommandBuffer vk_command_buffer, const VisibilityMaskDraw &draw) const {
+    vkCmdBindVertexBuffers(vk_command_buffer, 0, 1, &draw.vk_buffer, &draw.size_vertex_offset);
+    vkCmdBindIndexBuffer(vk_command_buffer, draw.vk_buffer, draw.size_index_offset, VK_INDEX_TYPE_UINT32);
+    vkCmdDrawIndexed(vk_command_buffer, draw.un_index_count, 1, 0, 0, 0);
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "vulkan/vulkan.h"
+
+#include "openxr/openxr.h"
+
+#include "frame_context.h"
+
+//One vertex of the hidden area meshes as the visibility mask shaders take it
+struct VisibilityMaskVertex {
+    float af_position[2]; //clip space, on the near plane
+    uint32_t un_view;
+};
+
+//Where one frame's hidden area meshes were written, all RecordDraw needs to draw them
+struct VisibilityMaskDraw {
+    VkBuffer vk_buffer = VK_NULL_HANDLE;
+    VkDeviceSize size_vertex_offset = 0;
+    VkDeviceSize size_index_offset = 0;
+    uint32_t un_index_count = 0;
+};
+
+//Hidden area meshes from XR_KHR_visibility_mask, the parts of every view's image the lenses never show. They are drawn into
+//depth at the near plane before anything else in the multiview pass, so every later fragment beneath them fails the depth
+//test before it is shaded.
+//
+//Meshes come in the view's tangent space and are projected with each frame's FOV. Views the runtime reports as changed
+//are marked from any thread and fetched again by the render thread before its next draw.
+class VisibilityMask {
+public:
+    static constexpr uint32_t k_un_max_views = 16;
+
+    static constexpr VkVertexInputBindingDescription k_vk_vertex_binding = {
+            .binding = 0,
+            .stride = sizeof(VisibilityMaskVertex),
+            .inputRate = VK_VERTEX_INPUT_RATE_VERTEX,
+    };
+    static constexpr VkVertexInputAttributeDescription k_avk_vertex_attributes[] = {
+            {.location = 0, .binding = 0, .format = VK_FORMAT_R32G32_SFLOAT, .offset = offsetof(VisibilityMaskVertex, af_position)},
+            {.location = 1, .binding = 0, .format = VK_FORMAT_R32_UINT, .offset = offsetof(VisibilityMaskVertex, un_view)},
+    };
+
+    //The instance has to have been created with XR_KHR_visibility_mask enabled. Returns false if the meshes cannot be
+    //fetched, BPrepare never has anything to draw then.
+    bool BInit(XrInstance xr_instance, XrSession xr_session, XrViewConfigurationType xr_view_configuration_type, uint32_t un_view_count);
+
+    //For XrEventDataVisibilityMaskChangedKHR, callable from any thread
+    void MarkChanged(uint32_t un_view);
+
+    bool BEnabled() const { return mb_enabled; }
+
+    //Refetches changed meshes and writes this frame's clip space vertices into the frame ring's transient buffer. Returns
+    //false if there is nothing to draw. The draw only changes with the meshes and the offsets it was allocated at, so
+    //commands recorded from it stay valid while those do.
+    bool BPrepare(FrameContextRing &frame_ring, const XrView *pxr_views, VisibilityMaskDraw &out_draw);
+
+    //Draws every view's mesh in one indexed draw. The caller binds a pipeline made from the visibility mask shaders.
+    void RecordDraw(VkCommandBuffer vk_command_buffer, const VisibilityMaskDraw &draw) const;
+
+private:
+    bool BFetch(uint32_t un_view);
+
+    XrSession mxr_session = XR_NULL_HANDLE;
+    XrViewConfigurationType mxr_view_configuration_type = XR_VIEW_CONFIGURATION_TYPE_PRIMARY_STEREO;
+    bool mb_enabled = false;
+
+    //bit per view whose mesh has to be fetched again
+    std::atomic<uint32_t> mun_changed_views = 0;
+
+    //per view, in the view's tangent space and indexing its own vertices
+    std::vector<std::vector<XrVector2f>> mvv_vertices;
+    std::vector<std::vector<uint32_t>> mvv_indices;
+
+    //every view's mesh after one another, rebuilt after a fetch
+    std::vector<uint32_t> mv_indices;
+    uint32_t mun_vertex_count = 0;
+
+    PFN_xrGetVisibilityMaskKHR xrGetVisibilityMaskKHR = nullptr;
+};
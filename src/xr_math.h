@@ -0,0 +1,154 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+
+#include "openxr/openxr.h"
+
+#include "simd.h"
+
+constexpr float k_f_pi = 3.14159265358979f;
+
+//Column major 4x4 matrix laid out the way GLSL std140/std430 expects a mat4
+struct Mat4 {
+    float af[16];
+};
+
+inline Mat4 Mat4Identity() {
+    return {{
+            1.f, 0.f, 0.f, 0.f,
+            0.f, 1.f, 0.f, 0.f,
+            0.f, 0.f, 1.f, 0.f,
+            0.f, 0.f, 0.f, 1.f,
+    }};
+}
+
+inline Mat4 Mat4Multiply(const Mat4 &mat4_a, const Mat4 &mat4_b) {
+    const Float4 af4_a[] = {Float4Load(mat4_a.af), Float4Load(mat4_a.af + 4), Float4Load(mat4_a.af + 8), Float4Load(mat4_a.af + 12)};
+
+    //Every column of the result is the columns of a weighted by that column of b
+    Mat4 mat4_result;
+    for (int n_col = 0; n_col < 4; n_col++) {
+        const float *af_b = mat4_b.af + n_col * 4;
+        Float4 f4_col = Float4Mul(af4_a[0], Float4Splat(af_b[0]));
+        f4_col = Float4MulAdd(af4_a[1], Float4Splat(af_b[1]), f4_col);
+        f4_col = Float4MulAdd(af4_a[2], Float4Splat(af_b[2]), f4_col);
+        f4_col = Float4MulAdd(af4_a[3], Float4Splat(af_b[3]), f4_col);
+        Float4Store(mat4_result.af + n_col * 4, f4_col);
+    }
+
+    return mat4_result;
+}
+
+inline Mat4 Mat4Translation(float f_x, float f_y, float f_z) {
+    Mat4 mat4_result = Mat4Identity();
+    mat4_result.af[12] = f_x;
+    mat4_result.af[13] = f_y;
+    mat4_result.af[14] = f_z;
+
+    return mat4_result;
+}
+
+//Local to parent transform of an XrPosef
+inline Mat4 Mat4FromPose(const XrPosef &xr_pose) {
+    const XrQuaternionf &q = xr_pose.orientation;
+
+    const float f_xx = q.x * q.x * 2.f, f_yy = q.y * q.y * 2.f, f_zz = q.z * q.z * 2.f;
+    const float f_xy = q.x * q.y * 2.f, f_xz = q.x * q.z * 2.f, f_yz = q.y * q.z * 2.f;
+    const float f_wx = q.w * q.x * 2.f, f_wy = q.w * q.y * 2.f, f_wz = q.w * q.z * 2.f;
+
+    return {{
+            1.f - f_yy - f_zz, f_xy + f_wz, f_xz - f_wy, 0.f,
+            f_xy - f_wz, 1.f - f_xx - f_zz, f_yz + f_wx, 0.f,
+            f_xz + f_wy, f_yz - f_wx, 1.f - f_xx - f_yy, 0.f,
+            xr_pose.position.x, xr_pose.position.y, xr_pose.position.z, 1.f,
+    }};
+}
+
+//Mat4FromPose of un_count poses, four at a time with one lane per pose
+inline void Mat4FromPoses(const XrPosef *pxr_poses, uint32_t un_count, Mat4 *pmat4_out) {
+    uint32_t i = 0;
+    for (; i + k_un_float4_lanes <= un_count; i += k_un_float4_lanes) {
+        const XrPosef *pxr = pxr_poses + i;
+
+        //XrQuaternionf is four packed floats, transposed into one register per component
+        Float4 f4_x = Float4Load(&pxr[0].orientation.x);
+        Float4 f4_y = Float4Load(&pxr[1].orientation.x);
+        Float4 f4_z = Float4Load(&pxr[2].orientation.x);
+        Float4 f4_w = Float4Load(&pxr[3].orientation.x);
+        Float4Transpose(f4_x, f4_y, f4_z, f4_w);
+
+        const Float4 f4_one = Float4Splat(1.f);
+        const Float4 f4_x2 = Float4Add(f4_x, f4_x), f4_y2 = Float4Add(f4_y, f4_y), f4_z2 = Float4Add(f4_z, f4_z);
+        const Float4 f4_xx = Float4Mul(f4_x, f4_x2), f4_yy = Float4Mul(f4_y, f4_y2), f4_zz = Float4Mul(f4_z, f4_z2);
+        const Float4 f4_xy = Float4Mul(f4_x, f4_y2), f4_xz = Float4Mul(f4_x, f4_z2), f4_yz = Float4Mul(f4_y, f4_z2);
+        const Float4 f4_wx = Float4Mul(f4_w, f4_x2), f4_wy = Float4Mul(f4_w, f4_y2), f4_wz = Float4Mul(f4_w, f4_z2);
+
+        //Element r of column c for all four poses, then transposed back into one column per pose
+        Float4 af4_columns[4][4] = {
+                {Float4Sub(Float4Sub(f4_one, f4_yy), f4_zz), Float4Add(f4_xy, f4_wz), Float4Sub(f4_xz, f4_wy), Float4Splat(0.f)},
+                {Float4Sub(f4_xy, f4_wz), Float4Sub(Float4Sub(f4_one, f4_xx), f4_zz), Float4Add(f4_yz, f4_wx), Float4Splat(0.f)},
+                {Float4Add(f4_xz, f4_wy), Float4Sub(f4_yz, f4_wx), Float4Sub(Float4Sub(f4_one, f4_xx), f4_yy), Float4Splat(0.f)},
+                {Float4Set(pxr[0].position.x, pxr[1].position.x, pxr[2].position.x, pxr[3].position.x),
+                 Float4Set(pxr[0].position.y, pxr[1].position.y, pxr[2].position.y, pxr[3].position.y),
+                 Float4Set(pxr[0].position.z, pxr[1].position.z, pxr[2].position.z, pxr[3].position.z), f4_one},
+        };
+
+        for (int n_col = 0; n_col < 4; n_col++) {
+            Float4 *af4_column = af4_columns[n_col];
+            Float4Transpose(af4_column[0], af4_column[1], af4_column[2], af4_column[3]);
+            for (uint32_t un_lane = 0; un_lane < k_un_float4_lanes; un_lane++) {
+                Float4Store(pmat4_out[i + un_lane].af + n_col * 4, af4_column[un_lane]);
+            }
+        }
+    }
+
+    for (; i < un_count; i++) {
+        pmat4_out[i] = Mat4FromPose(pxr_poses[i]);
+    }
+}
+
+//Inverse of Mat4FromPose, cheap because the rotation part is orthonormal
+inline Mat4 Mat4ViewFromPose(const XrPosef &xr_pose) {
+    const Mat4 mat4_pose = Mat4FromPose(xr_pose);
+    const float *af = mat4_pose.af;
+
+    return {{
+            af[0], af[4], af[8], 0.f,
+            af[1], af[5], af[9], 0.f,
+            af[2], af[6], af[10], 0.f,
+            -(af[0] * af[12] + af[1] * af[13] + af[2] * af[14]),
+            -(af[4] * af[12] + af[5] * af[13] + af[6] * af[14]),
+            -(af[8] * af[12] + af[9] * af[13] + af[10] * af[14]),
+            1.f,
+    }};
+}
+
+//Asymmetric projection for an XrFovf, in Vulkan clip space: y points down and depth is reversed, going from 1 at f_near to
+//0 at f_far. Float depth has most of its precision near 0, which is where the far and otherwise least precise depths land.
+inline Mat4 Mat4ProjectionFromFov(const XrFovf &xr_fov, float f_near, float f_far) {
+    const float f_tan_left = std::tan(xr_fov.angleLeft);
+    const float f_tan_right = std::tan(xr_fov.angleRight);
+    const float f_tan_up = std::tan(xr_fov.angleUp);
+    const float f_tan_down = std::tan(xr_fov.angleDown);
+
+    const float f_tan_width = f_tan_right - f_tan_left;
+    const float f_tan_height = f_tan_down - f_tan_up;
+
+    return {{
+            2.f / f_tan_width, 0.f, 0.f, 0.f,
+            0.f, 2.f / f_tan_height, 0.f, 0.f,
+            (f_tan_right + f_tan_left) / f_tan_width, (f_tan_up + f_tan_down) / f_tan_height, f_near / (f_far - f_near), -1.f,
+            0.f, 0.f, (f_far * f_near) / (f_far - f_near), 0.f,
+    }};
+}
+
+inline XrVector3f Mat4TransformPoint(const Mat4 &mat4, const XrVector3f &xr_point) {
+    const float *af = mat4.af;
+
+    return {
+            af[0] * xr_point.x + af[4] * xr_point.y + af[8] * xr_point.z + af[12],
+            af[1] * xr_point.x + af[5] * xr_point.y + af[9] * xr_point.z + af[13],
+            af[2] * xr_point.x + af[6] * xr_point.y + af[10] * xr_point.z + af[14],
+    };
+}
@@ -0,0 +1,561 @@
+//Checks the math built on simd.h against plain double precision references. Built once per SIMD path, see CMakeLists.txt.
+
+#include <cmath>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "frustum.h"
+#include "simd.h"
+#include "xr_math.h"
+
+#if defined(QOV_SIMD_NEON)
+constexpr const char *k_pc_simd_path = "NEON";
+#elif defined(QOV_SIMD_SSE2)
+constexpr const char *k_pc_simd_path = "SSE2";
+#else
+constexpr const char *k_pc_simd_path = "scalar";
+#endif
+
+//Objects closer than this to a plane may land on either side depending on rounding, the batched tests are not held to the
+//reference there
+constexpr double k_f_boundary_margin = 1e-4;
+
+constexpr uint8_t k_un_canary = 0xab;
+
+static uint32_t sun_failures = 0;
+
+static void Expect(bool b_passed, const char *pc_format, ...) {
+    if (b_passed) {
+        return;
+    }
+
+    sun_failures++;
+    std::printf("FAILED: ");
+    va_list va_args;
+    va_start(va_args, pc_format);
+    std::vprintf(pc_format, va_args);
+    va_end(va_args);
+    std::printf("\n");
+}
+
+static bool BNear(double f_a, double f_b, double f_tolerance) {
+    return std::abs(f_a - f_b) <= f_tolerance;
+}
+
+static std::mt19937 s_random(20240917u);
+
+static float FRandom(float f_min, float f_max) {
+    return std::uniform_real_distribution<float>(f_min, f_max)(s_random);
+}
+
+static XrPosef RandomPose() {
+    float af_q[4];
+    float f_length = 0.f;
+    while (f_length < 0.1f) {
+        for (float &f: af_q) {
+            f = FRandom(-1.f, 1.f);
+        }
+        f_length = std::sqrt(af_q[0] * af_q[0] + af_q[1] * af_q[1] + af_q[2] * af_q[2] + af_q[3] * af_q[3]);
+    }
+
+    return {
+            .orientation = {af_q[0] / f_length, af_q[1] / f_length, af_q[2] / f_length, af_q[3] / f_length},
+            .position = {FRandom(-5.f, 5.f), FRandom(-5.f, 5.f), FRandom(-5.f, 5.f)},
+    };
+}
+
+//Asymmetric like a headset's, each side between 20 and 60 degrees
+static XrFovf RandomFov() {
+    const float f_min = 20.f * k_f_pi / 180.f;
+    const float f_max = 60.f * k_f_pi / 180.f;
+
+    return {-FRandom(f_min, f_max), FRandom(f_min, f_max), FRandom(f_min, f_max), -FRandom(f_min, f_max)};
+}
+
+struct RefMat4 {
+    double af[16];
+};
+
+static RefMat4 RefMultiply(const RefMat4 &mat4_a, const RefMat4 &mat4_b) {
+    RefMat4 mat4_result{};
+    for (int n_col = 0; n_col < 4; n_col++) {
+        for (int n_row = 0; n_row < 4; n_row++) {
+            for (int k = 0; k < 4; k++) {
+                mat4_result.af[n_col * 4 + n_row] += mat4_a.af[k * 4 + n_row] * mat4_b.af[n_col * 4 + k];
+            }
+        }
+    }
+
+    return mat4_result;
+}
+
+static RefMat4 RefFromMat4(const Mat4 &mat4) {
+    RefMat4 mat4_result;
+    for (int i = 0; i < 16; i++) {
+        mat4_result.af[i] = mat4.af[i];
+    }
+
+    return mat4_result;
+}
+
+//Rotation of a unit quaternion as in any textbook, columns are the rotated axes
+static RefMat4 RefFromPose(const XrPosef &xr_pose) {
+    const double f_x = xr_pose.orientation.x, f_y = xr_pose.orientation.y, f_z = xr_pose.orientation.z, f_w = xr_pose.orientation.w;
+
+    return {{
+            1. - 2. * (f_y * f_y + f_z * f_z), 2. * (f_x * f_y + f_w * f_z), 2. * (f_x * f_z - f_w * f_y), 0.,
+            2. * (f_x * f_y - f_w * f_z), 1. - 2. * (f_x * f_x + f_z * f_z), 2. * (f_y * f_z + f_w * f_x), 0.,
+            2. * (f_x * f_z + f_w * f_y), 2. * (f_y * f_z - f_w * f_x), 1. - 2. * (f_x * f_x + f_y * f_y), 0.,
+            xr_pose.position.x, xr_pose.position.y, xr_pose.position.z, 1.,
+    }};
+}
+
+static void RefTransform(const RefMat4 &mat4, const double af_point[4], double af_out[4]) {
+    for (int n_row = 0; n_row < 4; n_row++) {
+        af_out[n_row] = 0.;
+        for (int k = 0; k < 4; k++) {
+            af_out[n_row] += mat4.af[k * 4 + n_row] * af_point[k];
+        }
+    }
+}
+
+static double RefPlaneDistance(const XrVector4f &xr_plane, double f_x, double f_y, double f_z) {
+    return xr_plane.x * f_x + xr_plane.y * f_y + xr_plane.z * f_z + xr_plane.w;
+}
+
+static void TestFloat4() {
+    const float af_a[] = {1.f, -2.f, 3.5f, 0.f};
+    const float af_b[] = {0.5f, -2.f, -4.f, 9.f};
+    const Float4 f4_a = Float4Load(af_a);
+    const Float4 f4_b = Float4Load(af_b);
+
+    float af_out[4];
+    auto ExpectLanes = [&](Float4 f4, auto fn_expected, const char *pc_name, double f_tolerance) {
+        Float4Store(af_out, f4);
+        for (uint32_t i = 0; i < k_un_float4_lanes; i++) {
+            const double f_expected = fn_expected(static_cast<double>(af_a[i]), static_cast<double>(af_b[i]));
+            Expect(BNear(af_out[i], f_expected, f_tolerance), "%s lane %u: %f, expected %f", pc_name, i, af_out[i], f_expected);
+        }
+    };
+
+    ExpectLanes(Float4Add(f4_a, f4_b), [](double f_a, double f_b) { return f_a + f_b; }, "Float4Add", 0.);
+    ExpectLanes(Float4Sub(f4_a, f4_b), [](double f_a, double f_b) { return f_a - f_b; }, "Float4Sub", 0.);
+    ExpectLanes(Float4Mul(f4_a, f4_b), [](double f_a, double f_b) { return f_a * f_b; }, "Float4Mul", 0.);
+    ExpectLanes(Float4Div(f4_a, f4_b), [](double f_a, double f_b) { return f_a / f_b; }, "Float4Div", 1e-6);
+    ExpectLanes(Float4MulAdd(f4_a, f4_b, f4_a), [](double f_a, double f_b) { return f_a * f_b + f_a; }, "Float4MulAdd", 1e-6);
+    ExpectLanes(Float4Min(f4_a, f4_b), [](double f_a, double f_b) { return std::min(f_a, f_b); }, "Float4Min", 0.);
+    ExpectLanes(Float4Max(f4_a, f4_b), [](double f_a, double f_b) { return std::max(f_a, f_b); }, "Float4Max", 0.);
+    ExpectLanes(Float4Sqrt(Float4Mul(f4_a, f4_a)), [](double f_a, double) { return std::abs(f_a); }, "Float4Sqrt", 1e-6);
+    ExpectLanes(Float4Set(af_a[0], af_a[1], af_a[2], af_a[3]), [](double f_a, double) { return f_a; }, "Float4Set", 0.);
+    ExpectLanes(Float4Splat(af_a[2]), [&](double, double) { return static_cast<double>(af_a[2]); }, "Float4Splat", 0.);
+
+    //Every mask pattern, lanes equal to the threshold count as both greater and less or equal
+    for (uint32_t un_bits = 0; un_bits < 16; un_bits++) {
+        float af_values[4];
+        for (uint32_t i = 0; i < k_un_float4_lanes; i++) {
+            af_values[i] = (un_bits >> i) & 1u ? 1.f : -1.f;
+        }
+        const Float4 f4_values = Float4Load(af_values);
+
+        const Mask4 m4_greater = Float4GreaterEqual(f4_values, Float4Splat(0.f));
+        Expect(UnMask4Bits(m4_greater) == un_bits, "Float4GreaterEqual/UnMask4Bits of pattern %u gave %u", un_bits, UnMask4Bits(m4_greater));
+        Expect(UnMask4Bits(Float4LessEqual(f4_values, Float4Splat(0.f))) == (~un_bits & 0xfu), "Float4LessEqual of pattern %u", un_bits);
+        Expect(UnMask4Bits(Float4GreaterEqual(f4_values, f4_values)) == 0xfu, "Float4GreaterEqual of equal lanes, pattern %u", un_bits);
+        Expect(UnMask4Bits(Mask4And(m4_greater, Mask4All())) == un_bits, "Mask4And with Mask4All, pattern %u", un_bits);
+        Expect(UnMask4Bits(Mask4And(m4_greater, Float4LessEqual(f4_values, Float4Splat(0.f)))) == 0u, "Mask4And of disjoint masks, pattern %u",
+               un_bits);
+
+        Float4Store(af_out, Float4Select(m4_greater, f4_a, f4_b));
+        for (uint32_t i = 0; i < k_un_float4_lanes; i++) {
+            const float f_expected = (un_bits >> i) & 1u ? af_a[i] : af_b[i];
+            Expect(af_out[i] == f_expected, "Float4Select pattern %u lane %u: %f, expected %f", un_bits, i, af_out[i], f_expected);
+        }
+    }
+
+    float af_rows[4][4];
+    for (uint32_t i = 0; i < 16; i++) {
+        af_rows[i / 4][i % 4] = static_cast<float>(i);
+    }
+    Float4 af4_rows[] = {Float4Load(af_rows[0]), Float4Load(af_rows[1]), Float4Load(af_rows[2]), Float4Load(af_rows[3])};
+    Float4Transpose(af4_rows[0], af4_rows[1], af4_rows[2], af4_rows[3]);
+    for (uint32_t un_row = 0; un_row < 4; un_row++) {
+        Float4Store(af_out, af4_rows[un_row]);
+        for (uint32_t un_col = 0; un_col < 4; un_col++) {
+            Expect(af_out[un_col] == af_rows[un_col][un_row], "Float4Transpose [%u][%u]: %f, expected %f", un_row, un_col, af_out[un_col],
+                   af_rows[un_col][un_row]);
+        }
+    }
+}
+
+static void TestMat4() {
+    for (int n_case = 0; n_case < 100; n_case++) {
+        Mat4 mat4_a, mat4_b;
+        for (int i = 0; i < 16; i++) {
+            mat4_a.af[i] = FRandom(-2.f, 2.f);
+            mat4_b.af[i] = FRandom(-2.f, 2.f);
+        }
+
+        const Mat4 mat4_result = Mat4Multiply(mat4_a, mat4_b);
+        const RefMat4 mat4_expected = RefMultiply(RefFromMat4(mat4_a), RefFromMat4(mat4_b));
+        for (int i = 0; i < 16; i++) {
+            Expect(BNear(mat4_result.af[i], mat4_expected.af[i], 1e-5), "Mat4Multiply case %i element %i: %f, expected %f", n_case, i,
+                   mat4_result.af[i], mat4_expected.af[i]);
+        }
+    }
+
+    //Up to two full batches and every tail length
+    for (uint32_t un_count = 0; un_count <= 2 * k_un_float4_lanes + 3; un_count++) {
+        std::vector<XrPosef> v_poses(un_count);
+        for (XrPosef &xr_pose: v_poses) {
+            xr_pose = RandomPose();
+        }
+
+        std::vector<Mat4> v_matrices(un_count + 1);
+        v_matrices[un_count].af[0] = 1234.f;
+        Mat4FromPoses(v_poses.data(), un_count, v_matrices.data());
+        Expect(v_matrices[un_count].af[0] == 1234.f, "Mat4FromPoses of %u poses wrote past the end", un_count);
+
+        for (uint32_t i = 0; i < un_count; i++) {
+            const Mat4 mat4_single = Mat4FromPose(v_poses[i]);
+            const RefMat4 mat4_expected = RefFromPose(v_poses[i]);
+            const Mat4 mat4_round_trip = Mat4Multiply(Mat4ViewFromPose(v_poses[i]), mat4_single);
+            const Mat4 mat4_identity = Mat4Identity();
+            for (int n_element = 0; n_element < 16; n_element++) {
+                Expect(BNear(v_matrices[i].af[n_element], mat4_expected.af[n_element], 1e-5), "Mat4FromPoses pose %u of %u element %i: %f, expected %f",
+                       i, un_count, n_element, v_matrices[i].af[n_element], mat4_expected.af[n_element]);
+                Expect(BNear(mat4_single.af[n_element], mat4_expected.af[n_element], 1e-5), "Mat4FromPose element %i: %f, expected %f", n_element,
+                       mat4_single.af[n_element], mat4_expected.af[n_element]);
+                Expect(BNear(mat4_round_trip.af[n_element], mat4_identity.af[n_element], 1e-5), "Mat4ViewFromPose * Mat4FromPose element %i: %f",
+                       n_element, mat4_round_trip.af[n_element]);
+            }
+        }
+    }
+}
+
+static void TestProjection() {
+    const float f_near = 0.1f;
+    const float f_far = 100.f;
+
+    for (int n_case = 0; n_case < 100; n_case++) {
+        const XrFovf xr_fov = RandomFov();
+        const RefMat4 mat4_projection = RefFromMat4(Mat4ProjectionFromFov(xr_fov, f_near, f_far));
+
+        //Frustum corners in view space, -z forward, have to land on the corners of Vulkan clip space with y down and depth
+        //going from 1 at the near plane to 0 at the far one
+        const double af_tan_x[] = {std::tan(static_cast<double>(xr_fov.angleLeft)), std::tan(static_cast<double>(xr_fov.angleRight))};
+        const double af_tan_y[] = {std::tan(static_cast<double>(xr_fov.angleUp)), std::tan(static_cast<double>(xr_fov.angleDown))};
+        const double af_ndc_x[] = {-1., 1.};
+        const double af_ndc_y[] = {-1., 1.};
+        for (double f_depth: {static_cast<double>(f_near), static_cast<double>(f_far)}) {
+            const double f_expected_z = f_depth == f_near ? 1. : 0.;
+            for (int n_x = 0; n_x < 2; n_x++) {
+                for (int n_y = 0; n_y < 2; n_y++) {
+                    const double af_point[] = {af_tan_x[n_x] * f_depth, af_tan_y[n_y] * f_depth, -f_depth, 1.};
+                    double af_clip[4];
+                    RefTransform(mat4_projection, af_point, af_clip);
+
+                    Expect(BNear(af_clip[3], f_depth, 1e-4 * f_depth), "Mat4ProjectionFromFov case %i w: %f, expected %f", n_case, af_clip[3], f_depth);
+                    Expect(BNear(af_clip[0] / af_clip[3], af_ndc_x[n_x], 1e-5), "Mat4ProjectionFromFov case %i x: %f, expected %f", n_case,
+                           af_clip[0] / af_clip[3], af_ndc_x[n_x]);
+                    Expect(BNear(af_clip[1] / af_clip[3], af_ndc_y[n_y], 1e-5), "Mat4ProjectionFromFov case %i y: %f, expected %f", n_case,
+                           af_clip[1] / af_clip[3], af_ndc_y[n_y]);
+                    Expect(BNear(af_clip[2] / af_clip[3], f_expected_z, 1e-5), "Mat4ProjectionFromFov case %i depth at %f: %f, expected %f", n_case,
+                           f_depth, af_clip[2] / af_clip[3], f_expected_z);
+                }
+            }
+        }
+
+        //Reversed depth only ever decreases with distance
+        double f_previous_z = 2.;
+        for (double f_depth = f_near; f_depth <= f_far; f_depth *= 1.5) {
+            const double af_point[] = {0., 0., -f_depth, 1.};
+            double af_clip[4];
+            RefTransform(mat4_projection, af_point, af_clip);
+            Expect(af_clip[2] / af_clip[3] < f_previous_z, "Mat4ProjectionFromFov case %i depth does not decrease at %f", n_case, f_depth);
+            f_previous_z = af_clip[2] / af_clip[3];
+        }
+    }
+}
+
+static void TestPlaneExtraction() {
+    const float f_near = 0.1f;
+    const float f_far = 100.f;
+    const double f_tolerance = 1e-4 * f_far;
+
+    for (int n_case = 0; n_case < 100; n_case++) {
+        const XrFovf xr_fov = RandomFov();
+        const XrPosef xr_pose = RandomPose();
+        const Frustum frustum = FrustumFromViewProjection(Mat4Multiply(Mat4ProjectionFromFov(xr_fov, f_near, f_far), Mat4ViewFromPose(xr_pose)));
+
+        for (uint32_t un_plane = 0; un_plane < FrustumPlaneCount; un_plane++) {
+            const XrVector4f &xr_plane = frustum.axr_planes[un_plane];
+            const double f_length = std::sqrt(xr_plane.x * xr_plane.x + xr_plane.y * xr_plane.y + xr_plane.z * xr_plane.z);
+            Expect(BNear(f_length, 1., 1e-5), "FrustumFromViewProjection case %i plane %u normal length %f", n_case, un_plane, f_length);
+        }
+
+        //Each corner of the view's frustum lies on the three planes meeting there and inside the other three
+        const RefMat4 mat4_pose = RefFromPose(xr_pose);
+        const double af_tan_x[] = {std::tan(static_cast<double>(xr_fov.angleLeft)), std::tan(static_cast<double>(xr_fov.angleRight))};
+        const double af_tan_y[] = {std::tan(static_cast<double>(xr_fov.angleUp)), std::tan(static_cast<double>(xr_fov.angleDown))};
+        const uint32_t aun_x_planes[] = {FrustumPlaneLeft, FrustumPlaneRight};
+        const uint32_t aun_y_planes[] = {FrustumPlaneTop, FrustumPlaneBottom};
+        for (int n_depth = 0; n_depth < 2; n_depth++) {
+            const double f_depth = n_depth == 0 ? f_near : f_far;
+            const uint32_t un_depth_plane = n_depth == 0 ? FrustumPlaneNear : FrustumPlaneFar;
+            for (int n_x = 0; n_x < 2; n_x++) {
+                for (int n_y = 0; n_y < 2; n_y++) {
+                    const double af_view_point[] = {af_tan_x[n_x] * f_depth, af_tan_y[n_y] * f_depth, -f_depth, 1.};
+                    double af_point[4];
+                    RefTransform(mat4_pose, af_view_point, af_point);
+
+                    for (uint32_t un_plane = 0; un_plane < FrustumPlaneCount; un_plane++) {
+                        const double f_distance = RefPlaneDistance(frustum.axr_planes[un_plane], af_point[0], af_point[1], af_point[2]);
+                        if (un_plane == aun_x_planes[n_x] || un_plane == aun_y_planes[n_y] || un_plane == un_depth_plane) {
+                            Expect(BNear(f_distance, 0., f_tolerance), "FrustumFromViewProjection case %i corner off plane %u by %f", n_case, un_plane,
+                                   f_distance);
+                        } else {
+                            Expect(f_distance > -f_tolerance, "FrustumFromViewProjection case %i corner outside plane %u by %f", n_case, un_plane,
+                                   f_distance);
+                        }
+                    }
+                }
+            }
+        }
+
+        //A point in the middle of the view is inside everything, one behind the eye is outside the near plane
+        const double af_view_points[][4] = {{0., 0., -(f_near + f_far) / 2., 1.}, {0., 0., 1., 1.}};
+        double af_point[4];
+        RefTransform(mat4_pose, af_view_points[0], af_point);
+        for (uint32_t un_plane = 0; un_plane < FrustumPlaneCount; un_plane++) {
+            Expect(RefPlaneDistance(frustum.axr_planes[un_plane], af_point[0], af_point[1], af_point[2]) > 0.,
+                   "FrustumFromViewProjection case %i center outside plane %u", n_case, un_plane);
+        }
+        RefTransform(mat4_pose, af_view_points[1], af_point);
+        Expect(RefPlaneDistance(frustum.axr_planes[FrustumPlaneNear], af_point[0], af_point[1], af_point[2]) < 0.,
+               "FrustumFromViewProjection case %i point behind the eye inside the near plane", n_case);
+
+        //Identical views make the combined volume the view's own
+        XrView axr_views[2] = {};
+        for (XrView &xr_view: axr_views) {
+            xr_view.pose = xr_pose;
+            xr_view.fov = xr_fov;
+        }
+        const Frustum frustum_views = FrustumFromViews(axr_views, 2, f_near, f_far);
+        Expect(std::memcmp(&frustum_views, &frustum, sizeof(Frustum)) == 0, "FrustumFromViews case %i of identical views differs from the view's",
+               n_case);
+    }
+}
+
+//Returns how far inside the frustum the sphere reaches at its worst plane, negative if it is fully outside one
+static double RefSphereMargin(const Frustum &frustum, double f_x, double f_y, double f_z, double f_radius) {
+    double f_margin = INFINITY;
+    for (const XrVector4f &xr_plane: frustum.axr_planes) {
+        f_margin = std::min(f_margin, RefPlaneDistance(xr_plane, f_x, f_y, f_z) + f_radius);
+    }
+
+    return f_margin;
+}
+
+static double RefBoxMargin(const Frustum &frustum, const double af_min[3], const double af_max[3]) {
+    double f_margin = INFINITY;
+    for (const XrVector4f &xr_plane: frustum.axr_planes) {
+        f_margin = std::min(f_margin, RefPlaneDistance(xr_plane, xr_plane.x >= 0.f ? af_max[0] : af_min[0], xr_plane.y >= 0.f ? af_max[1] : af_min[1],
+                                                       xr_plane.z >= 0.f ? af_max[2] : af_min[2]));
+    }
+
+    return f_margin;
+}
+
+struct Spheres {
+    std::vector<float> vf_x, vf_y, vf_z, vf_radius;
+
+    void Add(float f_x, float f_y, float f_z, float f_radius) {
+        vf_x.push_back(f_x);
+        vf_y.push_back(f_y);
+        vf_z.push_back(f_z);
+        vf_radius.push_back(f_radius);
+    }
+
+    uint32_t UnCount() const { return static_cast<uint32_t>(vf_x.size()); }
+
+    //One result per sphere, the lanes past the count have to be left alone
+    std::vector<uint8_t> VTest(const Frustum &frustum) const {
+        std::vector<uint8_t> v_visible(UnCount() + k_un_float4_lanes, k_un_canary);
+        FrustumTestSpheres(frustum, vf_x.data(), vf_y.data(), vf_z.data(), vf_radius.data(), UnCount(), v_visible.data());
+        for (uint32_t i = UnCount(); i < v_visible.size(); i++) {
+            Expect(v_visible[i] == k_un_canary, "FrustumTestSpheres of %u spheres wrote past the end", UnCount());
+        }
+        v_visible.resize(UnCount());
+
+        return v_visible;
+    }
+};
+
+struct Boxes {
+    std::vector<float> vf_min_x, vf_min_y, vf_min_z, vf_max_x, vf_max_y, vf_max_z;
+
+    void Add(float f_min_x, float f_min_y, float f_min_z, float f_max_x, float f_max_y, float f_max_z) {
+        vf_min_x.push_back(f_min_x);
+        vf_min_y.push_back(f_min_y);
+        vf_min_z.push_back(f_min_z);
+        vf_max_x.push_back(f_max_x);
+        vf_max_y.push_back(f_max_y);
+        vf_max_z.push_back(f_max_z);
+    }
+
+    uint32_t UnCount() const { return static_cast<uint32_t>(vf_min_x.size()); }
+
+    std::vector<uint8_t> VTest(const Frustum &frustum) const {
+        std::vector<uint8_t> v_visible(UnCount() + k_un_float4_lanes, k_un_canary);
+        FrustumTestBoxes(frustum, vf_min_x.data(), vf_min_y.data(), vf_min_z.data(), vf_max_x.data(), vf_max_y.data(), vf_max_z.data(), UnCount(),
+                         v_visible.data());
+        for (uint32_t i = UnCount(); i < v_visible.size(); i++) {
+            Expect(v_visible[i] == k_un_canary, "FrustumTestBoxes of %u boxes wrote past the end", UnCount());
+        }
+        v_visible.resize(UnCount());
+
+        return v_visible;
+    }
+};
+
+static void TestBatchedBounds() {
+    const float f_near = 0.1f;
+    const float f_far = 100.f;
+
+    for (int n_case = 0; n_case < 20; n_case++) {
+        XrView axr_views[2] = {};
+        const XrPosef xr_head = RandomPose();
+        for (int n_eye = 0; n_eye < 2; n_eye++) {
+            axr_views[n_eye].pose = xr_head;
+            axr_views[n_eye].pose.position.x += n_eye == 0 ? -0.032f : 0.032f;
+            axr_views[n_eye].fov = RandomFov();
+        }
+        const Frustum frustum = FrustumFromViews(axr_views, 2, f_near, f_far);
+
+        //A count that is no multiple of the lane count, so the tail is covered too
+        Spheres spheres;
+        Boxes boxes;
+        for (int i = 0; i < 1003; i++) {
+            const float f_x = xr_head.position.x + FRandom(-60.f, 60.f);
+            const float f_y = xr_head.position.y + FRandom(-60.f, 60.f);
+            const float f_z = xr_head.position.z + FRandom(-60.f, 60.f);
+            spheres.Add(f_x, f_y, f_z, FRandom(0.f, 5.f));
+            boxes.Add(f_x, f_y, f_z, f_x + FRandom(0.f, 5.f), f_y + FRandom(0.f, 5.f), f_z + FRandom(0.f, 5.f));
+        }
+
+        const std::vector<uint8_t> v_spheres_visible = spheres.VTest(frustum);
+        const std::vector<uint8_t> v_boxes_visible = boxes.VTest(frustum);
+        uint32_t un_visible = 0;
+        for (uint32_t i = 0; i < spheres.UnCount(); i++) {
+            const double f_sphere_margin = RefSphereMargin(frustum, spheres.vf_x[i], spheres.vf_y[i], spheres.vf_z[i], spheres.vf_radius[i]);
+            if (std::abs(f_sphere_margin) > k_f_boundary_margin) {
+                Expect(v_spheres_visible[i] == (f_sphere_margin >= 0. ? 1u : 0u), "FrustumTestSpheres case %i sphere %u: %u, margin %f", n_case, i,
+                       v_spheres_visible[i], f_sphere_margin);
+            }
+
+            const double af_min[] = {boxes.vf_min_x[i], boxes.vf_min_y[i], boxes.vf_min_z[i]};
+            const double af_max[] = {boxes.vf_max_x[i], boxes.vf_max_y[i], boxes.vf_max_z[i]};
+            const double f_box_margin = RefBoxMargin(frustum, af_min, af_max);
+            if (std::abs(f_box_margin) > k_f_boundary_margin) {
+                Expect(v_boxes_visible[i] == (f_box_margin >= 0. ? 1u : 0u), "FrustumTestBoxes case %i box %u: %u, margin %f", n_case, i,
+                       v_boxes_visible[i], f_box_margin);
+            }
+            un_visible += v_spheres_visible[i];
+        }
+
+        //Otherwise the comparison above says little
+        Expect(un_visible > 0 && un_visible < spheres.UnCount(), "FrustumTestSpheres case %i found %u of %u visible", n_case, un_visible,
+               spheres.UnCount());
+    }
+}
+
+//On the boundary, where rounding decides, everything is exact with axis aligned planes: the unit cube
+static void TestBoundaryCases() {
+    const Frustum frustum_cube = {{
+            {1.f, 0.f, 0.f, 1.f},
+            {-1.f, 0.f, 0.f, 1.f},
+            {0.f, 1.f, 0.f, 1.f},
+            {0.f, -1.f, 0.f, 1.f},
+            {0.f, 0.f, 1.f, 1.f},
+            {0.f, 0.f, -1.f, 1.f},
+    }};
+
+    Spheres spheres;
+    std::vector<uint8_t> v_expected;
+    auto AddSphere = [&](float f_x, float f_y, float f_z, float f_radius, uint8_t un_visible) {
+        spheres.Add(f_x, f_y, f_z, f_radius);
+        v_expected.push_back(un_visible);
+    };
+    AddSphere(-1.f, 0.f, 0.f, 0.f, 1);    //point on a plane
+    AddSphere(1.f, 1.f, 1.f, 0.f, 1);     //point on a corner of three planes
+    AddSphere(-2.f, 0.f, 0.f, 1.f, 1);    //touching a plane from outside
+    AddSphere(-2.f, 0.f, 0.f, 0.5f, 0);   //short of it
+    AddSphere(0.f, 0.f, 0.f, 0.f, 1);     //point inside
+    AddSphere(0.f, 3.f, 0.f, 0.f, 0);     //point outside
+    AddSphere(0.f, 0.f, 0.f, 1000.f, 1);  //containing the frustum
+    AddSphere(0.f, 0.f, -1.5f, 0.5f, 1);  //touching the far side
+
+    const std::vector<uint8_t> v_spheres_visible = spheres.VTest(frustum_cube);
+    for (uint32_t i = 0; i < spheres.UnCount(); i++) {
+        Expect(v_spheres_visible[i] == v_expected[i], "FrustumTestSpheres boundary case %u: %u, expected %u", i, v_spheres_visible[i], v_expected[i]);
+    }
+
+    Boxes boxes;
+    v_expected.clear();
+    auto AddBox = [&](float f_min_x, float f_min_y, float f_min_z, float f_max_x, float f_max_y, float f_max_z, uint8_t un_visible) {
+        boxes.Add(f_min_x, f_min_y, f_min_z, f_max_x, f_max_y, f_max_z);
+        v_expected.push_back(un_visible);
+    };
+    AddBox(-1.f, 0.f, 0.f, -1.f, 0.f, 0.f, 1);        //no extent at all, on a plane
+    AddBox(-1.5f, 0.f, 0.f, -1.5f, 0.f, 0.f, 0);      //no extent at all, outside
+    AddBox(-3.f, -1.f, -1.f, -1.f, -1.f, -1.f, 1);    //a line touching an edge from outside
+    AddBox(-0.5f, -0.5f, 0.f, 0.5f, 0.5f, 0.f, 1);    //flat, inside
+    AddBox(-0.5f, 2.f, -0.5f, 0.5f, 2.f, 0.5f, 0);    //flat, outside
+    AddBox(1.f, 1.f, 1.f, 2.f, 2.f, 2.f, 1);          //touching a corner
+    AddBox(-10.f, -10.f, -10.f, 10.f, 10.f, 10.f, 1); //containing the frustum
+    AddBox(0.f, 0.f, 1.5f, 0.f, 0.f, 2.f, 0);         //a line outside
+    AddBox(-2.f, -0.5f, -0.5f, -1.f, 0.5f, 0.5f, 1);  //sharing a face
+
+    const std::vector<uint8_t> v_boxes_visible = boxes.VTest(frustum_cube);
+    for (uint32_t i = 0; i < boxes.UnCount(); i++) {
+        Expect(v_boxes_visible[i] == v_expected[i], "FrustumTestBoxes boundary case %u: %u, expected %u", i, v_boxes_visible[i], v_expected[i]);
+    }
+
+    //Open planes, as FrustumFromViews leaves them where no view bounds the others, keep everything
+    Frustum frustum_open;
+    for (XrVector4f &xr_plane: frustum_open.axr_planes) {
+        xr_plane = {0.f, 0.f, 0.f, 1.f};
+    }
+    for (uint8_t un_visible: spheres.VTest(frustum_open)) {
+        Expect(un_visible == 1u, "FrustumTestSpheres culled against open planes");
+    }
+    for (uint8_t un_visible: boxes.VTest(frustum_open)) {
+        Expect(un_visible == 1u, "FrustumTestBoxes culled against open planes");
+    }
+
+    //Nothing to test, nothing written
+    Spheres spheres_none;
+    spheres_none.VTest(frustum_cube);
+    Boxes boxes_none;
+    boxes_none.VTest(frustum_cube);
+}
+
+int main() {
+    TestFloat4();
+    TestMat4();
+    TestProjection();
+    TestPlaneExtraction();
+    TestBatchedBounds();
+    TestBoundaryCases();
+
+    if (sun_failures > 0) {
+        std::printf("%u checks failed on the %s path\n", sun_failures, k_pc_simd_path);
+        return 1;
+    }
+
+    std::printf("All checks passed on the %s path\n", k_pc_simd_path);
+    return 0;
+}